@@ -40,6 +40,8 @@ float deltaTime;
 int main() {
 	GLFWwindow* window = initWindow("Assignment 0", screenWidth, screenHeight);
 	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+	//Reports any GPU objects still alive once main's resources are released
+	ew::GpuLeakCheck leakCheck;
 
 	ew::Shader shader = ew::Shader("assets/lit.vert", "assets/lit.frag");
 	ew::Model monkeyModel = ew::Model("assets/suzanne.fbx");
@@ -54,8 +56,8 @@ int main() {
 	glEnable(GL_DEPTH_TEST); //Depth testing
 
 	//Handles to OpenGL object are unsigned integers
-	GLuint brickTexture = ew::loadTexture("assets/tiles_color.jpg");
-	GLuint normalTexture = ew::loadTexture("assets/tiles_normal.jpg");
+	ew::TextureHandle brickTexture = ew::loadTexture("assets/tiles_color.jpg");
+	ew::TextureHandle normalTexture = ew::loadTexture("assets/tiles_normal.jpg");
 	//Bind brick texture to texture unit 0 
 	glBindTextureUnit(0, brickTexture);
 	glBindTextureUnit(1, normalTexture);
@@ -98,6 +100,7 @@ int main() {
 		drawUI();
 
 		glfwSwapBuffers(window);
+		ew::collectGpuGarbage();
 	}
 	printf("Shutting down...");
 }
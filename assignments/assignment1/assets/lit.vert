@@ -3,7 +3,7 @@
 layout(location = 0) in vec3 vPos;
 layout(location = 1) in vec3 vNormal;
 layout(location = 2) in vec2 vTexCoord;
-layout(location = 3) in vec3 vTangent;
+layout(location = 3) in vec4 vTangent; //w is the bitangent sign
 
 uniform mat4 _Model; 
 uniform mat4 _ViewProjection;
@@ -27,12 +27,12 @@ void main(){
 	vs_out.TexCoord = vTexCoord;
 	gl_Position = _ViewProjection * _Model * vec4(vPos,1.0);
 
-	vec3 T = normalize(vec3(_Model * vec4(vTangent, 0.0)));
+	vec3 T = normalize(vec3(_Model * vec4(vTangent.xyz, 0.0)));
 	vec3 N = normalize(vec3(_Model * vec4(vNormal, 0.0)));
 	// re-orthogonalize T with respect to N
 	T = normalize(T - dot(T, N) * N);
 	// then retrieve perpendicular vector B with the cross product of T and N
-	vec3 B = cross(N, T);
+	vec3 B = cross(N, T) * vTangent.w;
 
 	vs_out.TBN = mat3(T, B, N);  
 }
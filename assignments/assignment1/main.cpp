@@ -44,6 +44,8 @@ float gamma = 2.2f;
 int main() {
 	GLFWwindow* window = initWindow("Assignment 1", screenWidth, screenHeight);
 	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+	//Reports any GPU objects still alive once main's resources are released
+	ew::GpuLeakCheck leakCheck;
 
 	ew::Shader shader = ew::Shader("assets/lit.vert", "assets/lit.frag");
 	ew::Shader postProcess = ew::Shader("assets/post.vert", "assets/post.frag");
@@ -64,8 +66,8 @@ int main() {
 	hannah::Framebuffer framebuffer = hannah::createFramebufferWithRBO(screenWidth, screenHeight, GL_RGB16F);
 
 	//Handles to OpenGL object are unsigned integers
-	GLuint brickTexture = ew::loadTexture("assets/travertine_color.jpg");
-	GLuint normalTexture = ew::loadTexture("assets/travertine_normal.jpg");
+	ew::TextureHandle brickTexture = ew::loadTexture("assets/travertine_color.jpg");
+	ew::TextureHandle normalTexture = ew::loadTexture("assets/travertine_normal.jpg");
 
 	//Make "_MainTex" sampler2D sample from the 2D texture bound to unit 0
 	shader.use();
@@ -125,6 +127,7 @@ int main() {
 		drawUI();
 
 		glfwSwapBuffers(window);
+		ew::collectGpuGarbage();
 	}
 	printf("Shutting down...");
 }
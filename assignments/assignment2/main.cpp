@@ -54,6 +54,8 @@ hannah::Framebuffer shadowFramebuffer;
 int main() {
 	GLFWwindow* window = initWindow("Assignment 2", screenWidth, screenHeight);
 	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+	//Reports any GPU objects still alive once main's resources are released
+	ew::GpuLeakCheck leakCheck;
 
 	ew::Shader shader = ew::Shader("assets/lit.vert", "assets/lit.frag");
 	ew::Shader postProcess = ew::Shader("assets/post.vert", "assets/post.frag");
@@ -88,8 +90,8 @@ int main() {
 	shadowFramebuffer = hannah::createFramebufferWithShadowMap(shadowWidth, shadowHeight, GL_RGB16F);
 
 	//Handles to OpenGL object are unsigned integers
-	GLuint brickTexture = ew::loadTexture("assets/travertine_color.jpg");
-	GLuint normalTexture = ew::loadTexture("assets/travertine_normal.jpg");
+	ew::TextureHandle brickTexture = ew::loadTexture("assets/travertine_color.jpg");
+	ew::TextureHandle normalTexture = ew::loadTexture("assets/travertine_normal.jpg");
 
 	glBindTextureUnit(0, brickTexture);
 	glBindTextureUnit(1, normalTexture);
@@ -180,7 +182,10 @@ int main() {
 		drawUI();
 
 		glfwSwapBuffers(window);
+		ew::collectGpuGarbage();
 	}
+	//Globals outlive main, release them now so they don't show up as leaks
+	shadowFramebuffer = hannah::Framebuffer();
 	printf("Shutting down...");
 }
 
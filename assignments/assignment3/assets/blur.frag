@@ -0,0 +1,21 @@
+#version 450
+layout(location = 0) out vec4 FragColor; //GL_COLOR_ATTACHMENT0
+in vec2 UV; //From deferredLit.vert
+
+uniform layout(binding = 0) sampler2D _Source; //Needs linear filtering, taps land between texel pairs
+uniform vec2 _Direction; //One texel along the blur axis
+
+//One side of a hannah::GaussianKernel, tap 0 is the center
+#define MAX_TAPS 16
+uniform int _NumTaps;
+uniform float _Offsets[MAX_TAPS];
+uniform float _Weights[MAX_TAPS];
+
+void main(){
+	vec4 sum = textureLod(_Source,UV,0.0) * _Weights[0];
+	for(int i = 1; i < _NumTaps; i++){
+		sum += textureLod(_Source,UV + _Direction * _Offsets[i],0.0) * _Weights[i];
+		sum += textureLod(_Source,UV - _Direction * _Offsets[i],0.0) * _Weights[i];
+	}
+	FragColor = sum;
+}
@@ -29,14 +29,13 @@ float calcShadow(sampler2D shadowMap, vec4 lightSpacePos, float bias){
 	if(myDepth > 1.0f)
 		return 0.0f;
 
-	float shadowMapDepth = texture(shadowMap, sampleCoord.xy).r;
 	//step(a,b) returns 1.0 if a >= b, 0.0 otherwise
 	float totalShadow = 0.0f;
-	vec2 texelOffset = 1.0 /  textureSize(_ShadowMap,0);
+	vec2 texelOffset = 1.0 /  textureSize(shadowMap,0);
 	for(int y = -1; y <=1; y++){
 		for(int x = -1; x <=1; x++){
 			vec2 uv = sampleCoord.xy + vec2(x * texelOffset.x, y * texelOffset.y);
-			totalShadow += step(texture(_ShadowMap,uv).r,myDepth);
+			totalShadow += step(texture(shadowMap,uv).r,myDepth);
 		}
 	}
 	totalShadow /= 9.0;
@@ -50,15 +49,72 @@ float calcShadow(sampler2D shadowMap, vec4 lightSpacePos, float bias){
 uniform layout(binding = 0) sampler2D _gPositions;
 uniform layout(binding = 1) sampler2D _gNormals;
 uniform layout(binding = 2) sampler2D _gAlbedo;
+uniform layout(binding = 4) sampler2D _gDepth;
+
+//Compact layout: octahedral normals, shininess in albedo alpha, position from depth
+uniform bool _CompactGBuffer;
+uniform mat4 _InverseViewProjection;
+
+vec3 decodeOctahedral(vec2 e){
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+vec3 reconstructPosition(vec2 uv){
+	float depth = texture(_gDepth,uv).r;
+	vec4 clipPos = vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	vec4 worldPos = _InverseViewProjection * clipPos;
+	return worldPos.xyz / worldPos.w;
+}
 
 struct PointLight{
 	vec3 position;
 	float radius;
 	vec3 color;
+	int shadowFace; //First of its six faces in _ShadowFaces, -1 if unshadowed
 };
 #define MAX_POINT_LIGHTS 64
 uniform PointLight _PointLights[MAX_POINT_LIGHTS];
 
+//Point light shadows, all in tiles of one atlas (see hannah::ShadowAtlas)
+struct ShadowFace{
+	mat4 atlasFromWorld;
+	vec4 rect; //Tile in atlas uvs, min in xy and max in zw
+};
+layout(std430, binding = 1) readonly buffer ShadowFaces{
+	ShadowFace _ShadowFaces[];
+};
+uniform layout(binding = 5) sampler2DShadow _ShadowAtlas;
+
+//1 when lit, 0 when fully shadowed
+float calcAtlasShadow(int firstFace, vec3 fromLight, vec3 worldPos, vec3 normal){
+	if(firstFace < 0)
+		return 1.0;
+	//Cube face by major axis, same order as GL cube maps
+	vec3 a = abs(fromLight);
+	int face;
+	if(a.x >= a.y && a.x >= a.z)
+		face = fromLight.x >= 0.0 ? 0 : 1;
+	else if(a.y >= a.z)
+		face = fromLight.y >= 0.0 ? 2 : 3;
+	else
+		face = fromLight.z >= 0.0 ? 4 : 5;
+	ShadowFace shadowFace = _ShadowFaces[firstFace + face];
+
+	//Push out along the normal by about two texels at this distance instead of a depth bias,
+	//perspective depth is too uneven for a constant one
+	float tileTexels = (shadowFace.rect.z - shadowFace.rect.x) * textureSize(_ShadowAtlas,0).x + 1.0;
+	vec3 offsetPos = worldPos + normal * (4.0 * length(fromLight) / tileTexels);
+	vec4 atlasPos = shadowFace.atlasFromWorld * vec4(offsetPos,1.0);
+	atlasPos.xyz /= atlasPos.w;
+	//Clamped so filtering never reads a neighbouring tile
+	vec2 uv = clamp(atlasPos.xy,shadowFace.rect.xy,shadowFace.rect.zw);
+	return texture(_ShadowAtlas,vec3(uv,atlasPos.z));
+}
+
 //Linear falloff
 float attenuateLinear(float distance, float radius){
 	return clamp((radius-distance)/radius,0.0,1.0);
@@ -71,8 +127,7 @@ float attenuateExponential(float distance, float radius){
 	
 }
 
-vec3 calcPointLight(PointLight light,vec3 normal){
-	vec3 worldPos = texture(_gPositions,UV).xyz;
+vec3 calcPointLight(PointLight light,vec3 normal,vec3 worldPos,float shininess){
 
 	vec3 diff = light.position - worldPos;
 	//Direction toward light position
@@ -83,7 +138,7 @@ vec3 calcPointLight(PointLight light,vec3 normal){
 	vec3 toEye = normalize(_EyePos - worldPos);
 	//Blinn-phong uses half angle
 	vec3 h = normalize(toLight + toEye);
-	float specularFactor = pow(max(dot(normal,h),0.0),_Material.Shininess);
+	float specularFactor = pow(max(dot(normal,h),0.0),shininess);
 
 	vec3 lightColor = (diffuseFactor + specularFactor) * light.color;
 	//Attenuation
@@ -95,7 +150,21 @@ vec3 calcPointLight(PointLight light,vec3 normal){
 
 void main(){
 	//vec3 normal = normalize(fs_in.WorldNormal);
-	vec3 normal = texture(_gNormals,UV).xyz;
+	vec3 normal;
+	vec3 worldPos;
+	vec4 albedo;
+	float shininess;
+	if(_CompactGBuffer){
+		normal = decodeOctahedral(texture(_gNormals,UV).xy);
+		worldPos = reconstructPosition(UV);
+		albedo = texture(_gAlbedo,UV);
+		shininess = exp2(albedo.a * 10.0);
+	}else{
+		normal = texture(_gNormals,UV).xyz;
+		worldPos = texture(_gPositions,UV).xyz;
+		albedo = texture(_gAlbedo,UV);
+		shininess = _Material.Shininess;
+	}
 
 
 	PointLight mainLight;
@@ -104,11 +173,15 @@ void main(){
 	mainLight.color = (_LightColor);
 
 	vec3 totalLight = vec3(0);
-	totalLight += calcPointLight(mainLight,normal);
+	totalLight += calcPointLight(mainLight,normal,worldPos,shininess);
 	for(int i = 0; i < MAX_POINT_LIGHTS; i++){
-		totalLight += calcPointLight(_PointLights[i], normal);
+		vec3 fromLight = worldPos - _PointLights[i].position;
+		//Out of range lights add nothing, skip their shadow lookups too
+		if(dot(fromLight,fromLight) >= _PointLights[i].radius * _PointLights[i].radius)
+			continue;
+		float shadow = calcAtlasShadow(_PointLights[i].shadowFace,fromLight,worldPos,normal);
+		totalLight += calcPointLight(_PointLights[i],normal,worldPos,shininess) * shadow;
 	}
-	vec3 albedo = texture(_gAlbedo,UV).xyz;
-	FragColor1 = vec4(albedo * totalLight, 1);
+	FragColor1 = vec4(albedo.rgb * totalLight, 1);
 	//FragColor1 = _PointLights[0].color;
 }
\ No newline at end of file
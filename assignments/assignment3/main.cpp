@@ -14,15 +14,30 @@
 #include <ew/transform.h>
 #include <ew/cameraController.h>
 #include <ew/texture.h>
+#include <ew/textureCache.h>
 #include <ew/procGen.h>
 
 #include <hannah/framebuffer.h>
+#include <hannah/renderTargetPool.h>
+#include <hannah/renderGraph.h>
+#include <hannah/profiler.h>
+#include <hannah/shadowCache.h>
+#include <hannah/shadowAtlas.h>
+#include <hannah/momentShadows.h>
+#include <hannah/textureCompression.h>
+#include <hannah/meshLOD.h>
+#include <hannah/meshlet.h>
+#include <hannah/textureStreamer.h>
+#include <hannah/terrain.h>
+#include <hannah/noise.h>
+#include <hannah/marchingCubes.h>
+#include <hannah/subdivision.h>
 
 #include <time.h> 
 
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 GLFWwindow* initWindow(const char* title, int width, int height);
-void drawUI();
+void drawUI(const hannah::RenderTarget& gBuffer, unsigned int shadowTexture);
 
 ew::Camera camera;
 ew::Transform monkeyTransform;
@@ -59,26 +74,157 @@ float gamma = 2.2f;
 glm::vec3 lightDir = glm::vec3(0.0f, -1.0f, 0.0f);
 float minBias = 0.005f;
 float maxBias = 0.015f;
-
-hannah::Framebuffer shadowFramebuffer;
-hannah::Framebuffer gBuffer;
+//PCF compares depths per tap, VSM and EVSM blur depth moments once and take one filtered fetch per pixel
+hannah::ShadowFilter shadowFilter = hannah::ShadowFilter::PCF;
+int shadowBlurRadius = 4; //In shadow map texels
+float lightBleedReduction = 0.2f;
+
+//Screen sized targets are recreated by the pool when the window is resized
+hannah::RenderTargetPool renderTargets;
+int shadowTarget;
+//Static casters are drawn here only when they or the light change, then copied into the shadow map each frame
+int staticShadowTarget;
+hannah::ShadowCache shadowCache;
+//Normals, albedo and depth only, position is rebuilt from depth. Toggle to compare in the profiler.
+bool compactGBuffer = true;
+hannah::Profiler profiler;
+hannah::RenderGraph renderGraph(&renderTargets, &profiler);
+//Point light shadows share one depth atlas of fixed size, the lights covering the most screen get the biggest tiles
+hannah::ShadowAtlas shadowAtlas;
+bool pointLightShadows = true;
+hannah::MeshletCullStats planeCullStats;
+hannah::TextureStreamingStats streamingStats;
+hannah::TerrainStats terrainStats;
+size_t blobTriangles = 0;
+//The camera passes draw the monkey Loop subdivided where it is large on screen, shadows keep the imported mesh
+bool subdivideMonkey = true;
+unsigned int monkeyTriangles = 0;
 
 int main() {
 	GLFWwindow* window = initWindow("Assignment 3", screenWidth, screenHeight);
 	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+	//Reports any GPU objects still alive once main's resources are released
+	ew::GpuLeakCheck leakCheck;
 
 	ew::Shader shader = ew::Shader("assets/lit.vert", "assets/lit.frag");
 	ew::Shader postProcess = ew::Shader("assets/post.vert", "assets/post.frag");
 	ew::Shader depthShader = ew::Shader("assets/depth.vert", "assets/depth.frag");
+	ew::Shader momentShader = ew::Shader("assets/depth.vert", "assets/moments.frag");
+	ew::Shader blurShader = ew::Shader("assets/deferredLit.vert", "assets/blur.frag");
 	ew::Shader gShader = ew::Shader("assets/lit.vert", "assets/geometry.frag");
+	ew::Shader gCompactShader = ew::Shader("assets/lit.vert", "assets/geometryCompact.frag");
 	ew::Shader deferredShader = ew::Shader("assets/deferredLit.vert", "assets/deferredLit.frag");
 	ew::Shader lightOrbShader = ew::Shader("assets/lightOrb.vert", "assets/lightOrb.frag");
-	ew::Model monkeyModel = ew::Model("assets/suzanne.fbx");
-	ew::Mesh planeMesh = ew::Mesh(ew::createPlane(10, 10, 5));
+	//Imported once, the shadow caster bounds read its mesh data before the model takes it over.
+	//The monkey is the only point light shadow caster, its bounds decide which atlas faces it lands in.
+	ew::Scene monkeyScene = ew::loadScene("assets/suzanne.fbx");
+	hannah::ShadowCaster monkeyCaster;
+	hannah::computeBoundingSphere(monkeyScene.meshes, &monkeyCaster.center, &monkeyCaster.radius);
+	//Suzanne is a single mesh. Refined uniformly once into cached stencils, each frame only picks how much of that to draw.
+	double subdivisionStart = glfwGetTime();
+	hannah::SubdivisionMesh monkeySubdivision(monkeyScene.meshes[0], 3);
+	printf("Subdivided the monkey from %zu to %u triangles in %.2f ms\n", monkeyScene.meshes[0].indices.size() / 3, monkeySubdivision.getNumTriangles(),
+		(glfwGetTime() - subdivisionStart) * 1000.0);
+	ew::Model monkeyModel = ew::Model(std::move(monkeyScene));
+	//Dense enough to split into many meshlets so off screen parts get culled
+	hannah::MeshletMesh planeMesh(ew::createPlane(10, 10, 64));
 	ew::Transform planeTransform;
 	planeTransform.position = glm::vec3(0.0f, -1.0f, 0.0f);
 	planeTransform.scale = glm::vec3(10.0f);
-	ew::Mesh sphereMesh = ew::Mesh(ew::createSphere(1.0f, 8));
+	hannah::LODMesh sphereMesh(ew::createSphere(1.0f, 8));
+	int orbLODs[MAX_POINT_LIGHTS] = { 0 }; //Current LOD per light orb, needed for hysteresis
+	//The meshlet plane only keeps what the main camera sees, so shadows get a plain one
+	ew::Mesh shadowPlaneMesh(ew::createPlane(10, 10, 1));
+	//Closed, so they still write depth with front faces culled. The plane only receives shadows.
+	ew::Mesh pillarMesh(ew::createCylinder(0.25f, 2.0f, 16));
+	const int NUM_PILLARS = 4;
+	ew::Transform pillarTransforms[NUM_PILLARS];
+	for (int i = 0; i < NUM_PILLARS; i++)
+	{
+		pillarTransforms[i].position = glm::vec3(i % 2 ? 2.0f : -2.0f, 0.0f, i / 2 ? 2.0f : -2.0f);
+	}
+	std::vector<glm::mat4> staticCasters;
+	//A boulder roughened by ridged noise along its normals. Noise is sampled at x and z, so it is mirrored top to bottom, hidden by sinking it into the plane.
+	hannah::NoiseSettings rockNoise;
+	rockNoise.fractal = hannah::FractalType::RIDGED;
+	rockNoise.frequency = 2.5f;
+	rockNoise.octaves = 4;
+	ew::MeshData rockData = ew::createSphere(0.6f, 96);
+	double displaceStart = glfwGetTime();
+	hannah::displaceMesh(&rockData, rockNoise, 0.25f);
+	printf("Displaced %zu rock vertices with %d octave noise in %.2f ms (%s)\n", rockData.vertices.size(), rockNoise.octaves,
+		(glfwGetTime() - displaceStart) * 1000.0, hannah::noiseUsesAVX2() ? "AVX2" : "scalar");
+	ew::Mesh rockMesh(rockData);
+	ew::Transform rockTransform;
+	rockTransform.position = glm::vec3(-3.5f, -1.0f, 0.5f);
+	rockTransform.scale = glm::vec3(1.0f, 0.8f, 1.0f);
+	//A blob meshed from a signed distance volume. A small sphere orbits through it, only the chunks it passes are remeshed.
+	const glm::vec3 blobCenter = glm::vec3(3.5f, -0.5f, 0.5f);
+	const float blobBlend = 0.2f; //Smooth union width
+	hannah::VolumeGrid blobVolume;
+	blobVolume.size = glm::ivec3(64);
+	blobVolume.origin = blobCenter - glm::vec3(1.0f);
+	blobVolume.spacing = 2.0f / 63.0f;
+	blobVolume.values.resize((size_t)64 * 64 * 64);
+	hannah::IsoSettings blobSettings;
+	blobSettings.chunkCells = 16; //4^3 chunks, so the orbiter only dirties a few
+	hannah::IsoSurface blobSurface(&blobVolume, blobSettings);
+	//The orbiter only counts within its support, so moving it leaves distant samples alone.
+	//Cutting it off there only changes samples well outside the surface, where the sign is the same either way.
+	const float blobSupport = blobBlend + blobVolume.spacing * 3.0f;
+	glm::vec3 orbiter = blobCenter + glm::vec3(0.6f, 0.0f, 0.0f);
+	auto blobDistance = [&](glm::vec3 p) {
+		float a = glm::length(p - blobCenter) - 0.5f;
+		float b = glm::length(p - orbiter) - 0.22f;
+		if (b > blobSupport) {
+			return a;
+		}
+		float h = glm::clamp(0.5f + 0.5f * (b - a) / blobBlend, 0.0f, 1.0f);
+		return glm::mix(b, a, h) - blobBlend * h * (1.0f - h);
+	};
+	//Resamples the box around the orbiter's support and marks the chunks reading it
+	auto resampleOrbiter = [&]() {
+		float extent = 0.22f + blobSupport + blobVolume.spacing;
+		glm::ivec3 minSample, maxSample;
+		for (int i = 0; i < 3; i++)
+		{
+			minSample[i] = glm::max((int)floorf((orbiter[i] - extent - blobVolume.origin[i]) / blobVolume.spacing), 0);
+			maxSample[i] = glm::min((int)ceilf((orbiter[i] + extent - blobVolume.origin[i]) / blobVolume.spacing), blobVolume.size[i] - 1);
+		}
+		for (int z = minSample.z; z <= maxSample.z; z++)
+		{
+			for (int y = minSample.y; y <= maxSample.y; y++)
+			{
+				for (int x = minSample.x; x <= maxSample.x; x++)
+				{
+					blobVolume.values[((size_t)z * blobVolume.size.y + y) * blobVolume.size.x + x] = blobDistance(blobVolume.origin + glm::vec3(x, y, z) * blobVolume.spacing);
+				}
+			}
+		}
+		blobSurface.markDirty(minSample, maxSample);
+	};
+	for (int z = 0; z < blobVolume.size.z; z++)
+	{
+		for (int y = 0; y < blobVolume.size.y; y++)
+		{
+			for (int x = 0; x < blobVolume.size.x; x++)
+			{
+				blobVolume.values[((size_t)z * blobVolume.size.y + y) * blobVolume.size.x + x] = blobDistance(blobVolume.origin + glm::vec3(x, y, z) * blobVolume.spacing);
+			}
+		}
+	}
+	double meshStart = glfwGetTime();
+	blobSurface.update();
+	printf("Meshed a %d^3 volume into %zu triangles in %.2f ms\n", blobVolume.size.x, blobSurface.getMeshData().indices.size() / 3, (glfwGetTime() - meshStart) * 1000.0);
+	ew::Mesh blobMesh(blobSurface.getMeshData());
+	//Hills around the scene, far larger than the camera ever sees. Chunks stream in on worker threads as it moves.
+	hannah::HeightFunction hills = hannah::noiseHeightmap(0.01f, 30.0f, 6);
+	hannah::Terrain terrain([hills](float x, float z) {
+		//Flat below the plane, rising into hills further out
+		return hills(x, z) * glm::smoothstep(15.0f, 60.0f, glm::length(glm::vec2(x, z))) - 2.0f;
+	}, hannah::TerrainSettings());
+	std::vector<hannah::ShadowCaster> atlasCasters;
+	std::vector<hannah::ShadowLight> shadowLights(MAX_POINT_LIGHTS);
 
 	camera.position = glm::vec3(0.0f, 0.0f, 5.0f);
 	camera.target = glm::vec3(0.0f, 0.0f, 0.0f); //Look at the center of the scene
@@ -100,13 +246,47 @@ int main() {
 	unsigned int dummyVAO;
 	glCreateVertexArrays(1, &dummyVAO);
 
-	hannah::Framebuffer framebuffer = hannah::createFramebufferWithDepthBuffer(screenWidth, screenHeight, GL_RGB16F);
-	shadowFramebuffer = hannah::createFramebufferWithShadowMap(shadowWidth, shadowHeight, GL_RGB16F);
-	gBuffer = hannah::createGBuffer(screenWidth, screenHeight);
-
-	//Handles to OpenGL object are unsigned integers
-	GLuint brickTexture = ew::loadTexture("assets/travertine_color.jpg");
-	GLuint normalTexture = ew::loadTexture("assets/travertine_normal.jpg");
+	renderTargets.beginFrame(screenWidth, screenHeight);
+	hannah::RenderTargetDesc litDesc;
+	litDesc.numColors = 1;
+	litDesc.colorFormats[0] = GL_SRGB8_ALPHA8;
+	hannah::RenderTargetDesc shadowDesc;
+	shadowDesc.width = shadowWidth;
+	shadowDesc.height = shadowHeight;
+	shadowDesc.depthFormat = GL_DEPTH_COMPONENT16;
+	shadowDesc.filter = GL_NEAREST;
+	shadowTarget = renderTargets.createPersistent(shadowDesc);
+	staticShadowTarget = renderTargets.createPersistent(shadowDesc);
+	hannah::RenderTargetDesc momentDesc;
+	momentDesc.width = shadowWidth;
+	momentDesc.height = shadowHeight;
+	momentDesc.numColors = 1;
+	momentDesc.colorFormats[0] = GL_RG32F; //Half floats can't hold the EVSM warp
+	momentDesc.depthFormat = GL_DEPTH_COMPONENT16;
+	momentDesc.filter = GL_LINEAR_MIPMAP_LINEAR; //Trilinear fetches do the filtering PCF did by hand
+	hannah::RenderTargetDesc momentBlurDesc = momentDesc;
+	momentBlurDesc.depthFormat = 0;
+	momentBlurDesc.filter = GL_LINEAR;
+	hannah::RenderTargetDesc gBufferDesc;
+	gBufferDesc.numColors = 3;
+	gBufferDesc.colorFormats[0] = GL_RGB32F; //World position
+	gBufferDesc.colorFormats[1] = GL_RGB16F; //World normal
+	gBufferDesc.colorFormats[2] = GL_RGB16F; //Albedo
+	gBufferDesc.depthFormat = GL_DEPTH_COMPONENT16;
+	gBufferDesc.filter = GL_NEAREST;
+	hannah::RenderTargetDesc compactGBufferDesc;
+	compactGBufferDesc.numColors = 2;
+	compactGBufferDesc.colorFormats[0] = GL_RG16; //Octahedral world normal
+	compactGBufferDesc.colorFormats[1] = GL_SRGB8_ALPHA8; //Albedo, shininess in alpha
+	compactGBufferDesc.depthFormat = GL_DEPTH_COMPONENT24; //Positions are rebuilt from it, 16 bit depth bands at a distance
+	compactGBufferDesc.filter = GL_NEAREST;
+
+	//Block compressed, 0.7 + 1.3 MB with mips instead of 5.3 MB each. Compressed on the first run, later runs upload the cached blocks.
+	ew::TextureHandle brickTexture = ew::loadCompressedTexture("assets/travertine_color.jpg", hannah::BlockFormat::BC1);
+	ew::TextureHandle normalTexture = ew::loadCompressedTexture("assets/travertine_normal.jpg", hannah::BlockFormat::BC5);
+	//The monkey's albedo streams in coarsest mip first and only keeps the detail its size on screen needs
+	hannah::TextureStreamer textureStreamer;
+	hannah::StreamedTexture monkeyAlbedo = textureStreamer.add("assets/brick_color.jpg");
 
 	//Make "_MainTex" sampler2D sample from the 2D texture bound to unit 0
 	shader.use();
@@ -130,154 +310,466 @@ int main() {
 		deltaTime = time - prevFrameTime;
 		prevFrameTime = time;
 
-		//RENDER SCENE TO G-BUFFER
-		glBindFramebuffer(GL_FRAMEBUFFER, gBuffer.fbo);
-		glViewport(0, 0, gBuffer.width, gBuffer.height);
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		glBindTextureUnit(0, brickTexture);
-		glBindTextureUnit(1, normalTexture);
-
-		gShader.use();
-		gShader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
-		gShader.setMat4("_LightViewProj", lightCam.projectionMatrix() * lightCam.viewMatrix());
-		gShader.setMat4("_Model", planeTransform.modelMatrix());
-		planeMesh.draw();
-		gShader.setMat4("_Model", monkeyTransform.modelMatrix());
-		monkeyModel.draw();
-
-		//After geometry pass
-		//LIGHTING PASS
-		//if using post processing, we draw to our offscreen framebuffer
+		renderTargets.beginFrame(screenWidth, screenHeight);
+		profiler.beginFrame();
+
+		//Both camera passes draw the same visible meshlets
+		planeMesh.cull(camera, planeTransform.modelMatrix());
+		planeCullStats = planeMesh.getStats();
 		lightCam.position = (lightCam.target - glm::normalize(lightDir)) * 5.0f;
+		staticCasters.clear();
+		for (int i = 0; i < NUM_PILLARS; i++)
+		{
+			staticCasters.push_back(pillarTransforms[i].modelMatrix());
+		}
+		//Read once so a change from the UI pass takes effect next frame
+		hannah::ShadowFilter filter = shadowFilter;
+		bool momentShadows = filter != hannah::ShadowFilter::PCF;
+		bool redrawStaticShadows = false;
+		if (momentShadows) {
+			//Nothing reads the depth map meanwhile, so the graph culls its passes and the static layer goes stale
+			shadowCache.invalidate();
+		}
+		else {
+			redrawStaticShadows = shadowCache.update(lightCam.projectionMatrix() * lightCam.viewMatrix(), staticCasters, renderTargets.get(staticShadowTarget).depthBuffer);
+		}
+		//Read once so a toggle from the UI pass takes effect next frame
+		bool atlasShadows = pointLightShadows;
+		if (atlasShadows) {
+			for (int i = 0; i < MAX_POINT_LIGHTS; i++)
+			{
+				shadowLights[i].position = pointLights[i].position;
+				shadowLights[i].radius = pointLights[i].radius;
+			}
+			monkeyCaster.model = monkeyTransform.modelMatrix();
+			atlasCasters.clear();
+			atlasCasters.push_back(monkeyCaster);
+			shadowAtlas.update(shadowLights, atlasCasters, camera, (float)screenHeight);
+		}
+		//Its uvs cover the monkey once, so the texture spans about its diameter
+		textureStreamer.reportUsage(monkeyAlbedo, hannah::pixelsPerUnit(camera, monkeyTransform.position, (float)screenHeight) * monkeyCaster.radius * 2.0f);
+		textureStreamer.update();
+		streamingStats = textureStreamer.getStats();
+		{
+			hannah::ProfileScope terrainScope(&profiler, "Terrain update");
+			terrain.update(camera);
+		}
+		terrainStats = terrain.getStats();
+		{
+			hannah::ProfileScope remeshScope(&profiler, "Isosurface remesh");
+			//Both where the orbiter was and where it is now change
+			resampleOrbiter();
+			orbiter = blobCenter + glm::vec3(cosf(time) * 0.6f, sinf(time * 1.3f) * 0.3f, sinf(time) * 0.6f);
+			resampleOrbiter();
+			if (blobSurface.update()) {
+				blobMesh.load(blobSurface.getMeshData());
+			}
+		}
+		blobTriangles = blobSurface.getMeshData().indices.size() / 3;
+		//Read once so a toggle from the UI pass takes effect next frame
+		bool subdivided = subdivideMonkey;
+		if (subdivided) {
+			hannah::ProfileScope subdivisionScope(&profiler, "Subdivision update");
+			monkeySubdivision.update(camera, monkeyTransform.modelMatrix(), (float)screenHeight);
+			monkeyTriangles = monkeySubdivision.getNumTriangles();
+		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.fbo);
-		glViewport(0, 0, framebuffer.width, framebuffer.height);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		//Passes are listed in the order they were written, the graph sorts them by what they read and write
+		renderGraph.reset();
+		int shadowMap = renderGraph.import("Shadow map", renderTargets.get(shadowTarget));
+		int staticShadowMap = renderGraph.import("Static shadows", renderTargets.get(staticShadowTarget));
+		hannah::RenderTarget screen;
+		screen.width = screenWidth;
+		screen.height = screenHeight;
+		int backbuffer = renderGraph.import("Backbuffer", screen);
+		hannah::RenderTarget atlasTarget;
+		atlasTarget.depthBuffer = shadowAtlas.getTexture();
+		int atlas = renderGraph.import("Shadow atlas", atlasTarget);
+		renderGraph.markOutput(backbuffer);
 
-		deferredShader.use();
+		//RENDER SCENE TO G-BUFFER
+		//Read once so a toggle from the UI pass takes effect next frame
+		bool compact = compactGBuffer;
+		const hannah::RenderTargetDesc& activeGBufferDesc = compact ? compactGBufferDesc : gBufferDesc;
+		litDesc.depthFormat = activeGBufferDesc.depthFormat; //Same as the G-buffer, so its depth can be blitted in
+		hannah::RenderPassBuilder gBufferPass = renderGraph.addPass("G-buffer");
+		int gBuffer = gBufferPass.create("G-buffer", activeGBufferDesc);
+		gBufferPass.setExecute([&](const hannah::RenderGraph& graph) {
+			const hannah::RenderTarget& target = graph.getTarget(gBuffer);
+			glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+			glViewport(0, 0, target.width, target.height);
+			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			glBindTextureUnit(0, brickTexture);
+			glBindTextureUnit(1, normalTexture);
+
+			const ew::Shader& geometryShader = compact ? gCompactShader : gShader;
+			geometryShader.use();
+			geometryShader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
+			geometryShader.setMat4("_LightViewProj", lightCam.projectionMatrix() * lightCam.viewMatrix());
+			geometryShader.setFloat("_Shininess", material.Shininess);
+			geometryShader.setMat4("_Model", planeTransform.modelMatrix());
+			planeMesh.draw();
+			for (const glm::mat4& pillar : staticCasters)
+			{
+				geometryShader.setMat4("_Model", pillar);
+				pillarMesh.draw();
+			}
+			geometryShader.setMat4("_Model", rockTransform.modelMatrix());
+			rockMesh.draw();
+			geometryShader.setMat4("_Model", glm::mat4(1.0f));
+			terrain.draw();
+			blobMesh.draw();
+			glBindTextureUnit(0, textureStreamer.getTexture(monkeyAlbedo));
+			geometryShader.setMat4("_Model", monkeyTransform.modelMatrix());
+			if (subdivided) {
+				monkeySubdivision.draw();
+			}
+			else {
+				monkeyModel.draw();
+			}
+		});
 
-		for (int i = 0; i < MAX_POINT_LIGHTS; i++) {
-			//Creates prefix "_PointLights[0]." etc
-			std::string prefix = "_PointLights[" + std::to_string(i) + "].";
-			deferredShader.setVec3(prefix + "position", pointLights[i].position);
-			deferredShader.setVec3(prefix + "color", pointLights[i].color);
-			deferredShader.setFloat(prefix + "radius", pointLights[i].radius);
-		}
+		//LIGHTING PASS
+		//Lit color only lives from here to post processing
+		hannah::RenderPassBuilder lightingPass = renderGraph.addPass("Deferred lighting");
+		lightingPass.read(gBuffer);
+		lightingPass.read(gBuffer, hannah::RenderAccess::ATTACHMENT); //Depth blit
+		lightingPass.read(atlas);
+		int lit = lightingPass.create("Lit", litDesc);
+		lightingPass.setExecute([&](const hannah::RenderGraph& graph) {
+			const hannah::RenderTarget& gTarget = graph.getTarget(gBuffer);
+			const hannah::RenderTarget& target = graph.getTarget(lit);
+			glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+			glViewport(0, 0, target.width, target.height);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			deferredShader.use();
+
+			for (int i = 0; i < MAX_POINT_LIGHTS; i++) {
+				//Creates prefix "_PointLights[0]." etc
+				std::string prefix = "_PointLights[" + std::to_string(i) + "].";
+				deferredShader.setVec3(prefix + "position", pointLights[i].position);
+				deferredShader.setVec3(prefix + "color", pointLights[i].color);
+				deferredShader.setFloat(prefix + "radius", pointLights[i].radius);
+				deferredShader.setInt(prefix + "shadowFace", atlasShadows ? shadowAtlas.getFirstFace(i) : -1);
+			}
+
+			deferredShader.setVec3("lightPos", lightCam.position);
+			deferredShader.setVec3("_EyePos", camera.position);
+			deferredShader.setVec3("_LightDirection", glm::normalize(lightDir));
+			deferredShader.setFloat("_Material.Ka", material.Ka);
+			deferredShader.setFloat("_Material.Kd", material.Kd);
+			deferredShader.setFloat("_Material.Ks", material.Ks);
+			deferredShader.setFloat("_Material.Shininess", material.Shininess);
+
+			deferredShader.setFloat("minBias", minBias);
+			deferredShader.setFloat("maxBias", maxBias);
+
+			//Bind g-buffer textures
+			deferredShader.setInt("_CompactGBuffer", compact);
+			if (compact) {
+				deferredShader.setMat4("_InverseViewProjection", glm::inverse(camera.projectionMatrix() * camera.viewMatrix()));
+				glBindTextureUnit(1, gTarget.colorBuffer[0]);
+				glBindTextureUnit(2, gTarget.colorBuffer[1]);
+				glBindTextureUnit(4, gTarget.depthBuffer);
+			}
+			else {
+				glBindTextureUnit(0, gTarget.colorBuffer[0]);
+				glBindTextureUnit(1, gTarget.colorBuffer[1]);
+				glBindTextureUnit(2, gTarget.colorBuffer[2]);
+			}
+			shadowAtlas.bind(5);
+
+			glBindVertexArray(dummyVAO);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+
+			//Blit gBuffer depth to same framebuffer as fullscreen quad
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, gTarget.fbo); //Read from gBuffer 
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fbo); //Write to current fbo
+			glBlitFramebuffer(
+				0, 0, gTarget.width, gTarget.height, 0, 0, target.width, target.height, GL_DEPTH_BUFFER_BIT, GL_NEAREST
+			);
+		});
 
-		deferredShader.setVec3("lightPos", lightCam.position);
-		deferredShader.setVec3("_EyePos", camera.position);
-		deferredShader.setVec3("_LightDirection", glm::normalize(lightDir));
-		deferredShader.setFloat("_Material.Ka", material.Ka);
-		deferredShader.setFloat("_Material.Kd", material.Kd);
-		deferredShader.setFloat("_Material.Ks", material.Ks);
-		deferredShader.setFloat("_Material.Shininess", material.Shininess);
-
-		deferredShader.setFloat("minBias", minBias);
-		deferredShader.setFloat("maxBias", maxBias);
-
-		//Bind g-buffer textures
-		glBindTextureUnit(0, gBuffer.colorBuffer[0]);
-		glBindTextureUnit(1, gBuffer.colorBuffer[1]);
-		glBindTextureUnit(2, gBuffer.colorBuffer[2]);
-		glBindTextureUnit(3, shadowFramebuffer.depthBuffer); //For shadow mapping
-
-		glBindVertexArray(dummyVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 3);
-
-		//Blit gBuffer depth to same framebuffer as fullscreen quad
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer.fbo); //Read from gBuffer 
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer.fbo); //Write to current fbo
-		glBlitFramebuffer(
-			0, 0, screenWidth, screenHeight, 0, 0, screenWidth, screenHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST
-		);
 		//Draw all light orbs
-		lightOrbShader.use();
-		lightOrbShader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
-		for (int i = 0; i < MAX_POINT_LIGHTS; i++)
-		{
-			glm::mat4 m = glm::mat4(1.0f);
-			m = glm::translate(m, pointLights[i].position);
-			m = glm::scale(m, glm::vec3(0.2f)); //Whatever radius you want
-
-			lightOrbShader.setMat4("_Model", m);
-			lightOrbShader.setVec3("_Color", pointLights[i].color);
-			sphereMesh.draw();
+		hannah::RenderPassBuilder orbPass = renderGraph.addPass("Light orbs");
+		orbPass.write(lit);
+		orbPass.setExecute([&](const hannah::RenderGraph& graph) {
+			const hannah::RenderTarget& target = graph.getTarget(lit);
+			glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+			glViewport(0, 0, target.width, target.height);
+			lightOrbShader.use();
+			lightOrbShader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
+			for (int i = 0; i < MAX_POINT_LIGHTS; i++)
+			{
+				glm::mat4 m = glm::mat4(1.0f);
+				m = glm::translate(m, pointLights[i].position);
+				m = glm::scale(m, glm::vec3(0.2f)); //Whatever radius you want
+
+				lightOrbShader.setMat4("_Model", m);
+				lightOrbShader.setVec3("_Color", pointLights[i].color);
+				orbLODs[i] = sphereMesh.selectLOD(camera, m, target.height, orbLODs[i]);
+				sphereMesh.draw(orbLODs[i]);
+			}
+		});
+
+		//Only added on frames the cache is stale
+		if (redrawStaticShadows) {
+			hannah::RenderPassBuilder staticShadowPass = renderGraph.addPass("Static shadows");
+			staticShadowPass.write(staticShadowMap);
+			staticShadowPass.setExecute([&](const hannah::RenderGraph& graph) {
+				const hannah::RenderTarget& target = graph.getTarget(staticShadowMap);
+				glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+				glViewport(0, 0, target.width, target.height);
+				glClear(GL_DEPTH_BUFFER_BIT);
+
+				glCullFace(GL_FRONT);
+
+				depthShader.use();
+				depthShader.setMat4("_ViewProjection", lightCam.projectionMatrix() * lightCam.viewMatrix());
+				for (const glm::mat4& pillar : staticCasters)
+				{
+					depthShader.setMat4("_Model", pillar);
+					pillarMesh.draw();
+				}
+
+				glCullFace(GL_BACK);
+			});
 		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffer.fbo);
-		glBindTexture(GL_TEXTURE_2D, shadowFramebuffer.depthBuffer);
-		glViewport(0, 0, shadowWidth, shadowHeight);
-		glClear(GL_DEPTH_BUFFER_BIT);
-
-		glCullFace(GL_FRONT);
+		//Only faces whose light or casters changed are drawn, the rest of the atlas is kept from earlier frames
+		if (atlasShadows) {
+			hannah::RenderPassBuilder atlasPass = renderGraph.addPass("Shadow atlas");
+			atlasPass.write(atlas);
+			atlasPass.setExecute([&](const hannah::RenderGraph& graph) {
+				glCullFace(GL_FRONT);
+				depthShader.use();
+				shadowAtlas.render([&](const glm::mat4& viewProj, const std::vector<int>& casters) {
+					depthShader.setMat4("_ViewProjection", viewProj);
+					for (int c : casters)
+					{
+						depthShader.setMat4("_Model", atlasCasters[c].model);
+						monkeyModel.draw();
+					}
+				});
+				glCullFace(GL_BACK);
+			});
+		}
 
-		depthShader.use();
-		depthShader.setMat4("_ViewProjection", lightCam.projectionMatrix() * lightCam.viewMatrix());
-		depthShader.setMat4("_Model", monkeyTransform.modelMatrix());
-		monkeyModel.draw();
+		//Only read by the forward pass and the shadow map window, so it is culled while a moment filter is active
+		hannah::RenderPassBuilder shadowPass = renderGraph.addPass("Shadow map");
+		shadowPass.read(staticShadowMap, hannah::RenderAccess::ATTACHMENT);
+		shadowPass.write(shadowMap);
+		shadowPass.setExecute([&](const hannah::RenderGraph& graph) {
+			const hannah::RenderTarget& staticTarget = graph.getTarget(staticShadowMap);
+			const hannah::RenderTarget& target = graph.getTarget(shadowMap);
+			//Start from the cached static casters instead of clearing. Timed on its own, it is what the cache costs every frame.
+			{
+				hannah::ProfileScope copyScope(&profiler, "Static shadow copy");
+				glCopyImageSubData(staticTarget.depthBuffer, GL_TEXTURE_2D, 0, 0, 0, 0, target.depthBuffer, GL_TEXTURE_2D, 0, 0, 0, 0, target.width, target.height, 1);
+			}
+			glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+			glViewport(0, 0, target.width, target.height);
+
+			glCullFace(GL_FRONT);
+
+			depthShader.use();
+			depthShader.setMat4("_ViewProjection", lightCam.projectionMatrix() * lightCam.viewMatrix());
+			depthShader.setMat4("_Model", monkeyTransform.modelMatrix());
+			monkeyModel.draw();
+
+			glCullFace(GL_BACK);
+		});
+
+		//Moments instead of depth. A blurred layer of cached static moments couldn't be merged with new casters, so all are drawn.
+		int moments = -1;
+		int momentBlur = -1;
+		if (momentShadows) {
+			hannah::RenderPassBuilder momentPass = renderGraph.addPass("Shadow moments");
+			moments = momentPass.create("Shadow moments", momentDesc);
+			momentPass.setExecute([&](const hannah::RenderGraph& graph) {
+				const hannah::RenderTarget& target = graph.getTarget(moments);
+				glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+				glViewport(0, 0, target.width, target.height);
+				glm::vec2 clearMoments = hannah::getClearMoments(filter);
+				float clearColor[4] = { clearMoments.x, clearMoments.y, 0.0f, 0.0f };
+				glClearNamedFramebufferfv(target.fbo, GL_COLOR, 0, clearColor);
+				glClear(GL_DEPTH_BUFFER_BIT);
+
+				momentShader.use();
+				momentShader.setFloat("_MomentExponent", hannah::getMomentExponent(filter));
+				momentShader.setMat4("_ViewProjection", lightCam.projectionMatrix() * lightCam.viewMatrix());
+				momentShader.setMat4("_Model", planeTransform.modelMatrix());
+				shadowPlaneMesh.draw();
+				for (const glm::mat4& pillar : staticCasters)
+				{
+					momentShader.setMat4("_Model", pillar);
+					pillarMesh.draw();
+				}
+				momentShader.setMat4("_Model", monkeyTransform.modelMatrix());
+				monkeyModel.draw();
+			});
+
+			//Separable, the horizontal half goes to a scratch target and the vertical half back into the moments
+			hannah::RenderPassBuilder blurPass = renderGraph.addPass("Shadow blur");
+			blurPass.read(moments);
+			blurPass.write(moments);
+			momentBlur = blurPass.create("Shadow blur", momentBlurDesc);
+			blurPass.setExecute([&](const hannah::RenderGraph& graph) {
+				const hannah::RenderTarget& target = graph.getTarget(moments);
+				const hannah::RenderTarget& scratch = graph.getTarget(momentBlur);
+				hannah::GaussianKernel kernel = hannah::createGaussianKernel(shadowBlurRadius);
+				blurShader.use();
+				blurShader.setInt("_NumTaps", kernel.numTaps);
+				for (int i = 0; i < kernel.numTaps; i++)
+				{
+					blurShader.setFloat("_Offsets[" + std::to_string(i) + "]", kernel.offsets[i]);
+					blurShader.setFloat("_Weights[" + std::to_string(i) + "]", kernel.weights[i]);
+				}
+				glViewport(0, 0, target.width, target.height);
+				glDisable(GL_DEPTH_TEST);
+				glBindVertexArray(dummyVAO);
+
+				glBindFramebuffer(GL_FRAMEBUFFER, scratch.fbo);
+				glBindTextureUnit(0, target.colorBuffer[0]);
+				blurShader.setVec2("_Direction", 1.0f / target.width, 0.0f);
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+
+				glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+				glBindTextureUnit(0, scratch.colorBuffer[0]);
+				blurShader.setVec2("_Direction", 0.0f, 1.0f / target.height);
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+
+				glEnable(GL_DEPTH_TEST);
+				//Distant and grazing pixels filter from the lower levels
+				glGenerateTextureMipmap(target.colorBuffer[0]);
+			});
+		}
+		int shadow = momentShadows ? moments : shadowMap;
 
 		//RENDER
-		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.fbo);
-		glBindTextureUnit(0, brickTexture);
-		glBindTextureUnit(1, normalTexture);
-		glBindTextureUnit(2, shadowFramebuffer.depthBuffer);
-		//glViewport(0, 0, screenWidth, screenHeight);
-		//glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		//glClearColor(0.6f, 0.8f, 0.92f, 1.0f);
-
-		// reset viewport
-		glViewport(0, 0, screenWidth, screenHeight);
-		//glClear(GL_DEPTH_BUFFER_BIT);
-
-		glCullFace(GL_BACK);
-
-		shader.use();
-		shader.setInt("_MainTex", 0);
-		shader.setInt("normalMap", 1);
-		shader.setInt("_ShadowMap", 2);
-		shader.setMat4("_Model", glm::mat4(1.0f));
-		shader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
-		shader.setMat4("_LightViewProj", lightCam.projectionMatrix() * lightCam.viewMatrix());
-		shader.setVec3("_EyePos", camera.position);
-		shader.setVec3("_LightDirection", glm::normalize(lightDir));
-		shader.setFloat("_Material.Ka", material.Ka);
-		shader.setFloat("_Material.Kd", material.Kd);
-		shader.setFloat("_Material.Ks", material.Ks);
-		shader.setFloat("_Material.Shininess", material.Shininess);
-
-		shader.setFloat("minBias", minBias);
-		shader.setFloat("maxBias", maxBias);
-
-		shader.setMat4("_Model", planeTransform.modelMatrix());
-		planeMesh.draw();
-
-		shader.setMat4("_Model", monkeyTransform.modelMatrix());
-		monkeyModel.draw(); //Draws monkey model using current shader
-		
+		hannah::RenderPassBuilder forwardPass = renderGraph.addPass("Forward");
+		forwardPass.read(shadow);
+		forwardPass.write(lit);
+		forwardPass.setExecute([&](const hannah::RenderGraph& graph) {
+			const hannah::RenderTarget& target = graph.getTarget(lit);
+			glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+			glBindTextureUnit(0, brickTexture);
+			glBindTextureUnit(1, normalTexture);
+			if (momentShadows) {
+				glBindTextureUnit(3, graph.getTarget(moments).colorBuffer[0]);
+			}
+			else {
+				glBindTextureUnit(2, graph.getTarget(shadowMap).depthBuffer);
+			}
+			glViewport(0, 0, target.width, target.height);
+
+			shader.use();
+			shader.setInt("_MainTex", 0);
+			shader.setInt("normalMap", 1);
+			shader.setInt("_ShadowMap", 2);
+			shader.setInt("_ShadowMoments", 3);
+			shader.setInt("_ShadowFilter", (int)filter);
+			shader.setFloat("_MomentExponent", hannah::getMomentExponent(filter));
+			shader.setFloat("_LightBleedReduction", lightBleedReduction);
+			shader.setMat4("_Model", glm::mat4(1.0f));
+			shader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
+			shader.setMat4("_LightViewProj", lightCam.projectionMatrix() * lightCam.viewMatrix());
+			shader.setVec3("_EyePos", camera.position);
+			shader.setVec3("_LightDirection", glm::normalize(lightDir));
+			shader.setFloat("_Material.Ka", material.Ka);
+			shader.setFloat("_Material.Kd", material.Kd);
+			shader.setFloat("_Material.Ks", material.Ks);
+			shader.setFloat("_Material.Shininess", material.Shininess);
+
+			shader.setFloat("minBias", minBias);
+			shader.setFloat("maxBias", maxBias);
+
+			shader.setMat4("_Model", planeTransform.modelMatrix());
+			planeMesh.draw();
+			for (const glm::mat4& pillar : staticCasters)
+			{
+				shader.setMat4("_Model", pillar);
+				pillarMesh.draw();
+			}
+			shader.setMat4("_Model", rockTransform.modelMatrix());
+			rockMesh.draw();
+			shader.setMat4("_Model", glm::mat4(1.0f));
+			terrain.draw();
+			blobMesh.draw();
+
+			glBindTextureUnit(0, textureStreamer.getTexture(monkeyAlbedo));
+			shader.setMat4("_Model", monkeyTransform.modelMatrix());
+			if (subdivided) {
+				monkeySubdivision.draw();
+			}
+			else {
+				monkeyModel.draw(); //Draws monkey model using current shader
+			}
+		});
+
+		hannah::RenderPassBuilder postPass = renderGraph.addPass("Post process");
+		postPass.read(lit);
+		postPass.write(backbuffer);
+		postPass.setExecute([&](const hannah::RenderGraph& graph) {
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, screenWidth, screenHeight);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			postProcess.use();
+			postProcess.setFloat("gamma", gamma);
+
+			glBindTextureUnit(0, graph.getTarget(lit).colorBuffer[0]);
+			glBindVertexArray(dummyVAO);
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+		});
+
+		//The debug windows show the shadow map and G-buffer
+		hannah::RenderPassBuilder uiPass = renderGraph.addPass("UI");
+		uiPass.read(shadow);
+		uiPass.read(gBuffer);
+		uiPass.write(backbuffer);
+		uiPass.setExecute([&](const hannah::RenderGraph& graph) {
+			const hannah::RenderTarget& activeShadow = graph.getTarget(shadow);
+			drawUI(graph.getTarget(gBuffer), momentShadows ? activeShadow.colorBuffer[0] : activeShadow.depthBuffer);
+		});
+
+		renderGraph.execute();
+
 		//Rotate model around Y axis
 		monkeyTransform.rotation = glm::rotate(monkeyTransform.rotation, deltaTime, glm::vec3(0.0, 1.0, 0.0));
 	
 		//transform.modelMatrix() combines translation, rotation, and scale into a 4x4 model matrix
 		cameraController.move(window, &camera, deltaTime);
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	
-		postProcess.use();
-		postProcess.setFloat("gamma", gamma);
-
-		glBindTextureUnit(0, framebuffer.colorBuffer[0]);
-		glBindVertexArray(dummyVAO);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, framebuffer.colorBuffer[0]);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-
-		drawUI();
-
 		glfwSwapBuffers(window);
+		profiler.endFrame();
+		for (const hannah::ProfileResult& result : profiler.getResults())
+		{
+			if (result.name == "Static shadows") {
+				shadowCache.recordStaticCost(result.gpuMs);
+			}
+			else if (result.name == "Static shadow copy") {
+				shadowCache.recordCopyCost(result.gpuMs);
+			}
+		}
+		renderTargets.endFrame();
+		ew::collectGpuGarbage();
 	}
+	//Globals outlive main, release them now so they don't show up as leaks
+	renderGraph.printReport();
+	profiler.printReport();
+	renderTargets.printReport();
+	shadowCache.printReport();
+	shadowAtlas.printReport();
+	ew::TextureCache::get().printReport();
+	terrain.printReport();
+	renderGraph.reset();
+	renderTargets.clear();
+	profiler.clear();
+	shadowAtlas.clear();
 	printf("Shutting down...");
 }
 
@@ -287,7 +779,7 @@ void resetCamera(ew::Camera* camera, ew::CameraController* controller) {
 	controller->yaw = controller->pitch = 0;
 }
 
-void drawUI() {
+void drawUI(const hannah::RenderTarget& gBuffer, unsigned int shadowTexture) {
 	ImGui_ImplGlfw_NewFrame();
 	ImGui_ImplOpenGL3_NewFrame();
 	ImGui::NewFrame();
@@ -303,6 +795,36 @@ void drawUI() {
 		ImGui::SliderFloat("Height", &lightCam.orthoHeight, 4.0f, 10.0f);
 		ImGui::SliderFloat("MinBias", &minBias, 0.0f, 1.0f);
 		ImGui::SliderFloat("MaxBias", &maxBias, 0.0f, 1.0f);
+		int filter = (int)shadowFilter;
+		if (ImGui::Combo("Shadow filter", &filter, hannah::SHADOW_FILTER_NAMES, IM_ARRAYSIZE(hannah::SHADOW_FILTER_NAMES))) {
+			shadowFilter = (hannah::ShadowFilter)filter;
+		}
+		ImGui::SliderInt("Shadow blur radius", &shadowBlurRadius, 0, hannah::MAX_GAUSSIAN_RADIUS);
+		ImGui::SliderFloat("Light bleed reduction", &lightBleedReduction, 0.0f, 0.9f);
+	}
+	if (ImGui::CollapsingHeader("Meshlet Culling")) {
+		ImGui::Text("Meshlets: %u / %u", planeCullStats.meshletsVisible, planeCullStats.meshletsTotal);
+		ImGui::Text("Triangles: %u / %u", planeCullStats.trianglesVisible, planeCullStats.trianglesTotal);
+	}
+	if (ImGui::CollapsingHeader("Terrain")) {
+		ImGui::Text("Chunks: %u drawn, %u resident, %u pending, %u evicted", terrainStats.chunksDrawn, terrainStats.chunksResident, terrainStats.chunksPending, terrainStats.chunksEvicted);
+		ImGui::Text("Memory: %.1f MB", terrainStats.memoryUsed / (1024.0f * 1024.0f));
+		ImGui::Text("Isosurface: %zu triangles", blobTriangles);
+		ImGui::Checkbox("Subdivide monkey", &subdivideMonkey);
+		ImGui::Text("Monkey: %u triangles", monkeyTriangles);
+	}
+	if (ImGui::CollapsingHeader("Profiler")) {
+		ImGui::Checkbox("Compact G-buffer", &compactGBuffer);
+		const hannah::ShadowCacheStats& shadowStats = shadowCache.getStats();
+		ImGui::Text("Static shadows drawn %zu / %zu frames, copied in %.3f ms, saved %.1f ms", shadowStats.staticRenders, shadowStats.frames, shadowStats.copyGpuMs, shadowStats.getSavedMs());
+		ImGui::Checkbox("Point light shadows", &pointLightShadows);
+		const hannah::ShadowAtlasStats& atlasStats = shadowAtlas.getStats();
+		ImGui::Text("Shadow atlas: %zu / %zu lights, faces drawn %zu, reused %zu, waiting %zu", atlasStats.numShadowed, atlasStats.numLights, atlasStats.facesDrawn, atlasStats.facesReused, atlasStats.facesPending);
+		ImGui::Text("Texture streaming: %u pending, %.1f MB resident, %.1f KB uploaded, %u levels evicted", streamingStats.texturesPending, streamingStats.memoryUsed / (1024.0f * 1024.0f), streamingStats.bytesUploaded / 1024.0f, streamingStats.levelsEvicted);
+		for (const hannah::ProfileResult& result : profiler.getResults())
+		{
+			ImGui::Text("%*s%s: cpu %.2f ms, gpu %.2f ms", result.depth * 2, "", result.name.c_str(), result.cpuMs, result.gpuMs);
+		}
 	}
 	ImGui::End();
 
@@ -313,13 +835,13 @@ void drawUI() {
 	ImVec2 windowSize = ImGui::GetWindowSize();
 	//Invert 0-1 V to flip vertically for ImGui display
 	//shadowMap is the texture2D handle
-	ImGui::Image((ImTextureID)shadowFramebuffer.depthBuffer, windowSize, ImVec2(0, 1), ImVec2(1, 0));
+	ImGui::Image((ImTextureID)shadowTexture, windowSize, ImVec2(0, 1), ImVec2(1, 0));
 	ImGui::EndChild();
 	ImGui::End();
 
 	ImGui::Begin("GBuffers");
 	ImVec2 texSize = ImVec2(gBuffer.width / 4, gBuffer.height / 4);
-	for (size_t i = 0; i < 3; i++)
+	for (int i = 0; i < hannah::MAX_COLOR_ATTACHMENTS && gBuffer.colorBuffer[i] != 0; i++)
 	{
 		ImGui::Image((ImTextureID)gBuffer.colorBuffer[i], texSize, ImVec2(0, 1), ImVec2(1, 0));
 	}
@@ -0,0 +1,11 @@
+#version 450
+layout (location = 0) in vec3 vPos;
+//Per draw model matrix from hannah::DrawList (locations 4-7)
+layout (location = 4) in mat4 vModel;
+
+uniform mat4 _ViewProjection;
+
+void main()
+{
+    gl_Position = _ViewProjection * vModel * vec4(vPos, 1.0);
+}  
\ No newline at end of file
@@ -0,0 +1,31 @@
+#version 450 core
+layout(location = 0) out vec2 gNormal; //Octahedral worldspace normal
+layout(location = 1) out vec4 gAlbedo; //Alpha holds the shininess
+in vec4 LightSpacePos;
+
+in Surface{
+	vec3 WorldPos; 
+	vec3 WorldNormal;
+	vec2 TexCoord;
+	mat3 TBN;
+}fs_in;
+
+uniform sampler2D _MainTex;
+uniform float _Shininess;
+
+vec2 octWrap(vec2 v){
+	return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+//Folds the unit sphere onto a square, [0,1] to fit an unsigned normalized target
+vec2 encodeOctahedral(vec3 n){
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	n.xy = n.z >= 0.0 ? n.xy : octWrap(n.xy);
+	return n.xy * 0.5 + 0.5;
+}
+
+void main(){
+	gNormal = encodeOctahedral(normalize(fs_in.WorldNormal));
+	//Shininess spans 2-1024, log2 spreads it evenly over 8 bits
+	gAlbedo = vec4(texture(_MainTex,fs_in.TexCoord).rgb, log2(_Shininess) / 10.0);
+}
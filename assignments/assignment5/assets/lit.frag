@@ -37,14 +37,13 @@ float calcShadow(sampler2D shadowMap, vec4 lightSpacePos, float bias){
 	if(myDepth > 1.0f)
 		return 0.0f;
 
-	float shadowMapDepth = texture(shadowMap, sampleCoord.xy).r;
 	//step(a,b) returns 1.0 if a >= b, 0.0 otherwise
 	float totalShadow = 0.0f;
-	vec2 texelOffset = 1.0 /  textureSize(_ShadowMap,0);
+	vec2 texelOffset = 1.0 /  textureSize(shadowMap,0);
 	for(int y = -1; y <=1; y++){
 		for(int x = -1; x <=1; x++){
 			vec2 uv = sampleCoord.xy + vec2(x * texelOffset.x, y * texelOffset.y);
-			totalShadow += step(texture(_ShadowMap,uv).r,myDepth);
+			totalShadow += step(texture(shadowMap,uv).r,myDepth);
 		}
 	}
 	totalShadow /= 9.0;
@@ -55,14 +54,51 @@ float calcShadow(sampler2D shadowMap, vec4 lightSpacePos, float bias){
 	return totalShadow;
 }
 
+//Moment shadow maps (hannah::ShadowFilter), blurred once so a single filtered fetch replaces the PCF loop
+uniform sampler2D _ShadowMoments;
+uniform int _ShadowFilter; //0 PCF, 1 VSM, 2 EVSM
+uniform float _MomentExponent;
+uniform float _LightBleedReduction;
+
+//Chebyshev's upper bound on the fraction of light reaching depth t, given the filtered moments around it
+float chebyshevUpperBound(vec2 moments, float t, float minVariance){
+	if(t <= moments.x)
+		return 1.0;
+	float variance = max(moments.y - moments.x * moments.x, minVariance);
+	float d = t - moments.x;
+	float pMax = variance / (variance + d * d);
+	//Cut off the low tail, that is where light bleeds through overlapping occluders
+	return clamp((pMax - _LightBleedReduction) / (1.0 - _LightBleedReduction), 0.0, 1.0);
+}
+
+//Same result range as calcShadow, 1 fully shadowed
+float calcMomentShadow(sampler2D moments, vec4 lightSpacePos){
+	vec3 sampleCoord = lightSpacePos.xyz / lightSpacePos.w;
+	sampleCoord = sampleCoord * 0.5 + 0.5;
+	if(sampleCoord.z > 1.0 || any(lessThan(sampleCoord.xy, vec2(0.0))) || any(greaterThan(sampleCoord.xy, vec2(1.0))))
+		return 0.0;
+	vec2 filtered = texture(moments, sampleCoord.xy).rg;
+	float lit;
+	if(_MomentExponent > 0.0){
+		float warped = exp(_MomentExponent * (sampleCoord.z * 2.0 - 1.0));
+		//Minimum spread of 0.002 in [0,1] depth like VSM, carried through the warp's slope
+		float slope = 0.002 * 2.0 * _MomentExponent * warped;
+		lit = chebyshevUpperBound(filtered, warped, slope * slope);
+	}else{
+		lit = chebyshevUpperBound(filtered, sampleCoord.z, 0.002 * 0.002);
+	}
+	return 1.0 - lit;
+}
+
 void main(){
 	//Make sure fragment normal is still length 1 after interpolation.
 	vec3 normal = normalize(fs_in.WorldNormal);
 
 	vec3 lightDir = _LightDirection;
 
-	normal = texture(normalMap, fs_in.TexCoord).rgb;
-	normal = normal * 2.0 - 1.0;   
+	//BC5 only stores x and y, z is rebuilt since the normal is unit length
+	normal.xy = texture(normalMap, fs_in.TexCoord).rg * 2.0 - 1.0;
+	normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
 	normal = normalize(fs_in.TBN * normal); 
 
 	//Light pointing straight down
@@ -77,7 +113,7 @@ void main(){
 	vec3 lightColor = (_Material.Kd * diffuseFactor + _Material.Ks * specularFactor) * _LightColor;
 
 	float bias = max(maxBias * (1.0 - dot(normal, toLight)), minBias);
-	float shadow = calcShadow(_ShadowMap, LightSpacePos, bias); 
+	float shadow = _ShadowFilter == 0 ? calcShadow(_ShadowMap, LightSpacePos, bias) : calcMomentShadow(_ShadowMoments, LightSpacePos);
 
 	lightColor *= 1.0 - shadow;
 	lightColor+=_AmbientColor * _Material.Ka;
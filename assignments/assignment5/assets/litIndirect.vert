@@ -0,0 +1,42 @@
+#version 450
+//Vertex attributes
+layout(location = 0) in vec3 vPos;
+layout(location = 1) in vec3 vNormal;
+layout(location = 2) in vec2 vTexCoord;
+layout(location = 3) in vec4 vTangent; //w is the bitangent sign
+//Per draw model matrix from hannah::DrawList (locations 4-7)
+layout(location = 4) in mat4 vModel;
+
+uniform mat4 _ViewProjection;
+
+out Surface{
+	vec3 WorldPos; //Vertex position in world space
+	vec3 WorldNormal; //Vertex normal in world space
+	vec2 TexCoord;
+	mat3 TBN;
+}vs_out;
+
+uniform mat4 _LightViewProj; //view + projection of light source camera
+out vec4 LightSpacePos; //Sent to fragment shader
+
+
+void main(){
+	//Transform vertex position to World Space.
+	vs_out.WorldPos = vec3(vModel * vec4(vPos,1.0));
+	//Transform vertex normal to world space using Normal Matrix
+	vs_out.WorldNormal = transpose(inverse(mat3(vModel))) * vNormal;
+	vs_out.TexCoord = vTexCoord;
+
+	gl_Position = _ViewProjection * vModel * vec4(vPos,1.0);
+
+	LightSpacePos = _LightViewProj * vModel * vec4(vPos, 1.0);
+
+	vec3 T = normalize(vec3(vModel * vec4(vTangent.xyz, 0.0)));
+	vec3 N = normalize(vec3(vModel * vec4(vNormal, 0.0)));
+	// re-orthogonalize T with respect to N
+	T = normalize(T - dot(T, N) * N);
+	// then retrieve perpendicular vector B with the cross product of T and N
+	vec3 B = cross(N, T) * vTangent.w;
+
+	vs_out.TBN = mat3(T, B, N);  
+}
@@ -0,0 +1,14 @@
+#version 450
+layout(location = 0) out vec2 FragMoments; //GL_COLOR_ATTACHMENT0, RG32F
+
+uniform float _MomentExponent; //0 stores plain depth (VSM), otherwise e^(exponent * depth) (EVSM)
+
+void main(){
+	//NDC depth, [-1,1]
+	float depth = gl_FragCoord.z * 2.0 - 1.0;
+	float warped = _MomentExponent > 0.0 ? exp(_MomentExponent * depth) : depth * 0.5 + 0.5;
+	//Depth slope across the pixel goes into the variance, so sloped receivers don't shadow themselves
+	float dx = dFdx(warped);
+	float dy = dFdy(warped);
+	FragMoments = vec2(warped, warped * warped + 0.25 * (dx * dx + dy * dy));
+}
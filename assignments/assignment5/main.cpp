@@ -14,16 +14,26 @@
 #include <ew/transform.h>
 #include <ew/cameraController.h>
 #include <ew/texture.h>
+#include <ew/textureCache.h>
 #include <ew/procGen.h>
 
 #include <hannah/framebuffer.h>
+#include <hannah/renderTargetPool.h>
+#include <hannah/renderGraph.h>
+#include <hannah/profiler.h>
+#include <hannah/shadowCache.h>
+#include <hannah/shadowAtlas.h>
+#include <hannah/momentShadows.h>
+#include <hannah/textureCompression.h>
+#include <hannah/meshLOD.h>
+#include <hannah/meshArena.h>
 
 #include <time.h> 
 #include "vector"
 
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 GLFWwindow* initWindow(const char* title, int width, int height);
-void drawUI();
+void drawUI(const hannah::RenderTarget& gBuffer, unsigned int shadowTexture);
 
 
 ew::Camera camera;
@@ -46,49 +56,6 @@ struct PointLight {
 const int MAX_POINT_LIGHTS = 64;
 PointLight pointLights[MAX_POINT_LIGHTS];
 
-struct Transform {
-	glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
-	glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
-	glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
-
-	glm::mat4 modelMatrix() const {
-		glm::mat4 m = glm::mat4(1.0f);
-		m = glm::translate(m, position);
-		m *= glm::mat4_cast(rotation);
-		m = glm::scale(m, scale);
-		return m;
-	}
-};
-
-struct Node {
-	glm::mat4 localTransform;
-	glm::mat4 globalTransform;
-	unsigned int parentIndex;
-	Transform transform;
-};
-
-struct Hierarchy
-{
-	std::vector<Node*> nodes;
-	unsigned int nodeCount;
-};
-
-//Assumes list is ordered by depth
-void SolveFK(Hierarchy hierarchy)
-{
-	for each (Node *node in hierarchy.nodes)
-	{
-		if (node->parentIndex == -1)
-		{
-			node->globalTransform = node->localTransform;
-		}
-		else
-		{
-			node->globalTransform = hierarchy.nodes[node->parentIndex]->globalTransform * node->localTransform;
-		}
-	}
-}
-
 //Global state
 int screenWidth = 1080;
 int screenHeight = 720;
@@ -103,26 +70,76 @@ float gamma = 2.2f;
 glm::vec3 lightDir = glm::vec3(0.0f, -1.0f, 0.0f);
 float minBias = 0.005f;
 float maxBias = 0.015f;
-
-hannah::Framebuffer shadowFramebuffer;
-hannah::Framebuffer gBuffer;
+//PCF compares depths per tap, VSM and EVSM blur depth moments once and take one filtered fetch per pixel
+hannah::ShadowFilter shadowFilter = hannah::ShadowFilter::PCF;
+int shadowBlurRadius = 4; //In shadow map texels
+float lightBleedReduction = 0.2f;
+
+//Screen sized targets are recreated by the pool when the window is resized
+hannah::RenderTargetPool renderTargets;
+int shadowTarget;
+//Static casters are drawn here only when they or the light change, then copied into the shadow map each frame
+int staticShadowTarget;
+hannah::ShadowCache shadowCache;
+//Normals, albedo and depth only, position is rebuilt from depth. Toggle to compare in the profiler.
+bool compactGBuffer = true;
+hannah::Profiler profiler;
+hannah::RenderGraph renderGraph(&renderTargets, &profiler);
+//Point light shadows share one depth atlas of fixed size, the lights covering the most screen get the biggest tiles
+hannah::ShadowAtlas shadowAtlas;
+bool pointLightShadows = true;
 
 int main() {
 	GLFWwindow* window = initWindow("Assignment 3", screenWidth, screenHeight);
 	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+	//Reports any GPU objects still alive once main's resources are released
+	ew::GpuLeakCheck leakCheck;
 
-	ew::Shader shader = ew::Shader("assets/lit.vert", "assets/lit.frag");
+	ew::Shader shader = ew::Shader("assets/litIndirect.vert", "assets/lit.frag");
 	ew::Shader postProcess = ew::Shader("assets/post.vert", "assets/post.frag");
-	ew::Shader depthShader = ew::Shader("assets/depth.vert", "assets/depth.frag");
-	ew::Shader gShader = ew::Shader("assets/lit.vert", "assets/geometry.frag");
+	ew::Shader depthShader = ew::Shader("assets/depthIndirect.vert", "assets/depth.frag");
+	ew::Shader momentShader = ew::Shader("assets/depthIndirect.vert", "assets/moments.frag");
+	ew::Shader blurShader = ew::Shader("assets/deferredLit.vert", "assets/blur.frag");
+	ew::Shader gShader = ew::Shader("assets/litIndirect.vert", "assets/geometry.frag");
+	ew::Shader gCompactShader = ew::Shader("assets/litIndirect.vert", "assets/geometryCompact.frag");
 	ew::Shader deferredShader = ew::Shader("assets/deferredLit.vert", "assets/deferredLit.frag");
 	ew::Shader lightOrbShader = ew::Shader("assets/lightOrb.vert", "assets/lightOrb.frag");
-	ew::Model monkeyModel = ew::Model("assets/suzanne.fbx");
-	ew::Mesh planeMesh = ew::Mesh(ew::createPlane(10, 10, 5));
+
+	//Scene geometry shares one set of buffers so each pass is a single multi-draw call
+	hannah::MeshArena meshArena(65536, 196608);
+	hannah::DrawList sceneDrawList;
+	hannah::DrawList shadowDrawList;
+	std::vector<ew::MeshData> monkeyMeshData = ew::loadModelMeshData("assets/suzanne.fbx");
+	std::vector<int> monkeyMeshes;
+	for (size_t i = 0; i < monkeyMeshData.size(); i++)
+	{
+		monkeyMeshes.push_back(meshArena.add(monkeyMeshData[i]));
+	}
+	int planeMesh = meshArena.add(ew::createPlane(10, 10, 5));
 	ew::Transform planeTransform;
 	planeTransform.position = glm::vec3(0.0f, -1.0f, 0.0f);
 	planeTransform.scale = glm::vec3(10.0f);
-	ew::Mesh sphereMesh = ew::Mesh(ew::createSphere(1.0f, 8));
+	hannah::LODMesh sphereMesh(ew::createSphere(1.0f, 8));
+	int orbLODs[MAX_POINT_LIGHTS] = { 0 }; //Current LOD per light orb, needed for hysteresis
+	//Closed, so they still write depth with front faces culled. The plane only receives shadows.
+	int pillarMesh = meshArena.add(ew::createCylinder(0.25f, 2.0f, 16));
+	const int NUM_PILLARS = 4;
+	ew::Transform pillarTransforms[NUM_PILLARS];
+	for (int i = 0; i < NUM_PILLARS; i++)
+	{
+		pillarTransforms[i].position = glm::vec3(i % 2 ? 2.0f : -2.0f, 0.0f, i / 2 ? 2.0f : -2.0f);
+	}
+	hannah::DrawList staticShadowDrawList;
+	std::vector<glm::mat4> staticCasters;
+	//Moment maps still want the plane, it keeps filtering from reaching past the casters into the cleared background
+	hannah::DrawList shadowPlaneDrawList;
+	shadowPlaneDrawList.add(planeMesh, planeTransform.modelMatrix());
+	//Every monkey in the hierarchy casts point light shadows, each atlas face only draws those inside it
+	hannah::ShadowCaster monkeyCaster;
+	hannah::computeBoundingSphere(monkeyMeshData, &monkeyCaster.center, &monkeyCaster.radius);
+	std::vector<hannah::ShadowCaster> atlasCasters;
+	std::vector<hannah::ShadowLight> shadowLights(MAX_POINT_LIGHTS);
+	hannah::DrawList atlasDrawList;
 
 	camera.position = glm::vec3(0.0f, 0.0f, 5.0f);
 	camera.target = glm::vec3(0.0f, 0.0f, 0.0f); //Look at the center of the scene
@@ -144,13 +161,44 @@ int main() {
 	unsigned int dummyVAO;
 	glCreateVertexArrays(1, &dummyVAO);
 
-	hannah::Framebuffer framebuffer = hannah::createFramebufferWithDepthBuffer(screenWidth, screenHeight, GL_RGB16F);
-	shadowFramebuffer = hannah::createFramebufferWithShadowMap(shadowWidth, shadowHeight, GL_RGB16F);
-	gBuffer = hannah::createGBuffer(screenWidth, screenHeight);
-
-	//Handles to OpenGL object are unsigned integers
-	GLuint brickTexture = ew::loadTexture("assets/travertine_color.jpg");
-	GLuint normalTexture = ew::loadTexture("assets/travertine_normal.jpg");
+	renderTargets.beginFrame(screenWidth, screenHeight);
+	hannah::RenderTargetDesc litDesc;
+	litDesc.numColors = 1;
+	litDesc.colorFormats[0] = GL_SRGB8_ALPHA8;
+	hannah::RenderTargetDesc shadowDesc;
+	shadowDesc.width = shadowWidth;
+	shadowDesc.height = shadowHeight;
+	shadowDesc.depthFormat = GL_DEPTH_COMPONENT16;
+	shadowDesc.filter = GL_NEAREST;
+	shadowTarget = renderTargets.createPersistent(shadowDesc);
+	staticShadowTarget = renderTargets.createPersistent(shadowDesc);
+	hannah::RenderTargetDesc momentDesc;
+	momentDesc.width = shadowWidth;
+	momentDesc.height = shadowHeight;
+	momentDesc.numColors = 1;
+	momentDesc.colorFormats[0] = GL_RG32F; //Half floats can't hold the EVSM warp
+	momentDesc.depthFormat = GL_DEPTH_COMPONENT16;
+	momentDesc.filter = GL_LINEAR_MIPMAP_LINEAR; //Trilinear fetches do the filtering PCF did by hand
+	hannah::RenderTargetDesc momentBlurDesc = momentDesc;
+	momentBlurDesc.depthFormat = 0;
+	momentBlurDesc.filter = GL_LINEAR;
+	hannah::RenderTargetDesc gBufferDesc;
+	gBufferDesc.numColors = 3;
+	gBufferDesc.colorFormats[0] = GL_RGB32F; //World position
+	gBufferDesc.colorFormats[1] = GL_RGB16F; //World normal
+	gBufferDesc.colorFormats[2] = GL_RGB16F; //Albedo
+	gBufferDesc.depthFormat = GL_DEPTH_COMPONENT16;
+	gBufferDesc.filter = GL_NEAREST;
+	hannah::RenderTargetDesc compactGBufferDesc;
+	compactGBufferDesc.numColors = 2;
+	compactGBufferDesc.colorFormats[0] = GL_RG16; //Octahedral world normal
+	compactGBufferDesc.colorFormats[1] = GL_SRGB8_ALPHA8; //Albedo, shininess in alpha
+	compactGBufferDesc.depthFormat = GL_DEPTH_COMPONENT24; //Positions are rebuilt from it, 16 bit depth bands at a distance
+	compactGBufferDesc.filter = GL_NEAREST;
+
+	//Block compressed, 0.7 + 1.3 MB with mips instead of 5.3 MB each. Compressed on the first run, later runs upload the cached blocks.
+	ew::TextureHandle brickTexture = ew::loadCompressedTexture("assets/travertine_color.jpg", hannah::BlockFormat::BC1);
+	ew::TextureHandle normalTexture = ew::loadCompressedTexture("assets/travertine_normal.jpg", hannah::BlockFormat::BC5);
 
 	//Make "_MainTex" sampler2D sample from the 2D texture bound to unit 0
 	shader.use();
@@ -168,77 +216,57 @@ int main() {
 	}
 
 	
-	Node body;
-
-	Node topJoint;
-	Node topElbow;
-	Node topWrist;
-
-	Node bottomJoint;
-	Node bottomElbow;
-	Node bottomWrist;
-
-	Node rightShoulder;
-	Node leftShoulder;
-
-	Hierarchy hierarchy;
-	hierarchy.nodes.push_back(&body);          // index = 0
-	hierarchy.nodeCount++;
-
-	hierarchy.nodes.push_back(&topJoint);      // index = 1
-	hierarchy.nodeCount++;
-	hierarchy.nodes.push_back(&topElbow);      // index = 2
-	hierarchy.nodeCount++;
-	hierarchy.nodes.push_back(&topWrist);      // index = 3
-	hierarchy.nodeCount++;
-
-	hierarchy.nodes.push_back(&bottomJoint);   // index = 4
-	hierarchy.nodeCount++;
-	hierarchy.nodes.push_back(&bottomElbow);   // index = 5
-	hierarchy.nodeCount++;
-	hierarchy.nodes.push_back(&bottomWrist);   // index = 6
-	hierarchy.nodeCount++;
-
-	hierarchy.nodes.push_back(&rightShoulder); // index = 7
-	hierarchy.nodeCount++;
-	hierarchy.nodes.push_back(&leftShoulder);  // index = 8
-	hierarchy.nodeCount++;
-
-	body.parentIndex = -1;
-
-	topJoint.parentIndex = 0;
-	topElbow.parentIndex = 1;
-	topWrist.parentIndex = 2;
-
-	bottomJoint.parentIndex = 0;
-	bottomElbow.parentIndex = 4;
-	bottomWrist.parentIndex = 5;
-
-	rightShoulder.parentIndex = 0;
-	leftShoulder.parentIndex = 0;
+	//Parents come before their children, so solveFK can resolve the whole hierarchy in one pass
+	enum {
+		BODY,
+		TOP_JOINT,
+		TOP_ELBOW,
+		TOP_WRIST,
+		BOTTOM_JOINT,
+		BOTTOM_ELBOW,
+		BOTTOM_WRIST,
+		RIGHT_SHOULDER,
+		LEFT_SHOULDER,
+		NUM_NODES
+	};
+	std::vector<ew::SceneNode> hierarchy(NUM_NODES);
+	std::vector<glm::mat4> worldTransforms;
+
+	hierarchy[BODY].parentIndex = -1;
+
+	hierarchy[TOP_JOINT].parentIndex = BODY;
+	hierarchy[TOP_ELBOW].parentIndex = TOP_JOINT;
+	hierarchy[TOP_WRIST].parentIndex = TOP_ELBOW;
+
+	hierarchy[BOTTOM_JOINT].parentIndex = BODY;
+	hierarchy[BOTTOM_ELBOW].parentIndex = BOTTOM_JOINT;
+	hierarchy[BOTTOM_WRIST].parentIndex = BOTTOM_ELBOW;
+
+	hierarchy[RIGHT_SHOULDER].parentIndex = BODY;
+	hierarchy[LEFT_SHOULDER].parentIndex = BODY;
 	
-	body.transform.scale = glm::vec3(0.5f);
-	topJoint.transform.scale = glm::vec3(0.5f);
-	topElbow.transform.scale = glm::vec3(0.5f);
-	topWrist.transform.scale = glm::vec3(0.5f);
+	hierarchy[BODY].localTransform.scale = glm::vec3(0.5f);
+	hierarchy[TOP_JOINT].localTransform.scale = glm::vec3(0.5f);
+	hierarchy[TOP_ELBOW].localTransform.scale = glm::vec3(0.5f);
+	hierarchy[TOP_WRIST].localTransform.scale = glm::vec3(0.5f);
 
-	bottomJoint.transform.scale = glm::vec3(0.5f);
-	bottomElbow.transform.scale = glm::vec3(0.5f);
-	bottomWrist.transform.scale = glm::vec3(0.5f);
+	hierarchy[BOTTOM_JOINT].localTransform.scale = glm::vec3(0.5f);
+	hierarchy[BOTTOM_ELBOW].localTransform.scale = glm::vec3(0.5f);
+	hierarchy[BOTTOM_WRIST].localTransform.scale = glm::vec3(0.5f);
 
-	rightShoulder.transform.scale = glm::vec3(0.3f);
-	leftShoulder.transform.scale = glm::vec3(0.3f);
+	hierarchy[RIGHT_SHOULDER].localTransform.scale = glm::vec3(0.3f);
+	hierarchy[LEFT_SHOULDER].localTransform.scale = glm::vec3(0.3f);
 
-	body.transform.position = glm::vec3(0, 1.0f, 0.0f);
-	topJoint.transform.position = glm::vec3(0, 2.0f, 0.0f);
-	topElbow.transform.position = glm::vec3(2.0, 0.0f, 0.0f);
-	topWrist.transform.position = glm::vec3(2.0, 0.0f, 0.0f);
-	bottomJoint.transform.position = glm::vec3(0, -2.0f, 0.0f);
-	bottomElbow.transform.position = glm::vec3(-2.0, 0.0f, 0.0f);
-	bottomWrist.transform.position = glm::vec3(-2.0, 0.0f, 0.0f);
+	hierarchy[BODY].localTransform.position = glm::vec3(0, 1.0f, 0.0f);
+	hierarchy[TOP_JOINT].localTransform.position = glm::vec3(0, 2.0f, 0.0f);
+	hierarchy[TOP_ELBOW].localTransform.position = glm::vec3(2.0, 0.0f, 0.0f);
+	hierarchy[TOP_WRIST].localTransform.position = glm::vec3(2.0, 0.0f, 0.0f);
+	hierarchy[BOTTOM_JOINT].localTransform.position = glm::vec3(0, -2.0f, 0.0f);
+	hierarchy[BOTTOM_ELBOW].localTransform.position = glm::vec3(-2.0, 0.0f, 0.0f);
+	hierarchy[BOTTOM_WRIST].localTransform.position = glm::vec3(-2.0, 0.0f, 0.0f);
 
-	//rightSholder.transform.position = glm::vec3(2.0, 0.0f, 0.0f);
-	//leftSholder.transform.position = glm::vec3(-2.0, 0.0f, 0.0f);
+	//hierarchy[RIGHT_SHOULDER].localTransform.position = glm::vec3(2.0, 0.0f, 0.0f);
+	//hierarchy[LEFT_SHOULDER].localTransform.position = glm::vec3(-2.0, 0.0f, 0.0f);
 
 	while (!glfwWindowShouldClose(window)) {
 		glfwPollEvents();
@@ -247,178 +275,423 @@ int main() {
 		deltaTime = time - prevFrameTime;
 		prevFrameTime = time;
 
-		topJoint.transform.rotation = glm::rotate(topJoint.transform.rotation, deltaTime * 5, glm::vec3(0.0, 1.0, 0.0));
-		bottomJoint.transform.rotation = glm::rotate(bottomJoint.transform.rotation, deltaTime, glm::vec3(0.0, -1.0, 0.0));
-		rightShoulder.transform.position = glm::vec3(2.0, glm::sin(time * 2) * 0.5, 0.0f);
-		leftShoulder.transform.position = glm::vec3(-2.0, glm::sin(time * 2) * 0.5, 0.0f);
-		body.transform.rotation = glm::rotate(body.transform.rotation, deltaTime, glm::vec3(1.0, 0.0, 1.0));
+		renderTargets.beginFrame(screenWidth, screenHeight);
+		profiler.beginFrame();
 
-		for each (Node *node in hierarchy.nodes)
-		{
-			node->localTransform = node->transform.modelMatrix();
-		}
+		ew::Transform& topJoint = hierarchy[TOP_JOINT].localTransform;
+		ew::Transform& bottomJoint = hierarchy[BOTTOM_JOINT].localTransform;
+		ew::Transform& body = hierarchy[BODY].localTransform;
+		topJoint.rotation = glm::rotate(topJoint.rotation, deltaTime * 5, glm::vec3(0.0, 1.0, 0.0));
+		bottomJoint.rotation = glm::rotate(bottomJoint.rotation, deltaTime, glm::vec3(0.0, -1.0, 0.0));
+		hierarchy[RIGHT_SHOULDER].localTransform.position = glm::vec3(2.0, glm::sin(time * 2) * 0.5, 0.0f);
+		hierarchy[LEFT_SHOULDER].localTransform.position = glm::vec3(-2.0, glm::sin(time * 2) * 0.5, 0.0f);
+		body.rotation = glm::rotate(body.rotation, deltaTime, glm::vec3(1.0, 0.0, 1.0));
 
-		SolveFK(hierarchy);
+		ew::solveFK(hierarchy, &worldTransforms);
 
-		//RENDER SCENE TO G-BUFFER
-		glBindFramebuffer(GL_FRAMEBUFFER, gBuffer.fbo);
-		glViewport(0, 0, gBuffer.width, gBuffer.height);
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		glBindTextureUnit(0, brickTexture);
-		glBindTextureUnit(1, normalTexture);
-
-		gShader.use();
-		gShader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
-		gShader.setMat4("_LightViewProj", lightCam.projectionMatrix() * lightCam.viewMatrix());
-		gShader.setMat4("_Model", planeTransform.modelMatrix());
-		planeMesh.draw();
-		//gShader.setMat4("_Model", monkeyTransform.modelMatrix());
-		//monkeyModel.draw();
-		for each (Node * node in hierarchy.nodes)
+		//Rebuild draw lists with this frame's transforms
+		sceneDrawList.clear();
+		sceneDrawList.add(planeMesh, planeTransform.modelMatrix());
+		for (int i = 0; i < NUM_PILLARS; i++)
 		{
-			gShader.setMat4("_Model", node->globalTransform);
-			monkeyModel.draw();
+			sceneDrawList.add(pillarMesh, pillarTransforms[i].modelMatrix());
+		}
+		for (size_t n = 0; n < worldTransforms.size(); n++)
+		{
+			for (size_t i = 0; i < monkeyMeshes.size(); i++)
+			{
+				sceneDrawList.add(monkeyMeshes[i], worldTransforms[n]);
+			}
+		}
+		shadowDrawList.clear();
+		for (size_t i = 0; i < monkeyMeshes.size(); i++)
+		{
+			shadowDrawList.add(monkeyMeshes[i], monkeyTransform.modelMatrix());
 		}
-
-		//After geometry pass
-		//LIGHTING PASS
-		//if using post processing, we draw to our offscreen framebuffer
 		lightCam.position = (lightCam.target - glm::normalize(lightDir)) * 5.0f;
+		staticCasters.clear();
+		staticShadowDrawList.clear();
+		for (int i = 0; i < NUM_PILLARS; i++)
+		{
+			staticCasters.push_back(pillarTransforms[i].modelMatrix());
+			staticShadowDrawList.add(pillarMesh, staticCasters[i]);
+		}
+		//Read once so a change from the UI pass takes effect next frame
+		hannah::ShadowFilter filter = shadowFilter;
+		bool momentShadows = filter != hannah::ShadowFilter::PCF;
+		bool redrawStaticShadows = false;
+		if (momentShadows) {
+			//Nothing reads the depth map meanwhile, so the graph culls its passes and the static layer goes stale
+			shadowCache.invalidate();
+		}
+		else {
+			redrawStaticShadows = shadowCache.update(lightCam.projectionMatrix() * lightCam.viewMatrix(), staticCasters, renderTargets.get(staticShadowTarget).depthBuffer);
+		}
+		//Read once so a toggle from the UI pass takes effect next frame
+		bool atlasShadows = pointLightShadows;
+		if (atlasShadows) {
+			for (int i = 0; i < MAX_POINT_LIGHTS; i++)
+			{
+				shadowLights[i].position = pointLights[i].position;
+				shadowLights[i].radius = pointLights[i].radius;
+			}
+			atlasCasters.clear();
+			for (size_t n = 0; n < worldTransforms.size(); n++)
+			{
+				monkeyCaster.model = worldTransforms[n];
+				atlasCasters.push_back(monkeyCaster);
+			}
+			shadowAtlas.update(shadowLights, atlasCasters, camera, (float)screenHeight);
+		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.fbo);
-		glViewport(0, 0, framebuffer.width, framebuffer.height);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		//Passes are listed in the order they were written, the graph sorts them by what they read and write
+		renderGraph.reset();
+		int shadowMap = renderGraph.import("Shadow map", renderTargets.get(shadowTarget));
+		int staticShadowMap = renderGraph.import("Static shadows", renderTargets.get(staticShadowTarget));
+		hannah::RenderTarget screen;
+		screen.width = screenWidth;
+		screen.height = screenHeight;
+		int backbuffer = renderGraph.import("Backbuffer", screen);
+		hannah::RenderTarget atlasTarget;
+		atlasTarget.depthBuffer = shadowAtlas.getTexture();
+		int atlas = renderGraph.import("Shadow atlas", atlasTarget);
+		renderGraph.markOutput(backbuffer);
 
-		deferredShader.use();
+		//RENDER SCENE TO G-BUFFER
+		//Read once so a toggle from the UI pass takes effect next frame
+		bool compact = compactGBuffer;
+		const hannah::RenderTargetDesc& activeGBufferDesc = compact ? compactGBufferDesc : gBufferDesc;
+		litDesc.depthFormat = activeGBufferDesc.depthFormat; //Same as the G-buffer, so its depth can be blitted in
+		hannah::RenderPassBuilder gBufferPass = renderGraph.addPass("G-buffer");
+		int gBuffer = gBufferPass.create("G-buffer", activeGBufferDesc);
+		gBufferPass.setExecute([&](const hannah::RenderGraph& graph) {
+			const hannah::RenderTarget& target = graph.getTarget(gBuffer);
+			glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+			glViewport(0, 0, target.width, target.height);
+			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			glBindTextureUnit(0, brickTexture);
+			glBindTextureUnit(1, normalTexture);
+
+			const ew::Shader& geometryShader = compact ? gCompactShader : gShader;
+			geometryShader.use();
+			geometryShader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
+			geometryShader.setMat4("_LightViewProj", lightCam.projectionMatrix() * lightCam.viewMatrix());
+			geometryShader.setFloat("_Shininess", material.Shininess);
+			meshArena.draw(sceneDrawList);
+		});
 
-		for (int i = 0; i < MAX_POINT_LIGHTS; i++) {
-			//Creates prefix "_PointLights[0]." etc
-			std::string prefix = "_PointLights[" + std::to_string(i) + "].";
-			deferredShader.setVec3(prefix + "position", pointLights[i].position);
-			deferredShader.setVec3(prefix + "color", pointLights[i].color);
-			deferredShader.setFloat(prefix + "radius", pointLights[i].radius);
-		}
+		//LIGHTING PASS
+		//Lit color only lives from here to post processing
+		hannah::RenderPassBuilder lightingPass = renderGraph.addPass("Deferred lighting");
+		lightingPass.read(gBuffer);
+		lightingPass.read(gBuffer, hannah::RenderAccess::ATTACHMENT); //Depth blit
+		lightingPass.read(atlas);
+		int lit = lightingPass.create("Lit", litDesc);
+		lightingPass.setExecute([&](const hannah::RenderGraph& graph) {
+			const hannah::RenderTarget& gTarget = graph.getTarget(gBuffer);
+			const hannah::RenderTarget& target = graph.getTarget(lit);
+			glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+			glViewport(0, 0, target.width, target.height);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			deferredShader.use();
+
+			for (int i = 0; i < MAX_POINT_LIGHTS; i++) {
+				//Creates prefix "_PointLights[0]." etc
+				std::string prefix = "_PointLights[" + std::to_string(i) + "].";
+				deferredShader.setVec3(prefix + "position", pointLights[i].position);
+				deferredShader.setVec3(prefix + "color", pointLights[i].color);
+				deferredShader.setFloat(prefix + "radius", pointLights[i].radius);
+				deferredShader.setInt(prefix + "shadowFace", atlasShadows ? shadowAtlas.getFirstFace(i) : -1);
+			}
+
+			deferredShader.setVec3("lightPos", lightCam.position);
+			deferredShader.setVec3("_EyePos", camera.position);
+			deferredShader.setVec3("_LightDirection", glm::normalize(lightDir));
+			deferredShader.setFloat("_Material.Ka", material.Ka);
+			deferredShader.setFloat("_Material.Kd", material.Kd);
+			deferredShader.setFloat("_Material.Ks", material.Ks);
+			deferredShader.setFloat("_Material.Shininess", material.Shininess);
+
+			deferredShader.setFloat("minBias", minBias);
+			deferredShader.setFloat("maxBias", maxBias);
+
+			//Bind g-buffer textures
+			deferredShader.setInt("_CompactGBuffer", compact);
+			if (compact) {
+				deferredShader.setMat4("_InverseViewProjection", glm::inverse(camera.projectionMatrix() * camera.viewMatrix()));
+				glBindTextureUnit(1, gTarget.colorBuffer[0]);
+				glBindTextureUnit(2, gTarget.colorBuffer[1]);
+				glBindTextureUnit(4, gTarget.depthBuffer);
+			}
+			else {
+				glBindTextureUnit(0, gTarget.colorBuffer[0]);
+				glBindTextureUnit(1, gTarget.colorBuffer[1]);
+				glBindTextureUnit(2, gTarget.colorBuffer[2]);
+			}
+			shadowAtlas.bind(5);
+
+			glBindVertexArray(dummyVAO);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+
+			//Blit gBuffer depth to same framebuffer as fullscreen quad
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, gTarget.fbo); //Read from gBuffer 
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fbo); //Write to current fbo
+			glBlitFramebuffer(
+				0, 0, gTarget.width, gTarget.height, 0, 0, target.width, target.height, GL_DEPTH_BUFFER_BIT, GL_NEAREST
+			);
+		});
 
-		deferredShader.setVec3("lightPos", lightCam.position);
-		deferredShader.setVec3("_EyePos", camera.position);
-		deferredShader.setVec3("_LightDirection", glm::normalize(lightDir));
-		deferredShader.setFloat("_Material.Ka", material.Ka);
-		deferredShader.setFloat("_Material.Kd", material.Kd);
-		deferredShader.setFloat("_Material.Ks", material.Ks);
-		deferredShader.setFloat("_Material.Shininess", material.Shininess);
-
-		deferredShader.setFloat("minBias", minBias);
-		deferredShader.setFloat("maxBias", maxBias);
-
-		//Bind g-buffer textures
-		glBindTextureUnit(0, gBuffer.colorBuffer[0]);
-		glBindTextureUnit(1, gBuffer.colorBuffer[1]);
-		glBindTextureUnit(2, gBuffer.colorBuffer[2]);
-		glBindTextureUnit(3, shadowFramebuffer.depthBuffer); //For shadow mapping
-
-		glBindVertexArray(dummyVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 3);
-
-		//Blit gBuffer depth to same framebuffer as fullscreen quad
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer.fbo); //Read from gBuffer 
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer.fbo); //Write to current fbo
-		glBlitFramebuffer(
-			0, 0, screenWidth, screenHeight, 0, 0, screenWidth, screenHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST
-		);
 		//Draw all light orbs
-		lightOrbShader.use();
-		lightOrbShader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
-		for (int i = 0; i < MAX_POINT_LIGHTS; i++)
-		{
-			glm::mat4 m = glm::mat4(1.0f);
-			m = glm::translate(m, pointLights[i].position);
-			m = glm::scale(m, glm::vec3(0.2f)); //Whatever radius you want
-
-			lightOrbShader.setMat4("_Model", m);
-			lightOrbShader.setVec3("_Color", pointLights[i].color);
-			sphereMesh.draw();
+		hannah::RenderPassBuilder orbPass = renderGraph.addPass("Light orbs");
+		orbPass.write(lit);
+		orbPass.setExecute([&](const hannah::RenderGraph& graph) {
+			const hannah::RenderTarget& target = graph.getTarget(lit);
+			glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+			glViewport(0, 0, target.width, target.height);
+			lightOrbShader.use();
+			lightOrbShader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
+			for (int i = 0; i < MAX_POINT_LIGHTS; i++)
+			{
+				glm::mat4 m = glm::mat4(1.0f);
+				m = glm::translate(m, pointLights[i].position);
+				m = glm::scale(m, glm::vec3(0.2f)); //Whatever radius you want
+
+				lightOrbShader.setMat4("_Model", m);
+				lightOrbShader.setVec3("_Color", pointLights[i].color);
+				orbLODs[i] = sphereMesh.selectLOD(camera, m, target.height, orbLODs[i]);
+				sphereMesh.draw(orbLODs[i]);
+			}
+		});
+
+		//Only added on frames the cache is stale
+		if (redrawStaticShadows) {
+			hannah::RenderPassBuilder staticShadowPass = renderGraph.addPass("Static shadows");
+			staticShadowPass.write(staticShadowMap);
+			staticShadowPass.setExecute([&](const hannah::RenderGraph& graph) {
+				const hannah::RenderTarget& target = graph.getTarget(staticShadowMap);
+				glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+				glViewport(0, 0, target.width, target.height);
+				glClear(GL_DEPTH_BUFFER_BIT);
+
+				glCullFace(GL_FRONT);
+
+				depthShader.use();
+				depthShader.setMat4("_ViewProjection", lightCam.projectionMatrix() * lightCam.viewMatrix());
+				meshArena.draw(staticShadowDrawList);
+
+				glCullFace(GL_BACK);
+			});
 		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffer.fbo);
-		glBindTexture(GL_TEXTURE_2D, shadowFramebuffer.depthBuffer);
-		glViewport(0, 0, shadowWidth, shadowHeight);
-		glClear(GL_DEPTH_BUFFER_BIT);
-
-		glCullFace(GL_FRONT);
+		//Only faces whose light or casters changed are drawn, the rest of the atlas is kept from earlier frames
+		if (atlasShadows) {
+			hannah::RenderPassBuilder atlasPass = renderGraph.addPass("Shadow atlas");
+			atlasPass.write(atlas);
+			atlasPass.setExecute([&](const hannah::RenderGraph& graph) {
+				glCullFace(GL_FRONT);
+				depthShader.use();
+				shadowAtlas.render([&](const glm::mat4& viewProj, const std::vector<int>& casters) {
+					atlasDrawList.clear();
+					for (int c : casters)
+					{
+						for (size_t i = 0; i < monkeyMeshes.size(); i++)
+						{
+							atlasDrawList.add(monkeyMeshes[i], atlasCasters[c].model);
+						}
+					}
+					depthShader.setMat4("_ViewProjection", viewProj);
+					meshArena.draw(atlasDrawList);
+				});
+				glCullFace(GL_BACK);
+			});
+		}
 
-		depthShader.use();
-		depthShader.setMat4("_ViewProjection", lightCam.projectionMatrix() * lightCam.viewMatrix());
-		depthShader.setMat4("_Model", monkeyTransform.modelMatrix());
-		monkeyModel.draw();
+		//Only read by the forward pass and the shadow map window, so it is culled while a moment filter is active
+		hannah::RenderPassBuilder shadowPass = renderGraph.addPass("Shadow map");
+		shadowPass.read(staticShadowMap, hannah::RenderAccess::ATTACHMENT);
+		shadowPass.write(shadowMap);
+		shadowPass.setExecute([&](const hannah::RenderGraph& graph) {
+			const hannah::RenderTarget& staticTarget = graph.getTarget(staticShadowMap);
+			const hannah::RenderTarget& target = graph.getTarget(shadowMap);
+			//Start from the cached static casters instead of clearing. Timed on its own, it is what the cache costs every frame.
+			{
+				hannah::ProfileScope copyScope(&profiler, "Static shadow copy");
+				glCopyImageSubData(staticTarget.depthBuffer, GL_TEXTURE_2D, 0, 0, 0, 0, target.depthBuffer, GL_TEXTURE_2D, 0, 0, 0, 0, target.width, target.height, 1);
+			}
+			glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+			glViewport(0, 0, target.width, target.height);
+
+			glCullFace(GL_FRONT);
+
+			depthShader.use();
+			depthShader.setMat4("_ViewProjection", lightCam.projectionMatrix() * lightCam.viewMatrix());
+			meshArena.draw(shadowDrawList);
+
+			glCullFace(GL_BACK);
+		});
+
+		//Moments instead of depth. A blurred layer of cached static moments couldn't be merged with new casters, so all are drawn.
+		int moments = -1;
+		int momentBlur = -1;
+		if (momentShadows) {
+			hannah::RenderPassBuilder momentPass = renderGraph.addPass("Shadow moments");
+			moments = momentPass.create("Shadow moments", momentDesc);
+			momentPass.setExecute([&](const hannah::RenderGraph& graph) {
+				const hannah::RenderTarget& target = graph.getTarget(moments);
+				glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+				glViewport(0, 0, target.width, target.height);
+				glm::vec2 clearMoments = hannah::getClearMoments(filter);
+				float clearColor[4] = { clearMoments.x, clearMoments.y, 0.0f, 0.0f };
+				glClearNamedFramebufferfv(target.fbo, GL_COLOR, 0, clearColor);
+				glClear(GL_DEPTH_BUFFER_BIT);
+
+				momentShader.use();
+				momentShader.setFloat("_MomentExponent", hannah::getMomentExponent(filter));
+				momentShader.setMat4("_ViewProjection", lightCam.projectionMatrix() * lightCam.viewMatrix());
+				meshArena.draw(shadowPlaneDrawList);
+				meshArena.draw(staticShadowDrawList);
+				meshArena.draw(shadowDrawList);
+			});
+
+			//Separable, the horizontal half goes to a scratch target and the vertical half back into the moments
+			hannah::RenderPassBuilder blurPass = renderGraph.addPass("Shadow blur");
+			blurPass.read(moments);
+			blurPass.write(moments);
+			momentBlur = blurPass.create("Shadow blur", momentBlurDesc);
+			blurPass.setExecute([&](const hannah::RenderGraph& graph) {
+				const hannah::RenderTarget& target = graph.getTarget(moments);
+				const hannah::RenderTarget& scratch = graph.getTarget(momentBlur);
+				hannah::GaussianKernel kernel = hannah::createGaussianKernel(shadowBlurRadius);
+				blurShader.use();
+				blurShader.setInt("_NumTaps", kernel.numTaps);
+				for (int i = 0; i < kernel.numTaps; i++)
+				{
+					blurShader.setFloat("_Offsets[" + std::to_string(i) + "]", kernel.offsets[i]);
+					blurShader.setFloat("_Weights[" + std::to_string(i) + "]", kernel.weights[i]);
+				}
+				glViewport(0, 0, target.width, target.height);
+				glDisable(GL_DEPTH_TEST);
+				glBindVertexArray(dummyVAO);
+
+				glBindFramebuffer(GL_FRAMEBUFFER, scratch.fbo);
+				glBindTextureUnit(0, target.colorBuffer[0]);
+				blurShader.setVec2("_Direction", 1.0f / target.width, 0.0f);
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+
+				glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+				glBindTextureUnit(0, scratch.colorBuffer[0]);
+				blurShader.setVec2("_Direction", 0.0f, 1.0f / target.height);
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+
+				glEnable(GL_DEPTH_TEST);
+				//Distant and grazing pixels filter from the lower levels
+				glGenerateTextureMipmap(target.colorBuffer[0]);
+			});
+		}
+		int shadow = momentShadows ? moments : shadowMap;
 
 		//RENDER
-		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.fbo);
-		glBindTextureUnit(0, brickTexture);
-		glBindTextureUnit(1, normalTexture);
-		glBindTextureUnit(2, shadowFramebuffer.depthBuffer);
-		//glViewport(0, 0, screenWidth, screenHeight);
-		//glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		//glClearColor(0.6f, 0.8f, 0.92f, 1.0f);
-
-		// reset viewport
-		glViewport(0, 0, screenWidth, screenHeight);
-		//glClear(GL_DEPTH_BUFFER_BIT);
-
-		glCullFace(GL_BACK);
-
-		shader.use();
-		shader.setInt("_MainTex", 0);
-		shader.setInt("normalMap", 1);
-		shader.setInt("_ShadowMap", 2);
-		shader.setMat4("_Model", glm::mat4(1.0f));
-		shader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
-		shader.setMat4("_LightViewProj", lightCam.projectionMatrix() * lightCam.viewMatrix());
-		shader.setVec3("_EyePos", camera.position);
-		shader.setVec3("_LightDirection", glm::normalize(lightDir));
-		shader.setFloat("_Material.Ka", material.Ka);
-		shader.setFloat("_Material.Kd", material.Kd);
-		shader.setFloat("_Material.Ks", material.Ks);
-		shader.setFloat("_Material.Shininess", material.Shininess);
-
-		shader.setFloat("minBias", minBias);
-		shader.setFloat("maxBias", maxBias);
-
-		shader.setMat4("_Model", planeTransform.modelMatrix());
-		planeMesh.draw();
-
-		//shader.setMat4("_Model", monkeyTransform.modelMatrix());
-		//monkeyModel.draw(); //Draws monkey model using current shader
-
-		for each (Node * node in hierarchy.nodes)
-		{
-			shader.setMat4("_Model", node->globalTransform);
-			monkeyModel.draw();
-		}
-		
+		hannah::RenderPassBuilder forwardPass = renderGraph.addPass("Forward");
+		forwardPass.read(shadow);
+		forwardPass.write(lit);
+		forwardPass.setExecute([&](const hannah::RenderGraph& graph) {
+			const hannah::RenderTarget& target = graph.getTarget(lit);
+			glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+			glBindTextureUnit(0, brickTexture);
+			glBindTextureUnit(1, normalTexture);
+			if (momentShadows) {
+				glBindTextureUnit(3, graph.getTarget(moments).colorBuffer[0]);
+			}
+			else {
+				glBindTextureUnit(2, graph.getTarget(shadowMap).depthBuffer);
+			}
+			glViewport(0, 0, target.width, target.height);
+
+			shader.use();
+			shader.setInt("_MainTex", 0);
+			shader.setInt("normalMap", 1);
+			shader.setInt("_ShadowMap", 2);
+			shader.setInt("_ShadowMoments", 3);
+			shader.setInt("_ShadowFilter", (int)filter);
+			shader.setFloat("_MomentExponent", hannah::getMomentExponent(filter));
+			shader.setFloat("_LightBleedReduction", lightBleedReduction);
+			shader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
+			shader.setMat4("_LightViewProj", lightCam.projectionMatrix() * lightCam.viewMatrix());
+			shader.setVec3("_EyePos", camera.position);
+			shader.setVec3("_LightDirection", glm::normalize(lightDir));
+			shader.setFloat("_Material.Ka", material.Ka);
+			shader.setFloat("_Material.Kd", material.Kd);
+			shader.setFloat("_Material.Ks", material.Ks);
+			shader.setFloat("_Material.Shininess", material.Shininess);
+
+			shader.setFloat("minBias", minBias);
+			shader.setFloat("maxBias", maxBias);
+
+			meshArena.draw(sceneDrawList);
+		});
+
+		hannah::RenderPassBuilder postPass = renderGraph.addPass("Post process");
+		postPass.read(lit);
+		postPass.write(backbuffer);
+		postPass.setExecute([&](const hannah::RenderGraph& graph) {
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, screenWidth, screenHeight);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			postProcess.use();
+			postProcess.setFloat("gamma", gamma);
+
+			glBindTextureUnit(0, graph.getTarget(lit).colorBuffer[0]);
+			glBindVertexArray(dummyVAO);
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+		});
+
+		//The debug windows show the shadow map and G-buffer
+		hannah::RenderPassBuilder uiPass = renderGraph.addPass("UI");
+		uiPass.read(shadow);
+		uiPass.read(gBuffer);
+		uiPass.write(backbuffer);
+		uiPass.setExecute([&](const hannah::RenderGraph& graph) {
+			const hannah::RenderTarget& activeShadow = graph.getTarget(shadow);
+			drawUI(graph.getTarget(gBuffer), momentShadows ? activeShadow.colorBuffer[0] : activeShadow.depthBuffer);
+		});
+
+		renderGraph.execute();
+
 		//Rotate model around Y axis
 		monkeyTransform.rotation = glm::rotate(monkeyTransform.rotation, deltaTime, glm::vec3(0.0, 1.0, 0.0));
 	
 		//transform.modelMatrix() combines translation, rotation, and scale into a 4x4 model matrix
 		cameraController.move(window, &camera, deltaTime);
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	
-		postProcess.use();
-		postProcess.setFloat("gamma", gamma);
-
-		glBindTextureUnit(0, framebuffer.colorBuffer[0]);
-		glBindVertexArray(dummyVAO);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, framebuffer.colorBuffer[0]);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-
-		drawUI();
-
 		glfwSwapBuffers(window);
+		profiler.endFrame();
+		for (const hannah::ProfileResult& result : profiler.getResults())
+		{
+			if (result.name == "Static shadows") {
+				shadowCache.recordStaticCost(result.gpuMs);
+			}
+			else if (result.name == "Static shadow copy") {
+				shadowCache.recordCopyCost(result.gpuMs);
+			}
+		}
+		renderTargets.endFrame();
+		ew::collectGpuGarbage();
 	}
+	//Globals outlive main, release them now so they don't show up as leaks
+	renderGraph.printReport();
+	profiler.printReport();
+	renderTargets.printReport();
+	shadowCache.printReport();
+	shadowAtlas.printReport();
+	ew::TextureCache::get().printReport();
+	renderGraph.reset();
+	renderTargets.clear();
+	profiler.clear();
+	shadowAtlas.clear();
 	printf("Shutting down...");
 }
 
@@ -430,7 +703,7 @@ void resetCamera(ew::Camera* camera, ew::CameraController* controller) {
 	controller->yaw = controller->pitch = 0;
 }
 
-void drawUI() {
+void drawUI(const hannah::RenderTarget& gBuffer, unsigned int shadowTexture) {
 	ImGui_ImplGlfw_NewFrame();
 	ImGui_ImplOpenGL3_NewFrame();
 	ImGui::NewFrame();
@@ -446,6 +719,24 @@ void drawUI() {
 		ImGui::SliderFloat("Height", &lightCam.orthoHeight, 4.0f, 10.0f);
 		ImGui::SliderFloat("MinBias", &minBias, 0.0f, 1.0f);
 		ImGui::SliderFloat("MaxBias", &maxBias, 0.0f, 1.0f);
+		int filter = (int)shadowFilter;
+		if (ImGui::Combo("Shadow filter", &filter, hannah::SHADOW_FILTER_NAMES, IM_ARRAYSIZE(hannah::SHADOW_FILTER_NAMES))) {
+			shadowFilter = (hannah::ShadowFilter)filter;
+		}
+		ImGui::SliderInt("Shadow blur radius", &shadowBlurRadius, 0, hannah::MAX_GAUSSIAN_RADIUS);
+		ImGui::SliderFloat("Light bleed reduction", &lightBleedReduction, 0.0f, 0.9f);
+	}
+	if (ImGui::CollapsingHeader("Profiler")) {
+		ImGui::Checkbox("Compact G-buffer", &compactGBuffer);
+		const hannah::ShadowCacheStats& shadowStats = shadowCache.getStats();
+		ImGui::Text("Static shadows drawn %zu / %zu frames, copied in %.3f ms, saved %.1f ms", shadowStats.staticRenders, shadowStats.frames, shadowStats.copyGpuMs, shadowStats.getSavedMs());
+		ImGui::Checkbox("Point light shadows", &pointLightShadows);
+		const hannah::ShadowAtlasStats& atlasStats = shadowAtlas.getStats();
+		ImGui::Text("Shadow atlas: %zu / %zu lights, faces drawn %zu, reused %zu, waiting %zu", atlasStats.numShadowed, atlasStats.numLights, atlasStats.facesDrawn, atlasStats.facesReused, atlasStats.facesPending);
+		for (const hannah::ProfileResult& result : profiler.getResults())
+		{
+			ImGui::Text("%*s%s: cpu %.2f ms, gpu %.2f ms", result.depth * 2, "", result.name.c_str(), result.cpuMs, result.gpuMs);
+		}
 	}
 	ImGui::End();
 
@@ -456,13 +747,13 @@ void drawUI() {
 	ImVec2 windowSize = ImGui::GetWindowSize();
 	//Invert 0-1 V to flip vertically for ImGui display
 	//shadowMap is the texture2D handle
-	ImGui::Image((ImTextureID)shadowFramebuffer.depthBuffer, windowSize, ImVec2(0, 1), ImVec2(1, 0));
+	ImGui::Image((ImTextureID)shadowTexture, windowSize, ImVec2(0, 1), ImVec2(1, 0));
 	ImGui::EndChild();
 	ImGui::End();
 
 	ImGui::Begin("GBuffers");
 	ImVec2 texSize = ImVec2(gBuffer.width / 4, gBuffer.height / 4);
-	for (size_t i = 0; i < 3; i++)
+	for (int i = 0; i < hannah::MAX_COLOR_ATTACHMENTS && gBuffer.colorBuffer[i] != 0; i++)
 	{
 		ImGui::Image((ImTextureID)gBuffer.colorBuffer[i], texSize, ImVec2(0, 1), ImVec2(1, 0));
 	}
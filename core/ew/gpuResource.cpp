@@ -0,0 +1,179 @@
+#include "gpuResource.h"
+#include "external/glad.h"
+
+#include <stdio.h>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <unordered_set>
+
+namespace {
+	struct PendingDelete {
+		ew::GpuResourceType type;
+		unsigned int handle;
+	};
+
+	//Deletes queued in one frame, released once the fence after that frame signals
+	struct GarbageBatch {
+		GLsync fence;
+		std::vector<PendingDelete> deletes;
+	};
+
+	struct GpuGarbage {
+		std::mutex mutex;
+		std::vector<PendingDelete> pending;
+		std::deque<GarbageBatch> inFlight;
+		std::unordered_set<unsigned long long> live;
+	};
+
+	//Intentionally never destroyed so objects with static lifetime can still release handles during shutdown
+	GpuGarbage& getGarbage() {
+		static GpuGarbage* garbage = new GpuGarbage();
+		return *garbage;
+	}
+
+	const char* typeName(ew::GpuResourceType type) {
+		switch (type) {
+		case ew::GpuResourceType::BUFFER:
+			return "Buffer";
+		case ew::GpuResourceType::VERTEX_ARRAY:
+			return "Vertex array";
+		case ew::GpuResourceType::TEXTURE:
+			return "Texture";
+		case ew::GpuResourceType::FRAMEBUFFER:
+			return "Framebuffer";
+		case ew::GpuResourceType::RENDERBUFFER:
+			return "Renderbuffer";
+		case ew::GpuResourceType::PROGRAM:
+			return "Shader program";
+		case ew::GpuResourceType::QUERY:
+			return "Query";
+		default:
+			return "Unknown";
+		}
+	}
+
+	unsigned long long makeKey(ew::GpuResourceType type, unsigned int handle) {
+		return ((unsigned long long)type << 32) | handle;
+	}
+
+	void deleteNow(const PendingDelete& pending) {
+		switch (pending.type) {
+		case ew::GpuResourceType::BUFFER:
+			glDeleteBuffers(1, &pending.handle);
+			break;
+		case ew::GpuResourceType::VERTEX_ARRAY:
+			glDeleteVertexArrays(1, &pending.handle);
+			break;
+		case ew::GpuResourceType::TEXTURE:
+			glDeleteTextures(1, &pending.handle);
+			break;
+		case ew::GpuResourceType::FRAMEBUFFER:
+			glDeleteFramebuffers(1, &pending.handle);
+			break;
+		case ew::GpuResourceType::RENDERBUFFER:
+			glDeleteRenderbuffers(1, &pending.handle);
+			break;
+		case ew::GpuResourceType::PROGRAM:
+			glDeleteProgram(pending.handle);
+			break;
+		case ew::GpuResourceType::QUERY:
+			glDeleteQueries(1, &pending.handle);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void deleteBatch(GarbageBatch* batch) {
+		for (size_t i = 0; i < batch->deletes.size(); i++)
+		{
+			deleteNow(batch->deletes[i]);
+		}
+		if (batch->fence != NULL) {
+			glDeleteSync(batch->fence);
+		}
+	}
+}
+
+namespace ew {
+	void trackGpuResource(GpuResourceType type, unsigned int handle)
+	{
+		if (handle == 0) {
+			return;
+		}
+		GpuGarbage& garbage = getGarbage();
+		std::lock_guard<std::mutex> lock(garbage.mutex);
+		garbage.live.insert(makeKey(type, handle));
+	}
+
+	void deferDelete(GpuResourceType type, unsigned int handle)
+	{
+		if (handle == 0) {
+			return;
+		}
+		GpuGarbage& garbage = getGarbage();
+		std::lock_guard<std::mutex> lock(garbage.mutex);
+		garbage.live.erase(makeKey(type, handle));
+		garbage.pending.push_back({ type, handle });
+	}
+
+	void collectGpuGarbage()
+	{
+		GpuGarbage& garbage = getGarbage();
+		std::lock_guard<std::mutex> lock(garbage.mutex);
+		if (!garbage.pending.empty()) {
+			GarbageBatch batch;
+			batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			batch.deletes.swap(garbage.pending);
+			garbage.inFlight.push_back(std::move(batch));
+		}
+		//Batches are in submission order, so stop at the first one still in flight
+		while (!garbage.inFlight.empty()) {
+			GLenum status = glClientWaitSync(garbage.inFlight.front().fence, 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+				break;
+			}
+			deleteBatch(&garbage.inFlight.front());
+			garbage.inFlight.pop_front();
+		}
+	}
+
+	void flushGpuGarbage()
+	{
+		GpuGarbage& garbage = getGarbage();
+		std::lock_guard<std::mutex> lock(garbage.mutex);
+		glFinish();
+		while (!garbage.inFlight.empty()) {
+			deleteBatch(&garbage.inFlight.front());
+			garbage.inFlight.pop_front();
+		}
+		GarbageBatch batch;
+		batch.fence = NULL;
+		batch.deletes.swap(garbage.pending);
+		deleteBatch(&batch);
+	}
+
+	unsigned int printGpuLeakReport()
+	{
+		GpuGarbage& garbage = getGarbage();
+		std::lock_guard<std::mutex> lock(garbage.mutex);
+		unsigned int counts[(int)GpuResourceType::COUNT] = { 0 };
+		for (unsigned long long key : garbage.live)
+		{
+			counts[key >> 32]++;
+		}
+		if (garbage.live.empty()) {
+			printf("GPU leak report: no leaks\n");
+			return 0;
+		}
+		printf("GPU leak report: %zu objects never released\n", garbage.live.size());
+		for (int i = 0; i < (int)GpuResourceType::COUNT; i++)
+		{
+			if (counts[i] > 0) {
+				printf("  %s: %u\n", typeName((GpuResourceType)i), counts[i]);
+			}
+		}
+		return garbage.live.size();
+	}
+}
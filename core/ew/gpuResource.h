@@ -0,0 +1,73 @@
+#pragma once
+
+namespace ew {
+	enum class GpuResourceType {
+		BUFFER = 0,
+		VERTEX_ARRAY = 1,
+		TEXTURE = 2,
+		FRAMEBUFFER = 3,
+		RENDERBUFFER = 4,
+		PROGRAM = 5,
+		QUERY = 6,
+		COUNT
+	};
+
+	//Records a newly created GL object so it shows up in the leak report until deleted
+	void trackGpuResource(GpuResourceType type, unsigned int handle);
+	//Queues a GL object for deletion once every frame submitted so far has finished on the GPU. Safe from any thread.
+	void deferDelete(GpuResourceType type, unsigned int handle);
+	//Call once per frame on the render thread, after submitting the frame's work
+	void collectGpuGarbage();
+	//Waits for the GPU and deletes everything still queued
+	void flushGpuGarbage();
+	//Prints every tracked object that was never deleted. Returns the number of leaks.
+	unsigned int printGpuLeakReport();
+
+	/// <summary>
+	/// Move-only owner of a single GL object. Deletion is deferred until the GPU is done with it.
+	/// </summary>
+	template<GpuResourceType Type>
+	class GpuHandle {
+	public:
+		GpuHandle() {};
+		explicit GpuHandle(unsigned int handle) : m_handle(handle) {
+			trackGpuResource(Type, handle);
+		}
+		~GpuHandle() { reset(); }
+		GpuHandle(GpuHandle&& other) noexcept : m_handle(other.m_handle) { other.m_handle = 0; }
+		GpuHandle& operator=(GpuHandle&& other) noexcept {
+			if (this != &other) {
+				reset();
+				m_handle = other.m_handle;
+				other.m_handle = 0;
+			}
+			return *this;
+		}
+		GpuHandle(const GpuHandle&) = delete;
+		GpuHandle& operator=(const GpuHandle&) = delete;
+		void reset() {
+			deferDelete(Type, m_handle);
+			m_handle = 0;
+		}
+		inline unsigned int get()const { return m_handle; }
+		//Only lvalues convert, so a temporary handle can't be silently turned into a dangling raw handle
+		inline operator unsigned int()const& { return m_handle; }
+		operator unsigned int()const&& = delete;
+	private:
+		unsigned int m_handle = 0;
+	};
+
+	//Flushes deferred deletes and prints the leak report when it goes out of scope.
+	//Declare it right after creating the GL context so it outlives everything created afterwards.
+	struct GpuLeakCheck {
+		~GpuLeakCheck() {
+			flushGpuGarbage();
+			printGpuLeakReport();
+		}
+	};
+
+	typedef GpuHandle<GpuResourceType::TEXTURE> TextureHandle;
+	typedef GpuHandle<GpuResourceType::BUFFER> BufferHandle;
+	typedef GpuHandle<GpuResourceType::FRAMEBUFFER> FramebufferHandle;
+	typedef GpuHandle<GpuResourceType::QUERY> QueryHandle;
+}
@@ -0,0 +1,106 @@
+#include "jobSystem.h"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+ew::JobSystem::JobSystem(unsigned int numThreads)
+{
+	if (numThreads == 0) {
+		numThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	}
+	for (unsigned int i = 0; i < numThreads; i++)
+	{
+		m_workers.push_back(std::thread(&JobSystem::workerLoop, this));
+	}
+}
+
+ew::JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i].join();
+	}
+}
+
+ew::JobSystem& ew::JobSystem::get()
+{
+	static JobSystem jobSystem;
+	return jobSystem;
+}
+
+void ew::JobSystem::submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push(std::move(job));
+	}
+	m_wake.notify_one();
+}
+
+void ew::JobSystem::workerLoop()
+{
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+			if (m_stopping && m_jobs.empty()) {
+				return;
+			}
+			job = std::move(m_jobs.front());
+			m_jobs.pop();
+		}
+		job();
+	}
+}
+
+void ew::JobSystem::parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& job)
+{
+	if (count == 0) {
+		return;
+	}
+	batchSize = std::max(batchSize, (size_t)1);
+	size_t numBatches = (count + batchSize - 1) / batchSize;
+	if (numBatches == 1 || m_workers.empty()) {
+		job(0, count);
+		return;
+	}
+
+	//Shared so helpers that start after the loop is finished can still safely look at it
+	struct Batches {
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> done{ 0 };
+	};
+	std::shared_ptr<Batches> batches = std::make_shared<Batches>();
+	const std::function<void(size_t, size_t)>* jobPtr = &job;
+	auto runBatches = [batches, jobPtr, count, batchSize, numBatches]() {
+		size_t batch;
+		while ((batch = batches->next.fetch_add(1)) < numBatches) {
+			size_t begin = batch * batchSize;
+			(*jobPtr)(begin, std::min(begin + batchSize, count));
+			batches->done.fetch_add(1);
+		}
+	};
+
+	size_t numHelpers = std::min(numBatches - 1, m_workers.size());
+	for (size_t i = 0; i < numHelpers; i++)
+	{
+		submit(runBatches);
+	}
+	//The calling thread works too, so nested parallelFor calls can't deadlock waiting for busy workers
+	runBatches();
+	while (batches->done.load() < numBatches) {
+		std::this_thread::yield();
+	}
+}
+
+void ew::parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& job)
+{
+	JobSystem::get().parallelFor(count, batchSize, job);
+}
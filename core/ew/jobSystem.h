@@ -0,0 +1,34 @@
+#pragma once
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+
+namespace ew {
+	//Fixed pool of worker threads, one per hardware thread minus the calling thread
+	class JobSystem {
+	public:
+		JobSystem(unsigned int numThreads = 0);
+		~JobSystem();
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+		//Runs a job on a worker thread. Callers track completion themselves.
+		void submit(std::function<void()> job);
+		//Splits [0, count) into batches and runs job(begin, end) on every thread, including the caller. Returns when all batches are done.
+		void parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& job);
+		inline unsigned int getNumThreads()const { return m_workers.size() + 1; }
+		static JobSystem& get();
+	private:
+		void workerLoop();
+		std::vector<std::thread> m_workers;
+		std::queue<std::function<void()>> m_jobs;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		bool m_stopping = false;
+	};
+
+	//Shorthand for JobSystem::get().parallelFor
+	void parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& job);
+}
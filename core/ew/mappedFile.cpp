@@ -0,0 +1,158 @@
+#include "mappedFile.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+	//madvise wants page aligned ranges, so the start is rounded down and only whole pages inside the range are released
+	size_t getPageSize() {
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+#else
+		return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	}
+}
+
+ew::MappedFile::~MappedFile()
+{
+	close();
+}
+
+ew::MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+ew::MappedFile& ew::MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other) {
+		close();
+		std::swap(m_data, other.m_data);
+		std::swap(m_size, other.m_size);
+#ifdef _WIN32
+		std::swap(m_file, other.m_file);
+		std::swap(m_mapping, other.m_mapping);
+#endif
+	}
+	return *this;
+}
+
+bool ew::MappedFile::open(const char* filePath)
+{
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	void* data = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (data == NULL) {
+		if (mapping != NULL) {
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		return false;
+	}
+	m_file = file;
+	m_mapping = mapping;
+	m_size = (size_t)size.QuadPart;
+#else
+	int file = ::open(filePath, O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0) {
+		::close(file);
+		return false;
+	}
+	void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	//The mapping keeps the file alive on its own
+	::close(file);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	m_size = (size_t)info.st_size;
+#endif
+	m_data = (const unsigned char*)data;
+	return true;
+}
+
+void ew::MappedFile::close()
+{
+	if (m_data == nullptr) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+	CloseHandle(m_mapping);
+	CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = nullptr;
+#else
+	munmap((void*)m_data, m_size);
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
+
+void ew::MappedFile::prefetch(size_t offset, size_t size)const
+{
+	if (m_data == nullptr || offset >= m_size) {
+		return;
+	}
+	size_t pageSize = getPageSize();
+	size_t begin = offset / pageSize * pageSize;
+	size_t end = offset + size < m_size ? offset + size : m_size;
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (void*)(m_data + begin);
+	range.NumberOfBytes = end - begin;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	madvise((void*)(m_data + begin), end - begin, MADV_WILLNEED);
+#endif
+}
+
+void ew::MappedFile::release(size_t offset, size_t size)const
+{
+	if (m_data == nullptr || offset >= m_size) {
+		return;
+	}
+	size_t pageSize = getPageSize();
+	size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+	size_t end = offset + size < m_size ? offset + size : m_size;
+	//The last partial page may be shared with the next range, unless it is the end of the file
+	if (end != m_size) {
+		end = end / pageSize * pageSize;
+	}
+	if (end <= begin) {
+		return;
+	}
+#ifdef _WIN32
+	//Unlocking pages that aren't locked removes them from the working set
+	VirtualUnlock((void*)(m_data + begin), end - begin);
+#else
+	madvise((void*)(m_data + begin), end - begin, MADV_DONTNEED);
+#endif
+}
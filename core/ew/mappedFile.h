@@ -0,0 +1,32 @@
+#pragma once
+#include <stddef.h>
+
+namespace ew {
+	//Read only view of a whole file mapped into memory. Pages are read from disk on first touch, nothing is copied onto the heap.
+	class MappedFile {
+	public:
+		MappedFile() {}
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+		//Returns false if the file doesn't exist or is empty
+		bool open(const char* filePath);
+		void close();
+		//Hints that [offset, offset + size) is about to be read front to back
+		void prefetch(size_t offset, size_t size)const;
+		//Drops [offset, offset + size) from the resident set. It is read again from disk if touched later.
+		void release(size_t offset, size_t size)const;
+		inline bool isOpen()const { return m_data != nullptr; }
+		inline const unsigned char* getData()const { return m_data; }
+		inline size_t getSize()const { return m_size; }
+	private:
+		const unsigned char* m_data = nullptr;
+		size_t m_size = 0;
+#ifdef _WIN32
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#endif
+	};
+}
@@ -6,14 +6,40 @@
 */
 
 #include "mesh.h"
+#include "gpuResource.h"
 #include "external/glad.h"
+#include <utility>
+#include <stdio.h>
 
 namespace ew {
 	Mesh::Mesh(const MeshData& meshData)
 	{
 		load(meshData);
 	}
-	void Mesh::load(const MeshData& meshData)
+	Mesh::~Mesh()
+	{
+		if (m_initialized) {
+			deferDelete(GpuResourceType::VERTEX_ARRAY, m_vao);
+			deferDelete(GpuResourceType::BUFFER, m_vbo);
+			deferDelete(GpuResourceType::BUFFER, m_ebo);
+		}
+	}
+	Mesh::Mesh(Mesh&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+	Mesh& Mesh::operator=(Mesh&& other) noexcept
+	{
+		//Swapping hands our old objects to other, which releases them when it is destroyed
+		std::swap(m_initialized, other.m_initialized);
+		std::swap(m_vao, other.m_vao);
+		std::swap(m_vbo, other.m_vbo);
+		std::swap(m_ebo, other.m_ebo);
+		std::swap(m_numVertices, other.m_numVertices);
+		std::swap(m_numIndices, other.m_numIndices);
+		return *this;
+	}
+	void Mesh::init()
 	{
 		if (!m_initialized) {
 			glGenVertexArrays(1, &m_vao);
@@ -37,12 +63,18 @@ namespace ew {
 			glEnableVertexAttribArray(2);
 
 			//Tangent attribute
-			glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(offsetof(Vertex, tangent)));
+			glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(offsetof(Vertex, tangent)));
 			glEnableVertexAttribArray(3);
 
+			trackGpuResource(GpuResourceType::VERTEX_ARRAY, m_vao);
+			trackGpuResource(GpuResourceType::BUFFER, m_vbo);
+			trackGpuResource(GpuResourceType::BUFFER, m_ebo);
 			m_initialized = true;
 		}
-
+	}
+	void Mesh::load(const MeshData& meshData)
+	{
+		init();
 		glBindVertexArray(m_vao);
 		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
@@ -60,6 +92,76 @@ namespace ew {
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	}
+	/// <summary>
+	/// Replaces the index buffer only, for index lists rebuilt every frame
+	/// </summary>
+	/// <param name="indices">New indices into the existing vertices</param>
+	/// <param name="numIndices">Number of indices</param>
+	void Mesh::updateIndices(const unsigned int* indices, unsigned int numIndices)
+	{
+		glBindVertexArray(m_vao);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * numIndices, indices, GL_STREAM_DRAW);
+		m_numIndices = numIndices;
+		glBindVertexArray(0);
+	}
+	/// <summary>
+	/// Allocates both buffers and maps them for writing, so data can be generated straight into GPU memory.
+	/// Every vertex and index must be written before calling unmap.
+	/// A buffer with a count of 0 isn't mapped, since GL rejects empty ranges, and its pointer is set to NULL.
+	/// </summary>
+	/// <param name="numVertices">Number of vertices to allocate</param>
+	/// <param name="numIndices">Number of indices to allocate</param>
+	/// <param name="vertices">Receives the mapped vertex storage</param>
+	/// <param name="indices">Receives the mapped index storage</param>
+	/// <returns>False if mapping failed, in which case nothing is left mapped</returns>
+	bool Mesh::map(unsigned int numVertices, unsigned int numIndices, Vertex** vertices, unsigned int** indices)
+	{
+		init();
+		glBindVertexArray(m_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * numVertices, NULL, GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * numIndices, NULL, GL_STATIC_DRAW);
+		GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+		*vertices = numVertices == 0 ? NULL : (Vertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * numVertices, access);
+		*indices = numIndices == 0 ? NULL : (unsigned int*)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(unsigned int) * numIndices, access);
+		bool mapped = (numVertices == 0 || *vertices != NULL) && (numIndices == 0 || *indices != NULL);
+		if (!mapped) {
+			printf("Failed to map mesh buffers (%u vertices, %u indices)\n", numVertices, numIndices);
+			if (*vertices != NULL) {
+				glUnmapBuffer(GL_ARRAY_BUFFER);
+			}
+			if (*indices != NULL) {
+				glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+			}
+			*vertices = NULL;
+			*indices = NULL;
+			numVertices = 0;
+			numIndices = 0;
+		}
+		m_numVertices = numVertices;
+		m_numIndices = numIndices;
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		return mapped;
+	}
+	/// <summary>
+	/// Finishes writing data started with map
+	/// </summary>
+	/// <returns>False if the driver lost the buffer contents while mapped and the data must be uploaded again</returns>
+	bool Mesh::unmap()
+	{
+		glBindVertexArray(m_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		//Empty buffers were never mapped
+		bool vertexValid = m_numVertices == 0 || glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+		bool indexValid = m_numIndices == 0 || glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) == GL_TRUE;
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return vertexValid && indexValid;
+	}
 	void Mesh::draw(ew::DrawMode drawMode) const
 	{
 		glBindVertexArray(m_vao);
@@ -71,4 +173,14 @@ namespace ew {
 		}
 		
 	}
+	/// <summary>
+	/// Draws a sub range of the index buffer as triangles
+	/// </summary>
+	/// <param name="indexOffset">First index to draw</param>
+	/// <param name="indexCount">Number of indices to draw</param>
+	void Mesh::drawRange(unsigned int indexOffset, unsigned int indexCount) const
+	{
+		glBindVertexArray(m_vao);
+		glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (const void*)(sizeof(unsigned int) * indexOffset));
+	}
 }
\ No newline at end of file
@@ -12,7 +12,7 @@ namespace ew {
 		glm::vec3 normal;
 		glm::vec2 uv;
 
-		glm::vec3 tangent;
+		glm::vec4 tangent; //w is the bitangent sign, bitangent = cross(normal, tangent.xyz) * w
 	};
 
 	struct MeshData {
@@ -29,11 +29,22 @@ namespace ew {
 	public:
 		Mesh() {};
 		Mesh(const MeshData& meshData);
+		~Mesh();
+		//Owns its GL objects, so it can be moved but not copied
+		Mesh(Mesh&& other) noexcept;
+		Mesh& operator=(Mesh&& other) noexcept;
+		Mesh(const Mesh&) = delete;
+		Mesh& operator=(const Mesh&) = delete;
 		void load(const MeshData& meshData);
+		void updateIndices(const unsigned int* indices, unsigned int numIndices);
+		bool map(unsigned int numVertices, unsigned int numIndices, Vertex** vertices, unsigned int** indices);
+		bool unmap();
 		void draw(DrawMode drawMode = DrawMode::TRIANGLES)const;
+		void drawRange(unsigned int indexOffset, unsigned int indexCount)const;
 		inline int getNumVertices()const { return m_numVertices; }
 		inline int getNumIndices()const { return m_numIndices; }
 	private:
+		void init();
 		bool m_initialized = false;
 		unsigned int m_vao = 0;
 		unsigned int m_vbo = 0;
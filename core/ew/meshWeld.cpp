@@ -0,0 +1,128 @@
+#include "meshWeld.h"
+#include "jobSystem.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+	const int KEY_SIZE = 12;
+	const unsigned int EMPTY = 0xffffffff;
+
+	struct WeldKey {
+		long long values[KEY_SIZE];
+		bool operator==(const WeldKey& other)const { return memcmp(values, other.values, sizeof(values)) == 0; }
+	};
+
+	//Cell index on a grid of epsilon, or the raw bits for an exact match. Ignored attributes are all 0 so they always compare equal.
+	inline void quantize(const float* v, int count, float epsilon, long long* out) {
+		for (int i = 0; i < count; i++)
+		{
+			if (epsilon < 0.0f) {
+				out[i] = 0;
+			}
+			else if (epsilon == 0.0f) {
+				//+0 and -0 are the same value
+				float value = v[i] == 0.0f ? 0.0f : v[i];
+				unsigned int bits;
+				memcpy(&bits, &value, sizeof(bits));
+				out[i] = bits;
+			}
+			else {
+				out[i] = (long long)floor((double)v[i] / epsilon + 0.5);
+			}
+		}
+	}
+
+	inline unsigned long long hashKey(const WeldKey& key) {
+		unsigned long long h = 0;
+		for (int i = 0; i < KEY_SIZE; i++)
+		{
+			h = (h + (unsigned long long)key.values[i]) * 0x9E3779B97F4A7C15ull;
+			h ^= h >> 32;
+		}
+		//Mix high bits down, the table only looks at the low ones
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		return h;
+	}
+}
+
+namespace ew {
+	WeldStats weldVertices(MeshData* meshData, const WeldSettings& settings)
+	{
+		WeldStats stats;
+		size_t numVertices = meshData->vertices.size();
+		stats.verticesBefore = numVertices;
+		if (meshData->indices.empty()) {
+			meshData->indices.resize(numVertices);
+			for (size_t i = 0; i < numVertices; i++)
+			{
+				meshData->indices[i] = i;
+			}
+		}
+
+		//Keys and hashes don't depend on each other, so they are built in parallel before the serial inserts
+		std::vector<WeldKey> keys(numVertices);
+		std::vector<unsigned long long> hashes(numVertices);
+		ew::parallelFor(numVertices, 4096, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				const Vertex& v = meshData->vertices[i];
+				long long* out = keys[i].values;
+				quantize(&v.pos.x, 3, settings.positionEpsilon, out);
+				quantize(&v.normal.x, 3, settings.normalEpsilon, out + 3);
+				quantize(&v.uv.x, 2, settings.uvEpsilon, out + 6);
+				quantize(&v.tangent.x, 4, settings.tangentEpsilon, out + 8);
+				hashes[i] = hashKey(keys[i]);
+			}
+		});
+
+		//Open addressing with linear probing, kept at most half full
+		size_t tableSize = 1;
+		while (tableSize < numVertices * 2) {
+			tableSize <<= 1;
+		}
+		const size_t mask = tableSize - 1;
+		std::vector<unsigned int> table(tableSize, EMPTY);
+		std::vector<unsigned int> remap(numVertices);
+		std::vector<Vertex> vertices;
+		vertices.reserve(numVertices);
+		std::vector<unsigned int> firstOccurrence; //New vertex -> old vertex holding its key
+		firstOccurrence.reserve(numVertices);
+		for (size_t i = 0; i < numVertices; i++)
+		{
+			size_t slot = hashes[i] & mask;
+			while (table[slot] != EMPTY && !(keys[firstOccurrence[table[slot]]] == keys[i])) {
+				slot = (slot + 1) & mask;
+			}
+			if (table[slot] == EMPTY) {
+				table[slot] = vertices.size();
+				firstOccurrence.push_back(i);
+				vertices.push_back(meshData->vertices[i]);
+			}
+			remap[i] = table[slot];
+		}
+
+		//Drop triangles whose corners collapsed onto each other
+		std::vector<unsigned int>& indices = meshData->indices;
+		size_t numIndices = 0;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			unsigned int a = remap[indices[i]];
+			unsigned int b = remap[indices[i + 1]];
+			unsigned int c = remap[indices[i + 2]];
+			if (a == b || b == c || c == a) {
+				stats.trianglesRemoved++;
+				continue;
+			}
+			indices[numIndices++] = a;
+			indices[numIndices++] = b;
+			indices[numIndices++] = c;
+		}
+		indices.resize(numIndices);
+		meshData->vertices.swap(vertices);
+		stats.verticesAfter = meshData->vertices.size();
+		return stats;
+	}
+}
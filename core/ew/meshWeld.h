@@ -0,0 +1,30 @@
+#pragma once
+#include "mesh.h"
+
+namespace ew {
+	//Each attribute is snapped to a grid of its epsilon before comparing, so two vertices weld when they land in the same cell.
+	//0 requires an exact match, a negative epsilon ignores the attribute and keeps the first vertex's value.
+	struct WeldSettings {
+		float positionEpsilon = 1e-6f;
+		float normalEpsilon = 1e-3f;
+		float uvEpsilon = 1e-5f;
+		float tangentEpsilon = -1.0f; //Ignored by default, tangents are usually generated after welding
+	};
+
+	struct WeldStats {
+		size_t verticesBefore = 0;
+		size_t verticesAfter = 0;
+		size_t trianglesRemoved = 0; //Triangles that collapsed because their corners welded together
+		inline float getReduction()const { return verticesBefore > 0 ? 1.0f - (float)verticesAfter / verticesBefore : 0.0f; }
+	};
+
+	/// <summary>
+	/// Merges vertices whose attributes match within the given epsilons and remaps the indices.
+	/// Surviving vertices keep the order they first appear in and the exact attributes of their first occurrence.
+	/// Meshes without indices are treated as a triangle list.
+	/// </summary>
+	/// <param name="meshData">Mesh to weld in place</param>
+	/// <param name="settings">Per attribute tolerances</param>
+	/// <returns>Vertex counts before and after</returns>
+	WeldStats weldVertices(MeshData* meshData, const WeldSettings& settings = WeldSettings());
+}
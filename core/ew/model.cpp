@@ -3,24 +3,174 @@
 */
 
 #include "model.h"
+#include "external/glad.h"
+#include "tangentSpace.h"
+#include "objLoader.h"
+#include "meshWeld.h"
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 
 #include <assimp/scene.h>
 #include <glm/glm.hpp>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <ctype.h>
 
 namespace ew {
-	ew::Mesh processAiMesh(aiMesh* aiMesh);
+	ew::MeshData processAiMesh(aiMesh* aiMesh);
+	Material processAiMaterial(const aiMaterial* aiMaterial, const std::string& directory);
+	glm::vec3 convertAIVec3(const aiVector3D& v);
 
-	Model::Model(const std::string& filePath)
+	//Case insensitive
+	static bool hasExtension(const std::string& filePath, const char* extension) {
+		size_t length = strlen(extension);
+		if (filePath.size() < length) {
+			return false;
+		}
+		for (size_t i = 0; i < length; i++)
+		{
+			if (tolower((unsigned char)filePath[filePath.size() - length + i]) != extension[i]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Imports a model file as CPU-side meshes plus its node hierarchy, without creating any GL objects
+	/// </summary>
+	/// <param name="filePath">Path to any format Assimp can import. OBJ files use loadObjMeshData instead and get a single root node.</param>
+	/// <returns>Empty if the file failed to load</returns>
+	Scene loadScene(const std::string& filePath)
 	{
+		Scene scene;
+		//Assimp's OBJ importer is single threaded and slow on large scans, so OBJ gets its own parser
+		if (hasExtension(filePath, ".obj")) {
+			scene.meshes = loadObjMeshData(filePath);
+			scene.meshMaterials.assign(scene.meshes.size(), -1);
+			SceneNode root;
+			root.numMeshRefs = scene.meshes.size();
+			for (size_t i = 0; i < scene.meshes.size(); i++)
+			{
+				scene.meshRefs.push_back(i);
+			}
+			scene.nodes.push_back(root);
+			scene.nodeNames.push_back(filePath);
+			return scene;
+		}
 		Assimp::Importer importer;
 		const aiScene* aiScene = importer.ReadFile(filePath, aiProcess_Triangulate);
+		if (aiScene == NULL) {
+			printf("Failed to load model %s\n", filePath.c_str());
+			return scene;
+		}
+		scene.meshes.reserve(aiScene->mNumMeshes);
 		for (size_t i = 0; i < aiScene->mNumMeshes; i++)
 		{
 			aiMesh* aiMesh = aiScene->mMeshes[i];
-			m_meshes.push_back(processAiMesh(aiMesh));
+			scene.meshes.push_back(processAiMesh(aiMesh));
+			scene.meshMaterials.push_back(aiMesh->mMaterialIndex < aiScene->mNumMaterials ? (int)aiMesh->mMaterialIndex : -1);
+		}
+		//Texture paths in model files are relative to the model
+		size_t slash = filePath.find_last_of("/\\");
+		std::string directory = slash == std::string::npos ? "" : filePath.substr(0, slash + 1);
+		for (size_t i = 0; i < aiScene->mNumMaterials; i++)
+		{
+			scene.materials.push_back(processAiMaterial(aiScene->mMaterials[i], directory));
+		}
+
+		//Depth first with an explicit stack, CAD assemblies can nest deep enough to overflow recursion
+		std::vector<std::pair<const aiNode*, int>> stack;
+		if (aiScene->mRootNode != NULL) {
+			stack.push_back({ aiScene->mRootNode, -1 });
+		}
+		while (!stack.empty()) {
+			const aiNode* aiNode = stack.back().first;
+			SceneNode node;
+			node.parentIndex = stack.back().second;
+			stack.pop_back();
+
+			aiVector3D scale, position;
+			aiQuaternion rotation;
+			aiNode->mTransformation.Decompose(scale, rotation, position);
+			node.localTransform.position = convertAIVec3(position);
+			node.localTransform.rotation = glm::quat(rotation.w, rotation.x, rotation.y, rotation.z);
+			node.localTransform.scale = convertAIVec3(scale);
+			node.firstMeshRef = scene.meshRefs.size();
+			node.numMeshRefs = aiNode->mNumMeshes;
+			scene.meshRefs.insert(scene.meshRefs.end(), aiNode->mMeshes, aiNode->mMeshes + aiNode->mNumMeshes);
+
+			int index = scene.nodes.size();
+			scene.nodes.push_back(node);
+			scene.nodeNames.push_back(aiNode->mName.C_Str());
+			//Reversed so children come out in file order
+			for (unsigned int i = aiNode->mNumChildren; i > 0; i--)
+			{
+				stack.push_back({ aiNode->mChildren[i - 1], index });
+			}
+		}
+		return scene;
+	}
+
+	/// <summary>
+	/// Imports every mesh in a model file as CPU-side mesh data, without creating any GL objects
+	/// </summary>
+	/// <param name="filePath">Path to any format Assimp can import. OBJ files use loadObjMeshData instead.</param>
+	/// <returns>One MeshData per aiMesh, empty if the file failed to load</returns>
+	std::vector<MeshData> loadModelMeshData(const std::string& filePath)
+	{
+		return loadScene(filePath).meshes;
+	}
+
+	void solveFK(const std::vector<SceneNode>& nodes, std::vector<glm::mat4>* worldTransforms)
+	{
+		worldTransforms->resize(nodes.size());
+		glm::mat4* world = worldTransforms->data();
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			const SceneNode& node = nodes[i];
+			//Parents come first, so theirs is already solved
+			if (node.parentIndex < 0) {
+				world[i] = node.localTransform.modelMatrix();
+			}
+			else {
+				world[i] = world[node.parentIndex] * node.localTransform.modelMatrix();
+			}
+		}
+	}
+
+	Model::Model(const std::string& filePath)
+		: Model(loadScene(filePath))
+	{
+	}
+
+	Model::Model(Scene scene)
+	{
+		for (size_t i = 0; i < scene.meshes.size(); i++)
+		{
+			m_meshes.push_back(ew::Mesh(scene.meshes[i]));
+		}
+		m_nodes.swap(scene.nodes);
+		m_meshRefs.swap(scene.meshRefs);
+		m_meshMaterials.swap(scene.meshMaterials);
+		m_materials.swap(scene.materials);
+		TextureCache& textureCache = TextureCache::get();
+		m_materialTextures.resize(m_materials.size());
+		for (size_t i = 0; i < m_materials.size(); i++)
+		{
+			const Material& material = m_materials[i];
+			if (!material.diffuseTexture.empty()) {
+				m_materialTextures[i].diffuse = textureCache.load(material.diffuseTexture);
+			}
+			if (!material.normalTexture.empty()) {
+				m_materialTextures[i].normal = textureCache.load(material.normalTexture);
+			}
+			if (!material.roughnessTexture.empty()) {
+				m_materialTextures[i].roughness = textureCache.load(material.roughnessTexture);
+			}
 		}
+		updateTransforms();
 	}
 
 	void Model::draw()
@@ -31,16 +181,110 @@ namespace ew {
 		}
 	}
 
+	void Model::draw(const Shader& shader, const glm::mat4& model, const std::string& modelUniform)
+	{
+		//Meshes sharing a material are common, so only binds that change anything are made
+		unsigned int boundDiffuse = 0;
+		unsigned int boundNormal = 0;
+		for (size_t i = 0; i < m_nodes.size(); i++)
+		{
+			if (m_nodes[i].numMeshRefs == 0) {
+				continue;
+			}
+			shader.setMat4(modelUniform, model * m_worldTransforms[i]);
+			for (unsigned int j = 0; j < m_nodes[i].numMeshRefs; j++)
+			{
+				unsigned int mesh = m_meshRefs[m_nodes[i].firstMeshRef + j];
+				int material = m_meshMaterials[mesh];
+				if (material >= 0) {
+					const MaterialTextures& textures = m_materialTextures[material];
+					if (textures.diffuse != nullptr && *textures.diffuse != boundDiffuse) {
+						boundDiffuse = *textures.diffuse;
+						glBindTextureUnit(0, boundDiffuse);
+					}
+					if (textures.normal != nullptr && *textures.normal != boundNormal) {
+						boundNormal = *textures.normal;
+						glBindTextureUnit(1, boundNormal);
+					}
+				}
+				m_meshes[mesh].draw();
+			}
+		}
+	}
+
+	void Model::updateTransforms()
+	{
+		solveFK(m_nodes, &m_worldTransforms);
+	}
+
+	//First texture of the first type the material has, resolved against the model's directory
+	static std::string getTexturePath(const aiMaterial* aiMaterial, const aiTextureType* types, int numTypes, const std::string& directory) {
+		for (int i = 0; i < numTypes; i++)
+		{
+			aiString path;
+			if (aiMaterial->GetTextureCount(types[i]) == 0 || aiMaterial->GetTexture(types[i], 0, &path) != aiReturn_SUCCESS) {
+				continue;
+			}
+			//Textures embedded in the file start with *, those aren't supported
+			if (path.length == 0 || path.C_Str()[0] == '*') {
+				continue;
+			}
+			return directory + path.C_Str();
+		}
+		return "";
+	}
+
+	Material processAiMaterial(const aiMaterial* aiMaterial, const std::string& directory) {
+		Material material;
+		aiString name;
+		if (aiMaterial->Get(AI_MATKEY_NAME, name) == aiReturn_SUCCESS) {
+			material.name = name.C_Str();
+		}
+		const aiTextureType diffuseTypes[] = { aiTextureType_DIFFUSE, aiTextureType_BASE_COLOR };
+		//OBJ stores normal maps as bump maps
+		const aiTextureType normalTypes[] = { aiTextureType_NORMALS, aiTextureType_NORMAL_CAMERA, aiTextureType_HEIGHT };
+		const aiTextureType roughnessTypes[] = { aiTextureType_DIFFUSE_ROUGHNESS };
+		material.diffuseTexture = getTexturePath(aiMaterial, diffuseTypes, 2, directory);
+		material.normalTexture = getTexturePath(aiMaterial, normalTypes, 3, directory);
+		material.roughnessTexture = getTexturePath(aiMaterial, roughnessTypes, 1, directory);
+
+		aiColor3D diffuse;
+		aiColor4D baseColor;
+		if (aiMaterial->Get(AI_MATKEY_BASE_COLOR, baseColor) == aiReturn_SUCCESS) {
+			material.diffuseColor = glm::vec3(baseColor.r, baseColor.g, baseColor.b);
+		}
+		else if (aiMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse) == aiReturn_SUCCESS) {
+			material.diffuseColor = glm::vec3(diffuse.r, diffuse.g, diffuse.b);
+		}
+		float value;
+		if (aiMaterial->Get(AI_MATKEY_ROUGHNESS_FACTOR, value) == aiReturn_SUCCESS) {
+			material.roughness = value;
+		}
+		else if (aiMaterial->Get(AI_MATKEY_SHININESS, value) == aiReturn_SUCCESS && value > 0.0f) {
+			//Blinn-Phong exponent to roughness
+			material.roughness = sqrtf(2.0f / (value + 2.0f));
+		}
+		if (aiMaterial->Get(AI_MATKEY_METALLIC_FACTOR, value) == aiReturn_SUCCESS) {
+			material.metallic = value;
+		}
+		if (aiMaterial->Get(AI_MATKEY_OPACITY, value) == aiReturn_SUCCESS) {
+			material.opacity = value;
+		}
+		return material;
+	}
+
 	glm::vec3 convertAIVec3(const aiVector3D& v) {
 		return glm::vec3(v.x, v.y, v.z);
 	}
 
 	//Utility functions local to this file
-	ew::Mesh processAiMesh(aiMesh* aiMesh) {
+	ew::MeshData processAiMesh(aiMesh* aiMesh) {
 		ew::MeshData meshData;
+		meshData.vertices.reserve(aiMesh->mNumVertices);
+		meshData.indices.reserve(aiMesh->mNumFaces * 3);
 		for (size_t i = 0; i < aiMesh->mNumVertices; i++)
 		{
-			ew::Vertex vertex;
+			ew::Vertex vertex = {};
 			vertex.pos = convertAIVec3(aiMesh->mVertices[i]);
 			if (aiMesh->HasNormals()) {
 				vertex.normal = convertAIVec3(aiMesh->mNormals[i]);
@@ -48,10 +292,6 @@ namespace ew {
 			if (aiMesh->HasTextureCoords(0)) {
 				vertex.uv = glm::vec2(convertAIVec3(aiMesh->mTextureCoords[0][i]));
 			}
-			if (aiMesh->HasTangentsAndBitangents())
-			{
-				vertex.tangent = glm::vec3(convertAIVec3(aiMesh->mTangents[i]));
-			}
 			meshData.vertices.push_back(vertex);
 		}
 		//Convert faces to indices
@@ -62,7 +302,13 @@ namespace ew {
 				meshData.indices.push_back(aiMesh->mFaces[i].mIndices[j]);
 			}
 		}
-		return ew::Mesh(meshData);
+		//Assimp gives every face corner its own vertex, merging them cuts the vertex count about 3x and lets the post-transform cache work
+		weldVertices(&meshData);
+		//Computed once here so normal mapping never has to rebuild a tangent frame in the shader
+		if (aiMesh->HasNormals() && aiMesh->HasTextureCoords(0)) {
+			generateTangents(&meshData);
+		}
+		return meshData;
 	}
 
 }
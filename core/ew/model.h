@@ -5,14 +5,75 @@
 #pragma once
 #include "mesh.h"
 #include "shader.h"
+#include "transform.h"
+#include "textureCache.h"
 #include <vector>
+#include <string>
 
 namespace ew {
+	//One node of a flattened hierarchy. Parents always come before their children.
+	struct SceneNode {
+		int parentIndex = -1;
+		Transform localTransform;
+		unsigned int firstMeshRef = 0; //Range in Scene::meshRefs
+		unsigned int numMeshRefs = 0;
+	};
+
+	struct Material {
+		std::string name;
+		//Resolved relative to the model file, empty if the material has none
+		std::string diffuseTexture;
+		std::string normalTexture;
+		std::string roughnessTexture;
+		glm::vec3 diffuseColor = glm::vec3(1.0f);
+		float roughness = 1.0f;
+		float metallic = 0.0f;
+		float opacity = 1.0f;
+	};
+
+	struct Scene {
+		std::vector<SceneNode> nodes; //Depth first, so every subtree is contiguous
+		std::vector<std::string> nodeNames; //Kept apart so solving transforms only touches nodes
+		std::vector<unsigned int> meshRefs; //Indices into meshes. Repeated parts reference the same mesh instead of copying it.
+		std::vector<MeshData> meshes;
+		std::vector<int> meshMaterials; //Index into materials for each mesh, -1 if it has none
+		std::vector<Material> materials;
+	};
+
+	Scene loadScene(const std::string& filePath);
+	std::vector<MeshData> loadModelMeshData(const std::string& filePath);
+	//World transform of every node in one forward pass
+	void solveFK(const std::vector<SceneNode>& nodes, std::vector<glm::mat4>* worldTransforms);
+
 	class Model {
 	public:
 		Model(const std::string& filePath);
+		//Builds from a scene already imported with loadScene, so its mesh data can be read first without a second import
+		Model(Scene scene);
+		//Draws every mesh once, ignoring node transforms
 		void draw();
+		//Draws every node's meshes with model * its world transform set in modelUniform.
+		//Material diffuse and normal textures, where present, are bound to units 0 and 1 first.
+		void draw(const Shader& shader, const glm::mat4& model, const std::string& modelUniform = "_Model");
+		//Edit local transforms through getNodes, then call updateTransforms
+		inline std::vector<SceneNode>& getNodes() { return m_nodes; }
+		inline const std::vector<glm::mat4>& getWorldTransforms()const { return m_worldTransforms; }
+		void updateTransforms();
+		inline const std::vector<Material>& getMaterials()const { return m_materials; }
+		inline int getMeshMaterial(size_t mesh)const { return m_meshMaterials[mesh]; }
 	private:
+		//Textures come from TextureCache, so materials sharing an image share one GL texture
+		struct MaterialTextures {
+			SharedTexture diffuse;
+			SharedTexture normal;
+			SharedTexture roughness;
+		};
 		std::vector<ew::Mesh> m_meshes;
+		std::vector<SceneNode> m_nodes;
+		std::vector<unsigned int> m_meshRefs;
+		std::vector<glm::mat4> m_worldTransforms;
+		std::vector<Material> m_materials;
+		std::vector<MaterialTextures> m_materialTextures;
+		std::vector<int> m_meshMaterials;
 	};
 }
\ No newline at end of file
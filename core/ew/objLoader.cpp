@@ -0,0 +1,472 @@
+#include "objLoader.h"
+#include "tangentSpace.h"
+#include "mappedFile.h"
+#include "jobSystem.h"
+
+#include <glm/glm.hpp>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+namespace {
+	const size_t CHUNK_SIZE = 4 * 1024 * 1024;
+	const unsigned int MISSING = 0xffffffff;
+	//Negative OBJ indices count back from the current line, so they are stored relative to the chunk until its offsets are known
+	const long long RELATIVE_INDEX = 1LL << 62;
+
+	const double POW10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	inline bool isSpace(char c) {
+		return c == ' ' || c == '\t';
+	}
+	inline bool isDigit(char c) {
+		return c >= '0' && c <= '9';
+	}
+	inline const char* skipSpaces(const char* p, const char* end) {
+		while (p < end && isSpace(*p)) {
+			p++;
+		}
+		return p;
+	}
+
+	//Decimal floats like 1.5, -2e-3 or .25, without the locale lookups and allocations of strtof.
+	//Exact for up to 19 significant digits, more than any exporter writes. Returns p unchanged if there is no number.
+	const char* parseFloat(const char* p, const char* end, float* out) {
+		const char* start = p;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			p++;
+		}
+		unsigned long long mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool any = false;
+		while (p < end && isDigit(*p)) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+			}
+			else {
+				exponent++;
+			}
+			any = true;
+			p++;
+		}
+		if (p < end && *p == '.') {
+			p++;
+			while (p < end && isDigit(*p)) {
+				if (digits < 19) {
+					mantissa = mantissa * 10 + (*p - '0');
+					digits += mantissa != 0;
+					exponent--;
+				}
+				any = true;
+				p++;
+			}
+		}
+		if (!any) {
+			return start;
+		}
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			const char* e = p + 1;
+			bool negativeExponent = false;
+			if (e < end && (*e == '-' || *e == '+')) {
+				negativeExponent = *e == '-';
+				e++;
+			}
+			if (e < end && isDigit(*e)) {
+				int value = 0;
+				while (e < end && isDigit(*e)) {
+					value = std::min(value * 10 + (*e - '0'), 10000);
+					e++;
+				}
+				exponent += negativeExponent ? -value : value;
+				p = e;
+			}
+		}
+		double value = (double)mantissa;
+		if (exponent < 0 && exponent >= -22) {
+			value /= POW10[-exponent];
+		}
+		else if (exponent > 0 && exponent <= 22) {
+			value *= POW10[exponent];
+		}
+		else if (exponent != 0) {
+			value *= pow(10.0, exponent);
+		}
+		*out = (float)(negative ? -value : value);
+		return p;
+	}
+
+	//Reads up to maxCount floats, missing ones are left alone
+	const char* parseFloats(const char* p, const char* end, float* out, int maxCount) {
+		for (int i = 0; i < maxCount; i++)
+		{
+			p = parseFloat(skipSpaces(p, end), end, &out[i]);
+		}
+		return p;
+	}
+
+	const char* parseInt(const char* p, const char* end, long long* out) {
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			p++;
+		}
+		long long value = 0;
+		while (p < end && isDigit(*p)) {
+			value = value * 10 + (*p - '0');
+			p++;
+		}
+		*out = negative ? -value : value;
+		return p;
+	}
+
+	inline bool startsWord(const char* p, const char* end, const char* word) {
+		size_t length = strlen(word);
+		if ((size_t)(end - p) < length || memcmp(p, word, length) != 0) {
+			return false;
+		}
+		return (size_t)(end - p) == length || isSpace(p[length]) || p[length] == '\r';
+	}
+
+	struct ObjChunk {
+		const char* begin;
+		const char* end;
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec3> normals;
+		std::vector<long long> corners; //Position, uv and normal index of every triangle corner, -1 if missing
+		std::vector<size_t> meshBreaks; //Local triangle index of every o, g or usemtl line
+		bool failed = false;
+	};
+
+	//Converts a 1 based file index into a global 0 based one, or a chunk relative one for negative indices
+	inline long long encodeIndex(long long index, size_t localCount) {
+		if (index > 0) {
+			return index - 1;
+		}
+		if (index < 0) {
+			return RELATIVE_INDEX + (long long)localCount + index;
+		}
+		return -1;
+	}
+
+	void parseChunk(ObjChunk* chunk) {
+		const char* p = chunk->begin;
+		const char* end = chunk->end;
+		long long first[3];
+		long long previous[3];
+		while (p < end) {
+			const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+			if (lineEnd == nullptr) {
+				lineEnd = end;
+			}
+			p = skipSpaces(p, lineEnd);
+			if (startsWord(p, lineEnd, "v")) {
+				glm::vec3 v = glm::vec3(0.0f);
+				parseFloats(p + 1, lineEnd, &v.x, 3);
+				chunk->positions.push_back(v);
+			}
+			else if (startsWord(p, lineEnd, "vt")) {
+				glm::vec2 v = glm::vec2(0.0f);
+				parseFloats(p + 2, lineEnd, &v.x, 2);
+				chunk->uvs.push_back(v);
+			}
+			else if (startsWord(p, lineEnd, "vn")) {
+				glm::vec3 v = glm::vec3(0.0f);
+				parseFloats(p + 2, lineEnd, &v.x, 3);
+				chunk->normals.push_back(v);
+			}
+			else if (startsWord(p, lineEnd, "f")) {
+				//v, v/vt, v//vn or v/vt/vn per corner, fanned into triangles around the first corner
+				const char* q = p + 1;
+				int numCorners = 0;
+				while (true) {
+					q = skipSpaces(q, lineEnd);
+					if (q == lineEnd || !(isDigit(*q) || *q == '-' || *q == '+')) {
+						break;
+					}
+					long long raw[3] = { 0, 0, 0 };
+					q = parseInt(q, lineEnd, &raw[0]);
+					if (q < lineEnd && *q == '/') {
+						q++;
+						if (q < lineEnd && *q != '/') {
+							q = parseInt(q, lineEnd, &raw[1]);
+						}
+						if (q < lineEnd && *q == '/') {
+							q = parseInt(q + 1, lineEnd, &raw[2]);
+						}
+					}
+					long long corner[3] = {
+						encodeIndex(raw[0], chunk->positions.size()),
+						encodeIndex(raw[1], chunk->uvs.size()),
+						encodeIndex(raw[2], chunk->normals.size())
+					};
+					if (corner[0] == -1) {
+						chunk->failed = true;
+						return;
+					}
+					if (numCorners == 0) {
+						memcpy(first, corner, sizeof(first));
+					}
+					else if (numCorners >= 2) {
+						chunk->corners.insert(chunk->corners.end(), first, first + 3);
+						chunk->corners.insert(chunk->corners.end(), previous, previous + 3);
+						chunk->corners.insert(chunk->corners.end(), corner, corner + 3);
+					}
+					memcpy(previous, corner, sizeof(previous));
+					numCorners++;
+				}
+			}
+			else if (startsWord(p, lineEnd, "o") || startsWord(p, lineEnd, "g") || startsWord(p, lineEnd, "usemtl")) {
+				chunk->meshBreaks.push_back(chunk->corners.size() / 9);
+			}
+			p = lineEnd < end ? lineEnd + 1 : end;
+		}
+	}
+
+	struct Corner {
+		unsigned int position;
+		unsigned int uv;
+		unsigned int normal;
+		bool operator==(const Corner& other)const { return position == other.position && uv == other.uv && normal == other.normal; }
+	};
+
+	inline size_t hashCorner(const Corner& c) {
+		unsigned long long h = c.position * 0x9E3779B97F4A7C15ull;
+		h ^= (c.uv + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+		h ^= (c.normal + 0x165667B19E3779F9ull) * 0xFF51AFD7ED558CCDull;
+		return (size_t)(h ^ (h >> 29));
+	}
+
+	//Merges identical corners of one mesh into shared vertices. Every corner claims a slot in an open addressing table with
+	//compare and swap, and the lowest corner of each key wins, so the vertex order is the same no matter how threads interleave.
+	ew::MeshData buildMesh(const Corner* corners, size_t numCorners, const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& uvs, const std::vector<glm::vec3>& normals) {
+		const size_t batchSize = 64 * 1024;
+		size_t tableSize = 1;
+		while (tableSize < numCorners * 2) {
+			tableSize <<= 1;
+		}
+		const size_t mask = tableSize - 1;
+		std::unique_ptr<std::atomic<unsigned int>[]> table(new std::atomic<unsigned int>[tableSize]);
+		ew::parallelFor(tableSize, batchSize, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				table[i].store(MISSING, std::memory_order_relaxed);
+			}
+		});
+		ew::parallelFor(numCorners, batchSize, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				size_t slot = hashCorner(corners[i]) & mask;
+				while (true) {
+					unsigned int current = table[slot].load(std::memory_order_relaxed);
+					if (current == MISSING) {
+						if (table[slot].compare_exchange_weak(current, (unsigned int)i, std::memory_order_relaxed)) {
+							break;
+						}
+						continue;
+					}
+					if (corners[current] == corners[i]) {
+						if (i < current && !table[slot].compare_exchange_weak(current, (unsigned int)i, std::memory_order_relaxed)) {
+							continue;
+						}
+						break;
+					}
+					slot = (slot + 1) & mask;
+				}
+			}
+		});
+
+		//Every corner finds its winner, then winners are numbered in corner order by a blocked prefix sum
+		std::vector<unsigned int> winners(numCorners);
+		size_t numBatches = (numCorners + batchSize - 1) / batchSize;
+		std::vector<unsigned int> batchVertices(numBatches + 1, 0);
+		ew::parallelFor(numCorners, batchSize, [&](size_t begin, size_t end) {
+			unsigned int count = 0;
+			for (size_t i = begin; i < end; i++)
+			{
+				size_t slot = hashCorner(corners[i]) & mask;
+				unsigned int current = table[slot].load(std::memory_order_relaxed);
+				while (!(corners[current] == corners[i])) {
+					slot = (slot + 1) & mask;
+					current = table[slot].load(std::memory_order_relaxed);
+				}
+				winners[i] = current;
+				count += current == i;
+			}
+			batchVertices[begin / batchSize + 1] = count;
+		});
+		table.reset();
+		for (size_t b = 0; b < numBatches; b++)
+		{
+			batchVertices[b + 1] += batchVertices[b];
+		}
+
+		ew::MeshData meshData;
+		meshData.vertices.resize(batchVertices[numBatches]);
+		meshData.indices.resize(numCorners);
+		std::vector<unsigned int> vertexIds(numCorners);
+		ew::parallelFor(numCorners, batchSize, [&](size_t begin, size_t end) {
+			unsigned int next = batchVertices[begin / batchSize];
+			for (size_t i = begin; i < end; i++)
+			{
+				if (winners[i] != i) {
+					continue;
+				}
+				ew::Vertex vertex = {};
+				vertex.pos = positions[corners[i].position];
+				if (corners[i].uv != MISSING) {
+					vertex.uv = uvs[corners[i].uv];
+				}
+				if (corners[i].normal != MISSING) {
+					vertex.normal = normals[corners[i].normal];
+				}
+				meshData.vertices[next] = vertex;
+				vertexIds[i] = next++;
+			}
+		});
+		ew::parallelFor(numCorners, batchSize, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				meshData.indices[i] = vertexIds[winners[i]];
+			}
+		});
+		return meshData;
+	}
+}
+
+namespace ew {
+	std::vector<MeshData> loadObjMeshData(const std::string& filePath)
+	{
+		std::vector<MeshData> meshes;
+		MappedFile file;
+		if (!file.open(filePath.c_str())) {
+			printf("Failed to load model %s\n", filePath.c_str());
+			return meshes;
+		}
+		//Every byte is parsed, so start reading all of it while the chunks are split
+		file.prefetch(0, file.getSize());
+
+		//Chunks end on line breaks so no line is split between two workers
+		std::vector<ObjChunk> chunks;
+		const char* data = (const char*)file.getData();
+		const char* fileEnd = data + file.getSize();
+		const char* chunkBegin = data;
+		while (chunkBegin < fileEnd) {
+			const char* chunkEnd = chunkBegin + std::min(CHUNK_SIZE, (size_t)(fileEnd - chunkBegin));
+			if (chunkEnd < fileEnd) {
+				const char* lineEnd = (const char*)memchr(chunkEnd, '\n', fileEnd - chunkEnd);
+				chunkEnd = lineEnd != nullptr ? lineEnd + 1 : fileEnd;
+			}
+			chunks.emplace_back();
+			chunks.back().begin = chunkBegin;
+			chunks.back().end = chunkEnd;
+			chunkBegin = chunkEnd;
+		}
+		ew::parallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				parseChunk(&chunks[i]);
+			}
+		});
+
+		//Where each chunk's data lands in the combined arrays
+		size_t numChunks = chunks.size();
+		std::vector<size_t> positionOffsets(numChunks + 1, 0);
+		std::vector<size_t> uvOffsets(numChunks + 1, 0);
+		std::vector<size_t> normalOffsets(numChunks + 1, 0);
+		std::vector<size_t> cornerOffsets(numChunks + 1, 0);
+		for (size_t i = 0; i < numChunks; i++)
+		{
+			if (chunks[i].failed) {
+				printf("Failed to load model %s: malformed face\n", filePath.c_str());
+				return meshes;
+			}
+			positionOffsets[i + 1] = positionOffsets[i] + chunks[i].positions.size();
+			uvOffsets[i + 1] = uvOffsets[i] + chunks[i].uvs.size();
+			normalOffsets[i + 1] = normalOffsets[i] + chunks[i].normals.size();
+			cornerOffsets[i + 1] = cornerOffsets[i] + chunks[i].corners.size() / 3;
+		}
+		if (positionOffsets[numChunks] >= MISSING || cornerOffsets[numChunks] >= MISSING) {
+			printf("Failed to load model %s: too large for 32 bit indices\n", filePath.c_str());
+			return meshes;
+		}
+
+		std::vector<glm::vec3> positions(positionOffsets[numChunks]);
+		std::vector<glm::vec2> uvs(uvOffsets[numChunks]);
+		std::vector<glm::vec3> normals(normalOffsets[numChunks]);
+		std::vector<Corner> corners(cornerOffsets[numChunks]);
+		std::atomic<bool> outOfRange{ false };
+		ew::parallelFor(numChunks, 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				ObjChunk& chunk = chunks[i];
+				std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + positionOffsets[i]);
+				std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + uvOffsets[i]);
+				std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normalOffsets[i]);
+				auto resolve = [&](long long index, size_t chunkOffset, size_t count) {
+					if (index == -1) {
+						return MISSING;
+					}
+					if (index >= RELATIVE_INDEX / 2) {
+						index = index - RELATIVE_INDEX + (long long)chunkOffset;
+					}
+					if (index < 0 || (size_t)index >= count) {
+						outOfRange = true;
+						return MISSING;
+					}
+					return (unsigned int)index;
+				};
+				Corner* out = &corners[cornerOffsets[i]];
+				for (size_t c = 0; c + 2 < chunk.corners.size(); c += 3)
+				{
+					out->position = resolve(chunk.corners[c], positionOffsets[i], positions.size());
+					out->uv = resolve(chunk.corners[c + 1], uvOffsets[i], uvs.size());
+					out->normal = resolve(chunk.corners[c + 2], normalOffsets[i], normals.size());
+					out++;
+				}
+				//Parsed data is no longer needed, so free it as we go to keep peak memory down on huge files
+				std::vector<glm::vec3>().swap(chunk.positions);
+				std::vector<glm::vec2>().swap(chunk.uvs);
+				std::vector<glm::vec3>().swap(chunk.normals);
+				std::vector<long long>().swap(chunk.corners);
+			}
+		});
+		if (outOfRange) {
+			printf("Failed to load model %s: face index out of range\n", filePath.c_str());
+			return meshes;
+		}
+
+		//Split into meshes at o, g and usemtl lines, skipping ones with no faces
+		std::vector<size_t> meshBreaks;
+		meshBreaks.push_back(0);
+		for (size_t i = 0; i < numChunks; i++)
+		{
+			for (size_t b = 0; b < chunks[i].meshBreaks.size(); b++)
+			{
+				meshBreaks.push_back(cornerOffsets[i] + chunks[i].meshBreaks[b] * 3);
+			}
+		}
+		meshBreaks.push_back(corners.size());
+		meshBreaks.erase(std::unique(meshBreaks.begin(), meshBreaks.end()), meshBreaks.end());
+		bool hasTangentSpace = !uvs.empty() && !normals.empty();
+		for (size_t i = 0; i + 1 < meshBreaks.size(); i++)
+		{
+			meshes.push_back(buildMesh(&corners[meshBreaks[i]], meshBreaks[i + 1] - meshBreaks[i], positions, uvs, normals));
+			//Same as the Assimp path, so normal mapped shaders work on either
+			if (hasTangentSpace) {
+				generateTangents(&meshes.back());
+			}
+		}
+		return meshes;
+	}
+}
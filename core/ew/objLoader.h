@@ -0,0 +1,15 @@
+#pragma once
+#include "mesh.h"
+#include <string>
+#include <vector>
+
+namespace ew {
+	/// <summary>
+	/// Loads a Wavefront OBJ without going through Assimp. The file is memory mapped and parsed in line aligned chunks on every core,
+	/// then corners with the same position, uv and normal are merged into shared vertices through a concurrent hash table.
+	/// Polygons are fan triangulated, and every o, g or usemtl line that follows faces starts a new mesh.
+	/// </summary>
+	/// <param name="filePath">Path to a .obj file</param>
+	/// <returns>One MeshData per object, group or material, empty if the file failed to load</returns>
+	std::vector<MeshData> loadObjMeshData(const std::string& filePath);
+}
@@ -4,8 +4,11 @@
 
 #include "procGen.h"
 #include <stdlib.h>
+#include <math.h>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
+#include "jobSystem.h"
 
 using namespace glm;
 
@@ -32,6 +35,7 @@ namespace ew {
 			vertex.pos = pos;
 			vertex.normal = normal;
 			vertex.uv = glm::vec2(col, row);
+			vertex.tangent = vec4(a, 1.0f);
 			mesh->vertices.push_back(vertex);
 		}
 
@@ -60,181 +64,314 @@ namespace ew {
 		createCubeFace(vec3{ +0.0f,+0.0f,-1.0f }, size, &mesh); //Back
 		return mesh;
 	}
-	MeshData createPlane(float width, float height, int subdivisions)
-	{
-		//VERTICES
-		MeshData mesh;
-		int columns = subdivisions + 1;
-		for (size_t row = 0; row <= subdivisions; row++)
+	//Rows per job system batch, so small meshes are generated on the calling thread
+	static size_t rowsPerBatch(size_t columns) {
+		const size_t VERTICES_PER_BATCH = 16384;
+		return VERTICES_PER_BATCH / columns + 1;
+	}
+	/// <summary>
+	/// Builds cos/sin of evenly spaced angles once so generators don't call trig per vertex
+	/// </summary>
+	/// <param name="step">Angle between entries</param>
+	/// <param name="count">Number of entries</param>
+	/// <param name="cosTable">Filled with cos(i * step)</param>
+	/// <param name="sinTable">Filled with sin(i * step)</param>
+	static void fillSinCosTable(float step, size_t count, std::vector<float>* cosTable, std::vector<float>* sinTable) {
+		cosTable->resize(count);
+		sinTable->resize(count);
+		for (size_t i = 0; i < count; i++)
 		{
-			for (size_t col = 0; col <= subdivisions; col++)
+			cosTable->at(i) = cosf(step * i);
+			sinTable->at(i) = sinf(step * i);
+		}
+	}
+	void getPlaneSize(int subdivisions, unsigned int* numVertices, unsigned int* numIndices)
+	{
+		*numVertices = (subdivisions + 1) * (subdivisions + 1);
+		*numIndices = subdivisions * subdivisions * 6;
+	}
+	void getSphereSize(int subdivisions, unsigned int* numVertices, unsigned int* numIndices)
+	{
+		*numVertices = (subdivisions + 1) * (subdivisions + 1);
+		//Two caps plus the rows of quads between them
+		*numIndices = subdivisions * 6 + std::max(subdivisions - 2, 0) * subdivisions * 6;
+	}
+	void getCylinderSize(int subdivisions, unsigned int* numVertices, unsigned int* numIndices)
+	{
+		//Center vertices plus 4 rings
+		*numVertices = 2 + (subdivisions + 1) * 4;
+		*numIndices = (subdivisions + 1) * 12;
+	}
+	void createPlane(float width, float height, int subdivisions, Vertex* vertices, unsigned int* indices, unsigned int baseVertex)
+	{
+		size_t columns = subdivisions + 1;
+		size_t quadsPerRow = subdivisions; //Also the number of rows of quads
+		float invSubdivisions = 1.0f / subdivisions;
+		ew::parallelFor(columns, rowsPerBatch(columns), [&](size_t rowBegin, size_t rowEnd) {
+			for (size_t row = rowBegin; row < rowEnd; row++)
 			{
-				Vertex v;                                                                                                                                                                                                                                                                                                                                                                                                    
-				v.uv.x = ((float)col / subdivisions);
-				v.uv.y = ((float)row / subdivisions);
-				v.pos.x = -width/2 + width * v.uv.x;
-				v.pos.y = 0;
-				v.pos.z = height/2 -height * v.uv.y;
-				v.normal = vec3(0, 1, 0);
-				mesh.vertices.push_back(v);
+				Vertex* v = vertices + row * columns;
+				float uvY = row * invSubdivisions;
+				float posZ = height / 2 - height * uvY;
+				for (size_t col = 0; col < columns; col++)
+				{
+					v[col].uv = vec2(col * invSubdivisions, uvY);
+					v[col].pos = vec3(-width / 2 + width * v[col].uv.x, 0.0f, posZ);
+					v[col].normal = vec3(0, 1, 0);
+					v[col].tangent = vec4(1, 0, 0, 1);
+				}
 			}
-		}
-		//INDICES
-		for (size_t row = 0; row < subdivisions; row++)
-		{
-			for (size_t col = 0; col < subdivisions; col++)
+		});
+		ew::parallelFor(quadsPerRow, rowsPerBatch(columns), [&](size_t rowBegin, size_t rowEnd) {
+			for (size_t row = rowBegin; row < rowEnd; row++)
 			{
-				int start = row * columns + col;
-				mesh.indices.push_back(start);
-				mesh.indices.push_back(start + 1);
-				mesh.indices.push_back(start + columns + 1);
-				mesh.indices.push_back(start + columns + 1);
-				mesh.indices.push_back(start + columns);
-				mesh.indices.push_back(start);
+				unsigned int* i = indices + row * quadsPerRow * 6;
+				for (size_t col = 0; col < quadsPerRow; col++)
+				{
+					unsigned int start = baseVertex + row * columns + col;
+					*i++ = start;
+					*i++ = start + 1;
+					*i++ = start + columns + 1;
+					*i++ = start + columns + 1;
+					*i++ = start + columns;
+					*i++ = start;
+				}
 			}
-		}
-		return mesh;
+		});
 	}
-	MeshData createSphere(float radius, int subdivisions)
+	void createSphere(float radius, int subdivisions, Vertex* vertices, unsigned int* indices, unsigned int baseVertex)
 	{
-		MeshData mesh;
+		size_t columns = subdivisions + 1;
+		size_t quadsPerRow = subdivisions; //Also the number of rows of quads
+		float invSubdivisions = 1.0f / subdivisions;
+		std::vector<float> cosTheta, sinTheta, cosPhi, sinPhi;
+		fillSinCosTable(glm::two_pi<float>() / subdivisions, columns, &cosTheta, &sinTheta);
+		fillSinCosTable(glm::pi<float>() / subdivisions, columns, &cosPhi, &sinPhi);
+		//Close the seam exactly so the first and last columns share positions
+		cosTheta[subdivisions] = cosTheta[0];
+		sinTheta[subdivisions] = sinTheta[0];
+
 		//VERTICES
-		float thetaStep = glm::two_pi<float>() / subdivisions;
-		float phiStep = glm::pi<float>() / subdivisions;
-		for (size_t row = 0; row <= subdivisions; row++)
-		{
-			float phi = row * phiStep;
-			for (size_t col = 0; col <= subdivisions; col++)
+		ew::parallelFor(columns, rowsPerBatch(columns), [&](size_t rowBegin, size_t rowEnd) {
+			for (size_t row = rowBegin; row < rowEnd; row++)
 			{
-				float theta = thetaStep * col;
-				Vertex v;
-				v.normal.x = cosf(theta) * sinf(phi);
-				v.normal.y = cosf(phi);
-				v.normal.z = sinf(theta) * sinf(phi);
-				v.pos = v.normal * radius;
-				v.uv.x = (float)col / subdivisions;
-				v.uv.y = 1.0 - ((float)row / subdivisions);
-				mesh.vertices.push_back(v);
+				Vertex* v = vertices + row * columns;
+				float uvY = 1.0f - row * invSubdivisions;
+				for (size_t col = 0; col < columns; col++)
+				{
+					v[col].normal = vec3(cosTheta[col] * sinPhi[row], cosPhi[row], sinTheta[col] * sinPhi[row]);
+					v[col].pos = v[col].normal * radius;
+					v[col].uv = vec2(col * invSubdivisions, uvY);
+					//Along increasing theta. V runs against phi, which mirrors the bitangent.
+					v[col].tangent = vec4(-sinTheta[col], 0.0f, cosTheta[col], -1.0f);
+				}
 			}
-		}
-		
+		});
+
 		//INDICES
-		unsigned int columns = subdivisions + 1;
-		unsigned int sideStart = columns;
-		unsigned int poleStart = 0;
-		//Top cap
-		for (size_t i = 0; i < subdivisions; i++)
-		{
-			mesh.indices.push_back(sideStart + i);
-			mesh.indices.push_back(poleStart + i);
-			mesh.indices.push_back(sideStart +i+1);
-		}
-		//Rows of quads for sides
-		for (size_t row = 1; row < subdivisions - 1; row++)
-		{
-			for (size_t col = 0; col < subdivisions; col++)
+		//Each row of triangles writes to a known offset: top cap, rows of quads, bottom cap
+		unsigned int capIndices = subdivisions * 3;
+		unsigned int rowIndices = subdivisions * 6;
+		ew::parallelFor(quadsPerRow, rowsPerBatch(columns), [&](size_t rowBegin, size_t rowEnd) {
+			for (size_t row = rowBegin; row < rowEnd; row++)
 			{
-				unsigned int start = row * columns + col;
-				mesh.indices.push_back(start);
-				mesh.indices.push_back(start + 1);
-				mesh.indices.push_back(start + columns);
-				mesh.indices.push_back(start + columns);
-				mesh.indices.push_back(start + 1);
-				mesh.indices.push_back(start + columns + 1);
+				//Top cap
+				if (row == 0) {
+					unsigned int* i = indices;
+					unsigned int sideStart = baseVertex + columns;
+					unsigned int poleStart = baseVertex;
+					for (size_t col = 0; col < quadsPerRow; col++)
+					{
+						*i++ = sideStart + col;
+						*i++ = poleStart + col;
+						*i++ = sideStart + col + 1;
+					}
+				}
+				//Bottom cap
+				if (row == quadsPerRow - 1) {
+					unsigned int* i = indices + capIndices + std::max(subdivisions - 2, 0) * rowIndices;
+					unsigned int poleStart = baseVertex + subdivisions * columns;
+					unsigned int sideStart = poleStart - columns;
+					for (size_t col = 0; col < quadsPerRow; col++)
+					{
+						*i++ = sideStart + col;
+						*i++ = sideStart + col + 1;
+						*i++ = poleStart + col;
+					}
+				}
+				//Rows of quads for sides
+				if (row == 0 || row == quadsPerRow - 1) {
+					continue;
+				}
+				unsigned int* i = indices + capIndices + (row - 1) * rowIndices;
+				for (size_t col = 0; col < quadsPerRow; col++)
+				{
+					unsigned int start = baseVertex + row * columns + col;
+					*i++ = start;
+					*i++ = start + 1;
+					*i++ = start + columns;
+					*i++ = start + columns;
+					*i++ = start + 1;
+					*i++ = start + columns + 1;
+				}
 			}
-		}
-		//Bottom cap
-		poleStart = (columns * columns) - columns;
-		sideStart = poleStart - columns;
-		for (size_t i = 0; i < subdivisions; i++)
-		{
-			mesh.indices.push_back(sideStart + i);
-			mesh.indices.push_back(sideStart + i + 1);
-			mesh.indices.push_back(poleStart + i);
-		}
-		return mesh;
+		});
 	}
-	void createCylinderRing(MeshData* meshData, float radius, int subdivisions, float y, bool sideFacing) {
-		float thetaStep = two_pi<float>() / subdivisions;
-		for (size_t i = 0; i <= subdivisions; i++)
+	static Vertex* createCylinderRing(Vertex* v, const std::vector<float>& cosTable, const std::vector<float>& sinTable, float radius, int subdivisions, float y, bool sideFacing) {
+		for (size_t i = 0; i < cosTable.size(); i++)
 		{
-			float theta = i * thetaStep;
-			float cosA = cosf(theta);
-			float sinA = sinf(theta);
-			Vertex v;
-			v.pos = vec3(cosA * radius, y, sinA * radius);
+			float cosA = cosTable[i];
+			float sinA = sinTable[i];
+			v->pos = vec3(cosA * radius, y, sinA * radius);
 			if (sideFacing) {
-				v.normal = vec3(cosA, 0, sinA);
-				v.uv = vec2((float)i / subdivisions, y > 0 ? 1 : 0);
+				v->normal = vec3(cosA, 0, sinA);
+				v->uv = vec2((float)i / subdivisions, y > 0 ? 1 : 0);
+				v->tangent = vec4(-sinA, 0, cosA, -1);
 			}
 			else {
-				v.normal = vec3(0, sign(y), 0);
-				v.uv = vec2(cosA * 0.5f + 0.5f, sinA * 0.5f + 0.5f);
+				v->normal = vec3(0, sign(y), 0);
+				v->uv = vec2(cosA * 0.5f + 0.5f, sinA * 0.5f + 0.5f);
+				//Cap UVs follow x and z, which is mirrored on the top face
+				v->tangent = vec4(1, 0, 0, -sign(y));
 			}
-
-			meshData->vertices.push_back(v);
+			v++;
 		}
+		return v;
 	}
-	MeshData createCylinder(float radius, float height, int subdivisions)
+	void createCylinder(float radius, float height, int subdivisions, Vertex* vertices, unsigned int* indices, unsigned int baseVertex)
 	{
-		MeshData mesh;
+		//Only 4 rings, so this stays on the calling thread
+		std::vector<float> cosTable, sinTable;
+		fillSinCosTable(two_pi<float>() / subdivisions, subdivisions + 1, &cosTable, &sinTable);
+		cosTable[subdivisions] = cosTable[0];
+		sinTable[subdivisions] = sinTable[0];
 
 		//VERTICES
+		unsigned int numVertices, numIndices;
+		getCylinderSize(subdivisions, &numVertices, &numIndices);
 		{
 			const float topY = height * 0.5;
 			const float bottomY = -topY;
 
-			Vertex topVertex;
-			topVertex.pos = vec3(0, topY, 0);
-			topVertex.normal = vec3(0, 1, 0);
-			topVertex.uv = vec2(0.5f);
-			mesh.vertices.push_back(topVertex);
+			Vertex* v = vertices;
+			v->pos = vec3(0, topY, 0);
+			v->normal = vec3(0, 1, 0);
+			v->uv = vec2(0.5f);
+			v->tangent = vec4(1, 0, 0, -1);
+			v++;
 
-			createCylinderRing(&mesh, radius, subdivisions, topY, false);
-			createCylinderRing(&mesh, radius, subdivisions, topY, true);
-			createCylinderRing(&mesh, radius, subdivisions, bottomY, true);
-			createCylinderRing(&mesh, radius, subdivisions, bottomY, false);
+			v = createCylinderRing(v, cosTable, sinTable, radius, subdivisions, topY, false);
+			v = createCylinderRing(v, cosTable, sinTable, radius, subdivisions, topY, true);
+			v = createCylinderRing(v, cosTable, sinTable, radius, subdivisions, bottomY, true);
+			v = createCylinderRing(v, cosTable, sinTable, radius, subdivisions, bottomY, false);
 
-			Vertex bottomVertex;
-			bottomVertex.pos = vec3(0, bottomY, 0);
-			bottomVertex.normal = vec3(0, -1, 0);
-			bottomVertex.uv = vec2(0.5f);
-			mesh.vertices.push_back(bottomVertex);
+			v->pos = vec3(0, bottomY, 0);
+			v->normal = vec3(0, -1, 0);
+			v->uv = vec2(0.5f);
+			v->tangent = vec4(1, 0, 0, 1);
 		}
-		
 
 		//INDICES
 		{
-			int columns = subdivisions + 1;
+			unsigned int* i = indices;
+			unsigned int columns = subdivisions + 1;
 			//Top cap
-			for (size_t i = 0; i < columns; i++)
+			for (unsigned int c = 0; c < columns; c++)
 			{
-				mesh.indices.push_back(0);
-				mesh.indices.push_back(i + 1);
-				mesh.indices.push_back(i);
+				*i++ = baseVertex;
+				*i++ = baseVertex + c + 1;
+				*i++ = baseVertex + c;
 			}
-			int sideStart = columns;
+			unsigned int sideStart = baseVertex + columns;
 			//Sides
-			for (size_t i = 0; i < columns; i++)
+			for (unsigned int c = 0; c < columns; c++)
 			{
-				unsigned int start = sideStart + i;
-				mesh.indices.push_back(start);
-				mesh.indices.push_back(start + 1);
-				mesh.indices.push_back(start + columns);
-				mesh.indices.push_back(start + columns);
-				mesh.indices.push_back(start + 1);
-				mesh.indices.push_back(start + columns + 1);
+				unsigned int start = sideStart + c;
+				*i++ = start;
+				*i++ = start + 1;
+				*i++ = start + columns;
+				*i++ = start + columns;
+				*i++ = start + 1;
+				*i++ = start + columns + 1;
 			}
 			//Bottom cap
-			unsigned int bottomIndex = mesh.vertices.size() - 1;
+			unsigned int bottomIndex = baseVertex + numVertices - 1;
 			sideStart = bottomIndex - columns;
-			for (size_t i = 0; i < columns; i++)
+			for (unsigned int c = 0; c < columns; c++)
 			{
-				mesh.indices.push_back(bottomIndex);
-				mesh.indices.push_back(sideStart + i);
-				mesh.indices.push_back(sideStart + i + 1);
+				*i++ = bottomIndex;
+				*i++ = sideStart + c;
+				*i++ = sideStart + c + 1;
 			}
 		}
+	}
+	MeshData createPlane(float width, float height, int subdivisions)
+	{
+		MeshData mesh;
+		unsigned int numVertices, numIndices;
+		getPlaneSize(subdivisions, &numVertices, &numIndices);
+		mesh.vertices.resize(numVertices);
+		mesh.indices.resize(numIndices);
+		createPlane(width, height, subdivisions, mesh.vertices.data(), mesh.indices.data());
+		return mesh;
+	}
+	MeshData createSphere(float radius, int subdivisions)
+	{
+		MeshData mesh;
+		unsigned int numVertices, numIndices;
+		getSphereSize(subdivisions, &numVertices, &numIndices);
+		mesh.vertices.resize(numVertices);
+		mesh.indices.resize(numIndices);
+		createSphere(radius, subdivisions, mesh.vertices.data(), mesh.indices.data());
 		return mesh;
 	}
-}
\ No newline at end of file
+	MeshData createCylinder(float radius, float height, int subdivisions)
+	{
+		MeshData mesh;
+		unsigned int numVertices, numIndices;
+		getCylinderSize(subdivisions, &numVertices, &numIndices);
+		mesh.vertices.resize(numVertices);
+		mesh.indices.resize(numIndices);
+		createCylinder(radius, height, subdivisions, mesh.vertices.data(), mesh.indices.data());
+		return mesh;
+	}
+	/// <summary>
+	/// Shared path for the load functions. Generates into the mapped buffers, or re-uploads from memory if the driver discarded them.
+	/// </summary>
+	template<typename SizeFn, typename CreateFn>
+	static void loadGenerated(Mesh* mesh, int subdivisions, SizeFn getSize, CreateFn create) {
+		unsigned int numVertices, numIndices;
+		getSize(subdivisions, &numVertices, &numIndices);
+		Vertex* vertices;
+		unsigned int* indices;
+		if (mesh->map(numVertices, numIndices, &vertices, &indices)) {
+			create(vertices, indices);
+			if (mesh->unmap()) {
+				return;
+			}
+		}
+		MeshData meshData;
+		meshData.vertices.resize(numVertices);
+		meshData.indices.resize(numIndices);
+		create(meshData.vertices.data(), meshData.indices.data());
+		mesh->load(meshData);
+	}
+	void loadPlane(Mesh* mesh, float width, float height, int subdivisions)
+	{
+		loadGenerated(mesh, subdivisions, getPlaneSize, [&](Vertex* vertices, unsigned int* indices) {
+			createPlane(width, height, subdivisions, vertices, indices);
+		});
+	}
+	void loadSphere(Mesh* mesh, float radius, int subdivisions)
+	{
+		loadGenerated(mesh, subdivisions, getSphereSize, [&](Vertex* vertices, unsigned int* indices) {
+			createSphere(radius, subdivisions, vertices, indices);
+		});
+	}
+	void loadCylinder(Mesh* mesh, float radius, float height, int subdivisions)
+	{
+		loadGenerated(mesh, subdivisions, getCylinderSize, [&](Vertex* vertices, unsigned int* indices) {
+			createCylinder(radius, height, subdivisions, vertices, indices);
+		});
+	}
+}
@@ -10,4 +10,19 @@ namespace ew {
 	MeshData createPlane(float width, float height, int subdivisions);
 	MeshData createSphere(float radius, int subdivisions);
 	MeshData createCylinder(float radius, float height, int subdivisions);
+
+	//Exact vertex/index counts, for sizing storage passed to the pointer overloads below
+	void getPlaneSize(int subdivisions, unsigned int* numVertices, unsigned int* numIndices);
+	void getSphereSize(int subdivisions, unsigned int* numVertices, unsigned int* numIndices);
+	void getCylinderSize(int subdivisions, unsigned int* numVertices, unsigned int* numIndices);
+
+	//Write into caller provided storage without allocating it. Indices are offset by baseVertex so several meshes can share one buffer.
+	void createPlane(float width, float height, int subdivisions, Vertex* vertices, unsigned int* indices, unsigned int baseVertex = 0);
+	void createSphere(float radius, int subdivisions, Vertex* vertices, unsigned int* indices, unsigned int baseVertex = 0);
+	void createCylinder(float radius, float height, int subdivisions, Vertex* vertices, unsigned int* indices, unsigned int baseVertex = 0);
+
+	//Generate straight into the mesh's mapped GPU buffers, skipping the intermediate MeshData
+	void loadPlane(Mesh* mesh, float width, float height, int subdivisions);
+	void loadSphere(Mesh* mesh, float radius, int subdivisions);
+	void loadCylinder(Mesh* mesh, float radius, float height, int subdivisions);
 }
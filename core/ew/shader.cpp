@@ -3,6 +3,7 @@
 */
 
 #include "shader.h"
+#include "gpuResource.h"
 #include <fstream>
 #include <sstream>
 #include "external/glad.h"
@@ -88,6 +89,24 @@ namespace ew {
 		std::string vertexShaderSource = ew::loadShaderSourceFromFile(vertexShader.c_str());
 		std::string fragmentShaderSource = ew::loadShaderSourceFromFile(fragmentShader.c_str());
 		m_id = ew::createShaderProgram(vertexShaderSource.c_str(), fragmentShaderSource.c_str());
+		trackGpuResource(GpuResourceType::PROGRAM, m_id);
+	}
+	Shader::~Shader()
+	{
+		deferDelete(GpuResourceType::PROGRAM, m_id);
+	}
+	Shader::Shader(Shader&& other) noexcept : m_id(other.m_id)
+	{
+		other.m_id = 0;
+	}
+	Shader& Shader::operator=(Shader&& other) noexcept
+	{
+		if (this != &other) {
+			deferDelete(GpuResourceType::PROGRAM, m_id);
+			m_id = other.m_id;
+			other.m_id = 0;
+		}
+		return *this;
 	}
 	void Shader::use()const
 	{
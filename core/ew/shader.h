@@ -12,6 +12,12 @@ namespace ew {
 	class Shader {
 	public:
 		Shader(const std::string& vertexShader, const std::string& fragmentShader);
+		~Shader();
+		//Owns the program, so it can be moved but not copied
+		Shader(Shader&& other) noexcept;
+		Shader& operator=(Shader&& other) noexcept;
+		Shader(const Shader&) = delete;
+		Shader& operator=(const Shader&) = delete;
 		void use()const;
 		void setInt(const std::string& name, int v) const;
 		void setFloat(const std::string& name, float v) const;
@@ -23,6 +29,6 @@ namespace ew {
 		void setVec4(const std::string& name, const glm::vec4& v) const;
 		void setMat4(const std::string& name, const glm::mat4& m) const;
 	private:
-		unsigned int m_id; //Shader program handle
+		unsigned int m_id = 0; //Shader program handle
 	};
 }
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "tangentSpace.h"
+#include "jobSystem.h"
+
+#include <math.h>
+#include <vector>
+
+namespace {
+	const size_t TRIANGLES_PER_BATCH = 8192;
+	const size_t VERTICES_PER_BATCH = 8192;
+
+	//Unit tangent and bitangent of one triangle's UV mapping
+	struct FaceFrame {
+		glm::vec3 tangent;
+		glm::vec3 bitangent;
+		bool valid;
+	};
+
+	float cornerAngle(const glm::vec3& corner, const glm::vec3& a, const glm::vec3& b) {
+		glm::vec3 edgeA = a - corner;
+		glm::vec3 edgeB = b - corner;
+		float lengths = glm::length(edgeA) * glm::length(edgeB);
+		if (lengths <= 0.0f) {
+			return 0.0f;
+		}
+		return acosf(glm::clamp(glm::dot(edgeA, edgeB) / lengths, -1.0f, 1.0f));
+	}
+
+	//Removes the part of v along n, returns zero if nothing is left
+	glm::vec3 projectOntoPlane(const glm::vec3& v, const glm::vec3& n) {
+		glm::vec3 projected = v - n * glm::dot(n, v);
+		float length = glm::length(projected);
+		return length > 1e-12f ? projected / length : glm::vec3(0.0f);
+	}
+}
+
+namespace ew {
+	void generateTangents(Vertex* vertices, size_t numVertices, const unsigned int* indices, size_t numIndices, unsigned int baseVertex)
+	{
+		size_t numTriangles = numIndices / 3;
+		if (numVertices == 0) {
+			return;
+		}
+
+		//Per triangle frames, each triangle only writes its own slot
+		std::vector<FaceFrame> faces(numTriangles);
+		ew::parallelFor(numTriangles, TRIANGLES_PER_BATCH, [&](size_t begin, size_t end) {
+			for (size_t t = begin; t < end; t++)
+			{
+				const Vertex& v0 = vertices[indices[t * 3] - baseVertex];
+				const Vertex& v1 = vertices[indices[t * 3 + 1] - baseVertex];
+				const Vertex& v2 = vertices[indices[t * 3 + 2] - baseVertex];
+				glm::vec3 e1 = v1.pos - v0.pos;
+				glm::vec3 e2 = v2.pos - v0.pos;
+				glm::vec2 d1 = v1.uv - v0.uv;
+				glm::vec2 d2 = v2.uv - v0.uv;
+				float det = d1.x * d2.y - d2.x * d1.y;
+				FaceFrame& face = faces[t];
+				face.valid = fabsf(det) > 1e-20f;
+				if (!face.valid) {
+					continue;
+				}
+				//Dividing by |det| keeps the direction of each vector and leaves mirroring to the bitangent
+				float scale = det > 0.0f ? 1.0f : -1.0f;
+				face.tangent = (e1 * d2.y - e2 * d1.y) * scale;
+				face.bitangent = (e2 * d1.x - e1 * d2.x) * scale;
+			}
+		});
+
+		//Triangle corners around each vertex, so vertices can gather instead of triangles scattering with atomics
+		std::vector<unsigned int> cornerOffsets(numVertices + 1, 0);
+		for (size_t i = 0; i < numTriangles * 3; i++)
+		{
+			cornerOffsets[indices[i] - baseVertex + 1]++;
+		}
+		for (size_t i = 0; i < numVertices; i++)
+		{
+			cornerOffsets[i + 1] += cornerOffsets[i];
+		}
+		std::vector<unsigned int> corners(numTriangles * 3);
+		std::vector<unsigned int> fill(cornerOffsets.begin(), cornerOffsets.end() - 1);
+		for (size_t i = 0; i < numTriangles * 3; i++)
+		{
+			corners[fill[indices[i] - baseVertex]++] = i;
+		}
+
+		ew::parallelFor(numVertices, VERTICES_PER_BATCH, [&](size_t begin, size_t end) {
+			for (size_t v = begin; v < end; v++)
+			{
+				glm::vec3 n = vertices[v].normal;
+				glm::vec3 tangent = glm::vec3(0.0f);
+				glm::vec3 bitangent = glm::vec3(0.0f);
+				for (unsigned int c = cornerOffsets[v]; c < cornerOffsets[v + 1]; c++)
+				{
+					unsigned int corner = corners[c];
+					size_t t = corner / 3;
+					if (!faces[t].valid) {
+						continue;
+					}
+					unsigned int k = corner % 3;
+					float angle = cornerAngle(vertices[v].pos,
+						vertices[indices[t * 3 + (k + 1) % 3] - baseVertex].pos,
+						vertices[indices[t * 3 + (k + 2) % 3] - baseVertex].pos);
+					tangent += projectOntoPlane(faces[t].tangent, n) * angle;
+					bitangent += projectOntoPlane(faces[t].bitangent, n) * angle;
+				}
+				tangent = projectOntoPlane(tangent, n);
+				//No usable UVs around this vertex, so pick any direction perpendicular to the normal
+				if (glm::length(tangent) <= 0.0f) {
+					glm::vec3 axis = fabsf(n.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+					tangent = projectOntoPlane(axis, n);
+				}
+				float sign = glm::dot(glm::cross(n, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+				vertices[v].tangent = glm::vec4(tangent, sign);
+			}
+		});
+	}
+	void generateTangents(MeshData* meshData)
+	{
+		generateTangents(meshData->vertices.data(), meshData->vertices.size(), meshData->indices.data(), meshData->indices.size());
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "mesh.h"
+
+namespace ew {
+	/// <summary>
+	/// Fills Vertex::tangent with MikkTSpace style tangents: per triangle UV tangents projected onto each vertex normal,
+	/// weighted by corner angle and averaged. w holds the bitangent sign, so bitangent = cross(normal, tangent.xyz) * tangent.w.
+	/// Triangles are processed in parallel on the job system.
+	/// </summary>
+	/// <param name="vertices">Vertices with positions, normals and UVs already filled</param>
+	/// <param name="numVertices">Number of vertices</param>
+	/// <param name="indices">Triangle list</param>
+	/// <param name="numIndices">Number of indices</param>
+	/// <param name="baseVertex">Subtracted from every index, for meshes written into a shared buffer</param>
+	void generateTangents(Vertex* vertices, size_t numVertices, const unsigned int* indices, size_t numIndices, unsigned int baseVertex = 0);
+	void generateTangents(MeshData* meshData);
+}
@@ -5,6 +5,22 @@
 #include "texture.h"
 #include "external/glad.h"
 #include "external/stb_image.h"
+#include "../hannah/ktx2.h"
+
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+//S3TC is an extension, so the core profile header doesn't define these
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
 
 static int getTextureFormat(int numComponents) {
 	switch (numComponents) {
@@ -18,26 +34,256 @@ static int getTextureFormat(int numComponents) {
 		return GL_RED;
 	}
 }
+static int getCompressedFormat(hannah::BlockFormat format, bool srgb) {
+	switch (format) {
+	case hannah::BlockFormat::BC1:
+		return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case hannah::BlockFormat::BC3:
+		return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case hannah::BlockFormat::BC5:
+		return GL_COMPRESSED_RG_RGTC2;
+	default:
+		return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+}
+
+//Relative to the working directory, created on the first cache write
+static const char* TEXTURE_CACHE_DIRECTORY = "textureCache";
+
+//Modification time, 0 if the file doesn't exist
+static long long getModifiedTime(const char* filePath) {
+	struct stat info;
+	return stat(filePath, &info) == 0 ? (long long)info.st_mtime : 0;
+}
+
+//TEXTURE_CACHE_DIRECTORY/<image name>.<hash of its path>.<format>-<mip settings key>.ktx2.
+//Changing the format, the mip settings or the filters behind them gives a new name, so a stale chain is never picked up.
+static std::string getCachePath(const char* filePath, hannah::BlockFormat format, const hannah::MipSettings& mipSettings) {
+	std::string path = filePath;
+	size_t slash = path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	//FNV-1a, so images with the same name in different folders get their own entry
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < path.size(); i++)
+	{
+		hash = (hash ^ (unsigned char)path[i]) * 16777619u;
+	}
+	char hashText[16];
+	snprintf(hashText, sizeof(hashText), "%08x", hash);
+	return std::string(TEXTURE_CACHE_DIRECTORY) + "/" + name + "." + hashText + "." + hannah::getFormatName(format) + "-" + hannah::getMipSettingsKey(mipSettings) + ".ktx2";
+}
+
+static void createCacheDirectory() {
+#ifdef _WIN32
+	_mkdir(TEXTURE_CACHE_DIRECTORY);
+#else
+	mkdir(TEXTURE_CACHE_DIRECTORY, 0755);
+#endif
+}
+
+//Where the data of every level lives, in a CompressedTexture or straight in a mapped file
+struct TextureLevels {
+	hannah::BlockFormat format = hannah::BlockFormat::RGBA8;
+	bool srgb = false;
+	int width = 0;
+	int height = 0;
+	int numLayers = 0;
+	int numFaces = 1;
+	std::vector<const unsigned char*> data;
+	std::vector<size_t> sizes;
+};
+
+static TextureLevels getLevels(const hannah::CompressedTexture& texture) {
+	TextureLevels levels;
+	levels.format = texture.format;
+	levels.srgb = texture.srgb;
+	levels.width = texture.width;
+	levels.height = texture.height;
+	levels.numLayers = texture.numLayers;
+	levels.numFaces = texture.numFaces;
+	for (size_t i = 0; i < texture.levels.size(); i++)
+	{
+		levels.data.push_back(texture.levels[i].data());
+		levels.sizes.push_back(texture.levels[i].size());
+	}
+	return levels;
+}
+
+static TextureLevels getLevels(const hannah::MappedTexture& texture) {
+	TextureLevels levels;
+	levels.format = texture.getFormat();
+	levels.srgb = texture.isSrgb();
+	levels.width = texture.getWidth();
+	levels.height = texture.getHeight();
+	levels.numLayers = texture.getNumLayers();
+	levels.numFaces = texture.getNumFaces();
+	for (int i = 0; i < texture.getNumLevels(); i++)
+	{
+		levels.data.push_back(texture.getLevelData(i));
+		levels.sizes.push_back(texture.getLevelSize(i));
+	}
+	return levels;
+}
+
+static int getTarget(const TextureLevels& levels) {
+	if (levels.numFaces == 6) {
+		return levels.numLayers > 0 ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP;
+	}
+	return levels.numLayers > 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+}
+
+//Allocates immutable storage and uploads every level from where it already is, with no copy on our side.
+//Arrays and cubemaps go up a whole level per call, their layers and faces are already in GL's layer-face order.
+//If mapped is set, level pages are prefetched before and released after their upload. Leaves the texture bound.
+static unsigned int uploadLevels(const TextureLevels& levels, const hannah::MappedTexture* mapped) {
+	int target = getTarget(levels);
+	bool uncompressed = levels.format == hannah::BlockFormat::RGBA8;
+	int internalFormat = uncompressed ? (levels.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8) : getCompressedFormat(levels.format, levels.srgb);
+	int numLevels = (int)levels.data.size();
+	int depth = (levels.numLayers > 0 ? levels.numLayers : 1) * levels.numFaces;
+	unsigned int handle;
+	glCreateTextures(target, 1, &handle);
+	if (target == GL_TEXTURE_2D || target == GL_TEXTURE_CUBE_MAP) {
+		glTextureStorage2D(handle, numLevels, internalFormat, levels.width, levels.height);
+	}
+	else {
+		glTextureStorage3D(handle, numLevels, internalFormat, levels.width, levels.height, depth);
+	}
+	//Files store the smallest level first, so going from the last level reads them front to back
+	for (int i = numLevels; i-- > 0;)
+	{
+		if (mapped != nullptr && i > 0) {
+			mapped->prefetchLevel(i - 1);
+		}
+		int width = levels.width >> i > 0 ? levels.width >> i : 1;
+		int height = levels.height >> i > 0 ? levels.height >> i : 1;
+		if (target == GL_TEXTURE_2D) {
+			if (uncompressed) {
+				glTextureSubImage2D(handle, i, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, levels.data[i]);
+			}
+			else {
+				glCompressedTextureSubImage2D(handle, i, 0, 0, width, height, internalFormat, levels.sizes[i], levels.data[i]);
+			}
+		}
+		else {
+			if (uncompressed) {
+				glTextureSubImage3D(handle, i, 0, 0, 0, width, height, depth, GL_RGBA, GL_UNSIGNED_BYTE, levels.data[i]);
+			}
+			else {
+				glCompressedTextureSubImage3D(handle, i, 0, 0, 0, width, height, depth, internalFormat, levels.sizes[i], levels.data[i]);
+			}
+		}
+		if (mapped != nullptr) {
+			mapped->releaseLevel(i);
+		}
+	}
+	glBindTexture(target, handle);
+	return handle;
+}
+
+static size_t getLevelBytes(const TextureLevels& levels) {
+	size_t bytes = 0;
+	for (size_t i = 0; i < levels.sizes.size(); i++)
+	{
+		bytes += levels.sizes[i];
+	}
+	return bytes;
+}
+
+static void fillInfo(const TextureLevels& levels, ew::TextureInfo* info) {
+	if (info == nullptr) {
+		return;
+	}
+	info->width = levels.width;
+	info->height = levels.height;
+	switch (levels.format) {
+	case hannah::BlockFormat::BC1:
+		info->numComponents = 3;
+		break;
+	case hannah::BlockFormat::BC5:
+		info->numComponents = 2;
+		break;
+	default:
+		info->numComponents = 4;
+		break;
+	}
+	info->bytes = getLevelBytes(levels);
+	info->target = getTarget(levels);
+}
+
+//Uploads the cached levels straight from the file if it is at least as new as the image. Otherwise decodes the image, builds every level,
+//rewrites the cache and uploads from memory. If only the cache exists it is used on its own. Leaves the texture bound.
+static unsigned int loadCachedTexture(const char* filePath, hannah::BlockFormat format, const hannah::MipSettings& mipSettings, ew::TextureInfo* info) {
+	std::string cachePath = getCachePath(filePath, format, mipSettings);
+	long long sourceTime = getModifiedTime(filePath);
+	long long cacheTime = getModifiedTime(cachePath.c_str());
+	if (cacheTime != 0 && cacheTime >= sourceTime) {
+		hannah::MappedTexture mapped;
+		if (mapped.open(cachePath.c_str()) && mapped.getFormat() == format && mapped.getNumLayers() == 0 && mapped.getNumFaces() == 1) {
+			TextureLevels levels = getLevels(mapped);
+			fillInfo(levels, info);
+			return uploadLevels(levels, &mapped);
+		}
+	}
+	int width, height, numComponents;
+	stbi_set_flip_vertically_on_load(true);
+	unsigned char* data = stbi_load(filePath, &width, &height, &numComponents, 4);
+	if (data == NULL) {
+		printf("Failed to load image %s", filePath);
+		return 0;
+	}
+	hannah::CompressionStats stats;
+	hannah::CompressedTexture texture = hannah::compressTexture(data, width, height, format, mipSettings, &stats);
+	stbi_image_free(data);
+	if (format != hannah::BlockFormat::RGBA8) {
+		printf("Compressed %s to %s: PSNR %.2f dB, %.1f MP/s\n", filePath, hannah::getFormatName(format), stats.psnr, stats.getMegapixelsPerSecond());
+	}
+	createCacheDirectory();
+	if (!hannah::writeKTX2(cachePath.c_str(), texture)) {
+		printf("Failed to write %s\n", cachePath.c_str());
+	}
+	TextureLevels levels = getLevels(texture);
+	fillInfo(levels, info);
+	return uploadLevels(levels, nullptr);
+}
+
 namespace ew {
-	unsigned int loadTexture(const char* filePath) {
+	TextureHandle loadTexture(const char* filePath) {
 		return loadTexture(filePath, GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, true);
 	}
-	unsigned int loadTexture(const char* filePath, int wrapMode, int magFilter, int minFilter, bool mipmap) {
-		int width, height, numComponents;
-
-		stbi_set_flip_vertically_on_load(true);
+	TextureHandle loadTexture(const char* filePath, int wrapMode, int magFilter, int minFilter, bool mipmap, TextureInfo* info) {
+		unsigned int texture;
+		//Mips are built on the CPU with gamma correct filtering and cached, so later runs only upload them
+		if (mipmap) {
+			hannah::MipSettings mipSettings = hannah::guessMipSettings(filePath);
+			mipSettings.wrap = wrapMode == GL_REPEAT;
+			texture = loadCachedTexture(filePath, hannah::BlockFormat::RGBA8, mipSettings, info);
+			if (texture == 0) {
+				return TextureHandle();
+			}
+		}
+		else {
+			int width, height, numComponents;
+			stbi_set_flip_vertically_on_load(true);
 
-		unsigned char* data = stbi_load(filePath, &width, &height, &numComponents, 0);
-		if (data == NULL) {
-			printf("Failed to load image %s", filePath);
+			unsigned char* data = stbi_load(filePath, &width, &height, &numComponents, 0);
+			if (data == NULL) {
+				printf("Failed to load image %s", filePath);
+				return TextureHandle();
+			}
+			glGenTextures(1, &texture);
+			glBindTexture(GL_TEXTURE_2D, texture);
+			int format = getTextureFormat(numComponents);
+			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 			stbi_image_free(data);
-			return 0;
+			if (info != nullptr) {
+				info->width = width;
+				info->height = height;
+				info->numComponents = numComponents;
+				info->bytes = (size_t)width * height * numComponents;
+				info->target = GL_TEXTURE_2D;
+			}
 		}
-		unsigned int texture;
-		glGenTextures(1, &texture);
-		glBindTexture(GL_TEXTURE_2D, texture);
-		int format = getTextureFormat(numComponents);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
@@ -47,13 +293,41 @@ namespace ew {
 		float borderColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
 		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
 
-		if (mipmap) {
-			glGenerateMipmap(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return TextureHandle(texture);
+	}
+	TextureHandle loadCompressedTexture(const char* filePath, hannah::BlockFormat format, TextureInfo* info) {
+		hannah::MipSettings mipSettings = hannah::guessMipSettings(filePath);
+		if (format == hannah::BlockFormat::BC5) {
+			mipSettings.content = hannah::MipContent::NORMAL_MAP;
 		}
-
+		unsigned int texture = loadCachedTexture(filePath, format, mipSettings, info);
+		if (texture == 0) {
+			return TextureHandle();
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glBindTexture(GL_TEXTURE_2D, 0);
-		stbi_image_free(data);
-		return texture;
+		return TextureHandle(texture);
+	}
+	TextureHandle loadMappedTexture(const char* filePath, TextureInfo* info) {
+		hannah::MappedTexture mapped;
+		if (!mapped.open(filePath)) {
+			printf("Failed to open %s\n", filePath);
+			return TextureHandle();
+		}
+		TextureLevels levels = getLevels(mapped);
+		int target = getTarget(levels);
+		unsigned int texture = uploadLevels(levels, &mapped);
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		//Immutable storage only samples the levels it has, so this is complete even without mips
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(target, 0);
+		fillInfo(levels, info);
+		return TextureHandle(texture);
 	}
 }
-
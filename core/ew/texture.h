@@ -3,8 +3,45 @@
 */
 
 #pragma once
+#include "gpuResource.h"
+#include <stddef.h>
+
+//Defined in hannah/textureCompression.h. Only declared here so code using ew doesn't depend on hannah, include that header to pass one.
+namespace hannah {
+	enum class BlockFormat;
+}
 
 namespace ew {
-	unsigned int loadTexture(const char* filePath);
-	unsigned int loadTexture(const char* filePath, int wrapMode, int magFilter, int minFilter, bool mipmap);
+	struct TextureInfo {
+		int width = 0;
+		int height = 0;
+		int numComponents = 0;
+		size_t bytes = 0; //Approximate GPU memory, including mips
+		int target = 0; //GL_TEXTURE_2D, or the array/cubemap target of a mapped texture
+	};
+
+	TextureHandle loadTexture(const char* filePath);
+	/// <summary>
+	/// With mipmap set, the chain is built on the CPU in linear light (or renormalized for normal maps, guessed from the file name)
+	/// and cached in the textureCache folder of the working directory, keyed by path, wrap mode and mip settings. The texture is then always RGBA.
+	/// </summary>
+	TextureHandle loadTexture(const char* filePath, int wrapMode, int magFilter, int minFilter, bool mipmap, TextureInfo* info = nullptr);
+
+	/// <summary>
+	/// Loads an image as a block compressed texture with its full mip chain, uploaded as is.
+	/// The first load compresses it and writes a .ktx2 to the textureCache folder like loadTexture, later loads map that and upload it directly.
+	/// The cache is rebuilt whenever the image is newer. If only the .ktx2 exists it is used on its own.
+	/// </summary>
+	/// <param name="filePath">Source image, anything stb_image reads</param>
+	/// <param name="format">BC1/BC3/BC7 for color, BC5 for normal maps</param>
+	/// <returns>Texture with repeat wrapping and trilinear filtering</returns>
+	TextureHandle loadCompressedTexture(const char* filePath, hannah::BlockFormat format, TextureInfo* info = nullptr);
+
+	/// <summary>
+	/// Loads a KTX2 file written by hannah::writeKTX2 (2D, array, cubemap or cubemap array) by mapping it into memory
+	/// and passing each level straight to GL, so nothing is decoded or copied on the heap.
+	/// Pages are dropped from the resident set as soon as their level is uploaded.
+	/// </summary>
+	/// <returns>Texture with repeat wrapping and trilinear filtering, bound to info->target</returns>
+	TextureHandle loadMappedTexture(const char* filePath, TextureInfo* info = nullptr);
 }
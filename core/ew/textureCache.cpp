@@ -0,0 +1,105 @@
+#include "textureCache.h"
+#include "external/glad.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifndef _WIN32
+#include <limits.h>
+#endif
+
+namespace {
+	//Absolute path with . and .. resolved, falls back to the path as given if the file doesn't exist
+	std::string canonicalPath(const std::string& filePath) {
+		std::string path;
+#ifdef _WIN32
+		char buffer[_MAX_PATH];
+		if (_fullpath(buffer, filePath.c_str(), _MAX_PATH) != NULL) {
+			path = buffer;
+		}
+#else
+		char buffer[PATH_MAX];
+		if (realpath(filePath.c_str(), buffer) != NULL) {
+			path = buffer;
+		}
+#endif
+		if (path.empty()) {
+			path = filePath;
+		}
+#ifdef _WIN32
+		//Windows paths are case insensitive and accept either slash
+		for (size_t i = 0; i < path.size(); i++)
+		{
+			path[i] = path[i] == '\\' ? '/' : (char)tolower((unsigned char)path[i]);
+		}
+#endif
+		return path;
+	}
+}
+
+namespace ew {
+	TextureCache& TextureCache::get()
+	{
+		static TextureCache cache;
+		return cache;
+	}
+
+	SharedTexture TextureCache::load(const std::string& filePath)
+	{
+		return load(filePath, GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, true);
+	}
+
+	SharedTexture TextureCache::load(const std::string& filePath, int wrapMode, int magFilter, int minFilter, bool mipmap)
+	{
+		char sampler[64];
+		snprintf(sampler, sizeof(sampler), "|%d|%d|%d|%d", wrapMode, magFilter, minFilter, mipmap ? 1 : 0);
+		std::string key = canonicalPath(filePath) + sampler;
+
+		m_requests++;
+		Entry& entry = m_entries[key];
+		SharedTexture texture = entry.texture.lock();
+		if (texture == nullptr) {
+			TextureInfo info;
+			TextureHandle handle = loadTexture(filePath.c_str(), wrapMode, magFilter, minFilter, mipmap, &info);
+			if (handle.get() == 0) {
+				//Failed loads aren't cached, so a missing file can be fixed without restarting
+				m_entries.erase(key);
+				return SharedTexture();
+			}
+			texture = std::make_shared<const TextureHandle>(std::move(handle));
+			entry.texture = texture;
+			entry.info = info;
+			m_uploads++;
+			m_uploadedBytes += info.bytes;
+		}
+		m_requestedBytes += entry.info.bytes;
+		return texture;
+	}
+
+	void TextureCache::prune()
+	{
+		for (auto it = m_entries.begin(); it != m_entries.end();)
+		{
+			if (it->second.texture.expired()) {
+				it = m_entries.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+	}
+
+	void TextureCache::printReport()
+	{
+		prune();
+		size_t liveBytes = 0;
+		for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+		{
+			liveBytes += it->second.info.bytes;
+		}
+		printf("Texture cache: %zu requests, %zu uploads, %zu textures alive (%.1f MB)\n", m_requests, m_uploads, m_entries.size(), liveBytes / (1024.0 * 1024.0));
+		printf("Texture cache: uploaded %.1f MB of %.1f MB requested, saved %.1f MB\n", m_uploadedBytes / (1024.0 * 1024.0), m_requestedBytes / (1024.0 * 1024.0), (m_requestedBytes - m_uploadedBytes) / (1024.0 * 1024.0));
+	}
+}
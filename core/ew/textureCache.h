@@ -0,0 +1,37 @@
+#pragma once
+#include "texture.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace ew {
+	//Shared ownership of a cached texture. The GL texture is released when the last copy goes away.
+	typedef std::shared_ptr<const TextureHandle> SharedTexture;
+
+	/// <summary>
+	/// Decodes and uploads each image once per sampler setup, no matter how many times it is requested.
+	/// Entries are keyed by canonical path, so "assets/a.png" and "./assets/../assets/a.png" share a texture.
+	/// The cache only holds weak references, textures live as long as someone holds their SharedTexture.
+	/// Uses GL, so call it from the render thread only.
+	/// </summary>
+	class TextureCache {
+	public:
+		static TextureCache& get();
+		SharedTexture load(const std::string& filePath);
+		SharedTexture load(const std::string& filePath, int wrapMode, int magFilter, int minFilter, bool mipmap);
+		//Prints requested vs unique textures and the upload memory the cache saved
+		void printReport();
+	private:
+		struct Entry {
+			std::weak_ptr<const TextureHandle> texture;
+			TextureInfo info;
+		};
+		void prune();
+
+		std::unordered_map<std::string, Entry> m_entries;
+		size_t m_requests = 0;
+		size_t m_uploads = 0;
+		size_t m_requestedBytes = 0; //What every request would have uploaded without the cache
+		size_t m_uploadedBytes = 0;
+	};
+}
@@ -1,4 +1,44 @@
 #include "framebuffer.h"
+#include <utility>
+
+hannah::Framebuffer::~Framebuffer()
+{
+	ew::deferDelete(ew::GpuResourceType::FRAMEBUFFER, fbo);
+	for (size_t i = 0; i < 8; i++)
+	{
+		ew::deferDelete(ew::GpuResourceType::TEXTURE, colorBuffer[i]);
+	}
+	ew::deferDelete(ew::GpuResourceType::TEXTURE, depthBuffer);
+	ew::deferDelete(ew::GpuResourceType::RENDERBUFFER, rbo);
+}
+
+hannah::Framebuffer::Framebuffer(Framebuffer&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+//Swapping hands our old objects to other, which releases them when it is destroyed
+hannah::Framebuffer& hannah::Framebuffer::operator=(Framebuffer&& other) noexcept
+{
+	std::swap(fbo, other.fbo);
+	std::swap(colorBuffer, other.colorBuffer);
+	std::swap(depthBuffer, other.depthBuffer);
+	std::swap(rbo, other.rbo);
+	std::swap(width, other.width);
+	std::swap(height, other.height);
+	return *this;
+}
+
+//Registers every object the framebuffer owns with the leak tracker
+static void trackFramebuffer(const hannah::Framebuffer& framebuffer) {
+	ew::trackGpuResource(ew::GpuResourceType::FRAMEBUFFER, framebuffer.fbo);
+	for (size_t i = 0; i < 8; i++)
+	{
+		ew::trackGpuResource(ew::GpuResourceType::TEXTURE, framebuffer.colorBuffer[i]);
+	}
+	ew::trackGpuResource(ew::GpuResourceType::TEXTURE, framebuffer.depthBuffer);
+	ew::trackGpuResource(ew::GpuResourceType::RENDERBUFFER, framebuffer.rbo);
+}
 
 hannah::Framebuffer hannah::createFramebufferWithRBO(unsigned int width, unsigned int height, int colorFormat)
 {
@@ -20,17 +60,17 @@ hannah::Framebuffer hannah::createFramebufferWithRBO(unsigned int width, unsigne
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fbo.colorBuffer[0], 0);
 
 	// for assignment 1
-	unsigned int rbo;
-	glGenRenderbuffers(1, &rbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+	glGenRenderbuffers(1, &fbo.rbo);
+	glBindRenderbuffer(GL_RENDERBUFFER, fbo.rbo);
 	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, fbo.rbo);
 	
 	GLenum fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
 	if (fboStatus != GL_FRAMEBUFFER_COMPLETE) {
 		printf("Framebuffer incomplete: %d", fboStatus);
 	}
 
+	trackFramebuffer(fbo);
 	return fbo;
 }
 
@@ -64,6 +104,7 @@ hannah::Framebuffer hannah::createFramebufferWithDepthBuffer(unsigned int width,
 		printf("Framebuffer incomplete: %d", fboStatus);
 	}
 
+	trackFramebuffer(fbo);
 	return fbo;
 }
 
@@ -100,6 +141,7 @@ hannah::Framebuffer hannah::createFramebufferWithShadowMap(unsigned int width, u
 		printf("Framebuffer incomplete: %d", fboStatus);
 	}
 
+	trackFramebuffer(shadowfbo);
 	return shadowfbo;
 }
 
@@ -153,5 +195,6 @@ hannah::Framebuffer hannah::createGBuffer(unsigned int width, unsigned int heigh
 	//Clean up global state
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	trackFramebuffer(framebuffer);
 	return framebuffer;
 }
\ No newline at end of file
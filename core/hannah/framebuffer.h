@@ -4,17 +4,28 @@
 #include <glm/glm.hpp>
 #include "external/stb_image.h"
 #include "external/glad.h"
+#include "../ew/gpuResource.h"
 
 namespace hannah {
+	//Owns its GL objects, so it can be moved but not copied
 	struct Framebuffer {
-		unsigned int fbo;
-		unsigned int colorBuffer[8];
-		unsigned int depthBuffer;
-		unsigned int width;
-		unsigned int height;
+		unsigned int fbo = 0;
+		unsigned int colorBuffer[8] = { 0 };
+		unsigned int depthBuffer = 0;
+		unsigned int rbo = 0;
+		unsigned int width = 0;
+		unsigned int height = 0;
+
+		Framebuffer() {};
+		~Framebuffer();
+		Framebuffer(Framebuffer&& other) noexcept;
+		Framebuffer& operator=(Framebuffer&& other) noexcept;
+		Framebuffer(const Framebuffer&) = delete;
+		Framebuffer& operator=(const Framebuffer&) = delete;
 	};
 	Framebuffer createFramebufferWithRBO(unsigned int width, unsigned int height, int colorFormat);
 	Framebuffer createFramebufferWithDepthBuffer(unsigned int width, unsigned int height, int colorFormat);
 	Framebuffer createFramebufferWithShadowMap(unsigned int width, unsigned int height, int colorFormat);
+	//Position RGB32F, normal RGB16F, albedo RGB16F, 16 bit depth. About 26 bytes per pixel.
 	Framebuffer createGBuffer(unsigned int width, unsigned int height);
 }
\ No newline at end of file
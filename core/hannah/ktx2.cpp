@@ -0,0 +1,353 @@
+#include "ktx2.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+namespace {
+	const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	const size_t KTX2_LEVEL_INDEX_OFFSET = 80;
+
+	unsigned int getVkFormat(hannah::BlockFormat format, bool srgb) {
+		switch (format) {
+		case hannah::BlockFormat::BC1:
+			return srgb ? 132 : 131; //VK_FORMAT_BC1_RGB_SRGB_BLOCK / UNORM
+		case hannah::BlockFormat::BC3:
+			return srgb ? 138 : 137;
+		case hannah::BlockFormat::BC5:
+			return 141; //No sRGB variant
+		case hannah::BlockFormat::BC7:
+			return srgb ? 146 : 145;
+		default:
+			return srgb ? 43 : 37; //VK_FORMAT_R8G8B8A8_SRGB / UNORM
+		}
+	}
+
+	bool fromVkFormat(unsigned int vkFormat, hannah::BlockFormat* format, bool* srgb) {
+		switch (vkFormat) {
+		case 131: case 132: case 133: case 134:
+			*format = hannah::BlockFormat::BC1;
+			*srgb = vkFormat == 132 || vkFormat == 134;
+			return true;
+		case 137: case 138:
+			*format = hannah::BlockFormat::BC3;
+			*srgb = vkFormat == 138;
+			return true;
+		case 141:
+			*format = hannah::BlockFormat::BC5;
+			*srgb = false;
+			return true;
+		case 145: case 146:
+			*format = hannah::BlockFormat::BC7;
+			*srgb = vkFormat == 146;
+			return true;
+		case 37: case 43:
+			*format = hannah::BlockFormat::RGBA8;
+			*srgb = vkFormat == 43;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	void putU8(std::vector<unsigned char>* data, unsigned int value) {
+		data->push_back((unsigned char)value);
+	}
+
+	void putU16(std::vector<unsigned char>* data, unsigned int value) {
+		putU8(data, value & 0xFF);
+		putU8(data, (value >> 8) & 0xFF);
+	}
+
+	void putU32(std::vector<unsigned char>* data, unsigned int value) {
+		putU16(data, value & 0xFFFF);
+		putU16(data, value >> 16);
+	}
+
+	void putU64(std::vector<unsigned char>* data, unsigned long long value) {
+		putU32(data, (unsigned int)(value & 0xFFFFFFFF));
+		putU32(data, (unsigned int)(value >> 32));
+	}
+
+	void setU64(std::vector<unsigned char>* data, size_t offset, unsigned long long value) {
+		for (int i = 0; i < 8; i++)
+		{
+			(*data)[offset + i] = (unsigned char)(value >> (i * 8));
+		}
+	}
+
+	unsigned long long getU(const unsigned char* data, size_t offset, int numBytes) {
+		unsigned long long value = 0;
+		for (int i = 0; i < numBytes; i++)
+		{
+			value |= (unsigned long long)data[offset + i] << (i * 8);
+		}
+		return value;
+	}
+
+	//Size of the alignment KTX2 requires for level data, the least common multiple of the texel block size and 4
+	size_t getLevelAlignment(hannah::BlockFormat format) {
+		return format == hannah::BlockFormat::RGBA8 ? 4 : hannah::getBlockBytes(format);
+	}
+
+	//Basic data format descriptor, one sample per channel, or per 64 bit half of a block that holds a separate channel
+	std::vector<unsigned char> buildDFD(const hannah::CompressedTexture& texture) {
+		struct Sample {
+			unsigned int bitOffset;
+			unsigned int bitLength;
+			unsigned int channelType;
+		};
+		const unsigned int LINEAR = 0x10; //Alpha isn't sRGB encoded even in sRGB formats
+		Sample samples[4];
+		unsigned int blockDimensions = 3 | (3 << 8); //4x4x1x1, stored minus one
+		unsigned int bytesPlane = hannah::getBlockBytes(texture.format);
+		unsigned int sampleUpper = 0xFFFFFFFF;
+		int numSamples = 1;
+		unsigned int colorModel;
+		switch (texture.format) {
+		case hannah::BlockFormat::BC1:
+			colorModel = 128; //KHR_DF_MODEL_BC1A
+			samples[0] = { 0, 64, 0 };
+			break;
+		case hannah::BlockFormat::BC3:
+			colorModel = 130;
+			samples[0] = { 0, 64, 15 | (texture.srgb ? LINEAR : 0) };
+			samples[1] = { 64, 64, 0 };
+			numSamples = 2;
+			break;
+		case hannah::BlockFormat::BC5:
+			colorModel = 132;
+			samples[0] = { 0, 64, 0 };
+			samples[1] = { 64, 64, 1 };
+			numSamples = 2;
+			break;
+		case hannah::BlockFormat::BC7:
+			colorModel = 134;
+			samples[0] = { 0, 128, 0 };
+			break;
+		default:
+			colorModel = 1; //KHR_DF_MODEL_RGBSDA
+			for (int c = 0; c < 4; c++)
+			{
+				samples[c] = { (unsigned int)c * 8, 8, c == 3 ? 15 | (texture.srgb ? LINEAR : 0) : (unsigned int)c };
+			}
+			numSamples = 4;
+			blockDimensions = 0;
+			bytesPlane = 4;
+			sampleUpper = 255;
+			break;
+		}
+		unsigned int blockSize = 24 + 16 * numSamples;
+		std::vector<unsigned char> dfd;
+		putU32(&dfd, 4 + blockSize);
+		putU32(&dfd, 0); //Khronos vendor, basic descriptor
+		putU16(&dfd, 2); //Version
+		putU16(&dfd, blockSize);
+		putU8(&dfd, colorModel);
+		putU8(&dfd, 1); //BT.709 primaries
+		putU8(&dfd, texture.srgb ? 2 : 1);
+		putU8(&dfd, 0); //Straight alpha
+		putU32(&dfd, blockDimensions);
+		putU32(&dfd, bytesPlane);
+		putU32(&dfd, 0);
+		for (int i = 0; i < numSamples; i++)
+		{
+			putU16(&dfd, samples[i].bitOffset);
+			putU8(&dfd, samples[i].bitLength - 1);
+			putU8(&dfd, samples[i].channelType);
+			putU32(&dfd, 0); //Sample position
+			putU32(&dfd, 0);
+			putU32(&dfd, sampleUpper);
+		}
+		return dfd;
+	}
+}
+
+bool hannah::writeKTX2(const char* filePath, const CompressedTexture& texture)
+{
+	size_t numLevels = texture.levels.size();
+	std::vector<unsigned char> dfd = buildDFD(texture);
+	std::vector<unsigned char> data(KTX2_IDENTIFIER, KTX2_IDENTIFIER + sizeof(KTX2_IDENTIFIER));
+	putU32(&data, getVkFormat(texture.format, texture.srgb));
+	putU32(&data, 1); //typeSize is 1 for block compressed and 8 bit formats
+	putU32(&data, texture.width);
+	putU32(&data, texture.height);
+	putU32(&data, 0); //Depth
+	putU32(&data, texture.numLayers);
+	putU32(&data, texture.numFaces);
+	putU32(&data, (unsigned int)numLevels);
+	putU32(&data, 0); //No supercompression
+	size_t dfdOffset = KTX2_LEVEL_INDEX_OFFSET + numLevels * 24;
+	putU32(&data, (unsigned int)dfdOffset);
+	putU32(&data, (unsigned int)dfd.size());
+	putU32(&data, 0); //No key/value data
+	putU32(&data, 0);
+	putU64(&data, 0); //No supercompression global data
+	putU64(&data, 0);
+	data.resize(dfdOffset);
+	data.insert(data.end(), dfd.begin(), dfd.end());
+
+	//Levels are stored smallest first, so a reader can stream in the coarse ones before the rest.
+	//Every image size is a multiple of 4 bytes, so cubemap faces need no padding between them.
+	size_t alignment = getLevelAlignment(texture.format);
+	for (size_t i = numLevels; i-- > 0;)
+	{
+		data.resize((data.size() + alignment - 1) / alignment * alignment);
+		size_t levelIndex = KTX2_LEVEL_INDEX_OFFSET + i * 24;
+		setU64(&data, levelIndex, data.size());
+		setU64(&data, levelIndex + 8, texture.levels[i].size());
+		setU64(&data, levelIndex + 16, texture.levels[i].size());
+		data.insert(data.end(), texture.levels[i].begin(), texture.levels[i].end());
+	}
+
+	FILE* file = fopen(filePath, "wb");
+	if (file == NULL) {
+		return false;
+	}
+	bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+	fclose(file);
+	return written;
+}
+
+bool hannah::readKTX2(const char* filePath, CompressedTexture* texture)
+{
+	MappedTexture mapped;
+	if (!mapped.open(filePath)) {
+		return false;
+	}
+	CompressedTexture result;
+	result.format = mapped.getFormat();
+	result.srgb = mapped.isSrgb();
+	result.width = mapped.getWidth();
+	result.height = mapped.getHeight();
+	result.numLayers = mapped.getNumLayers();
+	result.numFaces = mapped.getNumFaces();
+	result.levels.resize(mapped.getNumLevels());
+	for (int i = 0; i < mapped.getNumLevels(); i++)
+	{
+		const unsigned char* level = mapped.getLevelData(i);
+		result.levels[i].assign(level, level + mapped.getLevelSize(i));
+	}
+	*texture = std::move(result);
+	return true;
+}
+
+hannah::CompressedTexture hannah::stackTextures(const std::vector<CompressedTexture>& textures, bool cubemap)
+{
+	CompressedTexture result;
+	if (textures.empty() || (cubemap && textures.size() % 6 != 0)) {
+		printf("Stacking needs at least one texture, and a multiple of 6 for cubemaps\n");
+		return result;
+	}
+	const CompressedTexture& first = textures[0];
+	for (const CompressedTexture& texture : textures)
+	{
+		if (texture.format != first.format || texture.srgb != first.srgb || texture.width != first.width || texture.height != first.height
+			|| texture.levels.size() != first.levels.size() || texture.getNumImages() != 1) {
+			printf("Stacked textures must be single images with the same format, size and number of levels\n");
+			return result;
+		}
+	}
+	if (cubemap && first.width != first.height) {
+		printf("Cubemap faces must be square\n");
+		return result;
+	}
+	result.format = first.format;
+	result.srgb = first.srgb;
+	result.width = first.width;
+	result.height = first.height;
+	result.numFaces = cubemap ? 6 : 1;
+	int numLayers = (int)textures.size() / result.numFaces;
+	result.numLayers = numLayers > 1 ? numLayers : 0;
+	result.levels.resize(first.levels.size());
+	for (size_t i = 0; i < result.levels.size(); i++)
+	{
+		result.levels[i].reserve(first.levels[i].size() * textures.size());
+		for (const CompressedTexture& texture : textures)
+		{
+			result.levels[i].insert(result.levels[i].end(), texture.levels[i].begin(), texture.levels[i].end());
+		}
+	}
+	return result;
+}
+
+bool hannah::MappedTexture::open(const char* filePath)
+{
+	close();
+	if (!m_file.open(filePath)) {
+		return false;
+	}
+	const unsigned char* data = m_file.getData();
+	size_t size = m_file.getSize();
+	if (size < KTX2_LEVEL_INDEX_OFFSET || memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+		printf("%s is not a KTX2 file\n", filePath);
+		close();
+		return false;
+	}
+	unsigned int vkFormat = (unsigned int)getU(data, 12, 4);
+	m_width = (int)getU(data, 20, 4);
+	m_height = (int)getU(data, 24, 4);
+	unsigned int depth = (unsigned int)getU(data, 28, 4);
+	m_numLayers = (int)getU(data, 32, 4);
+	m_numFaces = (int)getU(data, 36, 4);
+	size_t numLevels = std::max((size_t)getU(data, 40, 4), (size_t)1);
+	unsigned int supercompression = (unsigned int)getU(data, 44, 4);
+	if (!fromVkFormat(vkFormat, &m_format, &m_srgb) || depth > 1 || (m_numFaces != 1 && m_numFaces != 6) || supercompression != 0) {
+		printf("%s: only uncompressed BC1/BC3/BC5/BC7/RGBA8 2D, array and cubemap KTX2 files are supported\n", filePath);
+		close();
+		return false;
+	}
+	if (size < KTX2_LEVEL_INDEX_OFFSET + numLevels * 24) {
+		printf("%s is truncated\n", filePath);
+		close();
+		return false;
+	}
+	int numImages = std::max(m_numLayers, 1) * m_numFaces;
+	m_levels.resize(numLevels);
+	for (size_t i = 0; i < numLevels; i++)
+	{
+		size_t levelIndex = KTX2_LEVEL_INDEX_OFFSET + i * 24;
+		unsigned long long offset = getU(data, levelIndex, 8);
+		unsigned long long length = getU(data, levelIndex + 8, 8);
+		int levelWidth = std::max(m_width >> i, 1);
+		int levelHeight = std::max(m_height >> i, 1);
+		if (length != getCompressedSize(levelWidth, levelHeight, m_format) * numImages || offset + length > size) {
+			printf("%s: level %zu is truncated\n", filePath, i);
+			close();
+			return false;
+		}
+		m_levels[i].offset = (size_t)offset;
+		m_levels[i].size = (size_t)length;
+	}
+	return true;
+}
+
+void hannah::MappedTexture::close()
+{
+	m_file.close();
+	m_levels.clear();
+	m_width = 0;
+	m_height = 0;
+	m_numLayers = 0;
+	m_numFaces = 1;
+}
+
+const unsigned char* hannah::MappedTexture::getImage(int level, int layer, int face)const
+{
+	return getLevelData(level) + (size_t)(layer * m_numFaces + face) * getImageSize(level);
+}
+
+size_t hannah::MappedTexture::getImageSize(int level)const
+{
+	return m_levels[level].size / ((size_t)std::max(m_numLayers, 1) * m_numFaces);
+}
+
+void hannah::MappedTexture::prefetchLevel(int level)const
+{
+	m_file.prefetch(m_levels[level].offset, m_levels[level].size);
+}
+
+void hannah::MappedTexture::releaseLevel(int level)const
+{
+	m_file.release(m_levels[level].offset, m_levels[level].size);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "textureCompression.h"
+#include "../ew/mappedFile.h"
+
+namespace hannah {
+	//KTX2 container without supercompression, with the basic data format descriptor other tools expect
+	bool writeKTX2(const char* filePath, const CompressedTexture& texture);
+	//Only reads the formats above. Copies every level onto the heap, MappedTexture uploads straight from the file instead.
+	bool readKTX2(const char* filePath, CompressedTexture* texture);
+	//Combines single textures of the same format and size into an array, or a cubemap (array) from groups of 6 faces.
+	//Returns a texture without levels if they don't match.
+	CompressedTexture stackTextures(const std::vector<CompressedTexture>& textures, bool cubemap);
+
+	//KTX2 file mapped into memory. Level data stays in the mapping, aligned as KTX2 requires, so it can be handed to GL without a copy.
+	class MappedTexture {
+	public:
+		//Checks the header and level index. Level data isn't touched until it is read.
+		bool open(const char* filePath);
+		void close();
+		inline bool isOpen()const { return m_file.isOpen(); }
+		inline BlockFormat getFormat()const { return m_format; }
+		inline bool isSrgb()const { return m_srgb; }
+		inline int getWidth()const { return m_width; }
+		inline int getHeight()const { return m_height; }
+		inline int getNumLayers()const { return m_numLayers; }
+		inline int getNumFaces()const { return m_numFaces; }
+		inline int getNumLevels()const { return (int)m_levels.size(); }
+		//Every layer and face of a level, laid out as in CompressedTexture
+		inline const unsigned char* getLevelData(int level)const { return m_file.getData() + m_levels[level].offset; }
+		inline size_t getLevelSize(int level)const { return m_levels[level].size; }
+		const unsigned char* getImage(int level, int layer, int face)const;
+		size_t getImageSize(int level)const;
+		//Starts reading a level from disk ahead of use
+		void prefetchLevel(int level)const;
+		//Lets the OS drop a level's pages once it has been uploaded, so loading large sets doesn't grow the resident set
+		void releaseLevel(int level)const;
+	private:
+		struct Level {
+			size_t offset = 0;
+			size_t size = 0;
+		};
+		ew::MappedFile m_file;
+		std::vector<Level> m_levels;
+		BlockFormat m_format = BlockFormat::BC1;
+		bool m_srgb = false;
+		int m_width = 0;
+		int m_height = 0;
+		int m_numLayers = 0;
+		int m_numFaces = 1;
+	};
+}
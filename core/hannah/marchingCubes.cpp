@@ -0,0 +1,336 @@
+#include "marchingCubes.h"
+#include "../ew/jobSystem.h"
+
+#include <math.h>
+#include <algorithm>
+
+namespace {
+	const int MAX_CASE_TRIANGLES = 10;
+
+	//Corner c of a cell sits at (c & 1, (c >> 1) & 1, (c >> 2) & 1). Edges are numbered axis * 4 + k.
+	struct CaseTable {
+		int edgeCorners[12][2];
+		unsigned char numTriangles[256];
+		signed char triangles[256][MAX_CASE_TRIANGLES * 3];
+	};
+
+	int edgeBetween(const CaseTable& table, int a, int b) {
+		for (int e = 0; e < 12; e++)
+		{
+			if ((table.edgeCorners[e][0] == a && table.edgeCorners[e][1] == b) || (table.edgeCorners[e][0] == b && table.edgeCorners[e][1] == a)) {
+				return e;
+			}
+		}
+		return -1;
+	}
+
+	//Builds the triangle table instead of hard coding it. Each cube face contributes segments between its cut edges,
+	//and the segments link up into closed loops that are fanned into triangles.
+	//On ambiguous faces the inside corners are kept apart, which neighbouring cells agree on since they see the same face.
+	CaseTable buildCaseTable() {
+		CaseTable table;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			int k = 0;
+			for (int c = 0; c < 8; c++)
+			{
+				if ((c >> axis) & 1) {
+					continue;
+				}
+				table.edgeCorners[axis * 4 + k][0] = c;
+				table.edgeCorners[axis * 4 + k][1] = c | (1 << axis);
+				k++;
+			}
+		}
+
+		//Face corners counter clockwise seen from outside the cell
+		int faces[6][4];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			int u = (axis + 1) % 3;
+			int v = (axis + 2) % 3;
+			for (int side = 0; side < 2; side++)
+			{
+				int* face = faces[axis * 2 + side];
+				const int cycle[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+				for (int i = 0; i < 4; i++)
+				{
+					//u x v points along +axis, so the low side runs the other way
+					int j = side == 1 ? i : 3 - i;
+					face[i] = (side << axis) | (cycle[j][0] << u) | (cycle[j][1] << v);
+				}
+			}
+		}
+
+		for (int mask = 0; mask < 256; mask++)
+		{
+			//Segment on some face from the edge where it enters the inside region to the edge where it leaves
+			int next[12];
+			std::fill(next, next + 12, -1);
+			for (int f = 0; f < 6; f++)
+			{
+				int edges[4];
+				bool entering[4];
+				int numCuts = 0;
+				for (int i = 0; i < 4; i++)
+				{
+					int a = faces[f][i];
+					int b = faces[f][(i + 1) % 4];
+					bool insideA = (mask >> a) & 1;
+					bool insideB = (mask >> b) & 1;
+					if (insideA != insideB) {
+						edges[numCuts] = edgeBetween(table, a, b);
+						entering[numCuts] = insideB;
+						numCuts++;
+					}
+				}
+				for (int i = 0; i < numCuts; i++)
+				{
+					if (!entering[i]) {
+						continue;
+					}
+					for (int j = 1; j < numCuts; j++)
+					{
+						int exit = (i + j) % numCuts;
+						if (!entering[exit]) {
+							next[edges[i]] = edges[exit];
+							break;
+						}
+					}
+				}
+			}
+
+			table.numTriangles[mask] = 0;
+			bool visited[12] = { false };
+			for (int start = 0; start < 12; start++)
+			{
+				if (next[start] < 0 || visited[start]) {
+					continue;
+				}
+				int loop[12];
+				int loopSize = 0;
+				for (int e = start; !visited[e]; e = next[e])
+				{
+					visited[e] = true;
+					loop[loopSize++] = e;
+				}
+				for (int i = 1; i + 1 < loopSize; i++)
+				{
+					signed char* triangle = &table.triangles[mask][table.numTriangles[mask] * 3];
+					//Loops run counter clockwise around the outward normal
+					triangle[0] = loop[0];
+					triangle[1] = loop[i];
+					triangle[2] = loop[i + 1];
+					table.numTriangles[mask]++;
+				}
+			}
+		}
+		return table;
+	}
+
+	const CaseTable& getCaseTable() {
+		static CaseTable table = buildCaseTable();
+		return table;
+	}
+
+	//Samples flipped so inside is always below the iso level
+	struct SignedVolume {
+		const hannah::VolumeGrid* volume;
+		float sign;
+		inline float at(int x, int y, int z)const { return volume->at(x, y, z) * sign; }
+		inline glm::vec3 gradient(int x, int y, int z)const {
+			glm::ivec3 size = volume->size;
+			int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, size.x - 1);
+			int y0 = std::max(y - 1, 0), y1 = std::min(y + 1, size.y - 1);
+			int z0 = std::max(z - 1, 0), z1 = std::min(z + 1, size.z - 1);
+			return glm::vec3(
+				(at(x1, y, z) - at(x0, y, z)) / std::max(x1 - x0, 1),
+				(at(x, y1, z) - at(x, y0, z)) / std::max(y1 - y0, 1),
+				(at(x, y, z1) - at(x, y, z0)) / std::max(z1 - z0, 1));
+		}
+	};
+
+	void meshChunk(const hannah::VolumeGrid& volume, const hannah::IsoSettings& settings, glm::ivec3 cellMin, glm::ivec3 cellMax, ew::MeshData* out) {
+		const CaseTable& table = getCaseTable();
+		SignedVolume field = { &volume, settings.insideAbove ? -1.0f : 1.0f };
+		float iso = settings.isoLevel * field.sign;
+		out->vertices.clear();
+		out->indices.clear();
+
+		//One cached vertex per grid point and axis, so cells in this chunk share their edge vertices
+		int pointsX = cellMax.x - cellMin.x + 1;
+		int pointsY = cellMax.y - cellMin.y + 1;
+		int pointsZ = cellMax.z - cellMin.z + 1;
+		thread_local std::vector<int> edgeCache;
+		edgeCache.assign((size_t)pointsX * pointsY * pointsZ * 3, -1);
+
+		//Sample offsets of the 8 corners from corner 0
+		size_t strideY = volume.size.x;
+		size_t strideZ = (size_t)volume.size.x * volume.size.y;
+		size_t cornerOffsets[8];
+		for (int c = 0; c < 8; c++)
+		{
+			cornerOffsets[c] = (c & 1) + ((c >> 1) & 1) * strideY + ((c >> 2) & 1) * strideZ;
+		}
+		const float* samples = volume.values.data();
+
+		for (int z = cellMin.z; z < cellMax.z; z++)
+		{
+			for (int y = cellMin.y; y < cellMax.y; y++)
+			{
+				const float* row = samples + z * strideZ + y * strideY;
+				for (int x = cellMin.x; x < cellMax.x; x++)
+				{
+					float values[8];
+					int mask = 0;
+					for (int c = 0; c < 8; c++)
+					{
+						values[c] = row[x + cornerOffsets[c]] * field.sign;
+						mask |= (values[c] < iso) << c;
+					}
+					if (mask == 0 || mask == 255) {
+						continue;
+					}
+					for (int i = 0; i < table.numTriangles[mask] * 3; i++)
+					{
+						int edge = table.triangles[mask][i];
+						int axis = edge / 4;
+						int corner = table.edgeCorners[edge][0];
+						int px = x + (corner & 1);
+						int py = y + ((corner >> 1) & 1);
+						int pz = z + ((corner >> 2) & 1);
+						int& cached = edgeCache[((((size_t)(pz - cellMin.z) * pointsY) + (py - cellMin.y)) * pointsX + (px - cellMin.x)) * 3 + axis];
+						if (cached < 0) {
+							float va = values[corner];
+							float vb = values[table.edgeCorners[edge][1]];
+							float t = (iso - va) / (vb - va);
+							glm::vec3 point = glm::vec3(px, py, pz);
+							glm::ivec3 step = glm::ivec3(axis == 0, axis == 1, axis == 2);
+							glm::vec3 gradient = glm::mix(field.gradient(px, py, pz), field.gradient(px + step.x, py + step.y, pz + step.z), t);
+							point[axis] += t;
+
+							ew::Vertex vertex;
+							vertex.pos = volume.origin + point * volume.spacing;
+							vertex.normal = glm::length(gradient) > 0.0f ? glm::normalize(gradient) : glm::vec3(0, 1, 0);
+							vertex.uv = glm::vec2(0.0f);
+							//No UVs to follow, so any direction perpendicular to the normal will do
+							glm::vec3 reference = fabsf(vertex.normal.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+							vertex.tangent = glm::vec4(glm::normalize(glm::cross(reference, vertex.normal)), 1.0f);
+							cached = out->vertices.size();
+							out->vertices.push_back(vertex);
+						}
+						out->indices.push_back(cached);
+					}
+				}
+			}
+		}
+	}
+
+	//Concatenates chunk meshes, offsetting each chunk's indices past the vertices before it
+	void mergeChunks(const std::vector<const ew::MeshData*>& chunks, ew::MeshData* out) {
+		std::vector<size_t> vertexOffsets(chunks.size() + 1, 0);
+		std::vector<size_t> indexOffsets(chunks.size() + 1, 0);
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			vertexOffsets[i + 1] = vertexOffsets[i] + chunks[i]->vertices.size();
+			indexOffsets[i + 1] = indexOffsets[i] + chunks[i]->indices.size();
+		}
+		out->vertices.resize(vertexOffsets.back());
+		out->indices.resize(indexOffsets.back());
+		ew::parallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				std::copy(chunks[i]->vertices.begin(), chunks[i]->vertices.end(), out->vertices.begin() + vertexOffsets[i]);
+				unsigned int* indices = &out->indices[indexOffsets[i]];
+				for (size_t j = 0; j < chunks[i]->indices.size(); j++)
+				{
+					indices[j] = chunks[i]->indices[j] + (unsigned int)vertexOffsets[i];
+				}
+			}
+		});
+	}
+}
+
+hannah::IsoSurface::IsoSurface(const VolumeGrid* volume, const IsoSettings& settings)
+{
+	m_volume = volume;
+	m_settings = settings;
+	m_settings.chunkCells = std::max(m_settings.chunkCells, 1);
+	glm::ivec3 cells = glm::ivec3(std::max(volume->size.x - 1, 0), std::max(volume->size.y - 1, 0), std::max(volume->size.z - 1, 0));
+	int c = m_settings.chunkCells;
+	m_numChunks = glm::ivec3((cells.x + c - 1) / c, (cells.y + c - 1) / c, (cells.z + c - 1) / c);
+	m_chunks.resize((size_t)m_numChunks.x * m_numChunks.y * m_numChunks.z);
+}
+
+void hannah::IsoSurface::markDirty(glm::ivec3 minSample, glm::ivec3 maxSample)
+{
+	//Cells touching a sample, widened by one more for the gradient
+	int c = m_settings.chunkCells;
+	glm::ivec3 minChunk, maxChunk;
+	for (int i = 0; i < 3; i++)
+	{
+		minChunk[i] = std::max((minSample[i] - 2) / c, 0);
+		maxChunk[i] = std::min(std::max(maxSample[i] + 1, 0) / c, m_numChunks[i] - 1);
+	}
+	for (int z = minChunk.z; z <= maxChunk.z; z++)
+	{
+		for (int y = minChunk.y; y <= maxChunk.y; y++)
+		{
+			for (int x = minChunk.x; x <= maxChunk.x; x++)
+			{
+				m_chunks[((size_t)z * m_numChunks.y + y) * m_numChunks.x + x].dirty = true;
+			}
+		}
+	}
+}
+
+void hannah::IsoSurface::markAllDirty()
+{
+	for (size_t i = 0; i < m_chunks.size(); i++)
+	{
+		m_chunks[i].dirty = true;
+	}
+}
+
+bool hannah::IsoSurface::update()
+{
+	std::vector<size_t> dirty;
+	for (size_t i = 0; i < m_chunks.size(); i++)
+	{
+		if (m_chunks[i].dirty) {
+			dirty.push_back(i);
+		}
+	}
+	if (dirty.empty()) {
+		return false;
+	}
+
+	int c = m_settings.chunkCells;
+	glm::ivec3 cells = m_volume->size - glm::ivec3(1);
+	ew::parallelFor(dirty.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			size_t index = dirty[i];
+			glm::ivec3 chunk = glm::ivec3(index % m_numChunks.x, (index / m_numChunks.x) % m_numChunks.y, index / ((size_t)m_numChunks.x * m_numChunks.y));
+			glm::ivec3 cellMin = chunk * c;
+			glm::ivec3 cellMax = glm::ivec3(std::min(cellMin.x + c, cells.x), std::min(cellMin.y + c, cells.y), std::min(cellMin.z + c, cells.z));
+			meshChunk(*m_volume, m_settings, cellMin, cellMax, &m_chunks[index].meshData);
+			m_chunks[index].dirty = false;
+		}
+	});
+
+	std::vector<const ew::MeshData*> chunks(m_chunks.size());
+	for (size_t i = 0; i < m_chunks.size(); i++)
+	{
+		chunks[i] = &m_chunks[i].meshData;
+	}
+	mergeChunks(chunks, &m_meshData);
+	return true;
+}
+
+ew::MeshData hannah::marchingCubes(const VolumeGrid& volume, const IsoSettings& settings)
+{
+	IsoSurface surface(&volume, settings);
+	surface.update();
+	return surface.getMeshData();
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+#include "../ew/mesh.h"
+
+namespace hannah {
+	//Scalar field sampled on a regular grid
+	struct VolumeGrid {
+		glm::ivec3 size = glm::ivec3(0); //Samples along each axis
+		glm::vec3 origin = glm::vec3(0.0f); //World position of sample (0, 0, 0)
+		float spacing = 1.0f; //World distance between samples
+		std::vector<float> values; //x fastest, then y, then z
+		inline float at(int x, int y, int z)const { return values[((size_t)z * size.y + y) * size.x + x]; }
+	};
+
+	struct IsoSettings {
+		float isoLevel = 0.0f;
+		bool insideAbove = false; //False for signed distance (negative inside), true for density (high inside)
+		int chunkCells = 32; //Cells along each chunk edge, chunks are meshed in parallel
+	};
+
+	//Meshes the whole volume once. Normals come from the field gradient and point out of the surface.
+	ew::MeshData marchingCubes(const VolumeGrid& volume, const IsoSettings& settings);
+
+	//Keeps one mesh per chunk so edits only remesh the chunks they touch
+	class IsoSurface {
+	public:
+		IsoSurface(const VolumeGrid* volume, const IsoSettings& settings);
+		//Call after changing samples in [minSample, maxSample], inclusive
+		void markDirty(glm::ivec3 minSample, glm::ivec3 maxSample);
+		void markAllDirty();
+		//Remeshes dirty chunks in parallel and rebuilds the merged mesh. Returns false if nothing was dirty.
+		bool update();
+		inline const ew::MeshData& getMeshData()const { return m_meshData; }
+	private:
+		struct Chunk {
+			ew::MeshData meshData;
+			bool dirty = true;
+		};
+		const VolumeGrid* m_volume;
+		IsoSettings m_settings;
+		glm::ivec3 m_numChunks;
+		std::vector<Chunk> m_chunks;
+		ew::MeshData m_meshData;
+	};
+}
@@ -0,0 +1,316 @@
+#include "meshArena.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include "external/glad.h"
+#include "../ew/gpuResource.h"
+
+hannah::FreeListAllocator::FreeListAllocator(unsigned int capacity)
+{
+	reset(capacity);
+}
+
+//Frees everything
+void hannah::FreeListAllocator::reset(unsigned int capacity)
+{
+	m_capacity = capacity;
+	m_used = 0;
+	m_freeBlocks.clear();
+	if (capacity > 0) {
+		m_freeBlocks.push_back({ 0, capacity });
+	}
+}
+
+bool hannah::FreeListAllocator::allocate(unsigned int size, unsigned int* offset)
+{
+	if (size == 0) {
+		*offset = 0;
+		return true;
+	}
+	//First fit
+	for (size_t i = 0; i < m_freeBlocks.size(); i++)
+	{
+		ArenaBlock& block = m_freeBlocks[i];
+		if (block.size < size) {
+			continue;
+		}
+		*offset = block.offset;
+		block.offset += size;
+		block.size -= size;
+		if (block.size == 0) {
+			m_freeBlocks.erase(m_freeBlocks.begin() + i);
+		}
+		m_used += size;
+		return true;
+	}
+	return false;
+}
+
+void hannah::FreeListAllocator::free(unsigned int offset, unsigned int size)
+{
+	if (size == 0) {
+		return;
+	}
+	m_used -= size;
+
+	//Keep the list sorted so neighbours can be merged
+	std::vector<ArenaBlock>::iterator next = std::lower_bound(m_freeBlocks.begin(), m_freeBlocks.end(), offset,
+		[](const ArenaBlock& block, unsigned int offset) { return block.offset < offset; });
+	std::vector<ArenaBlock>::iterator it = m_freeBlocks.insert(next, { offset, size });
+
+	//Merge with following block
+	std::vector<ArenaBlock>::iterator after = it + 1;
+	if (after != m_freeBlocks.end() && it->offset + it->size == after->offset) {
+		it->size += after->size;
+		it = m_freeBlocks.erase(after) - 1;
+	}
+	//Merge with preceding block
+	if (it != m_freeBlocks.begin()) {
+		std::vector<ArenaBlock>::iterator before = it - 1;
+		if (before->offset + before->size == it->offset) {
+			before->size += it->size;
+			m_freeBlocks.erase(it);
+		}
+	}
+}
+
+unsigned int hannah::FreeListAllocator::getLargestFreeBlock() const
+{
+	unsigned int largest = 0;
+	for (size_t i = 0; i < m_freeBlocks.size(); i++)
+	{
+		largest = std::max(largest, m_freeBlocks[i].size);
+	}
+	return largest;
+}
+
+hannah::DrawList::DrawList()
+{
+	glCreateBuffers(1, &m_commandBuffer);
+	glCreateBuffers(1, &m_transformBuffer);
+	ew::trackGpuResource(ew::GpuResourceType::BUFFER, m_commandBuffer);
+	ew::trackGpuResource(ew::GpuResourceType::BUFFER, m_transformBuffer);
+}
+
+hannah::DrawList::~DrawList()
+{
+	ew::deferDelete(ew::GpuResourceType::BUFFER, m_commandBuffer);
+	ew::deferDelete(ew::GpuResourceType::BUFFER, m_transformBuffer);
+}
+
+void hannah::DrawList::clear()
+{
+	m_meshes.clear();
+	m_transforms.clear();
+}
+
+void hannah::DrawList::add(int mesh, const glm::mat4& model)
+{
+	m_meshes.push_back(mesh);
+	m_transforms.push_back(model);
+}
+
+hannah::MeshArena::MeshArena(unsigned int maxVertices, unsigned int maxIndices)
+	: m_vertexAllocator(maxVertices), m_indexAllocator(maxIndices)
+{
+	createBuffers(&m_vbo, &m_ebo);
+
+	glCreateVertexArrays(1, &m_vao);
+	ew::trackGpuResource(ew::GpuResourceType::VERTEX_ARRAY, m_vao);
+	glVertexArrayVertexBuffer(m_vao, 0, m_vbo, 0, sizeof(ew::Vertex));
+	glVertexArrayElementBuffer(m_vao, m_ebo);
+
+	//Same layout as ew::Mesh
+	//Position attribute
+	glVertexArrayAttribFormat(m_vao, 0, 3, GL_FLOAT, GL_FALSE, offsetof(ew::Vertex, pos));
+	//Normal attribute
+	glVertexArrayAttribFormat(m_vao, 1, 3, GL_FLOAT, GL_FALSE, offsetof(ew::Vertex, normal));
+	//UV attribute
+	glVertexArrayAttribFormat(m_vao, 2, 2, GL_FLOAT, GL_FALSE, offsetof(ew::Vertex, uv));
+	//Tangent attribute
+	glVertexArrayAttribFormat(m_vao, 3, 4, GL_FLOAT, GL_FALSE, offsetof(ew::Vertex, tangent));
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		glVertexArrayAttribBinding(m_vao, i, 0);
+		glEnableVertexArrayAttrib(m_vao, i);
+	}
+
+	//Per draw model matrix, one vec4 column per location. Buffer is bound per draw list.
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		glVertexArrayAttribFormat(m_vao, 4 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4) * i);
+		glVertexArrayAttribBinding(m_vao, 4 + i, 1);
+		glEnableVertexArrayAttrib(m_vao, 4 + i);
+	}
+	glVertexArrayBindingDivisor(m_vao, 1, 1);
+}
+
+hannah::MeshArena::~MeshArena()
+{
+	ew::deferDelete(ew::GpuResourceType::VERTEX_ARRAY, m_vao);
+	ew::deferDelete(ew::GpuResourceType::BUFFER, m_vbo);
+	ew::deferDelete(ew::GpuResourceType::BUFFER, m_ebo);
+}
+
+void hannah::MeshArena::createBuffers(unsigned int* vbo, unsigned int* ebo) const
+{
+	glCreateBuffers(1, vbo);
+	glNamedBufferStorage(*vbo, sizeof(ew::Vertex) * m_vertexAllocator.getCapacity(), NULL, GL_DYNAMIC_STORAGE_BIT);
+	glCreateBuffers(1, ebo);
+	glNamedBufferStorage(*ebo, sizeof(unsigned int) * m_indexAllocator.getCapacity(), NULL, GL_DYNAMIC_STORAGE_BIT);
+	ew::trackGpuResource(ew::GpuResourceType::BUFFER, *vbo);
+	ew::trackGpuResource(ew::GpuResourceType::BUFFER, *ebo);
+}
+
+int hannah::MeshArena::add(const ew::MeshData& meshData)
+{
+	unsigned int numVertices = meshData.vertices.size();
+	unsigned int numIndices = meshData.indices.size();
+
+	//Enough space in total but not in one block, so compact first
+	if ((m_vertexAllocator.getLargestFreeBlock() < numVertices && m_vertexAllocator.getCapacity() - m_vertexAllocator.getUsed() >= numVertices) ||
+		(m_indexAllocator.getLargestFreeBlock() < numIndices && m_indexAllocator.getCapacity() - m_indexAllocator.getUsed() >= numIndices)) {
+		defragment();
+	}
+
+	ArenaMesh mesh;
+	if (!m_vertexAllocator.allocate(numVertices, &mesh.vertices.offset)) {
+		printf("Mesh arena out of vertex space (%u requested)\n", numVertices);
+		return -1;
+	}
+	if (!m_indexAllocator.allocate(numIndices, &mesh.indices.offset)) {
+		printf("Mesh arena out of index space (%u requested)\n", numIndices);
+		m_vertexAllocator.free(mesh.vertices.offset, numVertices);
+		return -1;
+	}
+	mesh.vertices.size = numVertices;
+	mesh.indices.size = numIndices;
+	mesh.alive = true;
+
+	if (numVertices > 0) {
+		glNamedBufferSubData(m_vbo, sizeof(ew::Vertex) * mesh.vertices.offset, sizeof(ew::Vertex) * numVertices, meshData.vertices.data());
+	}
+	if (numIndices > 0) {
+		glNamedBufferSubData(m_ebo, sizeof(unsigned int) * mesh.indices.offset, sizeof(unsigned int) * numIndices, meshData.indices.data());
+	}
+
+	//Reuse ids of removed meshes
+	int id;
+	if (!m_freeMeshIds.empty()) {
+		id = m_freeMeshIds.back();
+		m_freeMeshIds.pop_back();
+		m_meshes[id] = mesh;
+	}
+	else {
+		id = m_meshes.size();
+		m_meshes.push_back(mesh);
+	}
+	return id;
+}
+
+void hannah::MeshArena::remove(int mesh)
+{
+	if (mesh < 0 || mesh >= (int)m_meshes.size() || !m_meshes[mesh].alive) {
+		return;
+	}
+	ArenaMesh& arenaMesh = m_meshes[mesh];
+	m_vertexAllocator.free(arenaMesh.vertices.offset, arenaMesh.vertices.size);
+	m_indexAllocator.free(arenaMesh.indices.offset, arenaMesh.indices.size);
+	arenaMesh.alive = false;
+	m_freeMeshIds.push_back(mesh);
+}
+
+//Packs all live meshes to the start of fresh buffers. Mesh ids stay valid.
+void hannah::MeshArena::defragment()
+{
+	unsigned int vbo, ebo;
+	createBuffers(&vbo, &ebo);
+
+	m_vertexAllocator.reset(m_vertexAllocator.getCapacity());
+	m_indexAllocator.reset(m_indexAllocator.getCapacity());
+	for (size_t i = 0; i < m_meshes.size(); i++)
+	{
+		ArenaMesh& mesh = m_meshes[i];
+		if (!mesh.alive) {
+			continue;
+		}
+		//Allocating from an empty allocator in order always packs tightly
+		unsigned int vertexOffset, indexOffset;
+		m_vertexAllocator.allocate(mesh.vertices.size, &vertexOffset);
+		m_indexAllocator.allocate(mesh.indices.size, &indexOffset);
+		if (mesh.vertices.size > 0) {
+			glCopyNamedBufferSubData(m_vbo, vbo, sizeof(ew::Vertex) * mesh.vertices.offset, sizeof(ew::Vertex) * vertexOffset, sizeof(ew::Vertex) * mesh.vertices.size);
+		}
+		if (mesh.indices.size > 0) {
+			glCopyNamedBufferSubData(m_ebo, ebo, sizeof(unsigned int) * mesh.indices.offset, sizeof(unsigned int) * indexOffset, sizeof(unsigned int) * mesh.indices.size);
+		}
+		mesh.vertices.offset = vertexOffset;
+		mesh.indices.offset = indexOffset;
+	}
+
+	//Frames already submitted may still read the old buffers
+	ew::deferDelete(ew::GpuResourceType::BUFFER, m_vbo);
+	ew::deferDelete(ew::GpuResourceType::BUFFER, m_ebo);
+	m_vbo = vbo;
+	m_ebo = ebo;
+	glVertexArrayVertexBuffer(m_vao, 0, m_vbo, 0, sizeof(ew::Vertex));
+	glVertexArrayElementBuffer(m_vao, m_ebo);
+}
+
+//0 when all free space is one block, approaching 1 as free space gets scattered
+float hannah::MeshArena::getFragmentation() const
+{
+	const FreeListAllocator* allocators[2] = { &m_vertexAllocator, &m_indexAllocator };
+	float fragmentation = 0.0f;
+	for (size_t i = 0; i < 2; i++)
+	{
+		unsigned int totalFree = allocators[i]->getCapacity() - allocators[i]->getUsed();
+		if (totalFree > 0) {
+			fragmentation = std::max(fragmentation, 1.0f - (float)allocators[i]->getLargestFreeBlock() / totalFree);
+		}
+	}
+	return fragmentation;
+}
+
+//Submits the whole draw list with a single glMultiDrawElementsIndirect
+void hannah::MeshArena::draw(DrawList& drawList) const
+{
+	size_t numDraws = drawList.m_meshes.size();
+	if (numDraws == 0) {
+		return;
+	}
+	drawList.m_commands.clear();
+	for (size_t i = 0; i < numDraws; i++)
+	{
+		int id = drawList.m_meshes[i];
+		if (id < 0 || id >= (int)m_meshes.size() || !m_meshes[id].alive) {
+			continue;
+		}
+		const ArenaMesh& mesh = m_meshes[id];
+		DrawElementsIndirectCommand command;
+		command.count = mesh.indices.size;
+		command.instanceCount = 1;
+		command.firstIndex = mesh.indices.offset;
+		command.baseVertex = mesh.vertices.offset;
+		command.baseInstance = i; //Selects model matrix i
+		drawList.m_commands.push_back(command);
+	}
+	if (drawList.m_commands.empty()) {
+		return;
+	}
+
+	//Grow GPU side buffers if needed
+	if (drawList.m_capacity < numDraws) {
+		glNamedBufferData(drawList.m_commandBuffer, sizeof(DrawElementsIndirectCommand) * numDraws, NULL, GL_DYNAMIC_DRAW);
+		glNamedBufferData(drawList.m_transformBuffer, sizeof(glm::mat4) * numDraws, NULL, GL_DYNAMIC_DRAW);
+		drawList.m_capacity = numDraws;
+	}
+	glNamedBufferSubData(drawList.m_commandBuffer, 0, sizeof(DrawElementsIndirectCommand) * drawList.m_commands.size(), drawList.m_commands.data());
+	glNamedBufferSubData(drawList.m_transformBuffer, 0, sizeof(glm::mat4) * numDraws, drawList.m_transforms.data());
+
+	glVertexArrayVertexBuffer(m_vao, 1, drawList.m_transformBuffer, 0, sizeof(glm::mat4));
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawList.m_commandBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, drawList.m_commands.size(), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+#include "../ew/mesh.h"
+
+namespace hannah {
+	//Range of elements (vertices or indices) inside one of the arena buffers
+	struct ArenaBlock {
+		unsigned int offset;
+		unsigned int size;
+	};
+
+	//First-fit free list over a fixed number of elements. Adjacent free blocks are merged on free.
+	class FreeListAllocator {
+	public:
+		FreeListAllocator(unsigned int capacity = 0);
+		void reset(unsigned int capacity);
+		bool allocate(unsigned int size, unsigned int* offset);
+		void free(unsigned int offset, unsigned int size);
+		unsigned int getLargestFreeBlock()const;
+		inline unsigned int getCapacity()const { return m_capacity; }
+		inline unsigned int getUsed()const { return m_used; }
+	private:
+		std::vector<ArenaBlock> m_freeBlocks; //Sorted by offset
+		unsigned int m_capacity = 0;
+		unsigned int m_used = 0;
+	};
+
+	//Layout expected by glMultiDrawElementsIndirect
+	struct DrawElementsIndirectCommand {
+		unsigned int count;
+		unsigned int instanceCount;
+		unsigned int firstIndex;
+		int baseVertex;
+		unsigned int baseInstance;
+	};
+
+	//List of (mesh, model matrix) pairs compiled into an indirect command buffer.
+	//The model matrix is fed to the vertex shader as a per-instance mat4 at attribute locations 4-7.
+	class DrawList {
+	public:
+		DrawList();
+		~DrawList();
+		DrawList(const DrawList&) = delete;
+		DrawList& operator=(const DrawList&) = delete;
+		void clear();
+		void add(int mesh, const glm::mat4& model);
+		inline size_t size()const { return m_meshes.size(); }
+	private:
+		friend class MeshArena;
+		std::vector<int> m_meshes;
+		std::vector<glm::mat4> m_transforms;
+		std::vector<DrawElementsIndirectCommand> m_commands;
+		unsigned int m_commandBuffer = 0;
+		unsigned int m_transformBuffer = 0;
+		size_t m_capacity = 0; //Number of draws the GPU buffers can currently hold
+	};
+
+	//Scene-wide vertex/index buffers shared by many meshes through one VAO.
+	//Meshes are referenced by id and are just offsets into the shared buffers.
+	class MeshArena {
+	public:
+		MeshArena(unsigned int maxVertices, unsigned int maxIndices);
+		~MeshArena();
+		MeshArena(const MeshArena&) = delete;
+		MeshArena& operator=(const MeshArena&) = delete;
+		int add(const ew::MeshData& meshData); //Returns -1 if the arena is full
+		void remove(int mesh);
+		void defragment();
+		void draw(DrawList& drawList)const;
+		float getFragmentation()const;
+		inline unsigned int getNumVertices()const { return m_vertexAllocator.getUsed(); }
+		inline unsigned int getNumIndices()const { return m_indexAllocator.getUsed(); }
+	private:
+		struct ArenaMesh {
+			ArenaBlock vertices;
+			ArenaBlock indices;
+			bool alive = false;
+		};
+		void createBuffers(unsigned int* vbo, unsigned int* ebo)const;
+		std::vector<ArenaMesh> m_meshes;
+		std::vector<int> m_freeMeshIds;
+		FreeListAllocator m_vertexAllocator;
+		FreeListAllocator m_indexAllocator;
+		unsigned int m_vao = 0;
+		unsigned int m_vbo = 0;
+		unsigned int m_ebo = 0;
+	};
+}
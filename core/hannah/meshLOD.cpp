@@ -0,0 +1,407 @@
+#include "meshLOD.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+	//Symmetric 4x4 matrix summing squared distances to planes, plus total weight for normalizing
+	struct Quadric {
+		double a[10] = { 0 }; //xx xy xz xw yy yz yw zz zw ww
+		double weight = 0;
+	};
+
+	void addPlane(Quadric* q, const glm::vec3& normal, float d, float weight) {
+		double n[4] = { normal.x, normal.y, normal.z, d };
+		int k = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			for (int j = i; j < 4; j++)
+			{
+				q->a[k++] += n[i] * n[j] * weight;
+			}
+		}
+		q->weight += weight;
+	}
+
+	void addQuadric(Quadric* q, const Quadric& other) {
+		for (int i = 0; i < 10; i++)
+		{
+			q->a[i] += other.a[i];
+		}
+		q->weight += other.weight;
+	}
+
+	//Weighted mean squared distance from p to the planes in q and r
+	float evaluate(const Quadric& q, const Quadric& r, const glm::vec3& p) {
+		double a[10];
+		for (int i = 0; i < 10; i++)
+		{
+			a[i] = q.a[i] + r.a[i];
+		}
+		double x = p.x, y = p.y, z = p.z;
+		double error = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+			+ a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+			+ a[7] * z * z + 2 * a[8] * z
+			+ a[9];
+		double weight = q.weight + r.weight;
+		return weight > 0 ? (float)(fabs(error) / weight) : 0.0f;
+	}
+
+	struct PositionKey {
+		unsigned int bits[3];
+		bool operator==(const PositionKey& other)const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+	};
+	struct PositionKeyHash {
+		size_t operator()(const PositionKey& key)const {
+			return (key.bits[0] * 73856093u) ^ (key.bits[1] * 19349663u) ^ (key.bits[2] * 83492791u);
+		}
+	};
+
+	//Maps every vertex to the first vertex sharing its exact position
+	std::vector<unsigned int> buildPositionGroups(const std::vector<ew::Vertex>& vertices) {
+		std::vector<unsigned int> groups(vertices.size());
+		std::unordered_map<PositionKey, unsigned int, PositionKeyHash> firstVertex;
+		firstVertex.reserve(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			PositionKey key;
+			memcpy(key.bits, &vertices[i].pos, sizeof(key.bits));
+			groups[i] = firstVertex.insert({ key, (unsigned int)i }).first->second;
+		}
+		return groups;
+	}
+
+	struct EdgeInfo {
+		unsigned int uses = 0;
+		unsigned long long vertices = 0; //First (vertex, vertex) pair seen for the edge
+		bool seam = false;
+	};
+
+	struct Collapse {
+		unsigned int from;
+		unsigned int to;
+		float error;
+	};
+
+	//Border and seam edges get a perpendicular constraint plane so their outline is kept
+	const float EDGE_CONSTRAINT_WEIGHT = 10.0f;
+}
+
+std::vector<unsigned int> hannah::simplifyMesh(const std::vector<ew::Vertex>& vertices, const std::vector<unsigned int>& indices, size_t targetIndexCount, float* resultError)
+{
+	size_t numVertices = vertices.size();
+	std::vector<unsigned int> groups = buildPositionGroups(vertices);
+
+	//Quadrics are per position group (indexed by the group's first vertex)
+	std::vector<Quadric> quadrics(numVertices);
+	std::unordered_map<unsigned long long, EdgeInfo> edges; //Keyed by (min group, max group)
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		glm::vec3 p0 = vertices[indices[i]].pos;
+		glm::vec3 p1 = vertices[indices[i + 1]].pos;
+		glm::vec3 p2 = vertices[indices[i + 2]].pos;
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float area = glm::length(n);
+		if (area <= 0.0f) {
+			continue;
+		}
+		n /= area;
+		for (int j = 0; j < 3; j++)
+		{
+			addPlane(&quadrics[groups[indices[i + j]]], n, -glm::dot(n, p0), area * 0.5f);
+		}
+		for (int j = 0; j < 3; j++)
+		{
+			unsigned int va = indices[i + j];
+			unsigned int vb = indices[i + (j + 1) % 3];
+			unsigned int ga = groups[va], gb = groups[vb];
+			if (ga > gb) {
+				std::swap(ga, gb);
+				std::swap(va, vb);
+			}
+			unsigned long long key = ((unsigned long long)ga << 32) | gb;
+			unsigned long long pair = ((unsigned long long)va << 32) | vb;
+			EdgeInfo& edge = edges[key];
+			if (edge.uses++ == 0) {
+				edge.vertices = pair;
+			}
+			else if (edge.vertices != pair) {
+				edge.seam = true; //Different vertices on each side
+			}
+		}
+	}
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		glm::vec3 p0 = vertices[indices[i]].pos;
+		glm::vec3 n = glm::cross(vertices[indices[i + 1]].pos - p0, vertices[indices[i + 2]].pos - p0);
+		if (glm::length(n) <= 0.0f) {
+			continue;
+		}
+		n = glm::normalize(n);
+		for (int j = 0; j < 3; j++)
+		{
+			unsigned int ga = groups[indices[i + j]];
+			unsigned int gb = groups[indices[i + (j + 1) % 3]];
+			unsigned long long key = ((unsigned long long)std::min(ga, gb) << 32) | std::max(ga, gb);
+			const EdgeInfo& info = edges[key];
+			if (info.uses != 1 && !info.seam) {
+				continue;
+			}
+			glm::vec3 pa = vertices[ga].pos;
+			glm::vec3 edge = vertices[gb].pos - pa;
+			float length = glm::length(edge);
+			if (length <= 0.0f) {
+				continue;
+			}
+			glm::vec3 planeNormal = glm::normalize(glm::cross(edge, n));
+			float weight = length * length * EDGE_CONSTRAINT_WEIGHT;
+			addPlane(&quadrics[ga], planeNormal, -glm::dot(planeNormal, pa), weight);
+			addPlane(&quadrics[gb], planeNormal, -glm::dot(planeNormal, pa), weight);
+		}
+	}
+
+	std::vector<unsigned int> result = indices;
+	std::vector<unsigned int> vertexRemap(numVertices);
+	std::vector<unsigned int> adjacencyOffsets(numVertices + 1);
+	std::vector<unsigned int> adjacency;
+	std::vector<char> touched(numVertices);
+	std::vector<Collapse> collapses;
+	std::vector<std::pair<unsigned int, unsigned int>> wedges; //(vertex in from group, vertex in to group)
+	float maxError = 0.0f;
+
+	while (result.size() > targetIndexCount) {
+		size_t numTriangles = result.size() / 3;
+
+		//Triangles around each position group
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			adjacencyOffsets[groups[result[i]] + 1]++;
+		}
+		for (size_t i = 0; i < numVertices; i++)
+		{
+			adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+		}
+		adjacency.resize(result.size());
+		std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			adjacency[fill[groups[result[i]]]++] = i / 3;
+		}
+
+		//Cheapest direction for every edge
+		collapses.clear();
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				unsigned int ga = groups[result[t * 3 + j]];
+				unsigned int gb = groups[result[t * 3 + (j + 1) % 3]];
+				float errorAB = evaluate(quadrics[ga], quadrics[gb], vertices[gb].pos);
+				float errorBA = evaluate(quadrics[ga], quadrics[gb], vertices[ga].pos);
+				if (errorAB <= errorBA) {
+					collapses.push_back({ ga, gb, errorAB });
+				}
+				else {
+					collapses.push_back({ gb, ga, errorBA });
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		for (size_t i = 0; i < numVertices; i++)
+		{
+			vertexRemap[i] = i;
+		}
+		std::fill(touched.begin(), touched.end(), 0);
+		size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+		size_t removed = 0;
+		size_t applied = 0;
+		for (size_t c = 0; c < collapses.size() && removed < trianglesToRemove; c++)
+		{
+			const Collapse& collapse = collapses[c];
+			if (touched[collapse.from] || touched[collapse.to]) {
+				continue;
+			}
+
+			//Every vertex of the from group must connect to a vertex of the to group, otherwise the collapse would tear a seam
+			wedges.clear();
+			bool valid = true;
+			size_t removedHere = 0;
+			for (unsigned int a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++)
+			{
+				const unsigned int* tri = &result[adjacency[a] * 3];
+				for (int j = 0; j < 3; j++)
+				{
+					if (groups[tri[j]] != collapse.from) {
+						continue;
+					}
+					bool found = false;
+					for (size_t w = 0; w < wedges.size(); w++)
+					{
+						found |= wedges[w].first == tri[j];
+					}
+					for (int k = 0; k < 3 && !found; k++)
+					{
+						if (groups[tri[k]] == collapse.to) {
+							wedges.push_back({ tri[j], tri[k] });
+							found = true;
+						}
+					}
+				}
+			}
+			for (unsigned int a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && valid; a++)
+			{
+				const unsigned int* tri = &result[adjacency[a] * 3];
+				bool hasTo = false;
+				for (int j = 0; j < 3; j++)
+				{
+					hasTo |= groups[tri[j]] == collapse.to;
+				}
+				if (hasTo) {
+					removedHere++;
+					continue;
+				}
+				glm::vec3 before[3], after[3];
+				for (int j = 0; j < 3; j++)
+				{
+					before[j] = after[j] = vertices[tri[j]].pos;
+					if (groups[tri[j]] != collapse.from) {
+						continue;
+					}
+					bool mapped = false;
+					for (size_t w = 0; w < wedges.size(); w++)
+					{
+						mapped |= wedges[w].first == tri[j];
+					}
+					valid &= mapped;
+					after[j] = vertices[collapse.to].pos;
+				}
+				//Reject collapses that flip or squash a remaining triangle
+				glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+				valid &= glm::dot(n0, n1) > 0.25f * glm::length(n0) * glm::length(n1);
+			}
+			if (!valid || removedHere == 0) {
+				continue;
+			}
+
+			for (size_t w = 0; w < wedges.size(); w++)
+			{
+				vertexRemap[wedges[w].first] = wedges[w].second;
+			}
+			addQuadric(&quadrics[collapse.to], quadrics[collapse.from]);
+			//Neighbouring collapses would invalidate the flip test, so lock the whole one-ring for this pass
+			for (unsigned int a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++)
+			{
+				const unsigned int* tri = &result[adjacency[a] * 3];
+				for (int j = 0; j < 3; j++)
+				{
+					touched[groups[tri[j]]] = 1;
+				}
+			}
+			maxError = std::max(maxError, collapse.error);
+			removed += removedHere;
+			applied++;
+		}
+		if (applied == 0) {
+			break;
+		}
+
+		//Apply remap and drop triangles that became degenerate
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			unsigned int a = vertexRemap[result[i]];
+			unsigned int b = vertexRemap[result[i + 1]];
+			unsigned int c = vertexRemap[result[i + 2]];
+			if (groups[a] == groups[b] || groups[b] == groups[c] || groups[c] == groups[a]) {
+				continue;
+			}
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	if (resultError != NULL) {
+		*resultError = sqrtf(maxError);
+	}
+	return result;
+}
+
+std::vector<hannah::MeshLOD> hannah::createLODChain(ew::MeshData* meshData, int maxLODs, float reduction)
+{
+	std::vector<MeshLOD> lods;
+	lods.push_back({ 0, (unsigned int)meshData->indices.size(), 0.0f });
+
+	std::vector<unsigned int> indices = meshData->indices;
+	float error = 0.0f;
+	for (int i = 1; i < maxLODs; i++)
+	{
+		size_t target = (size_t)(indices.size() / 3 * reduction) * 3;
+		float lodError;
+		std::vector<unsigned int> lodIndices = simplifyMesh(meshData->vertices, indices, target, &lodError);
+		//Stop once the simplifier can't make meaningful progress
+		if (lodIndices.empty() || lodIndices.size() > indices.size() * 0.9f) {
+			break;
+		}
+		//Each level is simplified from the previous one, so errors accumulate
+		error += lodError;
+		lods.push_back({ (unsigned int)meshData->indices.size(), (unsigned int)lodIndices.size(), error });
+		meshData->indices.insert(meshData->indices.end(), lodIndices.begin(), lodIndices.end());
+		indices.swap(lodIndices);
+	}
+	return lods;
+}
+
+float hannah::pixelsPerUnit(const ew::Camera& camera, const glm::vec3& worldPos, float screenHeight)
+{
+	if (camera.orthographic) {
+		return screenHeight / camera.orthoHeight;
+	}
+	float distance = std::max(glm::length(worldPos - camera.position), camera.nearPlane);
+	return screenHeight / (2.0f * distance * tanf(glm::radians(camera.fov) * 0.5f));
+}
+
+int hannah::selectLOD(const std::vector<MeshLOD>& lods, float pixelsPerUnit, int currentLOD, float threshold, float hysteresis)
+{
+	int lod = 0;
+	for (size_t i = 1; i < lods.size(); i++)
+	{
+		if (lods[i].error * pixelsPerUnit > threshold) {
+			break;
+		}
+		lod = i;
+	}
+	//Going coarser needs some margin, going finer happens as soon as the threshold is crossed
+	while (lod > currentLOD && lods[lod].error * pixelsPerUnit > threshold * (1.0f - hysteresis)) {
+		lod--;
+	}
+	return lod;
+}
+
+hannah::LODMesh::LODMesh(const ew::MeshData& meshData, int maxLODs, float reduction)
+{
+	ew::MeshData lodData = meshData;
+	m_lods = createLODChain(&lodData, maxLODs, reduction);
+	m_mesh.load(lodData);
+}
+
+int hannah::LODMesh::selectLOD(const ew::Camera& camera, const glm::mat4& model, float screenHeight, int currentLOD, float threshold) const
+{
+	//Errors are in object space, so scale them by the largest axis scale
+	float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	float pixels = pixelsPerUnit(camera, glm::vec3(model[3]), screenHeight) * scale;
+	currentLOD = std::min(std::max(currentLOD, 0), (int)m_lods.size() - 1);
+	return hannah::selectLOD(m_lods, pixels, currentLOD, threshold);
+}
+
+void hannah::LODMesh::draw(int lod) const
+{
+	lod = std::min(std::max(lod, 0), (int)m_lods.size() - 1);
+	m_mesh.drawRange(m_lods[lod].indexOffset, m_lods[lod].indexCount);
+}
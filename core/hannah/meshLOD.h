@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+#include "../ew/mesh.h"
+#include "../ew/camera.h"
+
+namespace hannah {
+	//Range of the shared index buffer used by one level of detail
+	struct MeshLOD {
+		unsigned int indexOffset;
+		unsigned int indexCount;
+		float error; //Approximate object space deviation from LOD 0
+	};
+
+	//Quadric error metric simplification by collapsing edges onto existing vertices, so the result indexes the same vertex buffer.
+	//UV/normal seams are kept intact by only collapsing a split vertex along edges that exist on every side of the seam.
+	std::vector<unsigned int> simplifyMesh(const std::vector<ew::Vertex>& vertices, const std::vector<unsigned int>& indices, size_t targetIndexCount, float* resultError);
+
+	//Appends progressively simpler index lists to meshData->indices. LOD 0 is the original mesh.
+	std::vector<MeshLOD> createLODChain(ew::MeshData* meshData, int maxLODs = 4, float reduction = 0.5f);
+
+	//Number of screen pixels covered by one world unit at worldPos
+	float pixelsPerUnit(const ew::Camera& camera, const glm::vec3& worldPos, float screenHeight);
+
+	//Picks the coarsest LOD whose projected error is under threshold pixels.
+	//Only switches to a coarser LOD once it is hysteresis (0-1) below the threshold to avoid popping back and forth.
+	int selectLOD(const std::vector<MeshLOD>& lods, float pixelsPerUnit, int currentLOD, float threshold = 1.0f, float hysteresis = 0.25f);
+
+	//Mesh with a LOD chain generated at load time, stored in a single index buffer
+	class LODMesh {
+	public:
+		LODMesh(const ew::MeshData& meshData, int maxLODs = 4, float reduction = 0.5f);
+		int selectLOD(const ew::Camera& camera, const glm::mat4& model, float screenHeight, int currentLOD, float threshold = 1.0f)const;
+		void draw(int lod)const;
+		inline int getNumLODs()const { return m_lods.size(); }
+		inline unsigned int getNumTriangles(int lod)const { return m_lods[lod].indexCount / 3; }
+	private:
+		ew::Mesh m_mesh;
+		std::vector<MeshLOD> m_lods;
+	};
+}
@@ -0,0 +1,268 @@
+#include "meshlet.h"
+#include "../ew/jobSystem.h"
+
+#include <math.h>
+#include <algorithm>
+
+//Closes the current meshlet and computes its bounds
+static void finishMeshlet(const ew::MeshData& meshData, hannah::MeshletData* data, hannah::Meshlet* meshlet) {
+	if (meshlet->triangleCount == 0) {
+		return;
+	}
+	const unsigned int* vertices = &data->vertices[meshlet->vertexOffset];
+	const unsigned char* triangles = &data->triangles[meshlet->triangleOffset];
+
+	//Sphere around the AABB center
+	glm::vec3 minPos = meshData.vertices[vertices[0]].pos;
+	glm::vec3 maxPos = minPos;
+	for (unsigned int i = 1; i < meshlet->vertexCount; i++)
+	{
+		minPos = glm::min(minPos, meshData.vertices[vertices[i]].pos);
+		maxPos = glm::max(maxPos, meshData.vertices[vertices[i]].pos);
+	}
+	meshlet->center = (minPos + maxPos) * 0.5f;
+	meshlet->radius = 0.0f;
+	for (unsigned int i = 0; i < meshlet->vertexCount; i++)
+	{
+		meshlet->radius = std::max(meshlet->radius, glm::length(meshData.vertices[vertices[i]].pos - meshlet->center));
+	}
+
+	//Normal cone around the average face normal
+	std::vector<glm::vec3> normals(meshlet->triangleCount);
+	glm::vec3 axis = glm::vec3(0.0f);
+	for (unsigned int i = 0; i < meshlet->triangleCount; i++)
+	{
+		glm::vec3 p0 = meshData.vertices[vertices[triangles[i * 3]]].pos;
+		glm::vec3 p1 = meshData.vertices[vertices[triangles[i * 3 + 1]]].pos;
+		glm::vec3 p2 = meshData.vertices[vertices[triangles[i * 3 + 2]]].pos;
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(n);
+		normals[i] = length > 0.0f ? n / length : glm::vec3(0.0f);
+		axis += normals[i];
+	}
+	meshlet->coneAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+	meshlet->coneCutoff = 1.0f;
+	if (glm::length(axis) <= 0.0f) {
+		data->meshlets.push_back(*meshlet);
+		return;
+	}
+	axis = glm::normalize(axis);
+	float minDot = 1.0f;
+	for (unsigned int i = 0; i < meshlet->triangleCount; i++)
+	{
+		minDot = std::min(minDot, glm::dot(normals[i], axis));
+	}
+	meshlet->coneAxis = axis;
+	//Cone wider than a hemisphere can't be culled
+	if (minDot > 0.0f) {
+		meshlet->coneCutoff = sqrtf(1.0f - minDot * minDot);
+	}
+	data->meshlets.push_back(*meshlet);
+}
+
+hannah::MeshletData hannah::buildMeshlets(const ew::MeshData& meshData, unsigned int maxVertices, unsigned int maxTriangles)
+{
+	MeshletData data;
+	maxVertices = std::min(maxVertices, 256u); //Local indices are bytes
+	size_t numVertices = meshData.vertices.size();
+	size_t numTriangles = meshData.indices.size() / 3;
+	data.meshlets.reserve(numTriangles / maxTriangles + 1);
+	data.triangles.reserve(numTriangles * 3);
+
+	//Triangles around each vertex
+	std::vector<unsigned int> adjacencyOffsets(numVertices + 1, 0);
+	for (size_t i = 0; i < numTriangles * 3; i++)
+	{
+		adjacencyOffsets[meshData.indices[i] + 1]++;
+	}
+	for (size_t i = 0; i < numVertices; i++)
+	{
+		adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+	}
+	std::vector<unsigned int> adjacency(numTriangles * 3);
+	std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < numTriangles * 3; i++)
+	{
+		adjacency[fill[meshData.indices[i]]++] = i / 3;
+	}
+
+	std::vector<int> localIndex(numVertices, -1);
+	std::vector<char> used(numTriangles, 0);
+	size_t nextSeed = 0;
+	Meshlet meshlet = {};
+	glm::vec3 centroidSum = glm::vec3(0.0f);
+	for (size_t added = 0; added < numTriangles; added++)
+	{
+		//Grow from triangles touching the meshlet, preferring ones that add the fewest vertices, then the closest
+		long long best = -1;
+		unsigned int bestNew = 4;
+		float bestDistance = 0.0f;
+		glm::vec3 centroid = centroidSum / (float)std::max(meshlet.vertexCount, 1u);
+		for (unsigned int v = 0; v < meshlet.vertexCount; v++)
+		{
+			unsigned int vertex = data.vertices[meshlet.vertexOffset + v];
+			for (unsigned int a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++)
+			{
+				unsigned int t = adjacency[a];
+				if (used[t]) {
+					continue;
+				}
+				const unsigned int* tri = &meshData.indices[t * 3];
+				unsigned int newVertices = (localIndex[tri[0]] < 0) + (localIndex[tri[1]] < 0) + (localIndex[tri[2]] < 0);
+				float distance = glm::length((meshData.vertices[tri[0]].pos + meshData.vertices[tri[1]].pos + meshData.vertices[tri[2]].pos) / 3.0f - centroid);
+				if (newVertices < bestNew || (newVertices == bestNew && distance < bestDistance)) {
+					best = t;
+					bestNew = newVertices;
+					bestDistance = distance;
+				}
+			}
+		}
+		//Nothing connected left or the meshlet is full, so start a new one
+		bool full = best >= 0 && (meshlet.vertexCount + bestNew > maxVertices || meshlet.triangleCount + 1 > maxTriangles);
+		if (best < 0 || full) {
+			if (meshlet.triangleCount > 0) {
+				finishMeshlet(meshData, &data, &meshlet);
+				for (unsigned int i = 0; i < meshlet.vertexCount; i++)
+				{
+					localIndex[data.vertices[meshlet.vertexOffset + i]] = -1;
+				}
+				meshlet = {};
+				meshlet.vertexOffset = data.vertices.size();
+				meshlet.triangleOffset = data.triangles.size();
+				centroidSum = glm::vec3(0.0f);
+			}
+			//A full meshlet continues where it left off, otherwise jump to the next unused triangle
+			if (best < 0) {
+				while (used[nextSeed]) {
+					nextSeed++;
+				}
+				best = nextSeed;
+			}
+		}
+
+		used[best] = 1;
+		const unsigned int* tri = &meshData.indices[best * 3];
+		for (int j = 0; j < 3; j++)
+		{
+			if (localIndex[tri[j]] < 0) {
+				localIndex[tri[j]] = meshlet.vertexCount++;
+				data.vertices.push_back(tri[j]);
+				centroidSum += meshData.vertices[tri[j]].pos;
+			}
+			data.triangles.push_back((unsigned char)localIndex[tri[j]]);
+		}
+		meshlet.triangleCount++;
+	}
+	finishMeshlet(meshData, &data, &meshlet);
+	return data;
+}
+
+hannah::Frustum hannah::extractFrustum(const glm::mat4& clipFromSpace)
+{
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(clipFromSpace[0][i], clipFromSpace[1][i], clipFromSpace[2][i], clipFromSpace[3][i]);
+	}
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0]; //Left
+	frustum.planes[1] = rows[3] - rows[0]; //Right
+	frustum.planes[2] = rows[3] + rows[1]; //Bottom
+	frustum.planes[3] = rows[3] - rows[1]; //Top
+	frustum.planes[4] = rows[3] + rows[2]; //Near
+	frustum.planes[5] = rows[3] - rows[2]; //Far
+	for (int i = 0; i < 6; i++)
+	{
+		frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+	}
+	return frustum;
+}
+
+void hannah::cullMeshlets(const MeshletData& meshletData, const ew::Camera& camera, const glm::mat4& model, std::vector<unsigned int>* visibleIndices, MeshletCullStats* stats)
+{
+	//Everything is tested in object space so meshlet bounds never need transforming
+	Frustum frustum = extractFrustum(camera.projectionMatrix() * camera.viewMatrix() * model);
+	glm::mat4 invModel = glm::inverse(model);
+	glm::vec3 cameraPos = glm::vec3(invModel * glm::vec4(camera.position, 1.0f));
+	glm::vec3 viewDir = glm::normalize(glm::vec3(invModel * glm::vec4(camera.target - camera.position, 0.0f)));
+	bool orthographic = camera.orthographic;
+
+	const size_t BATCH_SIZE = 64;
+	size_t numMeshlets = meshletData.meshlets.size();
+	size_t numBatches = (numMeshlets + BATCH_SIZE - 1) / BATCH_SIZE;
+	std::vector<std::vector<unsigned int>> batchIndices(numBatches);
+	std::vector<unsigned int> batchMeshlets(numBatches, 0);
+
+	ew::parallelFor(numMeshlets, BATCH_SIZE, [&](size_t begin, size_t end) {
+		size_t batch = begin / BATCH_SIZE;
+		std::vector<unsigned int>& indices = batchIndices[batch];
+		for (size_t m = begin; m < end; m++)
+		{
+			const Meshlet& meshlet = meshletData.meshlets[m];
+			bool visible = true;
+			for (int i = 0; i < 6 && visible; i++)
+			{
+				visible = glm::dot(glm::vec3(frustum.planes[i]), meshlet.center) + frustum.planes[i].w >= -meshlet.radius;
+			}
+			if (!visible) {
+				continue;
+			}
+			if (orthographic) {
+				if (glm::dot(viewDir, meshlet.coneAxis) >= meshlet.coneCutoff) {
+					continue;
+				}
+			}
+			else {
+				glm::vec3 toCenter = meshlet.center - cameraPos;
+				if (glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius) {
+					continue;
+				}
+			}
+			const unsigned int* vertices = &meshletData.vertices[meshlet.vertexOffset];
+			const unsigned char* triangles = &meshletData.triangles[meshlet.triangleOffset];
+			for (unsigned int i = 0; i < meshlet.triangleCount * 3; i++)
+			{
+				indices.push_back(vertices[triangles[i]]);
+			}
+			batchMeshlets[batch]++;
+		}
+	});
+
+	//Compact in meshlet order
+	size_t total = 0;
+	for (size_t i = 0; i < numBatches; i++)
+	{
+		total += batchIndices[i].size();
+	}
+	visibleIndices->clear();
+	visibleIndices->reserve(total);
+	MeshletCullStats result;
+	for (size_t i = 0; i < numBatches; i++)
+	{
+		visibleIndices->insert(visibleIndices->end(), batchIndices[i].begin(), batchIndices[i].end());
+		result.meshletsVisible += batchMeshlets[i];
+	}
+	if (stats != NULL) {
+		result.meshletsTotal = numMeshlets;
+		result.trianglesTotal = meshletData.triangles.size() / 3;
+		result.trianglesVisible = total / 3;
+		*stats = result;
+	}
+}
+
+hannah::MeshletMesh::MeshletMesh(const ew::MeshData& meshData)
+{
+	m_mesh.load(meshData);
+	m_meshlets = buildMeshlets(meshData);
+}
+
+void hannah::MeshletMesh::cull(const ew::Camera& camera, const glm::mat4& model)
+{
+	cullMeshlets(m_meshlets, camera, model, &m_visibleIndices, &m_stats);
+	m_mesh.updateIndices(m_visibleIndices.data(), m_visibleIndices.size());
+}
+
+void hannah::MeshletMesh::draw() const
+{
+	m_mesh.draw();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+#include "../ew/mesh.h"
+#include "../ew/camera.h"
+
+namespace hannah {
+	const unsigned int MAX_MESHLET_VERTICES = 64;
+	const unsigned int MAX_MESHLET_TRIANGLES = 124;
+
+	struct Meshlet {
+		unsigned int vertexOffset; //Into MeshletData::vertices
+		unsigned int triangleOffset; //Into MeshletData::triangles, 3 local indices per triangle
+		unsigned int vertexCount;
+		unsigned int triangleCount;
+		//Bounding sphere
+		glm::vec3 center;
+		float radius;
+		//Normal cone. Every triangle normal is within the cone, so the whole meshlet is back facing when the view direction is outside it.
+		glm::vec3 coneAxis;
+		float coneCutoff; //Sine of the cone half angle, 1 if the meshlet can never be cone culled
+	};
+
+	struct MeshletData {
+		std::vector<Meshlet> meshlets;
+		std::vector<unsigned int> vertices; //Meshlet local vertex -> mesh vertex
+		std::vector<unsigned char> triangles; //Meshlet local indices
+	};
+
+	//Six planes (xyz = normal, w = distance) pointing inward, in whatever space the matrix maps from
+	struct Frustum {
+		glm::vec4 planes[6];
+	};
+
+	struct MeshletCullStats {
+		unsigned int meshletsTotal = 0;
+		unsigned int meshletsVisible = 0;
+		unsigned int trianglesTotal = 0;
+		unsigned int trianglesVisible = 0;
+	};
+
+	//Greedily grows meshlets over connected triangles, keeping each one spatially compact
+	MeshletData buildMeshlets(const ew::MeshData& meshData, unsigned int maxVertices = MAX_MESHLET_VERTICES, unsigned int maxTriangles = MAX_MESHLET_TRIANGLES);
+	Frustum extractFrustum(const glm::mat4& clipFromSpace);
+	//Frustum and cone culls every meshlet on all job system threads, writing the surviving triangles as one compacted index list
+	void cullMeshlets(const MeshletData& meshletData, const ew::Camera& camera, const glm::mat4& model, std::vector<unsigned int>* visibleIndices, MeshletCullStats* stats);
+
+	//Mesh whose index buffer is rebuilt from visible meshlets every time cull is called
+	class MeshletMesh {
+	public:
+		MeshletMesh(const ew::MeshData& meshData);
+		void cull(const ew::Camera& camera, const glm::mat4& model);
+		void draw()const;
+		inline const MeshletCullStats& getStats()const { return m_stats; }
+	private:
+		ew::Mesh m_mesh;
+		MeshletData m_meshlets;
+		std::vector<unsigned int> m_visibleIndices;
+		MeshletCullStats m_stats;
+	};
+}
@@ -0,0 +1,282 @@
+#include "mipmap.h"
+#include "../ew/jobSystem.h"
+
+#include <math.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define MIPMAP_SSE 1
+#include <emmintrin.h>
+#else
+#define MIPMAP_SSE 0
+#endif
+
+//Pixels are filtered as 4 linear floats, one SSE register each. SSE2 is part of x64, so unlike AVX2 it needs no runtime check.
+//The scalar fallback does the same operations in the same order, so either gives the same levels.
+namespace {
+	const size_t PIXELS_PER_BATCH = 16384;
+	const float KAISER_ALPHA = 4.0f;
+	const float KAISER_RADIUS = 3.0f; //In output pixels
+	//Part of getMipSettingsKey, bump it when the filtering changes in a way the settings and constants above don't show
+	const int MIP_FILTER_VERSION = 1;
+
+	//Source pixels and weights for every output pixel along one axis, padded to the same number of taps
+	struct FilterTaps {
+		int numTaps = 0;
+		std::vector<int> indices;
+		std::vector<float> weights;
+	};
+
+	float besselI0(float x) {
+		float sum = 1.0f;
+		float term = 1.0f;
+		for (int k = 1; k < 20; k++)
+		{
+			term *= (x * 0.5f / k) * (x * 0.5f / k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	float kaiser(float t) {
+		const float PI = 3.14159265359f;
+		if (fabsf(t) >= KAISER_RADIUS) {
+			return 0.0f;
+		}
+		float sinc = t == 0.0f ? 1.0f : sinf(PI * t) / (PI * t);
+		float x = t / KAISER_RADIUS;
+		return sinc * besselI0(KAISER_ALPHA * sqrtf(1.0f - x * x)) / besselI0(KAISER_ALPHA);
+	}
+
+	FilterTaps buildTaps(int srcSize, int dstSize, const hannah::MipSettings& settings) {
+		FilterTaps taps;
+		float scale = (float)srcSize / dstSize;
+		//Output pixel x covers source [x * scale, (x + 1) * scale)
+		float radius = settings.filter == hannah::MipFilter::BOX ? scale * 0.5f : KAISER_RADIUS * scale;
+		taps.numTaps = (int)ceilf(radius * 2.0f) + 1;
+		taps.indices.resize((size_t)dstSize * taps.numTaps);
+		taps.weights.resize((size_t)dstSize * taps.numTaps);
+		for (int x = 0; x < dstSize; x++)
+		{
+			float center = (x + 0.5f) * scale;
+			int first = (int)floorf(center - radius);
+			float sum = 0.0f;
+			for (int k = 0; k < taps.numTaps; k++)
+			{
+				int i = first + k;
+				float weight;
+				if (settings.filter == hannah::MipFilter::BOX) {
+					weight = std::max(std::min((float)i + 1.0f, center + radius) - std::max((float)i, center - radius), 0.0f);
+				}
+				else {
+					weight = kaiser((i + 0.5f - center) / scale);
+				}
+				if (settings.wrap) {
+					i = ((i % srcSize) + srcSize) % srcSize;
+				}
+				else {
+					i = std::min(std::max(i, 0), srcSize - 1);
+				}
+				taps.indices[(size_t)x * taps.numTaps + k] = i;
+				taps.weights[(size_t)x * taps.numTaps + k] = weight;
+				sum += weight;
+			}
+			for (int k = 0; k < taps.numTaps; k++)
+			{
+				taps.weights[(size_t)x * taps.numTaps + k] /= sum;
+			}
+		}
+		return taps;
+	}
+
+	//acc += weight * pixel over count floats
+	inline void multiplyAdd(float* acc, float weight, const float* pixel, size_t count) {
+		size_t i = 0;
+#if MIPMAP_SSE
+		__m128 w = _mm_set1_ps(weight);
+		for (; i + 4 <= count; i += 4)
+		{
+			_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(w, _mm_loadu_ps(pixel + i))));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			acc[i] = acc[i] + weight * pixel[i];
+		}
+	}
+
+	float srgbToLinear(float c) {
+		return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	//Tables shared by every call. Decoding is a lookup, encoding finds the nearest code by where the value falls between codes.
+	struct SrgbTables {
+		float toLinear[256];
+		float thresholds[255]; //Linear value halfway between consecutive codes, in sRGB space
+		SrgbTables() {
+			for (int i = 0; i < 256; i++)
+			{
+				toLinear[i] = srgbToLinear(i / 255.0f);
+			}
+			for (int i = 0; i < 255; i++)
+			{
+				thresholds[i] = srgbToLinear((i + 0.5f) / 255.0f);
+			}
+		}
+	};
+	const SrgbTables SRGB;
+
+	inline unsigned char encodeLinear(float value) {
+		return (unsigned char)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	inline unsigned char encodeSrgb(float value) {
+		return (unsigned char)(std::upper_bound(SRGB.thresholds, SRGB.thresholds + 255, value) - SRGB.thresholds);
+	}
+
+	//Clamps filter overshoot and renormalizes normals, so the next level is built from valid values
+	void finishPixel(float* pixel, hannah::MipContent content) {
+		for (int c = 0; c < 4; c++)
+		{
+			pixel[c] = std::min(std::max(pixel[c], 0.0f), 1.0f);
+		}
+		if (content == hannah::MipContent::NORMAL_MAP) {
+			float x = pixel[0] * 2.0f - 1.0f;
+			float y = pixel[1] * 2.0f - 1.0f;
+			float z = pixel[2] * 2.0f - 1.0f;
+			float length = sqrtf(x * x + y * y + z * z);
+			if (length < 1e-6f) {
+				x = 0.0f;
+				y = 0.0f;
+				z = 1.0f;
+				length = 1.0f;
+			}
+			pixel[0] = x / length * 0.5f + 0.5f;
+			pixel[1] = y / length * 0.5f + 0.5f;
+			pixel[2] = z / length * 0.5f + 0.5f;
+		}
+	}
+}
+
+hannah::MipSettings hannah::guessMipSettings(const char* filePath)
+{
+	std::string name = filePath;
+	size_t slash = name.find_last_of("/\\");
+	if (slash != std::string::npos) {
+		name = name.substr(slash + 1);
+	}
+	for (size_t i = 0; i < name.size(); i++)
+	{
+		name[i] = (char)tolower((unsigned char)name[i]);
+	}
+	MipSettings settings;
+	const char* NORMAL_NAMES[] = { "normal", "nrm" };
+	const char* LINEAR_NAMES[] = { "rough", "metal", "height", "disp", "bump", "_ao", "occlusion", "mask", "spec", "gloss" };
+	for (const char* n : NORMAL_NAMES)
+	{
+		if (name.find(n) != std::string::npos) {
+			settings.content = MipContent::NORMAL_MAP;
+			return settings;
+		}
+	}
+	for (const char* n : LINEAR_NAMES)
+	{
+		if (name.find(n) != std::string::npos) {
+			settings.content = MipContent::LINEAR;
+			return settings;
+		}
+	}
+	return settings;
+}
+
+std::vector<std::vector<unsigned char>> hannah::buildMipChain(const unsigned char* rgba, int width, int height, const MipSettings& settings)
+{
+	std::vector<std::vector<unsigned char>> levels;
+	levels.push_back(std::vector<unsigned char>(rgba, rgba + (size_t)width * height * 4));
+
+	//Everything in between levels stays in linear float
+	bool srgb = settings.content == MipContent::SRGB_COLOR;
+	std::vector<float> current((size_t)width * height * 4);
+	ew::parallelFor((size_t)width * height, PIXELS_PER_BATCH, [&](size_t begin, size_t end) {
+		for (size_t i = begin * 4; i < end * 4; i++)
+		{
+			current[i] = srgb && i % 4 != 3 ? SRGB.toLinear[rgba[i]] : rgba[i] / 255.0f;
+		}
+	});
+
+	std::vector<float> rows;
+	std::vector<float> next;
+	while (width > 1 || height > 1) {
+		int nextWidth = std::max(width / 2, 1);
+		int nextHeight = std::max(height / 2, 1);
+		FilterTaps horizontal = buildTaps(width, nextWidth, settings);
+		FilterTaps vertical = buildTaps(height, nextHeight, settings);
+		size_t batchRows = std::max(PIXELS_PER_BATCH / nextWidth, (size_t)1);
+
+		//Separable, horizontal into full height rows first
+		rows.assign((size_t)nextWidth * height * 4, 0.0f);
+		ew::parallelFor(height, batchRows, [&](size_t begin, size_t end) {
+			for (size_t y = begin; y < end; y++)
+			{
+				const float* src = &current[y * width * 4];
+				float* dst = &rows[y * nextWidth * 4];
+				for (int x = 0; x < nextWidth; x++)
+				{
+					for (int k = 0; k < horizontal.numTaps; k++)
+					{
+						size_t tap = (size_t)x * horizontal.numTaps + k;
+						multiplyAdd(dst + x * 4, horizontal.weights[tap], src + horizontal.indices[tap] * 4, 4);
+					}
+				}
+			}
+		});
+
+		//Then whole rows at a time vertically, which vectorizes across the row
+		next.assign((size_t)nextWidth * nextHeight * 4, 0.0f);
+		std::vector<unsigned char> level((size_t)nextWidth * nextHeight * 4);
+		ew::parallelFor(nextHeight, batchRows, [&](size_t begin, size_t end) {
+			size_t rowFloats = (size_t)nextWidth * 4;
+			for (size_t y = begin; y < end; y++)
+			{
+				float* dst = &next[y * rowFloats];
+				for (int k = 0; k < vertical.numTaps; k++)
+				{
+					size_t tap = y * vertical.numTaps + k;
+					multiplyAdd(dst, vertical.weights[tap], &rows[vertical.indices[tap] * rowFloats], rowFloats);
+				}
+				unsigned char* out = &level[y * rowFloats];
+				for (int x = 0; x < nextWidth; x++)
+				{
+					float* pixel = dst + x * 4;
+					finishPixel(pixel, settings.content);
+					for (int c = 0; c < 4; c++)
+					{
+						out[x * 4 + c] = srgb && c != 3 ? encodeSrgb(pixel[c]) : encodeLinear(pixel[c]);
+					}
+				}
+			}
+		});
+		levels.push_back(std::move(level));
+		current.swap(next);
+		width = nextWidth;
+		height = nextHeight;
+	}
+	return levels;
+}
+
+std::string hannah::getMipSettingsKey(const MipSettings& settings)
+{
+	const char* CONTENT_NAMES[] = { "srgb", "linear", "normal" };
+	char key[64];
+	if (settings.filter == MipFilter::BOX) {
+		snprintf(key, sizeof(key), "box-%s-%s-v%d", CONTENT_NAMES[(int)settings.content], settings.wrap ? "wrap" : "clamp", MIP_FILTER_VERSION);
+	}
+	else {
+		snprintf(key, sizeof(key), "kaiser%ga%g-%s-%s-v%d", KAISER_RADIUS, KAISER_ALPHA, CONTENT_NAMES[(int)settings.content], settings.wrap ? "wrap" : "clamp", MIP_FILTER_VERSION);
+	}
+	return key;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include <string>
+
+namespace hannah {
+	enum class MipFilter {
+		BOX = 0, //Averages exactly the source pixels each output pixel covers
+		KAISER = 1 //Kaiser windowed sinc, keeps detail a box filter blurs away
+	};
+
+	enum class MipContent {
+		SRGB_COLOR = 0, //RGB is gamma encoded and filtered in linear light. Alpha is linear.
+		LINEAR = 1, //Data like roughness or masks, filtered as stored
+		NORMAL_MAP = 2 //RGB holds 0.5 + 0.5 * n and is renormalized after filtering. Alpha is linear.
+	};
+
+	struct MipSettings {
+		MipFilter filter = MipFilter::KAISER;
+		MipContent content = MipContent::SRGB_COLOR;
+		bool wrap = true; //Filters across the opposite edge for tiling textures, otherwise edge pixels are repeated
+	};
+
+	//Guesses the content from the file name, e.g. "tiles_normal.jpg" is a normal map and "metal_roughness.png" is linear data
+	MipSettings guessMipSettings(const char* filePath);
+	//Short name of the settings and the filter parameters behind them, e.g. "kaiser3a4-srgb-wrap-v1".
+	//Anything that changes the levels buildMipChain outputs changes it, so caches of built chains can be keyed by it.
+	std::string getMipSettingsKey(const MipSettings& settings);
+
+	//RGBA8 levels from full size down to 1x1, each half the size of the previous one rounded down.
+	//levels[0] is a copy of the input. Levels are filtered from the previous one in float, so rounding doesn't add up.
+	std::vector<std::vector<unsigned char>> buildMipChain(const unsigned char* rgba, int width, int height, const MipSettings& settings = MipSettings());
+}
@@ -0,0 +1,57 @@
+#include "momentShadows.h"
+
+#include <math.h>
+#include <algorithm>
+
+namespace {
+	const float EVSM_EXPONENT = 40.0f;
+}
+
+float hannah::getMomentExponent(ShadowFilter filter)
+{
+	return filter == ShadowFilter::EVSM ? EVSM_EXPONENT : 0.0f;
+}
+
+glm::vec2 hannah::getClearMoments(ShadowFilter filter)
+{
+	//Shaders warp NDC depth, which is 1 at the far plane
+	float depth = filter == ShadowFilter::EVSM ? expf(EVSM_EXPONENT) : 1.0f;
+	return glm::vec2(depth, depth * depth);
+}
+
+hannah::GaussianKernel hannah::createGaussianKernel(int radius)
+{
+	radius = std::min(std::max(radius, 0), MAX_GAUSSIAN_RADIUS);
+	GaussianKernel kernel;
+	if (radius == 0) {
+		kernel.numTaps = 1;
+		kernel.weights[0] = 1.0f;
+		return kernel;
+	}
+
+	//Discrete weights per texel, normalized over both sides
+	float sigma = radius * 0.5f;
+	float texelWeights[MAX_GAUSSIAN_RADIUS + 2] = { 0 };
+	float sum = 0.0f;
+	for (int i = 0; i <= radius; i++)
+	{
+		texelWeights[i] = expf(-(float)(i * i) / (2.0f * sigma * sigma));
+		sum += i == 0 ? texelWeights[i] : 2.0f * texelWeights[i];
+	}
+	for (int i = 0; i <= radius; i++)
+	{
+		texelWeights[i] /= sum;
+	}
+
+	//Pair texels i and i + 1 into one fetch at their weighted center
+	kernel.weights[0] = texelWeights[0];
+	kernel.numTaps = 1;
+	for (int i = 1; i <= radius; i += 2)
+	{
+		float weight = texelWeights[i] + texelWeights[i + 1];
+		kernel.offsets[kernel.numTaps] = (i * texelWeights[i] + (i + 1) * texelWeights[i + 1]) / weight;
+		kernel.weights[kernel.numTaps] = weight;
+		kernel.numTaps++;
+	}
+	return kernel;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <glm/glm.hpp>
+
+namespace hannah {
+	enum class ShadowFilter {
+		PCF = 0, //Depth map, 3x3 depth compares per pixel
+		VSM = 1, //Depth and depth squared, blurred once and filtered by the hardware like any texture
+		EVSM = 2 //The same moments of an exponentially warped depth, far less light bleeding
+	};
+	const char* const SHADOW_FILTER_NAMES[] = { "PCF", "VSM", "EVSM" };
+
+	//Warp exponent for the moment shaders, 0 for VSM. The second moment of e^40 is about as large as RG32F holds.
+	float getMomentExponent(ShadowFilter filter);
+	//Moments of a texel where nothing was drawn, i.e. at the far plane
+	glm::vec2 getClearMoments(ShadowFilter filter);
+
+	const int MAX_GAUSSIAN_TAPS = 16;
+	const int MAX_GAUSSIAN_RADIUS = (MAX_GAUSSIAN_TAPS - 1) * 2;
+
+	//One side of a symmetric 1D kernel, tap 0 is the center texel. Neighbouring texels share a tap, placed between them
+	//so one bilinear fetch returns their weighted sum. A radius r blur takes r / 2 + 1 fetches per side instead of r + 1.
+	struct GaussianKernel {
+		int numTaps = 0;
+		float offsets[MAX_GAUSSIAN_TAPS] = { 0 }; //In texels
+		float weights[MAX_GAUSSIAN_TAPS] = { 0 };
+	};
+
+	//Sigma is half the radius. Radius is clamped to [0, MAX_GAUSSIAN_RADIUS], 0 gives a single tap copy.
+	GaussianKernel createGaussianKernel(int radius);
+}
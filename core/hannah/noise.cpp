@@ -0,0 +1,423 @@
+#include "noise.h"
+#include "../ew/jobSystem.h"
+#include "external/glad.h"
+#include "../ew/tangentSpace.h"
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define NOISE_AVX2 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#define NOISE_AVX2_FUNCTION
+#else
+#include <immintrin.h>
+#define NOISE_AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+#else
+#define NOISE_AVX2 0
+#endif
+
+//The scalar and AVX2 paths do the same operations in the same order so either gives the same noise
+namespace {
+	const float SIMPLEX_F2 = 0.36602540378f; //(sqrt(3) - 1) / 2
+	const float SIMPLEX_G2 = 0.21132486540f; //(3 - sqrt(3)) / 6
+	const float GRADIENT_X[8] = { 1, -1, 1, -1, 1, -1, 0, 0 };
+	const float GRADIENT_Y[8] = { 1, 1, -1, -1, 0, 0, 1, -1 };
+	const size_t SAMPLES_PER_BATCH = 4096;
+
+	inline unsigned int hashLattice(int x, int y, unsigned int seed) {
+		unsigned int h = seed ^ ((unsigned int)x * 0x8da6b343u) ^ ((unsigned int)y * 0xd8163841u);
+		h *= 0xcb1ab31fu;
+		h ^= h >> 15;
+		h *= 0x2c1b3c6du;
+		h ^= h >> 12;
+		return h;
+	}
+
+	inline float latticeValue(unsigned int h) {
+		return (float)(int)(h & 0xFFFFFF) * (2.0f / 16777215.0f) - 1.0f;
+	}
+
+	inline float gradientDot(unsigned int h, float x, float y) {
+		return GRADIENT_X[h & 7] * x + GRADIENT_Y[h & 7] * y;
+	}
+
+	inline float lerp(float a, float b, float t) {
+		return a + (b - a) * t;
+	}
+
+	float valueNoise(float x, float y, unsigned int seed) {
+		float fx = floorf(x);
+		float fy = floorf(y);
+		int ix = (int)fx;
+		int iy = (int)fy;
+		float tx = x - fx;
+		float ty = y - fy;
+		tx = tx * tx * (3.0f - 2.0f * tx);
+		ty = ty * ty * (3.0f - 2.0f * ty);
+		float a = lerp(latticeValue(hashLattice(ix, iy, seed)), latticeValue(hashLattice(ix + 1, iy, seed)), tx);
+		float b = lerp(latticeValue(hashLattice(ix, iy + 1, seed)), latticeValue(hashLattice(ix + 1, iy + 1, seed)), tx);
+		return lerp(a, b, ty);
+	}
+
+	float gradientNoise(float x, float y, unsigned int seed) {
+		float fx = floorf(x);
+		float fy = floorf(y);
+		int ix = (int)fx;
+		int iy = (int)fy;
+		float dx = x - fx;
+		float dy = y - fy;
+		//Quintic fade so derivatives are continuous
+		float tx = dx * dx * dx * (dx * (dx * 6.0f - 15.0f) + 10.0f);
+		float ty = dy * dy * dy * (dy * (dy * 6.0f - 15.0f) + 10.0f);
+		float a = lerp(gradientDot(hashLattice(ix, iy, seed), dx, dy), gradientDot(hashLattice(ix + 1, iy, seed), dx - 1.0f, dy), tx);
+		float b = lerp(gradientDot(hashLattice(ix, iy + 1, seed), dx, dy - 1.0f), gradientDot(hashLattice(ix + 1, iy + 1, seed), dx - 1.0f, dy - 1.0f), tx);
+		return lerp(a, b, ty);
+	}
+
+	inline float simplexCorner(unsigned int h, float x, float y) {
+		float t = 0.5f - x * x - y * y;
+		if (t < 0.0f) {
+			return 0.0f;
+		}
+		t = t * t;
+		return t * t * gradientDot(h, x, y);
+	}
+
+	float simplexNoise(float x, float y, unsigned int seed) {
+		float s = (x + y) * SIMPLEX_F2;
+		float fi = floorf(x + s);
+		float fj = floorf(y + s);
+		int i = (int)fi;
+		int j = (int)fj;
+		float t = (fi + fj) * SIMPLEX_G2;
+		float x0 = x - (fi - t);
+		float y0 = y - (fj - t);
+		//Which of the two triangles in the skewed cell
+		float i1 = x0 > y0 ? 1.0f : 0.0f;
+		float j1 = 1.0f - i1;
+		float x1 = x0 - i1 + SIMPLEX_G2;
+		float y1 = y0 - j1 + SIMPLEX_G2;
+		float x2 = x0 - 1.0f + 2.0f * SIMPLEX_G2;
+		float y2 = y0 - 1.0f + 2.0f * SIMPLEX_G2;
+		float n0 = simplexCorner(hashLattice(i, j, seed), x0, y0);
+		float n1 = simplexCorner(hashLattice(i + (int)i1, j + (int)j1, seed), x1, y1);
+		float n2 = simplexCorner(hashLattice(i + 1, j + 1, seed), x2, y2);
+		return 70.0f * (n0 + n1 + n2);
+	}
+
+	inline float baseNoise(hannah::NoiseType type, float x, float y, unsigned int seed) {
+		switch (type) {
+		case hannah::NoiseType::VALUE:
+			return valueNoise(x, y, seed);
+		case hannah::NoiseType::SIMPLEX:
+			return simplexNoise(x, y, seed);
+		default:
+			return gradientNoise(x, y, seed);
+		}
+	}
+
+	//1 / sum of octave amplitudes, so fractals stay in the base noise range
+	float fractalScale(const hannah::NoiseSettings& settings) {
+		float sum = 0.0f;
+		float amplitude = 1.0f;
+		for (int i = 0; i < settings.octaves; i++)
+		{
+			sum += amplitude;
+			amplitude *= settings.gain;
+		}
+		return sum > 0.0f ? 1.0f / sum : 0.0f;
+	}
+
+#if NOISE_AVX2
+	bool cpuHasAVX2() {
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		//The OS also has to save the upper halves of the YMM registers
+		bool osSavesYMM = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		return osSavesYMM && (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	NOISE_AVX2_FUNCTION inline __m256i hashLattice8(__m256i x, __m256i y, __m256i seed) {
+		__m256i h = _mm256_xor_si256(seed, _mm256_xor_si256(
+			_mm256_mullo_epi32(x, _mm256_set1_epi32((int)0x8da6b343u)),
+			_mm256_mullo_epi32(y, _mm256_set1_epi32((int)0xd8163841u))));
+		h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int)0xcb1ab31fu));
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+		h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int)0x2c1b3c6du));
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 12));
+		return h;
+	}
+
+	NOISE_AVX2_FUNCTION inline __m256 latticeValue8(__m256i h) {
+		__m256 v = _mm256_cvtepi32_ps(_mm256_and_si256(h, _mm256_set1_epi32(0xFFFFFF)));
+		return _mm256_sub_ps(_mm256_mul_ps(v, _mm256_set1_ps(2.0f / 16777215.0f)), _mm256_set1_ps(1.0f));
+	}
+
+	NOISE_AVX2_FUNCTION inline __m256 gradientDot8(__m256i h, __m256 x, __m256 y) {
+		__m256i index = _mm256_and_si256(h, _mm256_set1_epi32(7));
+		__m256 gx = _mm256_permutevar8x32_ps(_mm256_loadu_ps(GRADIENT_X), index);
+		__m256 gy = _mm256_permutevar8x32_ps(_mm256_loadu_ps(GRADIENT_Y), index);
+		return _mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gy, y));
+	}
+
+	NOISE_AVX2_FUNCTION inline __m256 lerp8(__m256 a, __m256 b, __m256 t) {
+		return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+	}
+
+	NOISE_AVX2_FUNCTION __m256 valueNoise8(__m256 x, __m256 y, __m256i seed) {
+		__m256 fx = _mm256_floor_ps(x);
+		__m256 fy = _mm256_floor_ps(y);
+		__m256i ix = _mm256_cvttps_epi32(fx);
+		__m256i iy = _mm256_cvttps_epi32(fy);
+		__m256i one = _mm256_set1_epi32(1);
+		__m256i ix1 = _mm256_add_epi32(ix, one);
+		__m256i iy1 = _mm256_add_epi32(iy, one);
+		__m256 tx = _mm256_sub_ps(x, fx);
+		__m256 ty = _mm256_sub_ps(y, fy);
+		__m256 three = _mm256_set1_ps(3.0f);
+		__m256 two = _mm256_set1_ps(2.0f);
+		tx = _mm256_mul_ps(_mm256_mul_ps(tx, tx), _mm256_sub_ps(three, _mm256_mul_ps(two, tx)));
+		ty = _mm256_mul_ps(_mm256_mul_ps(ty, ty), _mm256_sub_ps(three, _mm256_mul_ps(two, ty)));
+		__m256 a = lerp8(latticeValue8(hashLattice8(ix, iy, seed)), latticeValue8(hashLattice8(ix1, iy, seed)), tx);
+		__m256 b = lerp8(latticeValue8(hashLattice8(ix, iy1, seed)), latticeValue8(hashLattice8(ix1, iy1, seed)), tx);
+		return lerp8(a, b, ty);
+	}
+
+	NOISE_AVX2_FUNCTION inline __m256 quintic8(__m256 t) {
+		__m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f))), _mm256_set1_ps(10.0f));
+		return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+	}
+
+	NOISE_AVX2_FUNCTION __m256 gradientNoise8(__m256 x, __m256 y, __m256i seed) {
+		__m256 fx = _mm256_floor_ps(x);
+		__m256 fy = _mm256_floor_ps(y);
+		__m256i ix = _mm256_cvttps_epi32(fx);
+		__m256i iy = _mm256_cvttps_epi32(fy);
+		__m256i one = _mm256_set1_epi32(1);
+		__m256i ix1 = _mm256_add_epi32(ix, one);
+		__m256i iy1 = _mm256_add_epi32(iy, one);
+		__m256 dx = _mm256_sub_ps(x, fx);
+		__m256 dy = _mm256_sub_ps(y, fy);
+		__m256 dx1 = _mm256_sub_ps(dx, _mm256_set1_ps(1.0f));
+		__m256 dy1 = _mm256_sub_ps(dy, _mm256_set1_ps(1.0f));
+		__m256 tx = quintic8(dx);
+		__m256 ty = quintic8(dy);
+		__m256 a = lerp8(gradientDot8(hashLattice8(ix, iy, seed), dx, dy), gradientDot8(hashLattice8(ix1, iy, seed), dx1, dy), tx);
+		__m256 b = lerp8(gradientDot8(hashLattice8(ix, iy1, seed), dx, dy1), gradientDot8(hashLattice8(ix1, iy1, seed), dx1, dy1), tx);
+		return lerp8(a, b, ty);
+	}
+
+	NOISE_AVX2_FUNCTION inline __m256 simplexCorner8(__m256i h, __m256 x, __m256 y) {
+		__m256 t = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y));
+		__m256 inside = _mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_GE_OQ);
+		t = _mm256_mul_ps(t, t);
+		__m256 n = _mm256_mul_ps(_mm256_mul_ps(t, t), gradientDot8(h, x, y));
+		return _mm256_and_ps(n, inside);
+	}
+
+	NOISE_AVX2_FUNCTION __m256 simplexNoise8(__m256 x, __m256 y, __m256i seed) {
+		__m256 g2 = _mm256_set1_ps(SIMPLEX_G2);
+		__m256 one = _mm256_set1_ps(1.0f);
+		__m256 s = _mm256_mul_ps(_mm256_add_ps(x, y), _mm256_set1_ps(SIMPLEX_F2));
+		__m256 fi = _mm256_floor_ps(_mm256_add_ps(x, s));
+		__m256 fj = _mm256_floor_ps(_mm256_add_ps(y, s));
+		__m256i i = _mm256_cvttps_epi32(fi);
+		__m256i j = _mm256_cvttps_epi32(fj);
+		__m256 t = _mm256_mul_ps(_mm256_add_ps(fi, fj), g2);
+		__m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(fi, t));
+		__m256 y0 = _mm256_sub_ps(y, _mm256_sub_ps(fj, t));
+		__m256 i1 = _mm256_and_ps(_mm256_cmp_ps(x0, y0, _CMP_GT_OQ), one);
+		__m256 j1 = _mm256_sub_ps(one, i1);
+		__m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, i1), g2);
+		__m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, j1), g2);
+		__m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, one), _mm256_set1_ps(2.0f * SIMPLEX_G2));
+		__m256 y2 = _mm256_add_ps(_mm256_sub_ps(y0, one), _mm256_set1_ps(2.0f * SIMPLEX_G2));
+		__m256i oneInt = _mm256_set1_epi32(1);
+		__m256 n0 = simplexCorner8(hashLattice8(i, j, seed), x0, y0);
+		__m256 n1 = simplexCorner8(hashLattice8(_mm256_add_epi32(i, _mm256_cvttps_epi32(i1)), _mm256_add_epi32(j, _mm256_cvttps_epi32(j1)), seed), x1, y1);
+		__m256 n2 = simplexCorner8(hashLattice8(_mm256_add_epi32(i, oneInt), _mm256_add_epi32(j, oneInt), seed), x2, y2);
+		return _mm256_mul_ps(_mm256_set1_ps(70.0f), _mm256_add_ps(_mm256_add_ps(n0, n1), n2));
+	}
+
+	NOISE_AVX2_FUNCTION inline __m256 baseNoise8(hannah::NoiseType type, __m256 x, __m256 y, __m256i seed) {
+		switch (type) {
+		case hannah::NoiseType::VALUE:
+			return valueNoise8(x, y, seed);
+		case hannah::NoiseType::SIMPLEX:
+			return simplexNoise8(x, y, seed);
+		default:
+			return gradientNoise8(x, y, seed);
+		}
+	}
+
+	NOISE_AVX2_FUNCTION void sampleNoiseAVX2(const hannah::NoiseSettings& settings, const float* x, const float* y, float* out, size_t count) {
+		float scale = fractalScale(settings);
+		__m256 signMask = _mm256_set1_ps(-0.0f);
+		for (size_t i = 0; i + 8 <= count; i += 8)
+		{
+			__m256 px = _mm256_loadu_ps(x + i);
+			__m256 py = _mm256_loadu_ps(y + i);
+			__m256 sum = _mm256_setzero_ps();
+			if (settings.fractal == hannah::FractalType::NONE) {
+				__m256 f = _mm256_set1_ps(settings.frequency);
+				sum = baseNoise8(settings.type, _mm256_mul_ps(px, f), _mm256_mul_ps(py, f), _mm256_set1_epi32((int)settings.seed));
+				_mm256_storeu_ps(out + i, sum);
+				continue;
+			}
+			float frequency = settings.frequency;
+			float amplitude = 1.0f;
+			for (int o = 0; o < settings.octaves; o++)
+			{
+				__m256 f = _mm256_set1_ps(frequency);
+				__m256 n = baseNoise8(settings.type, _mm256_mul_ps(px, f), _mm256_mul_ps(py, f), _mm256_set1_epi32((int)(settings.seed + o)));
+				if (settings.fractal == hannah::FractalType::RIDGED) {
+					n = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_andnot_ps(signMask, n));
+					n = _mm256_mul_ps(n, n);
+				}
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(n, _mm256_set1_ps(amplitude)));
+				frequency *= settings.lacunarity;
+				amplitude *= settings.gain;
+			}
+			_mm256_storeu_ps(out + i, _mm256_mul_ps(sum, _mm256_set1_ps(scale)));
+		}
+	}
+
+	const bool USE_AVX2 = cpuHasAVX2();
+#else
+	const bool USE_AVX2 = false;
+#endif
+}
+
+float hannah::sampleNoise(const NoiseSettings& settings, float x, float y)
+{
+	if (settings.fractal == FractalType::NONE) {
+		return baseNoise(settings.type, x * settings.frequency, y * settings.frequency, settings.seed);
+	}
+	float sum = 0.0f;
+	float frequency = settings.frequency;
+	float amplitude = 1.0f;
+	for (int o = 0; o < settings.octaves; o++)
+	{
+		float n = baseNoise(settings.type, x * frequency, y * frequency, settings.seed + o);
+		if (settings.fractal == FractalType::RIDGED) {
+			n = 1.0f - fabsf(n);
+			n = n * n;
+		}
+		sum += n * amplitude;
+		frequency *= settings.lacunarity;
+		amplitude *= settings.gain;
+	}
+	return sum * fractalScale(settings);
+}
+
+void hannah::sampleNoise(const NoiseSettings& settings, const float* x, const float* y, float* out, size_t count)
+{
+	size_t i = 0;
+#if NOISE_AVX2
+	if (USE_AVX2) {
+		sampleNoiseAVX2(settings, x, y, out, count);
+		i = count - count % 8;
+	}
+#endif
+	for (; i < count; i++)
+	{
+		out[i] = sampleNoise(settings, x[i], y[i]);
+	}
+}
+
+void hannah::fillNoise(const NoiseSettings& settings, glm::vec2 origin, glm::vec2 step, int width, int height, float* out)
+{
+	if (width <= 0 || height <= 0) {
+		return;
+	}
+	//x coordinates are the same for every row
+	std::vector<float> xs(width);
+	for (int i = 0; i < width; i++)
+	{
+		xs[i] = origin.x + step.x * i;
+	}
+	size_t rowsPerBatch = std::max(SAMPLES_PER_BATCH / width, (size_t)1);
+	ew::parallelFor(height, rowsPerBatch, [&](size_t begin, size_t end) {
+		std::vector<float> ys(width);
+		for (size_t row = begin; row < end; row++)
+		{
+			std::fill(ys.begin(), ys.end(), origin.y + step.y * row);
+			sampleNoise(settings, xs.data(), ys.data(), out + row * width, width);
+		}
+	});
+}
+
+void hannah::displaceMesh(ew::MeshData* meshData, const NoiseSettings& settings, float amplitude)
+{
+	size_t numVertices = meshData->vertices.size();
+	ew::parallelFor(numVertices, SAMPLES_PER_BATCH, [&](size_t begin, size_t end) {
+		size_t count = end - begin;
+		std::vector<float> xs(count), ys(count), heights(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			xs[i] = meshData->vertices[begin + i].pos.x;
+			ys[i] = meshData->vertices[begin + i].pos.z;
+		}
+		sampleNoise(settings, xs.data(), ys.data(), heights.data(), count);
+		for (size_t i = 0; i < count; i++)
+		{
+			ew::Vertex& v = meshData->vertices[begin + i];
+			v.pos += v.normal * heights[i] * amplitude;
+		}
+	});
+
+	//Area weighted face normals
+	std::vector<glm::vec3> normals(numVertices, glm::vec3(0.0f));
+	const std::vector<unsigned int>& indices = meshData->indices;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		glm::vec3 p0 = meshData->vertices[indices[i]].pos;
+		glm::vec3 n = glm::cross(meshData->vertices[indices[i + 1]].pos - p0, meshData->vertices[indices[i + 2]].pos - p0);
+		normals[indices[i]] += n;
+		normals[indices[i + 1]] += n;
+		normals[indices[i + 2]] += n;
+	}
+	for (size_t i = 0; i < numVertices; i++)
+	{
+		if (glm::length(normals[i]) > 0.0f) {
+			meshData->vertices[i].normal = glm::normalize(normals[i]);
+		}
+	}
+	ew::generateTangents(meshData);
+}
+
+ew::TextureHandle hannah::createNoiseTexture(const NoiseSettings& settings, glm::vec2 origin, glm::vec2 size, int width, int height)
+{
+	std::vector<float> data(width * height);
+	fillNoise(settings, origin, size / glm::vec2(width, height), width, height, data.data());
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, data.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return ew::TextureHandle(texture);
+}
+
+bool hannah::noiseUsesAVX2()
+{
+	return USE_AVX2;
+}
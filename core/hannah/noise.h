@@ -0,0 +1,43 @@
+#pragma once
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+#include "../ew/mesh.h"
+#include "../ew/gpuResource.h"
+
+namespace hannah {
+	enum class NoiseType {
+		VALUE = 0,
+		GRADIENT = 1,
+		SIMPLEX = 2
+	};
+
+	enum class FractalType {
+		NONE = 0,
+		FBM = 1, //Roughly -1 to 1
+		RIDGED = 2 //0 to 1, sharp crests where the base noise crosses zero
+	};
+
+	struct NoiseSettings {
+		NoiseType type = NoiseType::GRADIENT;
+		FractalType fractal = FractalType::FBM;
+		float frequency = 1.0f;
+		int octaves = 5;
+		float lacunarity = 2.0f; //Frequency multiplier per octave
+		float gain = 0.5f; //Amplitude multiplier per octave
+		unsigned int seed = 0;
+	};
+
+	//Single 2D sample. Batches below give the same results much faster.
+	float sampleNoise(const NoiseSettings& settings, float x, float y);
+	//Evaluates count samples at (x[i], y[i]), 8 at a time with AVX2 when the CPU supports it
+	void sampleNoise(const NoiseSettings& settings, const float* x, const float* y, float* out, size_t count);
+	//Fills a width x height grid starting at origin with spacing step. Rows are split across the job system.
+	void fillNoise(const NoiseSettings& settings, glm::vec2 origin, glm::vec2 step, int width, int height, float* out);
+	//Moves every vertex along its normal by noise(pos.xz) * amplitude, then rebuilds normals and tangents
+	void displaceMesh(ew::MeshData* meshData, const NoiseSettings& settings, float amplitude);
+	//Single channel float texture covering size world units from origin
+	ew::TextureHandle createNoiseTexture(const NoiseSettings& settings, glm::vec2 origin, glm::vec2 size, int width, int height);
+	//True if batches run on the AVX2 path
+	bool noiseUsesAVX2();
+}
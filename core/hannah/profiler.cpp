@@ -0,0 +1,145 @@
+#include "profiler.h"
+#include "external/glad.h"
+
+#include <stdio.h>
+
+namespace {
+	//Weight of the newest frame in the smoothed timings
+	const float SMOOTHING = 0.1f;
+}
+
+void hannah::Profiler::beginFrame()
+{
+	m_current = (int)(m_frameIndex % FRAMES_IN_FLIGHT);
+	m_frameIndex++;
+	//Only blocks if the GPU is more than FRAMES_IN_FLIGHT frames behind
+	Frame& frame = m_frames[m_current];
+	if (frame.pending) {
+		resolve(&frame, true);
+	}
+	frame.scopes.clear();
+	m_open.clear();
+}
+
+void hannah::Profiler::endFrame()
+{
+	while (!m_open.empty()) {
+		endScope();
+	}
+	m_frames[m_current].pending = true;
+	//Oldest first, so results never go back in time
+	for (unsigned int i = 1; i < FRAMES_IN_FLIGHT; i++)
+	{
+		Frame& frame = m_frames[(m_current + i) % FRAMES_IN_FLIGHT];
+		if (frame.pending && !resolve(&frame, false)) {
+			break;
+		}
+	}
+}
+
+void hannah::Profiler::beginScope(const char* name)
+{
+	glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+	Scope scope;
+	scope.name = name;
+	scope.depth = (int)m_open.size();
+	scope.beginQuery = getQuery();
+	scope.endQuery = getQuery();
+	scope.cpuMs = 0.0f;
+	glQueryCounter(scope.beginQuery, GL_TIMESTAMP);
+	scope.cpuBegin = std::chrono::steady_clock::now();
+	m_open.push_back(m_frames[m_current].scopes.size());
+	m_frames[m_current].scopes.push_back(scope);
+}
+
+void hannah::Profiler::endScope()
+{
+	if (m_open.empty()) {
+		printf("Profiler scope ended without beginning\n");
+		return;
+	}
+	Scope& scope = m_frames[m_current].scopes[m_open.back()];
+	m_open.pop_back();
+	scope.cpuMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - scope.cpuBegin).count();
+	glQueryCounter(scope.endQuery, GL_TIMESTAMP);
+	glPopDebugGroup();
+}
+
+void hannah::Profiler::printReport()const
+{
+	printf("Profiler:\n");
+	for (const ProfileResult& result : m_results)
+	{
+		printf("%*s%-*s cpu %6.3f ms  gpu %6.3f ms\n", result.depth * 2, "", 24 - result.depth * 2, result.name.c_str(), result.cpuMs, result.gpuMs);
+	}
+}
+
+void hannah::Profiler::clear()
+{
+	for (Frame& frame : m_frames)
+	{
+		frame.scopes.clear();
+		frame.pending = false;
+	}
+	m_open.clear();
+	m_freeQueries.clear();
+	m_queries.clear();
+	m_results.clear();
+}
+
+unsigned int hannah::Profiler::getQuery()
+{
+	if (!m_freeQueries.empty()) {
+		unsigned int query = m_freeQueries.back();
+		m_freeQueries.pop_back();
+		return query;
+	}
+	unsigned int query;
+	glCreateQueries(GL_TIMESTAMP, 1, &query);
+	m_queries.push_back(ew::QueryHandle(query));
+	return query;
+}
+
+bool hannah::Profiler::resolve(Frame* frame, bool wait)
+{
+	//Queries finish in order, so the last one covers the whole frame
+	if (!wait && !frame->scopes.empty()) {
+		int available = 0;
+		glGetQueryObjectiv(frame->scopes.back().endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			return false;
+		}
+	}
+
+	//Scopes come and go when passes get culled, so match them up by name and depth
+	std::vector<ProfileResult> results;
+	results.reserve(frame->scopes.size());
+	for (const Scope& scope : frame->scopes)
+	{
+		GLuint64 begin = 0;
+		GLuint64 end = 0;
+		glGetQueryObjectui64v(scope.beginQuery, GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(scope.endQuery, GL_QUERY_RESULT, &end);
+		m_freeQueries.push_back(scope.beginQuery);
+		m_freeQueries.push_back(scope.endQuery);
+
+		ProfileResult result;
+		result.name = scope.name;
+		result.depth = scope.depth;
+		result.cpuMs = scope.cpuMs;
+		result.gpuMs = (float)((double)(end - begin) / 1000000.0);
+		for (const ProfileResult& previous : m_results)
+		{
+			if (previous.depth == result.depth && previous.name == result.name) {
+				result.cpuMs = previous.cpuMs + (result.cpuMs - previous.cpuMs) * SMOOTHING;
+				result.gpuMs = previous.gpuMs + (result.gpuMs - previous.gpuMs) * SMOOTHING;
+				break;
+			}
+		}
+		results.push_back(result);
+	}
+	m_results.swap(results);
+	frame->scopes.clear();
+	frame->pending = false;
+	return true;
+}
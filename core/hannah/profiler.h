@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include "../ew/gpuResource.h"
+
+namespace hannah {
+	struct ProfileResult {
+		std::string name;
+		int depth; //0 for top level scopes
+		float cpuMs; //Smoothed over recent frames
+		float gpuMs;
+	};
+
+	/// <summary>
+	/// CPU and GPU timings of named scopes. GPU time comes from timestamp queries, read back a few frames later
+	/// so the CPU never waits on them. Scopes also push a debug group so they show up in RenderDoc and Nsight.
+	/// </summary>
+	class Profiler {
+	public:
+		Profiler() {}
+		Profiler(const Profiler&) = delete;
+		Profiler& operator=(const Profiler&) = delete;
+		void beginFrame();
+		//Reads back every finished frame without blocking
+		void endFrame();
+		void beginScope(const char* name);
+		void endScope();
+		//Scopes of the latest finished frame in the order they began
+		inline const std::vector<ProfileResult>& getResults()const { return m_results; }
+		void printReport()const;
+		//Deletes the queries. Globals need this before the leak check runs.
+		void clear();
+	private:
+		static const int FRAMES_IN_FLIGHT = 4;
+		struct Scope {
+			std::string name;
+			int depth;
+			unsigned int beginQuery;
+			unsigned int endQuery;
+			std::chrono::steady_clock::time_point cpuBegin;
+			float cpuMs;
+		};
+		struct Frame {
+			std::vector<Scope> scopes;
+			bool pending = false;
+		};
+		unsigned int getQuery();
+		//Returns false if the GPU hasn't finished the frame and wait is false
+		bool resolve(Frame* frame, bool wait);
+
+		Frame m_frames[FRAMES_IN_FLIGHT];
+		int m_current = 0;
+		unsigned int m_frameIndex = 0;
+		std::vector<size_t> m_open; //Scopes of the current frame that haven't ended
+		std::vector<ew::QueryHandle> m_queries;
+		std::vector<unsigned int> m_freeQueries;
+		std::vector<ProfileResult> m_results;
+	};
+
+	//Times the enclosing block
+	class ProfileScope {
+	public:
+		ProfileScope(Profiler* profiler, const char* name) : m_profiler(profiler) {
+			if (m_profiler) {
+				m_profiler->beginScope(name);
+			}
+		}
+		~ProfileScope() {
+			if (m_profiler) {
+				m_profiler->endScope();
+			}
+		}
+		ProfileScope(const ProfileScope&) = delete;
+		ProfileScope& operator=(const ProfileScope&) = delete;
+	private:
+		Profiler* m_profiler;
+	};
+}
@@ -0,0 +1,348 @@
+#include "renderGraph.h"
+
+#include <stdio.h>
+#include <queue>
+#include <algorithm>
+#include <functional>
+
+namespace {
+	//What a pass needs waited on before it can see image stores made by an earlier pass
+	unsigned int getBarrierBit(hannah::RenderAccess access) {
+		switch (access) {
+		case hannah::RenderAccess::TEXTURE:
+			return GL_TEXTURE_FETCH_BARRIER_BIT;
+		case hannah::RenderAccess::ATTACHMENT:
+			return GL_FRAMEBUFFER_BARRIER_BIT;
+		default:
+			return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+		}
+	}
+}
+
+int hannah::RenderPassBuilder::create(const char* name, const RenderTargetDesc& desc)
+{
+	RenderGraph::Resource resource;
+	resource.name = name;
+	resource.desc = desc;
+	m_graph->m_resources.push_back(resource);
+	int id = (int)m_graph->m_resources.size() - 1;
+	write(id);
+	return id;
+}
+
+void hannah::RenderPassBuilder::read(int resource, RenderAccess access)
+{
+	if (resource < 0 || resource >= (int)m_graph->m_resources.size()) {
+		printf("Render pass %s reads unknown resource %d\n", m_graph->m_passes[m_pass].name.c_str(), resource);
+		return;
+	}
+	m_graph->m_passes[m_pass].reads.push_back({ resource, access });
+	m_graph->m_compiled = false;
+}
+
+void hannah::RenderPassBuilder::write(int resource, RenderAccess access)
+{
+	if (resource < 0 || resource >= (int)m_graph->m_resources.size()) {
+		printf("Render pass %s writes unknown resource %d\n", m_graph->m_passes[m_pass].name.c_str(), resource);
+		return;
+	}
+	m_graph->m_passes[m_pass].writes.push_back({ resource, access });
+	m_graph->m_compiled = false;
+}
+
+void hannah::RenderPassBuilder::setSideEffect()
+{
+	m_graph->m_passes[m_pass].sideEffect = true;
+	m_graph->m_compiled = false;
+}
+
+void hannah::RenderPassBuilder::setExecute(RenderPassExecute execute)
+{
+	m_graph->m_passes[m_pass].execute = execute;
+}
+
+hannah::RenderGraph::~RenderGraph()
+{
+	releaseAll();
+}
+
+void hannah::RenderGraph::reset()
+{
+	releaseAll();
+	m_passes.clear();
+	m_resources.clear();
+	m_order.clear();
+	m_compiled = false;
+}
+
+int hannah::RenderGraph::import(const char* name, const RenderTarget& target)
+{
+	Resource resource;
+	resource.name = name;
+	resource.target = target;
+	resource.desc.width = target.width;
+	resource.desc.height = target.height;
+	resource.imported = true;
+	m_resources.push_back(resource);
+	m_compiled = false;
+	return (int)m_resources.size() - 1;
+}
+
+void hannah::RenderGraph::markOutput(int resource)
+{
+	m_resources[resource].output = true;
+	m_compiled = false;
+}
+
+hannah::RenderPassBuilder hannah::RenderGraph::addPass(const char* name)
+{
+	Pass pass;
+	pass.name = name;
+	m_passes.push_back(pass);
+	m_compiled = false;
+	return RenderPassBuilder(this, (int)m_passes.size() - 1);
+}
+
+void hannah::RenderGraph::compile()
+{
+	int numPasses = (int)m_passes.size();
+	int numResources = (int)m_resources.size();
+
+	//Writers of a target chain in the order they were added, readers come after every writer
+	std::vector<std::vector<int>> successors(numPasses);
+	std::vector<int> numPredecessors(numPasses, 0);
+	for (int r = 0; r < numResources; r++)
+	{
+		int previousWriter = -1;
+		for (int p = 0; p < numPasses; p++)
+		{
+			if (!writes(m_passes[p], r)) {
+				continue;
+			}
+			if (previousWriter >= 0) {
+				successors[previousWriter].push_back(p);
+				numPredecessors[p]++;
+			}
+			previousWriter = p;
+			for (int reader = 0; reader < numPasses; reader++)
+			{
+				if (reader == p || writes(m_passes[reader], r)) {
+					continue;
+				}
+				for (const Access& read : m_passes[reader].reads)
+				{
+					if (read.resource == r) {
+						successors[p].push_back(reader);
+						numPredecessors[reader]++;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	//Topological sort. Ties go to the pass added first, so independent passes keep the order they were written in.
+	std::vector<int> order;
+	std::priority_queue<int, std::vector<int>, std::greater<int>> ready;
+	for (int p = 0; p < numPasses; p++)
+	{
+		if (numPredecessors[p] == 0) {
+			ready.push(p);
+		}
+	}
+	while (!ready.empty()) {
+		int p = ready.top();
+		ready.pop();
+		order.push_back(p);
+		for (int next : successors[p])
+		{
+			if (--numPredecessors[next] == 0) {
+				ready.push(next);
+			}
+		}
+	}
+	if ((int)order.size() != numPasses) {
+		printf("Render graph has a dependency cycle, running passes in the order they were added\n");
+		order.clear();
+		for (int p = 0; p < numPasses; p++)
+		{
+			order.push_back(p);
+		}
+	}
+
+	//Walk back from the outputs. A pass is needed if a later needed pass reads something it writes.
+	std::vector<bool> needed(numResources, false);
+	std::vector<bool> kept(numPasses, false);
+	for (int r = 0; r < numResources; r++)
+	{
+		needed[r] = m_resources[r].output;
+	}
+	for (int i = numPasses - 1; i >= 0; i--)
+	{
+		const Pass& pass = m_passes[order[i]];
+		bool keep = pass.sideEffect;
+		for (const Access& write : pass.writes)
+		{
+			keep |= needed[write.resource];
+		}
+		if (!keep) {
+			continue;
+		}
+		kept[order[i]] = true;
+		for (const Access& read : pass.reads)
+		{
+			needed[read.resource] = true;
+		}
+	}
+	m_order.clear();
+	for (int p : order)
+	{
+		if (kept[p]) {
+			m_order.push_back(p);
+		}
+	}
+
+	//Lifetimes and barriers over the kept passes only
+	for (Resource& resource : m_resources)
+	{
+		resource.firstPass = -1;
+		resource.lastPass = -1;
+	}
+	std::vector<bool> imageWritten(numResources, false); //Last write was an image store
+	for (int i = 0; i < (int)m_order.size(); i++)
+	{
+		Pass& pass = m_passes[m_order[i]];
+		pass.acquires.clear();
+		pass.releases.clear();
+		pass.barrierBits = 0;
+		pass.textureBarrier = false;
+		for (int j = 0; j < 2; j++)
+		{
+			for (const Access& access : j == 0 ? pass.reads : pass.writes)
+			{
+				Resource& resource = m_resources[access.resource];
+				if (resource.firstPass < 0) {
+					resource.firstPass = i;
+				}
+				resource.lastPass = i;
+				if (imageWritten[access.resource]) {
+					pass.barrierBits |= getBarrierBit(access.access);
+				}
+			}
+		}
+		for (const Access& read : pass.reads)
+		{
+			for (const Access& write : pass.writes)
+			{
+				pass.textureBarrier |= read.resource == write.resource && read.access == RenderAccess::TEXTURE && write.access == RenderAccess::ATTACHMENT;
+			}
+		}
+		for (const Access& write : pass.writes)
+		{
+			imageWritten[write.resource] = write.access == RenderAccess::IMAGE;
+		}
+	}
+	for (int r = 0; r < numResources; r++)
+	{
+		const Resource& resource = m_resources[r];
+		if (!resource.imported && resource.firstPass >= 0) {
+			m_passes[m_order[resource.firstPass]].acquires.push_back(r);
+			m_passes[m_order[resource.lastPass]].releases.push_back(r);
+		}
+	}
+	m_compiled = true;
+}
+
+void hannah::RenderGraph::execute()
+{
+	if (!m_compiled) {
+		compile();
+	}
+	for (int p : m_order)
+	{
+		Pass& pass = m_passes[p];
+		for (int r : pass.acquires)
+		{
+			m_resources[r].target = m_pool->acquire(m_resources[r].desc);
+			m_resources[r].acquired = true;
+		}
+		{
+			ProfileScope scope(m_profiler, pass.name.c_str());
+			if (pass.barrierBits != 0) {
+				glMemoryBarrier(pass.barrierBits);
+			}
+			if (pass.textureBarrier) {
+				glTextureBarrier();
+			}
+			if (pass.execute) {
+				pass.execute(*this);
+			}
+		}
+		for (int r : pass.releases)
+		{
+			m_pool->release(m_resources[r].target);
+			m_resources[r].target = RenderTarget();
+			m_resources[r].acquired = false;
+		}
+	}
+}
+
+const hannah::RenderTarget& hannah::RenderGraph::getTarget(int resource)const
+{
+	return m_resources[resource].target;
+}
+
+void hannah::RenderGraph::printReport()const
+{
+	printf("Render graph: %zu passes, %zu culled\n", getNumPasses(), getNumCulled());
+	for (size_t i = 0; i < m_order.size(); i++)
+	{
+		const Pass& pass = m_passes[m_order[i]];
+		printf("  %zu: %s", i, pass.name.c_str());
+		if (pass.barrierBits != 0) {
+			printf(" (barrier 0x%x)", pass.barrierBits);
+		}
+		if (pass.textureBarrier) {
+			printf(" (texture barrier)");
+		}
+		printf("\n");
+	}
+	for (size_t p = 0; p < m_passes.size(); p++)
+	{
+		if (std::find(m_order.begin(), m_order.end(), (int)p) == m_order.end()) {
+			printf("  culled: %s\n", m_passes[p].name.c_str());
+		}
+	}
+	for (const Resource& resource : m_resources)
+	{
+		if (resource.firstPass < 0) {
+			printf("  target %s: unused\n", resource.name.c_str());
+		}
+		else {
+			printf("  target %s: passes %d-%d%s\n", resource.name.c_str(), resource.firstPass, resource.lastPass, resource.imported ? ", imported" : "");
+		}
+	}
+}
+
+bool hannah::RenderGraph::writes(const Pass& pass, int resource)const
+{
+	for (const Access& write : pass.writes)
+	{
+		if (write.resource == resource) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void hannah::RenderGraph::releaseAll()
+{
+	for (Resource& resource : m_resources)
+	{
+		if (resource.acquired) {
+			m_pool->release(resource.target);
+			resource.target = RenderTarget();
+			resource.acquired = false;
+		}
+	}
+}
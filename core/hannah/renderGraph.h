@@ -0,0 +1,106 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "renderTargetPool.h"
+#include "profiler.h"
+
+namespace hannah {
+	//How a pass touches a target. Ordering only cares about reads vs writes, the access picks the barrier.
+	enum class RenderAccess {
+		TEXTURE = 0, //Sampled in a shader
+		ATTACHMENT = 1, //Bound to the framebuffer: drawn to, depth tested against or blitted
+		IMAGE = 2 //Image load/store, which GL doesn't synchronize by itself
+	};
+
+	class RenderGraph;
+	typedef std::function<void(const RenderGraph& graph)> RenderPassExecute;
+
+	//Declares what one pass reads and writes. Returned by RenderGraph::addPass.
+	class RenderPassBuilder {
+	public:
+		RenderPassBuilder(RenderGraph* graph, int pass) : m_graph(graph), m_pass(pass) {}
+		//A target that only lives for part of the frame, written by this pass. Returns its resource id.
+		int create(const char* name, const RenderTargetDesc& desc);
+		void read(int resource, RenderAccess access = RenderAccess::TEXTURE);
+		void write(int resource, RenderAccess access = RenderAccess::ATTACHMENT);
+		//Keeps the pass even if nothing reads what it writes
+		void setSideEffect();
+		void setExecute(RenderPassExecute execute);
+	private:
+		RenderGraph* m_graph;
+		int m_pass;
+	};
+
+	/// <summary>
+	/// Frame graph of render passes. Passes declare the targets they read and write, and the graph works out the rest:
+	/// - Order: a pass runs after every pass that writes what it reads. Passes writing the same target run in the order they were added.
+	///   So a target is finished before anything samples it, and using one after reading it needs a new target instead.
+	///   Aliasing makes that free.
+	/// - Culling: passes whose writes never reach an output, or a pass with side effects, are skipped.
+	/// - Lifetimes: created targets are acquired from the pool right before their first pass and released after their last,
+	///   so targets that are never alive at once share memory.
+	/// - Barriers: glMemoryBarrier after image stores and glTextureBarrier when a pass samples what it draws to.
+	/// - Profiling: every pass gets a profiler scope and debug group named after it.
+	/// Rebuild it every frame: reset, import, add passes, compile, execute.
+	/// </summary>
+	class RenderGraph {
+	public:
+		RenderGraph(RenderTargetPool* pool, Profiler* profiler = nullptr) : m_pool(pool), m_profiler(profiler) {}
+		RenderGraph(const RenderGraph&) = delete;
+		RenderGraph& operator=(const RenderGraph&) = delete;
+		~RenderGraph();
+		void reset();
+		//A target owned outside the graph, like a persistent pool target or the default framebuffer (fbo 0)
+		int import(const char* name, const RenderTarget& target);
+		//The passes writing an output are kept even though no pass reads it
+		void markOutput(int resource);
+		RenderPassBuilder addPass(const char* name);
+		void compile();
+		void execute();
+		//For use inside a pass that declared the resource
+		const RenderTarget& getTarget(int resource)const;
+		inline size_t getNumPasses()const { return m_passes.size(); }
+		inline size_t getNumCulled()const { return m_passes.size() - m_order.size(); }
+		//Execution order, culled passes and target lifetimes
+		void printReport()const;
+	private:
+		friend class RenderPassBuilder;
+		struct Access {
+			int resource;
+			RenderAccess access;
+		};
+		struct Pass {
+			std::string name;
+			std::vector<Access> reads;
+			std::vector<Access> writes;
+			bool sideEffect = false;
+			RenderPassExecute execute;
+			//Filled in by compile
+			std::vector<int> acquires;
+			std::vector<int> releases;
+			unsigned int barrierBits = 0;
+			bool textureBarrier = false;
+		};
+		struct Resource {
+			std::string name;
+			RenderTargetDesc desc;
+			RenderTarget target;
+			bool imported = false;
+			bool output = false;
+			bool acquired = false;
+			int firstPass = -1; //Position in the execution order, -1 if no kept pass uses it
+			int lastPass = -1;
+		};
+		bool writes(const Pass& pass, int resource)const;
+		void releaseAll();
+
+		RenderTargetPool* m_pool;
+		Profiler* m_profiler;
+		std::vector<Pass> m_passes;
+		std::vector<Resource> m_resources;
+		std::vector<int> m_order; //Kept passes in execution order
+		bool m_compiled = false;
+	};
+}
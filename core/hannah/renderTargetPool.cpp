@@ -0,0 +1,310 @@
+#include "renderTargetPool.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+namespace {
+	//Frames a free texture is kept around for in case the pass that used it comes back
+	const unsigned int UNUSED_FRAMES = 8;
+
+	//Approximate, drivers may pad 3 channel formats to 4
+	size_t getBytesPerPixel(int format) {
+		switch (format) {
+		case GL_R8:
+			return 1;
+		case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16:
+			return 2;
+		case GL_RGB8: case GL_SRGB8: case GL_DEPTH_COMPONENT24:
+			return 3;
+		case GL_RGB16F:
+			return 6;
+		case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8:
+			return 8;
+		case GL_RGB32F:
+			return 12;
+		case GL_RGBA32F:
+			return 16;
+		default:
+			return 4;
+		}
+	}
+
+	bool isDepthFormat(int format) {
+		switch (format) {
+		case GL_DEPTH_COMPONENT16: case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32: case GL_DEPTH_COMPONENT32F:
+		case GL_DEPTH24_STENCIL8: case GL_DEPTH32F_STENCIL8:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	bool hasStencil(int format) {
+		return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+	}
+
+	bool isMipmapFilter(int filter) {
+		return filter == GL_NEAREST_MIPMAP_NEAREST || filter == GL_NEAREST_MIPMAP_LINEAR || filter == GL_LINEAR_MIPMAP_NEAREST || filter == GL_LINEAR_MIPMAP_LINEAR;
+	}
+
+	//The same filter without mipmaps, which is all mag filters and single level textures take
+	int getBaseFilter(int filter) {
+		switch (filter) {
+		case GL_NEAREST_MIPMAP_NEAREST: case GL_NEAREST_MIPMAP_LINEAR:
+			return GL_NEAREST;
+		case GL_LINEAR_MIPMAP_NEAREST: case GL_LINEAR_MIPMAP_LINEAR:
+			return GL_LINEAR;
+		default:
+			return filter;
+		}
+	}
+}
+
+hannah::RenderTargetPool::~RenderTargetPool()
+{
+	clear();
+}
+
+void hannah::RenderTargetPool::beginFrame(unsigned int screenWidth, unsigned int screenHeight)
+{
+	m_frame++;
+	//A minimized window reports 0x0, which can't be allocated, so targets keep their last size
+	if (screenWidth == 0 || screenHeight == 0 || (screenWidth == m_screenWidth && screenHeight == m_screenHeight)) {
+		return;
+	}
+	unsigned int oldWidth = m_screenWidth;
+	unsigned int oldHeight = m_screenHeight;
+	m_screenWidth = screenWidth;
+	m_screenHeight = screenHeight;
+	for (Persistent& persistent : m_persistent)
+	{
+		if (persistent.desc.width == 0 || persistent.desc.height == 0) {
+			releaseTextures(persistent.target);
+		}
+	}
+	//Nothing will ask for the old screen size again. Freeing before reallocating keeps a resize from holding both sizes.
+	for (size_t i = m_textures.size(); i-- > 0;)
+	{
+		if (!m_textures[i].inUse && m_textures[i].width == oldWidth && m_textures[i].height == oldHeight) {
+			freeTexture(i);
+		}
+	}
+	for (Persistent& persistent : m_persistent)
+	{
+		if (persistent.desc.width == 0 || persistent.desc.height == 0) {
+			persistent.target = assemble(persistent.desc, true);
+		}
+	}
+}
+
+void hannah::RenderTargetPool::endFrame()
+{
+	for (size_t i = m_textures.size(); i-- > 0;)
+	{
+		PooledTexture& texture = m_textures[i];
+		if (texture.inUse && !texture.persistent) {
+			texture.inUse = false;
+		}
+		if (!texture.inUse && m_frame - texture.lastUsedFrame > UNUSED_FRAMES) {
+			freeTexture(i);
+		}
+	}
+}
+
+int hannah::RenderTargetPool::createPersistent(const RenderTargetDesc& desc)
+{
+	Persistent persistent;
+	persistent.desc = desc;
+	persistent.target = assemble(desc, true);
+	m_persistent.push_back(persistent);
+	return (int)m_persistent.size() - 1;
+}
+
+hannah::RenderTarget hannah::RenderTargetPool::acquire(const RenderTargetDesc& desc)
+{
+	return assemble(desc, false);
+}
+
+void hannah::RenderTargetPool::release(const RenderTarget& target)
+{
+	releaseTextures(target);
+}
+
+void hannah::RenderTargetPool::clear()
+{
+	m_framebuffers.clear();
+	m_textures.clear();
+	m_persistent.clear();
+	m_stats.bytes = 0;
+	m_stats.numTextures = 0;
+	m_stats.numFramebuffers = 0;
+}
+
+void hannah::RenderTargetPool::printReport()const
+{
+	printf("Render targets: %zu textures, %zu framebuffers, %.1f MB (peak %.1f MB), %zu created in total\n", m_stats.numTextures, m_stats.numFramebuffers,
+		m_stats.bytes / 1048576.0, m_stats.peakBytes / 1048576.0, m_stats.numCreated);
+}
+
+unsigned int hannah::RenderTargetPool::acquireTexture(int format, unsigned int width, unsigned int height, int samples, int filter, bool persistent)
+{
+	for (PooledTexture& texture : m_textures)
+	{
+		if (!texture.inUse && texture.format == format && texture.width == width && texture.height == height && texture.samples == samples && texture.filter == filter) {
+			texture.inUse = true;
+			texture.persistent = persistent;
+			texture.lastUsedFrame = m_frame;
+			return texture.texture;
+		}
+	}
+
+	int levels = 1;
+	if (isMipmapFilter(filter) && samples == 1) {
+		while ((std::max(width, height) >> levels) > 0) {
+			levels++;
+		}
+	}
+	unsigned int handle;
+	if (samples > 1) {
+		glCreateTextures(GL_TEXTURE_2D_MULTISAMPLE, 1, &handle);
+		glTextureStorage2DMultisample(handle, samples, format, width, height, GL_TRUE);
+	}
+	else {
+		glCreateTextures(GL_TEXTURE_2D, 1, &handle);
+		glTextureStorage2D(handle, levels, format, width, height);
+		glTextureParameteri(handle, GL_TEXTURE_MIN_FILTER, filter);
+		glTextureParameteri(handle, GL_TEXTURE_MAG_FILTER, getBaseFilter(filter));
+		if (levels > 1) {
+			//Mipmapped targets get sampled minified, often at grazing angles
+			glTextureParameterf(handle, GL_TEXTURE_MAX_ANISOTROPY, 8.0f);
+		}
+		if (isDepthFormat(format)) {
+			//Outside a shadow map counts as lit
+			float borderColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+			glTextureParameteri(handle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+			glTextureParameteri(handle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+			glTextureParameterfv(handle, GL_TEXTURE_BORDER_COLOR, borderColor);
+		}
+		else {
+			glTextureParameteri(handle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTextureParameteri(handle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		}
+	}
+	PooledTexture texture;
+	texture.texture = ew::TextureHandle(handle);
+	texture.format = format;
+	texture.width = width;
+	texture.height = height;
+	texture.samples = samples;
+	texture.filter = filter;
+	texture.bytes = getBytesPerPixel(format) * width * height * samples;
+	if (levels > 1) {
+		texture.bytes = texture.bytes * 4 / 3; //Each level is a quarter of the one above
+	}
+	texture.inUse = true;
+	texture.persistent = persistent;
+	texture.lastUsedFrame = m_frame;
+	m_stats.bytes += texture.bytes;
+	m_stats.peakBytes = std::max(m_stats.peakBytes, m_stats.bytes);
+	m_stats.numTextures++;
+	m_stats.numCreated++;
+	m_textures.push_back(std::move(texture));
+	return handle;
+}
+
+hannah::RenderTarget hannah::RenderTargetPool::assemble(const RenderTargetDesc& desc, bool persistent)
+{
+	RenderTarget target;
+	target.width = desc.width != 0 ? desc.width : m_screenWidth;
+	target.height = desc.height != 0 ? desc.height : m_screenHeight;
+	int numColors = std::min(desc.numColors, MAX_COLOR_ATTACHMENTS);
+	for (int i = 0; i < numColors; i++)
+	{
+		target.colorBuffer[i] = acquireTexture(desc.colorFormats[i], target.width, target.height, desc.samples, desc.filter, persistent);
+	}
+	if (desc.depthFormat != 0) {
+		target.depthBuffer = acquireTexture(desc.depthFormat, target.width, target.height, desc.samples, getBaseFilter(desc.filter), persistent);
+	}
+	target.fbo = getFramebuffer(target, numColors);
+	return target;
+}
+
+unsigned int hannah::RenderTargetPool::getFramebuffer(const RenderTarget& target, int numColors)
+{
+	std::vector<unsigned int> key(target.colorBuffer, target.colorBuffer + numColors);
+	key.push_back(target.depthBuffer);
+	key.push_back(numColors);
+	auto it = m_framebuffers.find(key);
+	if (it != m_framebuffers.end()) {
+		return it->second;
+	}
+
+	unsigned int fbo;
+	glCreateFramebuffers(1, &fbo);
+	GLenum drawBuffers[MAX_COLOR_ATTACHMENTS];
+	for (int i = 0; i < numColors; i++)
+	{
+		glNamedFramebufferTexture(fbo, GL_COLOR_ATTACHMENT0 + i, target.colorBuffer[i], 0);
+		drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+	}
+	if (target.depthBuffer != 0) {
+		int format = 0;
+		for (const PooledTexture& texture : m_textures)
+		{
+			if (texture.texture.get() == target.depthBuffer) {
+				format = texture.format;
+			}
+		}
+		glNamedFramebufferTexture(fbo, hasStencil(format) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, target.depthBuffer, 0);
+	}
+	if (numColors > 0) {
+		glNamedFramebufferDrawBuffers(fbo, numColors, drawBuffers);
+	}
+	else {
+		glNamedFramebufferDrawBuffer(fbo, GL_NONE);
+		glNamedFramebufferReadBuffer(fbo, GL_NONE);
+	}
+	GLenum fboStatus = glCheckNamedFramebufferStatus(fbo, GL_FRAMEBUFFER);
+	if (fboStatus != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Framebuffer incomplete: %d\n", fboStatus);
+	}
+	m_framebuffers[key] = ew::FramebufferHandle(fbo);
+	m_stats.numFramebuffers++;
+	return fbo;
+}
+
+void hannah::RenderTargetPool::releaseTextures(const RenderTarget& target)
+{
+	for (PooledTexture& texture : m_textures)
+	{
+		unsigned int handle = texture.texture;
+		bool attached = handle == target.depthBuffer;
+		for (int i = 0; i < MAX_COLOR_ATTACHMENTS; i++)
+		{
+			attached |= handle == target.colorBuffer[i];
+		}
+		if (attached && handle != 0) {
+			texture.inUse = false;
+			texture.persistent = false;
+			texture.lastUsedFrame = m_frame;
+		}
+	}
+}
+
+void hannah::RenderTargetPool::freeTexture(size_t i)
+{
+	unsigned int handle = m_textures[i].texture;
+	for (auto it = m_framebuffers.begin(); it != m_framebuffers.end();)
+	{
+		if (std::find(it->first.begin(), it->first.end() - 1, handle) != it->first.end() - 1) {
+			it = m_framebuffers.erase(it);
+			m_stats.numFramebuffers--;
+		}
+		else {
+			++it;
+		}
+	}
+	m_stats.bytes -= m_textures[i].bytes;
+	m_stats.numTextures--;
+	m_textures.erase(m_textures.begin() + i);
+}
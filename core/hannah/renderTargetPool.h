@@ -0,0 +1,98 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <stddef.h>
+
+#include "external/glad.h"
+#include "../ew/gpuResource.h"
+
+namespace hannah {
+	const int MAX_COLOR_ATTACHMENTS = 8;
+
+	struct RenderTargetDesc {
+		unsigned int width = 0; //0 follows the screen size passed to beginFrame
+		unsigned int height = 0;
+		int samples = 1;
+		int numColors = 0;
+		int colorFormats[MAX_COLOR_ATTACHMENTS] = { 0 };
+		int depthFormat = 0; //0 for no depth attachment
+		int filter = GL_LINEAR; //Min and mag filter of every attachment
+		//A mipmap filter gives color attachments a full mip chain, regenerate it after drawing. Depth stays one level.
+	};
+
+	//Framebuffer handed out by RenderTargetPool, with the same fields as Framebuffer. The pool keeps ownership.
+	struct RenderTarget {
+		unsigned int fbo = 0;
+		unsigned int colorBuffer[MAX_COLOR_ATTACHMENTS] = { 0 };
+		unsigned int depthBuffer = 0;
+		unsigned int width = 0;
+		unsigned int height = 0;
+	};
+
+	struct RenderTargetStats {
+		size_t bytes = 0; //Attachment memory currently allocated
+		size_t peakBytes = 0;
+		size_t numTextures = 0;
+		size_t numFramebuffers = 0;
+		size_t numCreated = 0; //Attachments created since the pool was made, stays flat once frames reuse them
+	};
+
+	/// <summary>
+	/// Render targets shared through a pool of attachment textures keyed by (format, size, samples, filter).
+	/// Persistent targets live across frames and are recreated when the screen size changes.
+	/// Transient targets are acquired for part of a frame. Once released their textures go back to the pool,
+	/// so later passes this frame alias the same memory, and next frame the same acquires get the same textures.
+	/// Framebuffer objects are cached per attachment set. Textures unused for a few frames are freed.
+	/// </summary>
+	class RenderTargetPool {
+	public:
+		RenderTargetPool() {}
+		~RenderTargetPool();
+		RenderTargetPool(const RenderTargetPool&) = delete;
+		RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+		//Call once per frame before acquiring. A new screen size recreates persistent screen sized targets.
+		void beginFrame(unsigned int screenWidth, unsigned int screenHeight);
+		//Releases transient targets still held and frees textures unused for a while
+		void endFrame();
+		//Returns an id for get. Look the target up every frame, its objects change on resize.
+		int createPersistent(const RenderTargetDesc& desc);
+		inline const RenderTarget& get(int target)const { return m_persistent[target].target; }
+		RenderTarget acquire(const RenderTargetDesc& desc);
+		void release(const RenderTarget& target);
+		//Deletes every GL object, persistent targets included
+		void clear();
+		inline const RenderTargetStats& getStats()const { return m_stats; }
+		void printReport()const;
+	private:
+		struct PooledTexture {
+			ew::TextureHandle texture;
+			int format;
+			unsigned int width;
+			unsigned int height;
+			int samples;
+			int filter;
+			size_t bytes;
+			bool inUse;
+			bool persistent;
+			unsigned int lastUsedFrame;
+		};
+		struct Persistent {
+			RenderTargetDesc desc;
+			RenderTarget target;
+		};
+		unsigned int acquireTexture(int format, unsigned int width, unsigned int height, int samples, int filter, bool persistent);
+		RenderTarget assemble(const RenderTargetDesc& desc, bool persistent);
+		unsigned int getFramebuffer(const RenderTarget& target, int numColors);
+		void releaseTextures(const RenderTarget& target);
+		//Also drops every framebuffer it was attached to
+		void freeTexture(size_t i);
+
+		std::vector<PooledTexture> m_textures;
+		std::map<std::vector<unsigned int>, ew::FramebufferHandle> m_framebuffers; //Keyed by attachments, then the number of colors
+		std::vector<Persistent> m_persistent;
+		unsigned int m_screenWidth = 0;
+		unsigned int m_screenHeight = 0;
+		unsigned int m_frame = 0;
+		RenderTargetStats m_stats;
+	};
+}
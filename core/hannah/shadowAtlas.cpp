@@ -0,0 +1,540 @@
+#include "shadowAtlas.h"
+#include "meshlet.h"
+#include "meshLOD.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+	//Same faces and up vectors as GL cube maps
+	const glm::vec3 CUBE_DIRECTIONS[6] = {
+		glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+		glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+	};
+	const glm::vec3 CUBE_UPS[6] = {
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+	};
+
+	int getNumFaces(const hannah::ShadowLight& light) {
+		return light.type == hannah::ShadowLightType::POINT ? 6 : 1;
+	}
+
+	bool sameLight(const hannah::ShadowLight& a, const hannah::ShadowLight& b) {
+		if (a.type != b.type || a.position != b.position || a.radius != b.radius) {
+			return false;
+		}
+		return a.type == hannah::ShadowLightType::POINT || (a.direction == b.direction && a.outerAngle == b.outerAngle);
+	}
+
+	bool sphereInFrustum(const hannah::Frustum& frustum, const glm::vec3& center, float radius) {
+		for (int i = 0; i < 6; i++)
+		{
+			if (glm::dot(glm::vec3(frustum.planes[i]), center) + frustum.planes[i].w < -radius) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	int nextPowerOfTwo(float x) {
+		int size = 1;
+		while ((float)size < x && size < (1 << 30)) {
+			size <<= 1;
+		}
+		return size;
+	}
+
+	int log2i(int x) {
+		int log = 0;
+		while (x > 1) {
+			x >>= 1;
+			log++;
+		}
+		return log;
+	}
+}
+
+void hannah::computeBoundingSphere(const std::vector<ew::MeshData>& meshes, glm::vec3* center, float* radius)
+{
+	glm::vec3 minPos = glm::vec3(FLT_MAX);
+	glm::vec3 maxPos = glm::vec3(-FLT_MAX);
+	for (const ew::MeshData& mesh : meshes)
+	{
+		for (const ew::Vertex& vertex : mesh.vertices)
+		{
+			minPos = glm::min(minPos, vertex.pos);
+			maxPos = glm::max(maxPos, vertex.pos);
+		}
+	}
+	if (minPos.x > maxPos.x) {
+		*center = glm::vec3(0.0f);
+		*radius = 0.0f;
+		return;
+	}
+	*center = (minPos + maxPos) * 0.5f;
+	float radiusSq = 0.0f;
+	for (const ew::MeshData& mesh : meshes)
+	{
+		for (const ew::Vertex& vertex : mesh.vertices)
+		{
+			glm::vec3 offset = vertex.pos - *center;
+			radiusSq = std::max(radiusSq, glm::dot(offset, offset));
+		}
+	}
+	*radius = sqrtf(radiusSq);
+}
+
+void hannah::ShadowAtlas::TileAllocator::reset(int size, int minSize)
+{
+	m_size = size;
+	m_numLevels = log2i(size / std::max(minSize, 1)) + 1;
+	m_levelOffsets.resize(m_numLevels);
+	int offset = 0;
+	for (int level = 0; level < m_numLevels; level++)
+	{
+		m_levelOffsets[level] = offset;
+		offset += 1 << (2 * level);
+	}
+	m_states.assign(offset, FREE);
+}
+
+int hannah::ShadowAtlas::TileAllocator::allocate(int size)
+{
+	if (size <= 0 || size > m_size) {
+		return -1;
+	}
+	int level = log2i(m_size / size);
+	if (level >= m_numLevels) {
+		return -1;
+	}
+	return find(0, 0, 0, level);
+}
+
+int hannah::ShadowAtlas::TileAllocator::find(int level, int ix, int iy, int targetLevel)
+{
+	int node = index(level, ix, iy);
+	if (m_states[node] == USED) {
+		return -1;
+	}
+	if (level == targetLevel) {
+		if (m_states[node] != FREE) {
+			return -1;
+		}
+		m_states[node] = USED;
+		return node;
+	}
+	m_states[node] = SPLIT;
+	//Fill squares that are already split before breaking up whole free ones, keeps large squares available
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int child = 0; child < 4; child++)
+		{
+			int cx = ix * 2 + (child & 1);
+			int cy = iy * 2 + (child >> 1);
+			State state = m_states[index(level + 1, cx, cy)];
+			if (state == USED || (pass == 0) != (state == SPLIT)) {
+				continue;
+			}
+			int tile = find(level + 1, cx, cy, targetLevel);
+			if (tile >= 0) {
+				return tile;
+			}
+		}
+	}
+	//Only reachable if the node was split already, so marking it split changed nothing
+	return -1;
+}
+
+void hannah::ShadowAtlas::TileAllocator::free(int tile)
+{
+	int level, ix, iy;
+	decode(tile, &level, &ix, &iy);
+	m_states[tile] = FREE;
+	//Merge back up while all four siblings are free
+	while (level > 0) {
+		ix /= 2;
+		iy /= 2;
+		level--;
+		for (int child = 0; child < 4; child++)
+		{
+			if (m_states[index(level + 1, ix * 2 + (child & 1), iy * 2 + (child >> 1))] != FREE) {
+				return;
+			}
+		}
+		m_states[index(level, ix, iy)] = FREE;
+	}
+}
+
+void hannah::ShadowAtlas::TileAllocator::getRect(int tile, int* x, int* y, int* size)const
+{
+	int level, ix, iy;
+	decode(tile, &level, &ix, &iy);
+	*size = m_size >> level;
+	*x = ix * *size;
+	*y = iy * *size;
+}
+
+void hannah::ShadowAtlas::TileAllocator::decode(int tile, int* level, int* ix, int* iy)const
+{
+	*level = m_numLevels - 1;
+	while (*level > 0 && tile < m_levelOffsets[*level]) {
+		(*level)--;
+	}
+	int local = tile - m_levelOffsets[*level];
+	*ix = local % (1 << *level);
+	*iy = local / (1 << *level);
+}
+
+hannah::ShadowAtlas::ShadowAtlas(const ShadowAtlasSettings& settings)
+	: m_settings(settings)
+{
+	m_settings.minTileSize = std::min(m_settings.minTileSize, m_settings.atlasSize);
+	m_settings.maxTileSize = std::max(std::min(m_settings.maxTileSize, m_settings.atlasSize), m_settings.minTileSize);
+	m_allocator.reset(m_settings.atlasSize, m_settings.minTileSize);
+}
+
+void hannah::ShadowAtlas::update(const std::vector<ShadowLight>& lights, const std::vector<ShadowCaster>& casters, const ew::Camera& camera, float screenHeight)
+{
+	int minTile = m_settings.minTileSize;
+	int numLights = (int)lights.size();
+	for (int i = numLights; i < (int)m_lights.size(); i++)
+	{
+		freeTiles(&m_lights[i]);
+	}
+	m_lights.resize(numLights);
+
+	//World space caster bounds, and which casters moved since last frame
+	size_t numCasters = casters.size();
+	std::vector<glm::vec4> bounds(numCasters);
+	std::vector<bool> moved(numCasters);
+	for (size_t c = 0; c < numCasters; c++)
+	{
+		const glm::mat4& model = casters[c].model;
+		float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		bounds[c] = glm::vec4(glm::vec3(model * glm::vec4(casters[c].center, 1.0f)), casters[c].radius * scale);
+		moved[c] = c >= m_casterModels.size() || model != m_casterModels[c];
+	}
+
+	//Only lights that touch the screen and have something to shadow compete for space, most important first
+	Frustum view = extractFrustum(camera.projectionMatrix() * camera.viewMatrix());
+	std::vector<int> candidates;
+	std::vector<std::vector<int>> lightCasters(numLights); //Casters within each light's radius
+	for (int i = 0; i < numLights; i++)
+	{
+		const ShadowLight& light = lights[i];
+		m_lights[i].importance = 0.0f;
+		if (!sphereInFrustum(view, light.position, light.radius)) {
+			continue;
+		}
+		std::vector<int>& inRange = lightCasters[i];
+		for (size_t c = 0; c < numCasters; c++)
+		{
+			if (glm::distance(glm::vec3(bounds[c]), light.position) < light.radius + bounds[c].w) {
+				inRange.push_back((int)c);
+			}
+		}
+		if (inRange.empty()) {
+			continue;
+		}
+		//Pixels the light's radius covers on screen, the whole screen once the camera is inside it
+		bool inside = glm::distance(camera.position, light.position) < light.radius;
+		m_lights[i].importance = inside ? screenHeight : pixelsPerUnit(camera, light.position, screenHeight) * light.radius;
+		candidates.push_back(i);
+	}
+	std::stable_sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+		return m_lights[a].importance > m_lights[b].importance;
+	});
+
+	//Size every tile by importance, then halve the least important until the faces fit in the atlas by area.
+	//Lights already at the smallest size lose their shadows, least important first.
+	std::vector<int> sizes(numLights, 0);
+	size_t capacity = (size_t)m_settings.atlasSize * m_settings.atlasSize;
+	size_t used = 0;
+	for (int i : candidates)
+	{
+		float texels = m_lights[i].importance * m_settings.resolutionScale;
+		sizes[i] = std::min(std::max(nextPowerOfTwo(texels), minTile), m_settings.maxTileSize);
+		used += (size_t)getNumFaces(lights[i]) * sizes[i] * sizes[i];
+	}
+	int numKept = (int)candidates.size();
+	int cursor = numKept - 1;
+	while (used > capacity && numKept > 0) {
+		while (cursor >= 0 && sizes[candidates[cursor]] <= minTile) {
+			cursor--;
+		}
+		if (cursor >= 0) {
+			int i = candidates[cursor];
+			used -= (size_t)getNumFaces(lights[i]) * sizes[i] * sizes[i] * 3 / 4;
+			sizes[i] /= 2;
+		}
+		else {
+			int i = candidates[--numKept];
+			used -= (size_t)getNumFaces(lights[i]) * sizes[i] * sizes[i];
+			sizes[i] = 0;
+		}
+	}
+	candidates.resize(numKept);
+
+	//Lights whose tile size didn't change keep their tiles, and with them last frame's depth
+	for (int i = 0; i < numLights; i++)
+	{
+		if (m_lights[i].tileSize != sizes[i] || m_lights[i].light.type != lights[i].type) {
+			freeTiles(&m_lights[i]);
+		}
+	}
+	std::vector<int> allocations;
+	for (int i : candidates)
+	{
+		if (m_lights[i].tileSize == 0) {
+			allocations.push_back(i);
+		}
+	}
+	//Largest first, squares placed that way can't fragment a quadtree
+	std::stable_sort(allocations.begin(), allocations.end(), [&](int a, int b) {
+		return sizes[a] > sizes[b];
+	});
+	bool packed = true;
+	for (size_t k = 0; k < allocations.size() && packed; k++)
+	{
+		LightState& state = m_lights[allocations[k]];
+		state.tileSize = sizes[allocations[k]];
+		for (int f = 0; f < getNumFaces(lights[allocations[k]]) && packed; f++)
+		{
+			state.tiles[f] = m_allocator.allocate(state.tileSize);
+			packed = state.tiles[f] >= 0;
+		}
+	}
+	if (!packed) {
+		//Tiles kept from earlier frames fragmented the atlas. Everything fits by area, so reassigning
+		//every tile largest first always succeeds, at the cost of redrawing every face.
+		m_allocator.reset(m_settings.atlasSize, minTile);
+		for (LightState& state : m_lights)
+		{
+			state.tileSize = 0;
+			for (int f = 0; f < 6; f++)
+			{
+				state.tiles[f] = -1;
+				state.faceDrawn[f] = false;
+				state.faceStale[f] = false;
+			}
+		}
+		allocations = candidates;
+		std::stable_sort(allocations.begin(), allocations.end(), [&](int a, int b) {
+			return sizes[a] > sizes[b];
+		});
+		for (int i : allocations)
+		{
+			m_lights[i].tileSize = sizes[i];
+			for (int f = 0; f < getNumFaces(lights[i]); f++)
+			{
+				m_lights[i].tiles[f] = m_allocator.allocate(sizes[i]);
+			}
+		}
+		m_stats.numRepacks++;
+	}
+
+	//Cull casters per face. A face is drawn if its tile is new, the light changed, or a caster in it moved, came or went.
+	m_drawQueue.clear();
+	m_stats.facesReused = 0;
+	m_stats.facesPending = 0;
+	for (int i : candidates)
+	{
+		LightState& state = m_lights[i];
+		const ShadowLight& light = lights[i];
+		bool lightChanged = !sameLight(state.light, light);
+		state.light = light;
+		for (int f = 0; f < getNumFaces(light); f++)
+		{
+			state.viewProj[f] = getFaceViewProj(light, f);
+			Frustum frustum = extractFrustum(state.viewProj[f]);
+			std::vector<int> faceCasters;
+			for (int c : lightCasters[i])
+			{
+				if (sphereInFrustum(frustum, glm::vec3(bounds[c]), bounds[c].w)) {
+					faceCasters.push_back(c);
+				}
+			}
+			bool dirty = !state.faceDrawn[f] || state.faceStale[f] || lightChanged || faceCasters != state.faceCasters[f];
+			for (size_t k = 0; k < faceCasters.size() && !dirty; k++)
+			{
+				dirty = moved[faceCasters[k]];
+			}
+			state.faceCasters[f].swap(faceCasters);
+			if (!dirty) {
+				m_stats.facesReused++;
+			}
+			else if ((int)m_drawQueue.size() < m_settings.maxFacesPerFrame) {
+				m_drawQueue.push_back({ i, f });
+				state.faceDrawn[f] = true;
+				state.faceStale[f] = false;
+			}
+			else {
+				state.faceStale[f] = true;
+				m_stats.facesPending++;
+			}
+		}
+	}
+	for (int i = 0; i < numLights; i++)
+	{
+		m_lights[i].light = lights[i];
+	}
+	m_casterModels.resize(numCasters);
+	for (size_t c = 0; c < numCasters; c++)
+	{
+		m_casterModels[c] = casters[c].model;
+	}
+
+	//Lights with every face drawn at least once are shadowed, slightly stale faces included
+	m_faces.clear();
+	m_firstFaces.assign(numLights, -1);
+	float atlasSize = (float)m_settings.atlasSize;
+	for (int i = 0; i < numLights; i++)
+	{
+		const LightState& state = m_lights[i];
+		int numFaces = getNumFaces(state.light);
+		bool drawn = state.tileSize > 0;
+		for (int f = 0; f < numFaces && drawn; f++)
+		{
+			drawn = state.faceDrawn[f];
+		}
+		if (!drawn) {
+			continue;
+		}
+		m_firstFaces[i] = (int)m_faces.size();
+		for (int f = 0; f < numFaces; f++)
+		{
+			int x, y, size;
+			m_allocator.getRect(state.tiles[f], &x, &y, &size);
+			//Clip space xy to the tile's uvs, z to [0,1]
+			glm::mat4 tileFromClip = glm::mat4(1.0f);
+			tileFromClip[0][0] = size * 0.5f / atlasSize;
+			tileFromClip[1][1] = size * 0.5f / atlasSize;
+			tileFromClip[2][2] = 0.5f;
+			tileFromClip[3] = glm::vec4((x + size * 0.5f) / atlasSize, (y + size * 0.5f) / atlasSize, 0.5f, 1.0f);
+			ShadowFace face;
+			face.atlasFromWorld = tileFromClip * state.viewProj[f];
+			face.rect = glm::vec4(x + 0.5f, y + 0.5f, x + size - 0.5f, y + size - 0.5f) / atlasSize;
+			m_faces.push_back(face);
+		}
+	}
+
+	m_stats.numLights = numLights;
+	m_stats.numShadowed = 0;
+	for (int first : m_firstFaces)
+	{
+		m_stats.numShadowed += first >= 0;
+	}
+	m_stats.numFaces = m_faces.size();
+	m_stats.facesDrawn = m_drawQueue.size();
+	m_stats.totalFacesDrawn += m_drawQueue.size();
+	m_stats.totalFaces += m_faces.size();
+	m_stats.bytes = capacity * 2;
+}
+
+void hannah::ShadowAtlas::render(const DrawCasters& draw)
+{
+	if (m_texture == 0) {
+		unsigned int handle;
+		glCreateTextures(GL_TEXTURE_2D, 1, &handle);
+		glTextureStorage2D(handle, 1, GL_DEPTH_COMPONENT16, m_settings.atlasSize, m_settings.atlasSize);
+		glTextureParameteri(handle, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(handle, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(handle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(handle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		//Hardware 2x2 compare, shaders clamp to the face's rect so it never reads a neighbouring tile
+		glTextureParameteri(handle, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTextureParameteri(handle, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		m_texture = ew::TextureHandle(handle);
+
+		unsigned int fbo;
+		glCreateFramebuffers(1, &fbo);
+		glNamedFramebufferTexture(fbo, GL_DEPTH_ATTACHMENT, m_texture, 0);
+		glNamedFramebufferDrawBuffer(fbo, GL_NONE);
+		glNamedFramebufferReadBuffer(fbo, GL_NONE);
+		m_framebuffer = ew::FramebufferHandle(fbo);
+
+		unsigned int buffer;
+		glCreateBuffers(1, &buffer);
+		m_faceBuffer = ew::BufferHandle(buffer);
+	}
+
+	//Each face clears and draws only its own tile, everything else in the atlas is kept
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glEnable(GL_SCISSOR_TEST);
+	for (const DrawFace& drawFace : m_drawQueue)
+	{
+		const LightState& state = m_lights[drawFace.light];
+		int x, y, size;
+		m_allocator.getRect(state.tiles[drawFace.face], &x, &y, &size);
+		glViewport(x, y, size, size);
+		glScissor(x, y, size, size);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		if (!state.faceCasters[drawFace.face].empty()) {
+			draw(state.viewProj[drawFace.face], state.faceCasters[drawFace.face]);
+		}
+	}
+	glDisable(GL_SCISSOR_TEST);
+
+	//Never empty, so binding it is always valid
+	size_t numFaces = std::max(m_faces.size(), (size_t)1);
+	glNamedBufferData(m_faceBuffer, sizeof(ShadowFace) * numFaces, m_faces.empty() ? NULL : m_faces.data(), GL_DYNAMIC_DRAW);
+}
+
+void hannah::ShadowAtlas::bind(int textureUnit)const
+{
+	glBindTextureUnit(textureUnit, m_texture);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SHADOW_FACE_BINDING, m_faceBuffer);
+}
+
+void hannah::ShadowAtlas::printReport()const
+{
+	float averageFaces = m_stats.totalFaces > 0 ? (float)m_stats.totalFacesDrawn / m_stats.totalFaces : 0.0f;
+	printf("Shadow atlas: %zu of %zu lights shadowed in %zu faces, %.1f%% of shadowed faces redrawn per frame, %zu repacks, %.1f MB\n",
+		m_stats.numShadowed, m_stats.numLights, m_stats.numFaces, averageFaces * 100.0f, m_stats.numRepacks, m_stats.bytes / (1024.0f * 1024.0f));
+}
+
+void hannah::ShadowAtlas::clear()
+{
+	m_framebuffer.reset();
+	m_texture.reset();
+	m_faceBuffer.reset();
+	m_lights.clear();
+	m_casterModels.clear();
+	m_firstFaces.clear();
+	m_faces.clear();
+	m_drawQueue.clear();
+	m_allocator.reset(m_settings.atlasSize, m_settings.minTileSize);
+}
+
+void hannah::ShadowAtlas::freeTiles(LightState* state)
+{
+	for (int f = 0; f < 6; f++)
+	{
+		if (state->tiles[f] >= 0) {
+			m_allocator.free(state->tiles[f]);
+		}
+		state->tiles[f] = -1;
+		state->faceDrawn[f] = false;
+		state->faceStale[f] = false;
+		state->faceCasters[f].clear();
+	}
+	state->tileSize = 0;
+}
+
+glm::mat4 hannah::ShadowAtlas::getFaceViewProj(const ShadowLight& light, int face)const
+{
+	float nearPlane = std::min(m_settings.nearPlane, light.radius * 0.5f);
+	if (light.type == ShadowLightType::SPOT) {
+		glm::vec3 direction = glm::normalize(light.direction);
+		glm::vec3 up = fabsf(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		float fov = glm::radians(std::min(light.outerAngle, 89.0f) * 2.0f);
+		return glm::perspective(fov, 1.0f, nearPlane, light.radius) * glm::lookAt(light.position, light.position + direction, up);
+	}
+	return glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, light.radius) * glm::lookAt(light.position, light.position + CUBE_DIRECTIONS[face], CUBE_UPS[face]);
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <vector>
+#include <functional>
+
+#include <glm/glm.hpp>
+#include "external/glad.h"
+#include "../ew/mesh.h"
+#include "../ew/camera.h"
+#include "../ew/gpuResource.h"
+
+namespace hannah {
+	//Storage buffer binding of the ShadowFace array
+	const int SHADOW_FACE_BINDING = 1;
+
+	enum class ShadowLightType {
+		POINT = 0, //Six cube faces
+		SPOT = 1 //One face
+	};
+
+	//Lights keep their index across frames, that is how tiles are reused
+	struct ShadowLight {
+		ShadowLightType type = ShadowLightType::POINT;
+		glm::vec3 position = glm::vec3(0.0f);
+		float radius = 1.0f; //Far plane of every face, nothing past it is lit
+		glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f); //Spot only
+		float outerAngle = 45.0f; //Spot only, half angle of the cone in degrees
+	};
+
+	//Bounding sphere in model space plus this frame's model matrix. A caster moves when its matrix changes.
+	struct ShadowCaster {
+		glm::mat4 model = glm::mat4(1.0f);
+		glm::vec3 center = glm::vec3(0.0f);
+		float radius = 1.0f;
+	};
+
+	//Matches the std430 layout shaders read at SHADOW_FACE_BINDING
+	struct ShadowFace {
+		glm::mat4 atlasFromWorld; //Perspective divide gives atlas uv in xy and depth in z
+		glm::vec4 rect; //Tile in atlas uv, min in xy and max in zw, inset by half a texel so filtering stays inside
+	};
+
+	struct ShadowAtlasSettings {
+		int atlasSize = 4096; //Power of two. The whole footprint is this squared at 2 bytes per texel.
+		int minTileSize = 64;
+		int maxTileSize = 1024;
+		float resolutionScale = 2.0f; //Tile texels per pixel of the light's radius on screen
+		int maxFacesPerFrame = 96; //Faces drawn per frame, the rest wait. Lights on tiles that were never drawn go unshadowed meanwhile.
+		float nearPlane = 0.05f;
+	};
+
+	struct ShadowAtlasStats {
+		size_t numLights = 0;
+		size_t numShadowed = 0; //Lights with valid tiles this frame
+		size_t numFaces = 0;
+		size_t facesDrawn = 0; //This frame
+		size_t facesReused = 0; //This frame, shadowed faces that kept last frame's depth
+		size_t facesPending = 0; //Stale faces left for later frames by maxFacesPerFrame
+		size_t numRepacks = 0; //Frames where fragmentation forced every tile to be reassigned
+		size_t totalFacesDrawn = 0;
+		size_t totalFaces = 0;
+		size_t bytes = 0;
+	};
+
+	//Bounding sphere around every vertex, for ShadowCaster
+	void computeBoundingSphere(const std::vector<ew::MeshData>& meshes, glm::vec3* center, float* radius);
+
+	/// <summary>
+	/// Shadows for many point and spot lights in one depth texture of fixed size.
+	/// Every frame each light visible on screen with a caster in range gets a power of two tile per face, sized by
+	/// how large the light is on screen. Tiles shrink, least important lights first, until everything fits,
+	/// and lights that still don't fit go unshadowed, so memory is bounded by the atlas no matter how many lights there are.
+	/// A face is only redrawn when its tile is new, the light changed, or a caster in its frustum moved.
+	/// Call update, then render with the depth shader ready, then bind for lighting. Shaders pick the face of a point light
+	/// by the major axis of (position - light position): +X -X +Y -Y +Z -Z.
+	/// </summary>
+	class ShadowAtlas {
+	public:
+		typedef std::function<void(const glm::mat4& viewProj, const std::vector<int>& casters)> DrawCasters;
+
+		ShadowAtlas(const ShadowAtlasSettings& settings = ShadowAtlasSettings());
+		ShadowAtlas(const ShadowAtlas&) = delete;
+		ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+		//Assigns tiles and decides which faces to draw. No GL, so it can run before the frame's passes.
+		void update(const std::vector<ShadowLight>& lights, const std::vector<ShadowCaster>& casters, const ew::Camera& camera, float screenHeight);
+		//Draws the stale faces, calling draw once per face with only the casters inside it, then uploads the face buffer.
+		//Viewport and scissor are set per tile, cull and shader state are up to the caller.
+		void render(const DrawCasters& draw);
+		//Binds the atlas to textureUnit for a sampler2DShadow and the faces to SHADOW_FACE_BINDING
+		void bind(int textureUnit)const;
+		//Into the face buffer, -1 if the light has no shadow this frame
+		inline int getFirstFace(int light)const { return m_firstFaces[light]; }
+		inline unsigned int getTexture()const { return m_texture; }
+		inline const ShadowAtlasStats& getStats()const { return m_stats; }
+		void printReport()const;
+		//Releases the atlas and forgets every light, e.g. before the GL context goes away
+		void clear();
+	private:
+		//Power of two squares carved out of the atlas like a 2D buddy allocator. Freed siblings merge back.
+		class TileAllocator {
+		public:
+			void reset(int size, int minSize);
+			//Returns a tile id, -1 if no square of that size is free
+			int allocate(int size);
+			void free(int tile);
+			void getRect(int tile, int* x, int* y, int* size)const;
+		private:
+			enum State : unsigned char { FREE, SPLIT, USED };
+			int find(int level, int ix, int iy, int targetLevel);
+			void decode(int tile, int* level, int* ix, int* iy)const;
+			inline int index(int level, int ix, int iy)const { return m_levelOffsets[level] + iy * (1 << level) + ix; }
+			int m_size = 0;
+			int m_numLevels = 0;
+			std::vector<int> m_levelOffsets;
+			std::vector<State> m_states;
+		};
+		struct LightState {
+			ShadowLight light;
+			int tileSize = 0; //0 if it has no tiles
+			int tiles[6] = { -1, -1, -1, -1, -1, -1 };
+			bool faceDrawn[6] = { false }; //The tile holds depth drawn for this light
+			bool faceStale[6] = { false }; //Drawn, but something changed since and the budget ran out
+			std::vector<int> faceCasters[6];
+			glm::mat4 viewProj[6];
+			float importance = 0.0f;
+		};
+		void freeTiles(LightState* state);
+		glm::mat4 getFaceViewProj(const ShadowLight& light, int face)const;
+
+		ShadowAtlasSettings m_settings;
+		TileAllocator m_allocator;
+		std::vector<LightState> m_lights;
+		std::vector<glm::mat4> m_casterModels; //Last frame's, to spot movement
+		std::vector<int> m_firstFaces;
+		std::vector<ShadowFace> m_faces;
+		struct DrawFace {
+			int light;
+			int face;
+		};
+		std::vector<DrawFace> m_drawQueue;
+		ew::TextureHandle m_texture;
+		ew::FramebufferHandle m_framebuffer;
+		ew::BufferHandle m_faceBuffer;
+		ShadowAtlasStats m_stats;
+	};
+}
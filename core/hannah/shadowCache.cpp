@@ -0,0 +1,30 @@
+#include "shadowCache.h"
+
+#include <stdio.h>
+
+bool hannah::ShadowCache::update(const glm::mat4& lightViewProj, const std::vector<glm::mat4>& staticTransforms, unsigned int staticLayer)
+{
+	m_stats.frames++;
+	//Exact compares are fine, unchanged inputs produce bit identical matrices
+	bool lightChanged = lightViewProj != m_lightViewProj;
+	bool castersChanged = staticTransforms != m_staticTransforms;
+	if (m_valid && !lightChanged && !castersChanged && staticLayer == m_staticLayer) {
+		return false;
+	}
+	if (m_valid) {
+		m_stats.lightChanges += lightChanged;
+		m_stats.casterChanges += castersChanged;
+	}
+	m_lightViewProj = lightViewProj;
+	m_staticTransforms = staticTransforms;
+	m_staticLayer = staticLayer;
+	m_valid = true;
+	m_stats.staticRenders++;
+	return true;
+}
+
+void hannah::ShadowCache::printReport()const
+{
+	printf("Shadow cache: static layer drawn %zu of %zu frames (%zu light changes, %zu caster changes), %.3f ms per draw, %.3f ms per copy, saved about %.1f ms\n",
+		m_stats.staticRenders, m_stats.frames, m_stats.lightChanges, m_stats.casterChanges, m_stats.staticGpuMs, m_stats.copyGpuMs, m_stats.getSavedMs());
+}
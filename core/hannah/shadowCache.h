@@ -0,0 +1,43 @@
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace hannah {
+	struct ShadowCacheStats {
+		size_t frames = 0;
+		size_t staticRenders = 0; //Frames where the static layer was redrawn
+		size_t lightChanges = 0;
+		size_t casterChanges = 0; //Static casters added, removed or moved
+		float staticGpuMs = 0.0f; //Latest measured cost of drawing the static layer
+		float copyGpuMs = 0.0f; //Latest measured cost of copying the static layer into the shadow map, paid every frame
+		//Static layer draws skipped times what one costs, minus every frame's copy. Negative if caching costs more than it skips.
+		inline float getSavedMs()const { return (float)(frames - staticRenders) * staticGpuMs - (float)frames * copyGpuMs; }
+	};
+
+	/// <summary>
+	/// Decides when the static part of a shadow map has to be redrawn. Static casters are drawn into their own
+	/// depth layer only when the light or one of them changed, then every frame the layer is copied into the
+	/// shadow map and only dynamic casters are drawn on top. No GL here, the caller owns both depth textures.
+	/// </summary>
+	class ShadowCache {
+	public:
+		//Call once per frame before drawing shadows. staticLayer is the cached depth texture, a new one counts as empty.
+		//Returns true if the static casters have to be drawn into it this frame.
+		bool update(const glm::mat4& lightViewProj, const std::vector<glm::mat4>& staticTransforms, unsigned int staticLayer);
+		//Forces a redraw next frame, e.g. after swapping the static casters' meshes
+		inline void invalidate() { m_valid = false; }
+		//Feed the profiled time of a frame that drew the static layer
+		inline void recordStaticCost(float gpuMs) { m_stats.staticGpuMs = gpuMs; }
+		//Feed the profiled time of the copy into the shadow map
+		inline void recordCopyCost(float gpuMs) { m_stats.copyGpuMs = gpuMs; }
+		inline const ShadowCacheStats& getStats()const { return m_stats; }
+		void printReport()const;
+	private:
+		bool m_valid = false;
+		glm::mat4 m_lightViewProj = glm::mat4(1.0f);
+		std::vector<glm::mat4> m_staticTransforms;
+		unsigned int m_staticLayer = 0;
+		ShadowCacheStats m_stats;
+	};
+}
@@ -0,0 +1,677 @@
+#include "subdivision.h"
+#include "../ew/jobSystem.h"
+#include "meshLOD.h"
+#include "../ew/tangentSpace.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <utility>
+
+namespace {
+	inline unsigned long long edgeKey(unsigned int a, unsigned int b) {
+		return a < b ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+	}
+
+	//Triangular grid with n segments per side. Point (i, j) sits at v0 + i/n * (v1 - v0) + j/n * (v2 - v0), rows of constant j are stored in order.
+	inline unsigned int gridPoints(unsigned int n) {
+		return (n + 1) * (n + 2) / 2;
+	}
+	inline unsigned int gridIndex(unsigned int n, unsigned int i, unsigned int j) {
+		return j * (n + 1) - j * (j - 1) / 2 + i;
+	}
+
+	//Calls f(i0, j0, i1, j1, i2, j2) for every triangle of the grid, wound the same way as the base triangle
+	template<typename F>
+	void forEachGridTriangle(unsigned int n, F f) {
+		for (unsigned int j = 0; j < n; j++)
+		{
+			for (unsigned int i = 0; i + j < n; i++)
+			{
+				f(i, j, i + 1, j, i, j + 1);
+				if (i + j + 1 < n) {
+					f(i + 1, j, i + 1, j + 1, i, j + 1);
+				}
+			}
+		}
+	}
+
+	struct EdgeUse {
+		unsigned long long key;
+		unsigned int opposite;
+		bool operator<(const EdgeUse& other)const { return key < other.key; }
+	};
+
+	//Wedges are vertices as in MeshData: a position plus a UV. Several wedges share a position along UV seams.
+	struct Level {
+		unsigned int numPositions = 0;
+		std::vector<unsigned int> wedgePositions;
+		std::vector<glm::vec2> wedgeUVs;
+		std::vector<unsigned int> grids; //gridPoints(n) wedges per patch
+		hannah::StencilTable stencils; //Positions of this level over the base positions
+	};
+
+	typedef std::vector<std::pair<unsigned int, float>> LocalRow;
+
+	//Each new row is a few weights over the previous level's rows, which are already over the base positions.
+	//Rows are merged in batches that each write their own arrays, then stitched together.
+	template<typename F>
+	hannah::StencilTable composeStencils(size_t numRows, const hannah::StencilTable& previous, F localRow) {
+		const size_t batchSize = 1024;
+		size_t numBatches = (numRows + batchSize - 1) / batchSize;
+		std::vector<hannah::StencilTable> batches(numBatches);
+		ew::parallelFor(numBatches, 1, [&](size_t begin, size_t end) {
+			LocalRow local;
+			for (size_t b = begin; b < end; b++)
+			{
+				hannah::StencilTable& out = batches[b];
+				size_t rowEnd = std::min((b + 1) * batchSize, numRows);
+				for (size_t row = b * batchSize; row < rowEnd; row++)
+				{
+					local.clear();
+					localRow(row, local);
+					size_t rowStart = out.sources.size();
+					for (size_t k = 0; k < local.size(); k++)
+					{
+						unsigned int src = local[k].first;
+						for (unsigned int s = previous.offsets[src]; s < previous.offsets[src + 1]; s++)
+						{
+							float weight = local[k].second * previous.weights[s];
+							size_t m = rowStart;
+							while (m < out.sources.size() && out.sources[m] != previous.sources[s]) {
+								m++;
+							}
+							if (m == out.sources.size()) {
+								out.sources.push_back(previous.sources[s]);
+								out.weights.push_back(weight);
+							}
+							else {
+								out.weights[m] += weight;
+							}
+						}
+					}
+					out.offsets.push_back(out.sources.size());
+				}
+			}
+		});
+
+		hannah::StencilTable table;
+		table.offsets.reserve(numRows + 1);
+		table.offsets.push_back(0);
+		for (size_t b = 0; b < numBatches; b++)
+		{
+			unsigned int base = table.sources.size();
+			for (size_t r = 0; r < batches[b].offsets.size(); r++)
+			{
+				table.offsets.push_back(base + batches[b].offsets[r]);
+			}
+			table.sources.insert(table.sources.end(), batches[b].sources.begin(), batches[b].sources.end());
+			table.weights.insert(table.weights.end(), batches[b].weights.begin(), batches[b].weights.end());
+		}
+		return table;
+	}
+
+	//One level of Loop subdivision: every edge gets a new position and every triangle becomes four
+	Level subdivide(const Level& level, unsigned int n, size_t numPatches) {
+		const unsigned int points = gridPoints(n);
+		const size_t usesPerPatch = (size_t)n * n * 3;
+		const unsigned int numPositions = level.numPositions;
+		const unsigned int numWedges = level.wedgePositions.size();
+
+		//Every triangle edge by position, with the position across from it, and by wedge
+		std::vector<EdgeUse> uses(numPatches * usesPerPatch);
+		std::vector<unsigned long long> wedgeEdges(uses.size());
+		ew::parallelFor(numPatches, 64, [&](size_t begin, size_t end) {
+			for (size_t p = begin; p < end; p++)
+			{
+				const unsigned int* grid = &level.grids[p * points];
+				size_t k = p * usesPerPatch;
+				forEachGridTriangle(n, [&](unsigned int i0, unsigned int j0, unsigned int i1, unsigned int j1, unsigned int i2, unsigned int j2) {
+					unsigned int w[3] = { grid[gridIndex(n, i0, j0)], grid[gridIndex(n, i1, j1)], grid[gridIndex(n, i2, j2)] };
+					for (int e = 0; e < 3; e++)
+					{
+						unsigned int a = w[e];
+						unsigned int b = w[(e + 1) % 3];
+						uses[k].key = edgeKey(level.wedgePositions[a], level.wedgePositions[b]);
+						uses[k].opposite = level.wedgePositions[w[(e + 2) % 3]];
+						wedgeEdges[k] = edgeKey(a, b);
+						k++;
+					}
+				});
+			}
+		});
+		std::sort(uses.begin(), uses.end());
+		std::sort(wedgeEdges.begin(), wedgeEdges.end());
+		wedgeEdges.erase(std::unique(wedgeEdges.begin(), wedgeEdges.end()), wedgeEdges.end());
+
+		//Edges used by exactly two triangles are smooth, anything else is treated as a boundary crease
+		std::vector<unsigned long long> edges;
+		std::vector<unsigned int> opposites; //Two per edge
+		std::vector<unsigned char> smooth;
+		for (size_t i = 0; i < uses.size();)
+		{
+			size_t j = i;
+			while (j < uses.size() && uses[j].key == uses[i].key) {
+				j++;
+			}
+			edges.push_back(uses[i].key);
+			smooth.push_back(j - i == 2);
+			opposites.push_back(uses[i].opposite);
+			opposites.push_back(uses[j - 1].opposite);
+			i = j;
+		}
+		std::vector<EdgeUse>().swap(uses);
+
+		//Neighbour rings for the even rule
+		std::vector<unsigned int> neighborOffsets(numPositions + 1, 0);
+		std::vector<unsigned int> creaseCount(numPositions, 0);
+		std::vector<unsigned int> creaseNeighbors(numPositions * 2, 0);
+		for (size_t e = 0; e < edges.size(); e++)
+		{
+			unsigned int a = edges[e] >> 32;
+			unsigned int b = edges[e] & 0xffffffff;
+			neighborOffsets[a + 1]++;
+			neighborOffsets[b + 1]++;
+			if (!smooth[e]) {
+				if (creaseCount[a] < 2) {
+					creaseNeighbors[a * 2 + creaseCount[a]] = b;
+				}
+				if (creaseCount[b] < 2) {
+					creaseNeighbors[b * 2 + creaseCount[b]] = a;
+				}
+				creaseCount[a]++;
+				creaseCount[b]++;
+			}
+		}
+		for (unsigned int p = 0; p < numPositions; p++)
+		{
+			neighborOffsets[p + 1] += neighborOffsets[p];
+		}
+		std::vector<unsigned int> neighbors(neighborOffsets[numPositions]);
+		{
+			std::vector<unsigned int> fill(neighborOffsets.begin(), neighborOffsets.end() - 1);
+			for (size_t e = 0; e < edges.size(); e++)
+			{
+				unsigned int a = edges[e] >> 32;
+				unsigned int b = edges[e] & 0xffffffff;
+				neighbors[fill[a]++] = b;
+				neighbors[fill[b]++] = a;
+			}
+		}
+
+		Level next;
+		next.numPositions = numPositions + edges.size();
+		next.stencils = composeStencils(next.numPositions, level.stencils, [&](size_t row, LocalRow& local) {
+			if (row < numPositions) {
+				unsigned int p = row;
+				if (creaseCount[p] == 0) {
+					unsigned int valence = neighborOffsets[p + 1] - neighborOffsets[p];
+					float beta = valence == 3 ? 3.0f / 16.0f : 3.0f / (8.0f * valence);
+					local.push_back({ p, 1.0f - valence * beta });
+					for (unsigned int k = neighborOffsets[p]; k < neighborOffsets[p + 1]; k++)
+					{
+						local.push_back({ neighbors[k], beta });
+					}
+				}
+				else if (creaseCount[p] == 2) {
+					local.push_back({ p, 0.75f });
+					local.push_back({ creaseNeighbors[p * 2], 0.125f });
+					local.push_back({ creaseNeighbors[p * 2 + 1], 0.125f });
+				}
+				else {
+					//Corners, crease ends and non-manifold vertices stay put
+					local.push_back({ p, 1.0f });
+				}
+			}
+			else {
+				size_t e = row - numPositions;
+				unsigned int a = edges[e] >> 32;
+				unsigned int b = edges[e] & 0xffffffff;
+				if (smooth[e]) {
+					local.push_back({ a, 0.375f });
+					local.push_back({ b, 0.375f });
+					local.push_back({ opposites[e * 2], 0.125f });
+					local.push_back({ opposites[e * 2 + 1], 0.125f });
+				}
+				else {
+					local.push_back({ a, 0.5f });
+					local.push_back({ b, 0.5f });
+				}
+			}
+		});
+
+		//Old wedges keep their ids, each wedge edge adds one on the matching position edge
+		size_t numNextWedges = numWedges + wedgeEdges.size();
+		next.wedgePositions.resize(numNextWedges);
+		next.wedgeUVs.resize(numNextWedges);
+		std::copy(level.wedgePositions.begin(), level.wedgePositions.end(), next.wedgePositions.begin());
+		std::copy(level.wedgeUVs.begin(), level.wedgeUVs.end(), next.wedgeUVs.begin());
+		ew::parallelFor(wedgeEdges.size(), 4096, [&](size_t begin, size_t end) {
+			for (size_t e = begin; e < end; e++)
+			{
+				unsigned int a = wedgeEdges[e] >> 32;
+				unsigned int b = wedgeEdges[e] & 0xffffffff;
+				unsigned long long key = edgeKey(level.wedgePositions[a], level.wedgePositions[b]);
+				size_t positionEdge = std::lower_bound(edges.begin(), edges.end(), key) - edges.begin();
+				next.wedgePositions[numWedges + e] = numPositions + positionEdge;
+				next.wedgeUVs[numWedges + e] = (level.wedgeUVs[a] + level.wedgeUVs[b]) * 0.5f;
+			}
+		});
+
+		//Even grid points come from the old grid, odd ones are the midpoint of the old edge they split
+		const unsigned int n2 = n * 2;
+		const unsigned int nextPoints = gridPoints(n2);
+		next.grids.resize(numPatches * nextPoints);
+		ew::parallelFor(numPatches, 64, [&](size_t begin, size_t end) {
+			for (size_t p = begin; p < end; p++)
+			{
+				const unsigned int* grid = &level.grids[p * points];
+				unsigned int* nextGrid = &next.grids[p * nextPoints];
+				for (unsigned int j = 0; j <= n2; j++)
+				{
+					for (unsigned int i = 0; i + j <= n2; i++)
+					{
+						unsigned int wedge;
+						if (i % 2 == 0 && j % 2 == 0) {
+							wedge = grid[gridIndex(n, i / 2, j / 2)];
+						}
+						else {
+							unsigned int a, b;
+							if (j % 2 == 0) {
+								a = grid[gridIndex(n, (i - 1) / 2, j / 2)];
+								b = grid[gridIndex(n, (i + 1) / 2, j / 2)];
+							}
+							else if (i % 2 == 0) {
+								a = grid[gridIndex(n, i / 2, (j - 1) / 2)];
+								b = grid[gridIndex(n, i / 2, (j + 1) / 2)];
+							}
+							else {
+								a = grid[gridIndex(n, (i + 1) / 2, (j - 1) / 2)];
+								b = grid[gridIndex(n, (i - 1) / 2, (j + 1) / 2)];
+							}
+							wedge = numWedges + (std::lower_bound(wedgeEdges.begin(), wedgeEdges.end(), edgeKey(a, b)) - wedgeEdges.begin());
+						}
+						nextGrid[gridIndex(n2, i, j)] = wedge;
+					}
+				}
+			}
+		});
+		return next;
+	}
+}
+
+void hannah::StencilTable::apply(const glm::vec3* in, glm::vec3* out) const
+{
+	ew::parallelFor(getNumRows(), 4096, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			glm::vec3 sum = glm::vec3(0.0f);
+			for (unsigned int k = offsets[i]; k < offsets[i + 1]; k++)
+			{
+				sum += in[sources[k]] * weights[k];
+			}
+			out[i] = sum;
+		}
+	});
+}
+
+hannah::SubdivisionMesh::SubdivisionMesh(const ew::MeshData& meshData, int maxLevel)
+{
+	m_maxLevel = std::max(maxLevel, 0);
+	m_numBaseVertices = meshData.vertices.size();
+
+	//Weld identical positions so UV and normal seams don't split the surface
+	std::vector<unsigned int> order(m_numBaseVertices);
+	for (unsigned int i = 0; i < m_numBaseVertices; i++)
+	{
+		order[i] = i;
+	}
+	auto lessPos = [&](unsigned int a, unsigned int b) {
+		const glm::vec3& pa = meshData.vertices[a].pos;
+		const glm::vec3& pb = meshData.vertices[b].pos;
+		if (pa.x != pb.x) return pa.x < pb.x;
+		if (pa.y != pb.y) return pa.y < pb.y;
+		return pa.z < pb.z;
+	};
+	std::sort(order.begin(), order.end(), lessPos);
+	Level level;
+	level.wedgePositions.resize(m_numBaseVertices);
+	level.wedgeUVs.resize(m_numBaseVertices);
+	for (unsigned int i = 0; i < m_numBaseVertices; i++)
+	{
+		if (i == 0 || lessPos(order[i - 1], order[i])) {
+			m_basePositionVertex.push_back(order[i]);
+		}
+		level.wedgePositions[order[i]] = m_basePositionVertex.size() - 1;
+		level.wedgeUVs[order[i]] = meshData.vertices[order[i]].uv;
+	}
+	level.numPositions = m_basePositionVertex.size();
+
+	//Every base triangle is a patch, degenerate ones have no surface to refine
+	for (size_t i = 0; i + 2 < meshData.indices.size(); i += 3)
+	{
+		unsigned int a = meshData.indices[i];
+		unsigned int b = meshData.indices[i + 1];
+		unsigned int c = meshData.indices[i + 2];
+		unsigned int pa = level.wedgePositions[a];
+		unsigned int pb = level.wedgePositions[b];
+		unsigned int pc = level.wedgePositions[c];
+		if (pa == pb || pb == pc || pc == pa) {
+			continue;
+		}
+		level.grids.push_back(a);
+		level.grids.push_back(b);
+		level.grids.push_back(c);
+	}
+	size_t numPatches = level.grids.size() / 3;
+
+	level.stencils.offsets.resize(level.numPositions + 1);
+	level.stencils.sources.resize(level.numPositions);
+	level.stencils.weights.assign(level.numPositions, 1.0f);
+	for (unsigned int p = 0; p <= level.numPositions; p++)
+	{
+		level.stencils.offsets[p] = p;
+		if (p < level.numPositions) {
+			level.stencils.sources[p] = p;
+		}
+	}
+
+	for (int l = 0; l < m_maxLevel; l++)
+	{
+		level = subdivide(level, 1u << l, numPatches);
+	}
+
+	const unsigned int n = 1u << m_maxLevel;
+	m_gridSize = gridPoints(n);
+	m_patchGrids.swap(level.grids);
+	m_vertexPositions.swap(level.wedgePositions);
+	m_stencils = std::move(level.stencils);
+	m_positions.resize(level.numPositions);
+
+	m_meshData.vertices.resize(m_vertexPositions.size());
+	for (size_t i = 0; i < m_vertexPositions.size(); i++)
+	{
+		m_meshData.vertices[i].uv = level.wedgeUVs[i];
+	}
+	const size_t indicesPerPatch = (size_t)n * n * 3;
+	m_meshData.indices.resize(numPatches * indicesPerPatch);
+	ew::parallelFor(numPatches, 64, [&](size_t begin, size_t end) {
+		for (size_t p = begin; p < end; p++)
+		{
+			unsigned int* out = &m_meshData.indices[p * indicesPerPatch];
+			forEachGridTriangle(n, [&](unsigned int i0, unsigned int j0, unsigned int i1, unsigned int j1, unsigned int i2, unsigned int j2) {
+				*out++ = gridVertex(p, i0, j0);
+				*out++ = gridVertex(p, i1, j1);
+				*out++ = gridVertex(p, i2, j2);
+			});
+		}
+	});
+
+	//Triangles around each refined position, normals are gathered from these instead of scattered with atomics
+	m_cornerOffsets.assign(m_positions.size() + 1, 0);
+	for (size_t i = 0; i < m_meshData.indices.size(); i++)
+	{
+		m_cornerOffsets[m_vertexPositions[m_meshData.indices[i]] + 1]++;
+	}
+	for (size_t p = 0; p < m_positions.size(); p++)
+	{
+		m_cornerOffsets[p + 1] += m_cornerOffsets[p];
+	}
+	m_corners.resize(m_meshData.indices.size());
+	{
+		std::vector<unsigned int> fill(m_cornerOffsets.begin(), m_cornerOffsets.end() - 1);
+		for (size_t i = 0; i < m_meshData.indices.size(); i++)
+		{
+			m_corners[fill[m_vertexPositions[m_meshData.indices[i]]]++] = i / 3;
+		}
+	}
+
+	//Base edges by position, so patches on either side of a UV seam still agree on how to stitch
+	std::vector<unsigned long long> baseEdges(numPatches * 3);
+	for (size_t p = 0; p < numPatches; p++)
+	{
+		unsigned int corners[3] = { m_vertexPositions[gridVertex(p, 0, 0)], m_vertexPositions[gridVertex(p, n, 0)], m_vertexPositions[gridVertex(p, 0, n)] };
+		for (int k = 0; k < 3; k++)
+		{
+			baseEdges[p * 3 + k] = edgeKey(corners[k], corners[(k + 1) % 3]);
+		}
+	}
+	std::vector<unsigned long long> uniqueEdges = baseEdges;
+	std::sort(uniqueEdges.begin(), uniqueEdges.end());
+	uniqueEdges.erase(std::unique(uniqueEdges.begin(), uniqueEdges.end()), uniqueEdges.end());
+	m_numBaseEdges = uniqueEdges.size();
+	m_patchEdges.resize(baseEdges.size());
+	for (size_t i = 0; i < baseEdges.size(); i++)
+	{
+		m_patchEdges[i] = std::lower_bound(uniqueEdges.begin(), uniqueEdges.end(), baseEdges[i]) - uniqueEdges.begin();
+	}
+	m_patchLevels.assign(numPatches, m_maxLevel);
+	m_numTriangles = m_meshData.indices.size() / 3;
+
+	m_basePositions.resize(m_basePositionVertex.size());
+	for (size_t p = 0; p < m_basePositionVertex.size(); p++)
+	{
+		m_basePositions[p] = meshData.vertices[m_basePositionVertex[p]].pos;
+	}
+	evaluate();
+}
+
+void hannah::SubdivisionMesh::setBasePositions(const std::vector<glm::vec3>& positions)
+{
+	if (positions.size() != m_numBaseVertices) {
+		printf("Subdivision mesh expected %u base positions, got %zu\n", m_numBaseVertices, positions.size());
+		return;
+	}
+	for (size_t p = 0; p < m_basePositionVertex.size(); p++)
+	{
+		m_basePositions[p] = positions[m_basePositionVertex[p]];
+	}
+	evaluate();
+}
+
+void hannah::SubdivisionMesh::evaluate()
+{
+	m_stencils.apply(m_basePositions.data(), m_positions.data());
+
+	//Area weighted face normals, shared by every vertex on a position so seams stay smooth
+	size_t numTriangles = m_meshData.indices.size() / 3;
+	std::vector<glm::vec3> faceNormals(numTriangles);
+	ew::parallelFor(numTriangles, 4096, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++)
+		{
+			const glm::vec3& a = m_positions[m_vertexPositions[m_meshData.indices[t * 3]]];
+			const glm::vec3& b = m_positions[m_vertexPositions[m_meshData.indices[t * 3 + 1]]];
+			const glm::vec3& c = m_positions[m_vertexPositions[m_meshData.indices[t * 3 + 2]]];
+			faceNormals[t] = glm::cross(b - a, c - a);
+		}
+	});
+	std::vector<glm::vec3> normals(m_positions.size());
+	ew::parallelFor(m_positions.size(), 4096, [&](size_t begin, size_t end) {
+		for (size_t p = begin; p < end; p++)
+		{
+			glm::vec3 sum = glm::vec3(0.0f);
+			for (unsigned int k = m_cornerOffsets[p]; k < m_cornerOffsets[p + 1]; k++)
+			{
+				sum += faceNormals[m_corners[k]];
+			}
+			float length = glm::length(sum);
+			normals[p] = length > 0.0f ? sum / length : glm::vec3(0.0f, 1.0f, 0.0f);
+		}
+	});
+	ew::parallelFor(m_meshData.vertices.size(), 4096, [&](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; v++)
+		{
+			m_meshData.vertices[v].pos = m_positions[m_vertexPositions[v]];
+			m_meshData.vertices[v].normal = normals[m_vertexPositions[v]];
+		}
+	});
+	ew::generateTangents(&m_meshData);
+
+	m_mesh.load(m_meshData);
+	if (!m_indices.empty()) {
+		m_mesh.updateIndices(m_indices.data(), m_indices.size());
+	}
+}
+
+unsigned int hannah::SubdivisionMesh::gridVertex(size_t patch, int i, int j) const
+{
+	return m_patchGrids[patch * m_gridSize + gridIndex(1u << m_maxLevel, i, j)];
+}
+
+void hannah::SubdivisionMesh::update(const ew::Camera& camera, const glm::mat4& model, float screenHeight, float targetEdgePixels)
+{
+	const unsigned int n = 1u << m_maxLevel;
+	size_t numPatches = m_patchLevels.size();
+	std::vector<int> levels(numPatches);
+	ew::parallelFor(numPatches, 256, [&](size_t begin, size_t end) {
+		for (size_t p = begin; p < end; p++)
+		{
+			glm::vec3 corners[3] = {
+				glm::vec3(model * glm::vec4(m_positions[m_vertexPositions[gridVertex(p, 0, 0)]], 1.0f)),
+				glm::vec3(model * glm::vec4(m_positions[m_vertexPositions[gridVertex(p, n, 0)]], 1.0f)),
+				glm::vec3(model * glm::vec4(m_positions[m_vertexPositions[gridVertex(p, 0, n)]], 1.0f))
+			};
+			float longest = std::max(glm::length(corners[1] - corners[0]), std::max(glm::length(corners[2] - corners[1]), glm::length(corners[0] - corners[2])));
+			glm::vec3 center = (corners[0] + corners[1] + corners[2]) / 3.0f;
+			//Every level halves the edge length on screen
+			float pixels = longest * pixelsPerUnit(camera, center, screenHeight);
+			int level = pixels > targetEdgePixels ? (int)ceilf(log2f(pixels / targetEdgePixels)) : 0;
+			levels[p] = std::min(level, m_maxLevel);
+		}
+	});
+	if (levels == m_patchLevels && !m_indices.empty()) {
+		return;
+	}
+	m_patchLevels.swap(levels);
+
+	//A shared edge is drawn at the coarser of its two patches
+	std::vector<int> edgeLevels(m_numBaseEdges, m_maxLevel);
+	for (size_t p = 0; p < numPatches; p++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			int& edgeLevel = edgeLevels[m_patchEdges[p * 3 + k]];
+			edgeLevel = std::min(edgeLevel, m_patchLevels[p]);
+		}
+	}
+
+	//Each patch writes into room for its full level, stitching uses less, then the gaps are squeezed out
+	std::vector<size_t> offsets(numPatches + 1, 0);
+	for (size_t p = 0; p < numPatches; p++)
+	{
+		offsets[p + 1] = offsets[p] + ((size_t)3 << (2 * m_patchLevels[p]));
+	}
+	std::vector<size_t> counts(numPatches);
+	m_indices.resize(offsets[numPatches]);
+	ew::parallelFor(numPatches, 64, [&](size_t begin, size_t end) {
+		for (size_t p = begin; p < end; p++)
+		{
+			//An edge at level l keeps every 2^(maxLevel - l)th refined vertex. Both patches on it keep the same ones, so there are no T-junctions.
+			unsigned int edgeSteps[3];
+			for (int k = 0; k < 3; k++)
+			{
+				edgeSteps[k] = 1u << (m_maxLevel - edgeLevels[m_patchEdges[p * 3 + k]]);
+			}
+			unsigned int* out = &m_indices[offsets[p]];
+			unsigned int* outStart = out;
+			auto emit = [&](unsigned int i0, unsigned int j0, unsigned int i1, unsigned int j1, unsigned int i2, unsigned int j2) {
+				*out++ = gridVertex(p, i0, j0);
+				*out++ = gridVertex(p, i1, j1);
+				*out++ = gridVertex(p, i2, j2);
+			};
+
+			if (m_patchLevels[p] <= 1) {
+				//Every point is on the border, so fan the border polygon from a kept midpoint
+				unsigned int h = n / 2;
+				unsigned int polygon[6][2] = { { 0, 0 }, { h, 0 }, { n, 0 }, { h, h }, { 0, n }, { 0, h } };
+				int ring[6];
+				int ringSize = 0;
+				int apex = 0;
+				for (int k = 0; k < 6; k++)
+				{
+					if (k % 2 == 1 && edgeSteps[k / 2] > h) {
+						continue;
+					}
+					if (k % 2 == 1 && apex == 0) {
+						apex = ringSize;
+					}
+					ring[ringSize++] = k;
+				}
+				for (int k = 1; k + 1 < ringSize; k++)
+				{
+					int a = ring[apex];
+					int b = ring[(apex + k) % ringSize];
+					int c = ring[(apex + k + 1) % ringSize];
+					emit(polygon[a][0], polygon[a][1], polygon[b][0], polygon[b][1], polygon[c][0], polygon[c][1]);
+				}
+				counts[p] = out - outStart;
+				continue;
+			}
+
+			//Interior at the patch's own level, inset by one step from the border
+			unsigned int step = 1u << (m_maxLevel - m_patchLevels[p]);
+			unsigned int steps = 1u << m_patchLevels[p];
+			forEachGridTriangle(steps - 3, [&](unsigned int i0, unsigned int j0, unsigned int i1, unsigned int j1, unsigned int i2, unsigned int j2) {
+				emit((i0 + 1) * step, (j0 + 1) * step, (i1 + 1) * step, (j1 + 1) * step, (i2 + 1) * step, (j2 + 1) * step);
+			});
+			//Zip each border edge to the parallel row of the interior. Both rows are monotonic along the edge, so any merge order gives valid triangles.
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int outerCount = n / edgeSteps[k];
+				unsigned int innerCount = steps - 3;
+				//Points along the edge and their distance along it, doubled to stay integer
+				auto outer = [&](unsigned int x, unsigned int& i, unsigned int& j) {
+					unsigned int t = x * edgeSteps[k];
+					i = k == 0 ? t : (k == 1 ? n - t : 0);
+					j = k == 0 ? 0 : (k == 1 ? t : n - t);
+					return 2 * t;
+				};
+				auto inner = [&](unsigned int y, unsigned int& i, unsigned int& j) {
+					unsigned int t = (y + 1) * step;
+					i = k == 0 ? t : (k == 1 ? n - step - t : step);
+					j = k == 0 ? step : (k == 1 ? t : n - step - t);
+					return k == 0 ? 2 * t : (k == 1 ? 2 * t + step : 2 * (t + step));
+				};
+				unsigned int x = 0;
+				unsigned int y = 0;
+				unsigned int oi, oj, ii, ij, ni, nj;
+				outer(0, oi, oj);
+				inner(0, ii, ij);
+				while (x < outerCount || y < innerCount) {
+					bool advanceOuter = y == innerCount || (x < outerCount && outer(x + 1, ni, nj) <= inner(y + 1, ni, nj));
+					if (advanceOuter) {
+						outer(x + 1, ni, nj);
+						emit(oi, oj, ni, nj, ii, ij);
+						oi = ni;
+						oj = nj;
+						x++;
+					}
+					else {
+						inner(y + 1, ni, nj);
+						emit(oi, oj, ni, nj, ii, ij);
+						ii = ni;
+						ij = nj;
+						y++;
+					}
+				}
+			}
+			counts[p] = out - outStart;
+		}
+	});
+	size_t numIndices = 0;
+	for (size_t p = 0; p < numPatches; p++)
+	{
+		if (offsets[p] != numIndices) {
+			std::copy(m_indices.begin() + offsets[p], m_indices.begin() + offsets[p] + counts[p], m_indices.begin() + numIndices);
+		}
+		numIndices += counts[p];
+	}
+	m_indices.resize(numIndices);
+	m_numTriangles = numIndices / 3;
+	m_mesh.updateIndices(m_indices.data(), m_indices.size());
+}
+
+void hannah::SubdivisionMesh::draw() const
+{
+	m_mesh.draw();
+}
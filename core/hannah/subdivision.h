@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+#include "../ew/mesh.h"
+#include "../ew/camera.h"
+
+namespace hannah {
+	//Sparse rows of weights over the base mesh positions, one row per refined position
+	struct StencilTable {
+		std::vector<unsigned int> offsets; //Row i is [offsets[i], offsets[i + 1])
+		std::vector<unsigned int> sources;
+		std::vector<float> weights;
+		inline size_t getNumRows()const { return offsets.empty() ? 0 : offsets.size() - 1; }
+		//out[i] = sum of weights * in[sources] for row i, split across the job system
+		void apply(const glm::vec3* in, glm::vec3* out)const;
+	};
+
+	//Loop subdivision of a triangle mesh, refined uniformly to maxLevel once and cached as stencils.
+	//Each frame every base triangle picks how many of those levels to draw from its size on screen,
+	//so only close up regions get dense. Neighbours at different levels share the same refined vertices, so there are no cracks.
+	class SubdivisionMesh {
+	public:
+		SubdivisionMesh(const ew::MeshData& meshData, int maxLevel = 3);
+		//Re-evaluates the refined surface from new base positions, one per vertex of the original MeshData.
+		//Only a sparse matrix vector product plus normals and tangents, the topology is never rebuilt.
+		void setBasePositions(const std::vector<glm::vec3>& positions);
+		//Picks a level per base triangle so refined edges are about targetEdgePixels long, then rebuilds the index buffer if anything changed
+		void update(const ew::Camera& camera, const glm::mat4& model, float screenHeight, float targetEdgePixels = 8.0f);
+		void draw()const;
+		inline int getMaxLevel()const { return m_maxLevel; }
+		inline unsigned int getNumTriangles()const { return m_numTriangles; }
+		//Fully refined mesh, as if every triangle was at maxLevel
+		inline const ew::MeshData& getMeshData()const { return m_meshData; }
+	private:
+		void evaluate();
+		unsigned int gridVertex(size_t patch, int i, int j)const;
+
+		int m_maxLevel;
+		unsigned int m_numBaseVertices;
+		unsigned int m_gridSize; //Refined vertices per base triangle
+		std::vector<unsigned int> m_basePositionVertex; //Base position -> first MeshData vertex using it
+		std::vector<glm::vec3> m_basePositions;
+		StencilTable m_stencils; //Refined position rows over base positions
+		std::vector<glm::vec3> m_positions;
+		std::vector<unsigned int> m_vertexPositions; //Refined vertex -> refined position
+		std::vector<unsigned int> m_patchGrids; //Refined vertex of every grid point of every base triangle
+		std::vector<unsigned int> m_cornerOffsets; //Refined position -> triangle corners touching it, for normals
+		std::vector<unsigned int> m_corners;
+		std::vector<unsigned int> m_patchEdges; //3 base edge ids per base triangle
+		unsigned int m_numBaseEdges;
+		std::vector<int> m_patchLevels;
+		std::vector<unsigned int> m_indices;
+		unsigned int m_numTriangles = 0;
+		ew::MeshData m_meshData;
+		ew::Mesh m_mesh;
+	};
+}
@@ -0,0 +1,355 @@
+#include "terrain.h"
+#include "../ew/jobSystem.h"
+#include "noise.h"
+#include "external/stb_image.h"
+#include "../ew/procGen.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <mutex>
+#include <algorithm>
+
+//Chunk keys pack the quadtree level and the chunk's grid coordinates within that level
+static unsigned long long makeKey(int level, unsigned int x, unsigned int z) {
+	return ((unsigned long long)level << 56) | ((unsigned long long)x << 28) | z;
+}
+static int keyLevel(unsigned long long key) {
+	return (int)(key >> 56);
+}
+static unsigned int keyX(unsigned long long key) {
+	return (unsigned int)((key >> 28) & 0xFFFFFFF);
+}
+static unsigned int keyZ(unsigned long long key) {
+	return (unsigned int)(key & 0xFFFFFFF);
+}
+
+//Finished chunks waiting for the render thread to upload them
+struct hannah::Terrain::Shared {
+	struct Completed {
+		unsigned long long key;
+		ew::MeshData meshData;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+	HeightFunction heights;
+	TerrainSettings settings;
+	std::mutex mutex;
+	std::vector<Completed> completed;
+};
+
+//Builds one chunk on top of createPlane: displaced grid plus a skirt hanging down from every edge
+static ew::MeshData buildChunk(const hannah::HeightFunction& heights, const hannah::TerrainSettings& settings, unsigned long long key, glm::vec3* boundsMin, glm::vec3* boundsMax) {
+	int level = keyLevel(key);
+	float size = settings.worldSize / (float)(1u << level);
+	float centerX = -settings.worldSize * 0.5f + (keyX(key) + 0.5f) * size;
+	float centerZ = -settings.worldSize * 0.5f + (keyZ(key) + 0.5f) * size;
+	int resolution = settings.chunkResolution;
+	unsigned int columns = resolution + 1;
+	float step = size / resolution;
+
+	unsigned int numVertices, numIndices;
+	ew::getPlaneSize(resolution, &numVertices, &numIndices);
+	unsigned int gridVertices = numVertices;
+	unsigned int gridIndices = numIndices;
+	ew::MeshData meshData;
+	meshData.vertices.resize(gridVertices + columns * 4);
+	meshData.indices.resize(gridIndices + resolution * 6 * 4);
+	ew::createPlane(size, size, resolution, meshData.vertices.data(), meshData.indices.data());
+
+	//Heights with a one sample border so normals match across chunk edges
+	unsigned int sampleColumns = columns + 2;
+	std::vector<float> samples(sampleColumns * sampleColumns);
+	for (unsigned int row = 0; row < sampleColumns; row++)
+	{
+		//Rows run towards -z like createPlane
+		float z = centerZ + size * 0.5f - ((int)row - 1) * step;
+		for (unsigned int col = 0; col < sampleColumns; col++)
+		{
+			float x = centerX - size * 0.5f + ((int)col - 1) * step;
+			samples[row * sampleColumns + col] = heights(x, z);
+		}
+	}
+
+	*boundsMin = glm::vec3(centerX - size * 0.5f, INFINITY, centerZ - size * 0.5f);
+	*boundsMax = glm::vec3(centerX + size * 0.5f, -INFINITY, centerZ + size * 0.5f);
+	for (unsigned int row = 0; row < columns; row++)
+	{
+		for (unsigned int col = 0; col < columns; col++)
+		{
+			ew::Vertex& v = meshData.vertices[row * columns + col];
+			const float* s = &samples[(row + 1) * sampleColumns + col + 1];
+			v.pos.x += centerX;
+			v.pos.z += centerZ;
+			v.pos.y = s[0];
+			//Central differences, the next sample row is one step towards -z
+			float left = s[-1];
+			float right = s[1];
+			float back = s[sampleColumns];
+			float forward = s[-(int)sampleColumns];
+			v.normal = glm::normalize(glm::vec3(left - right, 2.0f * step, back - forward));
+			glm::vec3 tangent = glm::vec3(2.0f * step, right - left, 0.0f);
+			v.tangent = glm::vec4(glm::normalize(tangent - v.normal * glm::dot(v.normal, tangent)), 1.0f);
+			v.uv = glm::vec2(v.pos.x, -v.pos.z) / settings.uvScale;
+			boundsMin->y = std::min(boundsMin->y, v.pos.y);
+			boundsMax->y = std::max(boundsMax->y, v.pos.y);
+		}
+	}
+
+	//Each edge is walked so the skirt faces outwards
+	float skirtDepth = size * settings.skirtScale;
+	unsigned int last = columns - 1;
+	unsigned int edges[4][2] = {
+		{ last * columns, 1 }, //-z edge, towards +x
+		{ last * columns + last, (unsigned int)-(int)columns }, //+x edge, towards +z
+		{ last, (unsigned int)-1 }, //+z edge, towards -x
+		{ 0, columns }, //-x edge, towards -z
+	};
+	unsigned int skirtVertex = gridVertices;
+	unsigned int* index = &meshData.indices[gridIndices];
+	for (int e = 0; e < 4; e++)
+	{
+		unsigned int first = skirtVertex;
+		for (unsigned int i = 0; i < columns; i++)
+		{
+			ew::Vertex v = meshData.vertices[edges[e][0] + i * edges[e][1]];
+			v.pos.y -= skirtDepth;
+			meshData.vertices[skirtVertex++] = v;
+		}
+		for (int i = 0; i < resolution; i++)
+		{
+			unsigned int a = edges[e][0] + i * edges[e][1];
+			unsigned int b = a + edges[e][1];
+			*index++ = a;
+			*index++ = b;
+			*index++ = first + i + 1;
+			*index++ = a;
+			*index++ = first + i + 1;
+			*index++ = first + i;
+		}
+	}
+	boundsMin->y -= skirtDepth;
+	return meshData;
+}
+
+hannah::HeightFunction hannah::loadHeightmap(const char* filePath, float worldSize, float heightScale)
+{
+	int width, height, numComponents;
+	stbi_set_flip_vertically_on_load(false);
+	unsigned short* data = stbi_load_16(filePath, &width, &height, &numComponents, 1);
+	if (data == NULL) {
+		printf("Failed to load heightmap %s", filePath);
+		return [](float, float) { return 0.0f; };
+	}
+	std::shared_ptr<std::vector<float>> pixels = std::make_shared<std::vector<float>>(width * height);
+	for (int i = 0; i < width * height; i++)
+	{
+		(*pixels)[i] = data[i] / 65535.0f * heightScale;
+	}
+	stbi_image_free(data);
+
+	//Bilinear, clamped at the edges. Image rows run from -z to +z.
+	return [pixels, width, height, worldSize](float x, float z) {
+		float u = glm::clamp((x / worldSize + 0.5f) * (width - 1), 0.0f, (float)(width - 1));
+		float v = glm::clamp((z / worldSize + 0.5f) * (height - 1), 0.0f, (float)(height - 1));
+		int x0 = std::min((int)u, std::max(width - 2, 0));
+		int y0 = std::min((int)v, std::max(height - 2, 0));
+		int x1 = std::min(x0 + 1, width - 1);
+		int y1 = std::min(y0 + 1, height - 1);
+		float fx = u - x0;
+		float fy = v - y0;
+		const std::vector<float>& p = *pixels;
+		float top = glm::mix(p[y0 * width + x0], p[y0 * width + x1], fx);
+		float bottom = glm::mix(p[y1 * width + x0], p[y1 * width + x1], fx);
+		return glm::mix(top, bottom, fy);
+	};
+}
+
+hannah::HeightFunction hannah::noiseHeightmap(float frequency, float heightScale, int octaves, unsigned int seed)
+{
+	NoiseSettings settings;
+	settings.type = NoiseType::GRADIENT;
+	settings.fractal = FractalType::FBM;
+	settings.frequency = frequency;
+	settings.octaves = octaves;
+	settings.seed = seed;
+	return [settings, heightScale](float x, float z) {
+		return (sampleNoise(settings, x, z) * 0.5f + 0.5f) * heightScale;
+	};
+}
+
+hannah::Terrain::Terrain(HeightFunction heights, const TerrainSettings& settings)
+{
+	m_settings = settings;
+	m_settings.maxLevel = glm::clamp(m_settings.maxLevel, 0, 27);
+	m_settings.chunkResolution = std::max(m_settings.chunkResolution, 1);
+	m_shared = std::make_shared<Shared>();
+	m_shared->heights = heights;
+	m_shared->settings = m_settings;
+
+	//The root is built up front and never evicted, so there is always something to draw
+	glm::vec3 boundsMin, boundsMax;
+	ew::MeshData root = buildChunk(heights, m_settings, makeKey(0, 0, 0), &boundsMin, &boundsMax);
+	insertChunk(makeKey(0, 0, 0), root, boundsMin, boundsMax);
+}
+
+void hannah::Terrain::update(const ew::Camera& camera)
+{
+	m_frame++;
+	uploadCompleted();
+
+	m_frustum = extractFrustum(camera.projectionMatrix() * camera.viewMatrix());
+	m_drawList.clear();
+	m_requests.clear();
+	visit(makeKey(0, 0, 0), camera.position);
+	submitRequests();
+	evict();
+
+	m_stats.chunksResident = m_chunks.size();
+	m_stats.chunksDrawn = m_drawList.size();
+	m_stats.chunksPending = m_pending.size();
+}
+
+void hannah::Terrain::draw() const
+{
+	for (size_t i = 0; i < m_drawList.size(); i++)
+	{
+		m_chunks.at(m_drawList[i]).mesh.draw();
+	}
+}
+
+void hannah::Terrain::printReport()const
+{
+	printf("Terrain: %u chunks resident, %u drawn, %u pending, %u evicted, %.1f of %.1f MB\n", m_stats.chunksResident, m_stats.chunksDrawn,
+		m_stats.chunksPending, m_stats.chunksEvicted, m_stats.memoryUsed / (1024.0f * 1024.0f), m_settings.memoryBudget / (1024.0f * 1024.0f));
+}
+
+//Only resident chunks are visited, and children only once all four are ready, so the drawn set never has holes
+void hannah::Terrain::visit(unsigned long long key, const glm::vec3& cameraPos)
+{
+	Chunk& chunk = m_chunks.at(key);
+	touch(key, &chunk);
+
+	int level = keyLevel(key);
+	if (level < m_settings.maxLevel) {
+		float size = chunk.boundsMax.x - chunk.boundsMin.x;
+		float distance = glm::length(cameraPos - glm::clamp(cameraPos, chunk.boundsMin, chunk.boundsMax));
+		if (distance < size * m_settings.splitDistance) {
+			unsigned long long children[4];
+			bool childrenReady = true;
+			for (int i = 0; i < 4; i++)
+			{
+				children[i] = makeKey(level + 1, keyX(key) * 2 + (i & 1), keyZ(key) * 2 + (i >> 1));
+				auto child = m_chunks.find(children[i]);
+				if (child != m_chunks.end()) {
+					//Keep finished siblings warm while the rest are still generating
+					touch(children[i], &child->second);
+				}
+				else {
+					childrenReady = false;
+					if (m_pending.count(children[i]) == 0) {
+						m_requests.push_back({ children[i], level + 1, distance });
+					}
+				}
+			}
+			if (childrenReady) {
+				for (int i = 0; i < 4; i++)
+				{
+					visit(children[i], cameraPos);
+				}
+				return;
+			}
+		}
+	}
+
+	for (int i = 0; i < 6; i++)
+	{
+		//Corner of the box furthest along the plane normal
+		glm::vec3 normal = glm::vec3(m_frustum.planes[i]);
+		glm::vec3 corner = glm::mix(chunk.boundsMin, chunk.boundsMax, glm::step(glm::vec3(0.0f), normal));
+		if (glm::dot(normal, corner) + m_frustum.planes[i].w < 0.0f) {
+			return;
+		}
+	}
+	m_drawList.push_back(key);
+}
+
+void hannah::Terrain::touch(unsigned long long key, Chunk* chunk)
+{
+	chunk->lastUsedFrame = m_frame;
+	if (keyLevel(key) > 0) {
+		m_lru.splice(m_lru.begin(), m_lru, chunk->lru);
+	}
+}
+
+void hannah::Terrain::insertChunk(unsigned long long key, const ew::MeshData& meshData, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	Chunk& chunk = m_chunks[key];
+	chunk.mesh.load(meshData);
+	chunk.boundsMin = boundsMin;
+	chunk.boundsMax = boundsMax;
+	chunk.bytes = meshData.vertices.size() * sizeof(ew::Vertex) + meshData.indices.size() * sizeof(unsigned int);
+	chunk.lastUsedFrame = m_frame;
+	if (keyLevel(key) > 0) {
+		m_lru.push_front(key);
+		chunk.lru = m_lru.begin();
+	}
+	m_stats.memoryUsed += chunk.bytes;
+}
+
+void hannah::Terrain::uploadCompleted()
+{
+	std::vector<Shared::Completed> completed;
+	{
+		std::lock_guard<std::mutex> lock(m_shared->mutex);
+		size_t count = std::min(m_shared->completed.size(), (size_t)m_settings.maxUploadsPerFrame);
+		completed.reserve(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			completed.push_back(std::move(m_shared->completed[i]));
+		}
+		m_shared->completed.erase(m_shared->completed.begin(), m_shared->completed.begin() + count);
+	}
+	for (size_t i = 0; i < completed.size(); i++)
+	{
+		m_pending.erase(completed[i].key);
+		insertChunk(completed[i].key, completed[i].meshData, completed[i].boundsMin, completed[i].boundsMax);
+	}
+}
+
+void hannah::Terrain::submitRequests()
+{
+	//Coarse levels first so the tree refines evenly, then nearest first
+	std::sort(m_requests.begin(), m_requests.end(), [](const Request& a, const Request& b) {
+		return a.level != b.level ? a.level < b.level : a.distance < b.distance;
+	});
+	for (size_t i = 0; i < m_requests.size() && m_pending.size() < (size_t)m_settings.maxPendingChunks; i++)
+	{
+		unsigned long long key = m_requests[i].key;
+		m_pending.insert(key);
+		//Jobs hold the shared state, so they can finish safely even if the terrain is destroyed first
+		std::shared_ptr<Shared> shared = m_shared;
+		ew::JobSystem::get().submit([shared, key]() {
+			Shared::Completed result;
+			result.key = key;
+			result.meshData = buildChunk(shared->heights, shared->settings, key, &result.boundsMin, &result.boundsMax);
+			std::lock_guard<std::mutex> lock(shared->mutex);
+			shared->completed.push_back(std::move(result));
+		});
+	}
+}
+
+void hannah::Terrain::evict()
+{
+	//Least recently used at the back. Anything used this frame is needed, so stop there even if over budget.
+	while (m_stats.memoryUsed > m_settings.memoryBudget && !m_lru.empty()) {
+		unsigned long long key = m_lru.back();
+		auto chunk = m_chunks.find(key);
+		if (chunk->second.lastUsedFrame == m_frame) {
+			break;
+		}
+		m_stats.memoryUsed -= chunk->second.bytes;
+		m_stats.chunksEvicted++;
+		m_chunks.erase(chunk);
+		m_lru.pop_back();
+	}
+}
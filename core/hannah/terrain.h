@@ -0,0 +1,89 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <glm/glm.hpp>
+#include "../ew/mesh.h"
+#include "../ew/camera.h"
+#include "meshlet.h"
+
+namespace hannah {
+	//World space height at (x, z). Called from worker threads, so it must be thread safe.
+	typedef std::function<float(float x, float z)> HeightFunction;
+
+	//Samples a grayscale image stretched over a square world centered on the origin. Returns a flat function if loading fails.
+	HeightFunction loadHeightmap(const char* filePath, float worldSize, float heightScale);
+	//Gradient noise fBm from noise.h, remapped to 0 - heightScale
+	HeightFunction noiseHeightmap(float frequency, float heightScale, int octaves, unsigned int seed = 0);
+
+	struct TerrainSettings {
+		float worldSize = 1024.0f; //Width of the whole square terrain
+		int maxLevel = 6; //Deepest quadtree level, chunks there are worldSize / 2^maxLevel wide
+		int chunkResolution = 32; //Quads along each chunk edge, the same at every level
+		float splitDistance = 1.5f; //Chunks split when the camera is closer than this many chunk widths
+		float skirtScale = 0.05f; //Skirt depth as a fraction of chunk width, hides cracks between levels
+		float uvScale = 10.0f; //World units per texture repeat
+		size_t memoryBudget = 64 * 1024 * 1024; //Bytes of chunk vertex/index data kept resident
+		int maxUploadsPerFrame = 4;
+		int maxPendingChunks = 16;
+	};
+
+	struct TerrainStats {
+		unsigned int chunksResident = 0;
+		unsigned int chunksDrawn = 0;
+		unsigned int chunksPending = 0;
+		unsigned int chunksEvicted = 0; //Total since creation
+		size_t memoryUsed = 0;
+	};
+
+	//Quadtree of fixed resolution chunks generated on worker threads around the camera.
+	//Work per frame depends on how many chunks are near the camera, not on the size of the world.
+	class Terrain {
+	public:
+		Terrain(HeightFunction heights, const TerrainSettings& settings);
+		Terrain(const Terrain&) = delete;
+		Terrain& operator=(const Terrain&) = delete;
+		//Uploads finished chunks, picks which ones to draw, requests missing ones and evicts over budget
+		void update(const ew::Camera& camera);
+		//Vertices are in world space, so draw with an identity model matrix
+		void draw()const;
+		inline const TerrainStats& getStats()const { return m_stats; }
+		void printReport()const;
+	private:
+		struct Chunk {
+			ew::Mesh mesh;
+			glm::vec3 boundsMin;
+			glm::vec3 boundsMax;
+			size_t bytes = 0;
+			unsigned int lastUsedFrame = 0;
+			std::list<unsigned long long>::iterator lru;
+		};
+		struct Request {
+			unsigned long long key;
+			int level;
+			float distance;
+		};
+		struct Shared;
+		void visit(unsigned long long key, const glm::vec3& cameraPos);
+		void touch(unsigned long long key, Chunk* chunk);
+		void insertChunk(unsigned long long key, const ew::MeshData& meshData, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+		void uploadCompleted();
+		void submitRequests();
+		void evict();
+
+		TerrainSettings m_settings;
+		std::shared_ptr<Shared> m_shared;
+		std::unordered_map<unsigned long long, Chunk> m_chunks;
+		std::unordered_set<unsigned long long> m_pending;
+		std::list<unsigned long long> m_lru; //Most recently used first, never holds the root
+		std::vector<unsigned long long> m_drawList;
+		std::vector<Request> m_requests;
+		Frustum m_frustum;
+		unsigned int m_frame = 0;
+		TerrainStats m_stats;
+	};
+}
@@ -0,0 +1,884 @@
+#include "textureCompression.h"
+#include "../ew/jobSystem.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <chrono>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define COMPRESS_AVX2 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#define COMPRESS_AVX2_FUNCTION
+#else
+#include <immintrin.h>
+#define COMPRESS_AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+#else
+#define COMPRESS_AVX2 0
+#endif
+
+//Blocks are held as 4 channels x 16 pixels of 0-255 floats, so every channel of a block row is one SIMD load.
+//The scalar and AVX2 index searches do the same operations in the same order, so either gives the same output.
+namespace {
+	const size_t BLOCKS_PER_BATCH = 256;
+	const float BC1_WEIGHTS[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	//Weights of a0 for the 8 value and the 6 value + 0/255 BC4 modes. Negative entries are the fixed 0 and 255.
+	const float BC4_WEIGHTS_8[8] = { 1.0f, 0.0f, 6.0f / 7.0f, 5.0f / 7.0f, 4.0f / 7.0f, 3.0f / 7.0f, 2.0f / 7.0f, 1.0f / 7.0f };
+	const float BC4_WEIGHTS_6[8] = { 1.0f, 0.0f, 4.0f / 5.0f, 3.0f / 5.0f, 2.0f / 5.0f, 1.0f / 5.0f, -1.0f, -1.0f };
+	const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	inline float clampColor(float value) {
+		return std::min(std::max(value, 0.0f), 255.0f);
+	}
+
+#if COMPRESS_AVX2
+	bool cpuHasAVX2() {
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		//The OS also has to save the upper halves of the YMM registers
+		bool osSavesYMM = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		return osSavesYMM && (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	COMPRESS_AVX2_FUNCTION void nearestEntriesAVX2(const float(*pixels)[16], const float(*palette)[4], int paletteSize, int numChannels, unsigned char* indices, float* errors) {
+		for (int half = 0; half < 16; half += 8)
+		{
+			__m256 channels[4];
+			for (int c = 0; c < numChannels; c++)
+			{
+				channels[c] = _mm256_loadu_ps(pixels[c] + half);
+			}
+			__m256 best = _mm256_set1_ps(FLT_MAX);
+			__m256 bestIndex = _mm256_setzero_ps();
+			for (int e = 0; e < paletteSize; e++)
+			{
+				__m256 distance = _mm256_setzero_ps();
+				for (int c = 0; c < numChannels; c++)
+				{
+					__m256 d = _mm256_sub_ps(channels[c], _mm256_set1_ps(palette[e][c]));
+					distance = _mm256_add_ps(distance, _mm256_mul_ps(d, d));
+				}
+				__m256 closer = _mm256_cmp_ps(distance, best, _CMP_LT_OQ);
+				best = _mm256_blendv_ps(best, distance, closer);
+				bestIndex = _mm256_blendv_ps(bestIndex, _mm256_set1_ps((float)e), closer);
+			}
+			float index[8];
+			_mm256_storeu_ps(index, bestIndex);
+			_mm256_storeu_ps(errors + half, best);
+			for (int i = 0; i < 8; i++)
+			{
+				indices[half + i] = (unsigned char)index[i];
+			}
+		}
+	}
+
+	const bool USE_AVX2 = cpuHasAVX2();
+#else
+	const bool USE_AVX2 = false;
+#endif
+
+	void nearestEntries(const float(*pixels)[16], const float(*palette)[4], int paletteSize, int numChannels, unsigned char* indices, float* errors) {
+		for (int i = 0; i < 16; i++)
+		{
+			float best = FLT_MAX;
+			int bestIndex = 0;
+			for (int e = 0; e < paletteSize; e++)
+			{
+				float distance = 0.0f;
+				for (int c = 0; c < numChannels; c++)
+				{
+					float d = pixels[c][i] - palette[e][c];
+					distance = distance + d * d;
+				}
+				if (distance < best) {
+					best = distance;
+					bestIndex = e;
+				}
+			}
+			indices[i] = (unsigned char)bestIndex;
+			errors[i] = best;
+		}
+	}
+
+	//Picks the closest palette entry for every pixel over the first numChannels channels. Returns the summed squared error.
+	float assignIndices(const float(*pixels)[16], const float(*palette)[4], int paletteSize, int numChannels, unsigned char* indices) {
+		float errors[16];
+#if COMPRESS_AVX2
+		if (USE_AVX2) {
+			nearestEntriesAVX2(pixels, palette, paletteSize, numChannels, indices, errors);
+		}
+		else
+#endif
+		{
+			nearestEntries(pixels, palette, paletteSize, numChannels, indices, errors);
+		}
+		float error = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			error += errors[i];
+		}
+		return error;
+	}
+
+	void loadBlock(const unsigned char* rgba, int width, int height, int blockX, int blockY, float(*pixels)[16]) {
+		for (int y = 0; y < 4; y++)
+		{
+			int row = std::min(blockY * 4 + y, height - 1);
+			for (int x = 0; x < 4; x++)
+			{
+				int column = std::min(blockX * 4 + x, width - 1);
+				const unsigned char* pixel = rgba + ((size_t)row * width + column) * 4;
+				for (int c = 0; c < 4; c++)
+				{
+					pixels[c][y * 4 + x] = pixel[c];
+				}
+			}
+		}
+	}
+
+	//Line through the mean along the principal axis of the block, by power iteration on the covariance.
+	//The endpoints are where the pixels' projections onto it start and end.
+	void fitEndpoints(const float(*pixels)[16], int numChannels, float* e0, float* e1) {
+		float mean[4];
+		float axis[4];
+		for (int c = 0; c < numChannels; c++)
+		{
+			float minimum = pixels[c][0];
+			float maximum = pixels[c][0];
+			float sum = 0.0f;
+			for (int i = 0; i < 16; i++)
+			{
+				minimum = std::min(minimum, pixels[c][i]);
+				maximum = std::max(maximum, pixels[c][i]);
+				sum += pixels[c][i];
+			}
+			mean[c] = sum / 16.0f;
+			axis[c] = maximum - minimum;
+		}
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			for (int a = 0; a < numChannels; a++)
+			{
+				for (int b = a; b < numChannels; b++)
+				{
+					covariance[a][b] += (pixels[a][i] - mean[a]) * (pixels[b][i] - mean[b]);
+				}
+			}
+		}
+		for (int a = 0; a < numChannels; a++)
+		{
+			for (int b = 0; b < a; b++)
+			{
+				covariance[a][b] = covariance[b][a];
+			}
+		}
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			float length = 0.0f;
+			for (int a = 0; a < numChannels; a++)
+			{
+				for (int b = 0; b < numChannels; b++)
+				{
+					next[a] += covariance[a][b] * axis[b];
+				}
+				length += next[a] * next[a];
+			}
+			if (length < 1e-12f) {
+				break;
+			}
+			length = sqrtf(length);
+			for (int a = 0; a < numChannels; a++)
+			{
+				axis[a] = next[a] / length;
+			}
+		}
+		float length = 0.0f;
+		for (int c = 0; c < numChannels; c++)
+		{
+			length += axis[c] * axis[c];
+		}
+		length = length > 0.0f ? 1.0f / sqrtf(length) : 0.0f;
+
+		float minT = 0.0f;
+		float maxT = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < numChannels; c++)
+			{
+				t += (pixels[c][i] - mean[c]) * axis[c] * length;
+			}
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+		for (int c = 0; c < numChannels; c++)
+		{
+			e0[c] = clampColor(mean[c] + axis[c] * length * minT);
+			e1[c] = clampColor(mean[c] + axis[c] * length * maxT);
+		}
+	}
+
+	//Least squares endpoints for fixed indices. weights[i] is how much of e0 palette entry i holds, negative entries are ignored.
+	//Returns false if the indices don't pin down both endpoints.
+	bool refineEndpoints(const float(*pixels)[16], int numChannels, const unsigned char* indices, const float* weights, float* e0, float* e1) {
+		float aa = 0.0f;
+		float ab = 0.0f;
+		float bb = 0.0f;
+		float x0[4] = {};
+		float x1[4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			float a = weights[indices[i]];
+			if (a < 0.0f) {
+				continue;
+			}
+			float b = 1.0f - a;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < numChannels; c++)
+			{
+				x0[c] += a * pixels[c][i];
+				x1[c] += b * pixels[c][i];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (fabsf(determinant) < 1e-6f) {
+			return false;
+		}
+		for (int c = 0; c < numChannels; c++)
+		{
+			e0[c] = clampColor((bb * x0[c] - ab * x1[c]) / determinant);
+			e1[c] = clampColor((aa * x1[c] - ab * x0[c]) / determinant);
+		}
+		return true;
+	}
+
+	//BC1 color
+
+	unsigned short packRGB565(const float* color) {
+		int r = std::min(std::max((int)(color[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+		int g = std::min(std::max((int)(color[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+		int b = std::min(std::max((int)(color[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+		return (unsigned short)((r << 11) | (g << 5) | b);
+	}
+
+	void unpackRGB565(unsigned short color, int* rgb) {
+		int r = color >> 11;
+		int g = (color >> 5) & 63;
+		int b = color & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	void bc1Palette(unsigned short c0, unsigned short c1, bool fourColor, int(*palette)[4]) {
+		unpackRGB565(c0, palette[0]);
+		unpackRGB565(c1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			int a = palette[0][c];
+			int b = palette[1][c];
+			palette[2][c] = fourColor ? (2 * a + b + 1) / 3 : (a + b) / 2;
+			palette[3][c] = fourColor ? (a + 2 * b + 1) / 3 : 0;
+		}
+		for (int i = 0; i < 4; i++)
+		{
+			palette[i][3] = 255;
+		}
+	}
+
+	//Always four color mode, which is also the only mode BC3 color blocks have
+	void encodeBC1(const float(*pixels)[16], unsigned char* out) {
+		float e0[4];
+		float e1[4];
+		fitEndpoints(pixels, 3, e0, e1);
+		unsigned char indices[16];
+		unsigned char bestIndices[16] = {};
+		unsigned short best0 = 0;
+		unsigned short best1 = 0;
+		float bestError = FLT_MAX;
+		for (int iteration = 0; iteration < 3; iteration++)
+		{
+			unsigned short c0 = packRGB565(e0);
+			unsigned short c1 = packRGB565(e1);
+			int palette[4][4];
+			bc1Palette(c0, c1, true, palette);
+			float paletteFloat[4][4];
+			for (int i = 0; i < 16; i++)
+			{
+				paletteFloat[i / 4][i % 4] = (float)palette[i / 4][i % 4];
+			}
+			float error = assignIndices(pixels, paletteFloat, 4, 3, indices);
+			if (error < bestError) {
+				bestError = error;
+				best0 = c0;
+				best1 = c1;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+			if (error == 0.0f || !refineEndpoints(pixels, 3, indices, BC1_WEIGHTS, e0, e1)) {
+				break;
+			}
+		}
+		//Four color mode needs c0 > c1. Swapping the endpoints swaps entries 0/1 and 2/3.
+		if (best0 < best1) {
+			std::swap(best0, best1);
+			for (int i = 0; i < 16; i++)
+			{
+				bestIndices[i] ^= 1;
+			}
+		}
+		else if (best0 == best1) {
+			memset(bestIndices, 0, sizeof(bestIndices));
+		}
+		unsigned int bits = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			bits |= (unsigned int)bestIndices[i] << (i * 2);
+		}
+		out[0] = best0 & 0xFF;
+		out[1] = best0 >> 8;
+		out[2] = best1 & 0xFF;
+		out[3] = best1 >> 8;
+		for (int i = 0; i < 4; i++)
+		{
+			out[4 + i] = (bits >> (i * 8)) & 0xFF;
+		}
+	}
+
+	void decodeBC1(const unsigned char* block, bool alwaysFourColor, unsigned char(*pixels)[4]) {
+		unsigned short c0 = block[0] | (block[1] << 8);
+		unsigned short c1 = block[2] | (block[3] << 8);
+		int palette[4][4];
+		bc1Palette(c0, c1, alwaysFourColor || c0 > c1, palette);
+		unsigned int bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned int)block[7] << 24);
+		for (int i = 0; i < 16; i++)
+		{
+			int index = (bits >> (i * 2)) & 3;
+			for (int c = 0; c < 4; c++)
+			{
+				pixels[i][c] = (unsigned char)palette[index][c];
+			}
+		}
+	}
+
+	//BC4 single channel, used for BC3 alpha and both BC5 channels
+
+	void bc4Palette(int a0, int a1, int* palette) {
+		palette[0] = a0;
+		palette[1] = a1;
+		if (a0 > a1) {
+			for (int i = 1; i <= 6; i++)
+			{
+				palette[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+			}
+		}
+		else {
+			for (int i = 1; i <= 4; i++)
+			{
+				palette[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	//One BC4 mode from starting endpoints lo <= hi. Returns the error, or FLT_MAX if the mode can't represent the endpoints.
+	float tryBC4Mode(const float(*values)[16], bool eightValues, float lo, float hi, int* bestA0, int* bestA1, unsigned char* bestIndices) {
+		const float* weights = eightValues ? BC4_WEIGHTS_8 : BC4_WEIGHTS_6;
+		float e0[4] = { eightValues ? hi : lo };
+		float e1[4] = { eightValues ? lo : hi };
+		float bestError = FLT_MAX;
+		unsigned char indices[16];
+		for (int iteration = 0; iteration < 3; iteration++)
+		{
+			int a0 = (int)(e0[0] + 0.5f);
+			int a1 = (int)(e1[0] + 0.5f);
+			//The mode is picked by the endpoint order, so keep it
+			if (eightValues && a0 <= a1) {
+				if (a0 == a1 && a0 < 255) {
+					a0++;
+				}
+				else if (a0 == a1) {
+					a1--;
+				}
+				else {
+					std::swap(a0, a1);
+				}
+			}
+			else if (!eightValues && a0 > a1) {
+				std::swap(a0, a1);
+			}
+			int palette[8];
+			bc4Palette(a0, a1, palette);
+			float paletteFloat[8][4] = {};
+			for (int i = 0; i < 8; i++)
+			{
+				paletteFloat[i][0] = (float)palette[i];
+			}
+			float error = assignIndices(values, paletteFloat, 8, 1, indices);
+			if (error < bestError) {
+				bestError = error;
+				*bestA0 = a0;
+				*bestA1 = a1;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+			e0[0] = (float)a0;
+			e1[0] = (float)a1;
+			if (error == 0.0f || !refineEndpoints(values, 1, indices, weights, e0, e1)) {
+				break;
+			}
+		}
+		return bestError;
+	}
+
+	void encodeBC4(const float* channel, unsigned char* out) {
+		const float(*values)[16] = reinterpret_cast<const float(*)[16]>(channel);
+		float lo = 255.0f;
+		float hi = 0.0f;
+		//The 6 value mode has exact 0 and 255, so its endpoints only need to cover what's in between
+		float innerLo = 255.0f;
+		float innerHi = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			lo = std::min(lo, channel[i]);
+			hi = std::max(hi, channel[i]);
+			if (channel[i] > 0.0f && channel[i] < 255.0f) {
+				innerLo = std::min(innerLo, channel[i]);
+				innerHi = std::max(innerHi, channel[i]);
+			}
+		}
+		if (innerLo > innerHi) {
+			innerLo = innerHi = lo;
+		}
+		int a0, a1;
+		unsigned char indices[16];
+		float error = tryBC4Mode(values, true, lo, hi, &a0, &a1, indices);
+		if (error > 0.0f) {
+			int sixA0, sixA1;
+			unsigned char sixIndices[16];
+			if (tryBC4Mode(values, false, innerLo, innerHi, &sixA0, &sixA1, sixIndices) < error) {
+				a0 = sixA0;
+				a1 = sixA1;
+				memcpy(indices, sixIndices, sizeof(indices));
+			}
+		}
+		unsigned long long bits = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			bits |= (unsigned long long)indices[i] << (i * 3);
+		}
+		out[0] = (unsigned char)a0;
+		out[1] = (unsigned char)a1;
+		for (int i = 0; i < 6; i++)
+		{
+			out[2 + i] = (bits >> (i * 8)) & 0xFF;
+		}
+	}
+
+	void decodeBC4(const unsigned char* block, unsigned char* values, int stride) {
+		int palette[8];
+		bc4Palette(block[0], block[1], palette);
+		unsigned long long bits = 0;
+		for (int i = 0; i < 6; i++)
+		{
+			bits |= (unsigned long long)block[2 + i] << (i * 8);
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			values[i * stride] = (unsigned char)palette[(bits >> (i * 3)) & 7];
+		}
+	}
+
+	//BC7 mode 6: 7 bit RGBA endpoints, each with a p-bit shared by its channels as the lowest bit, and 4 bit indices
+
+	struct BitWriter {
+		unsigned char* data;
+		int position = 0;
+		void write(unsigned int value, int numBits) {
+			for (int i = 0; i < numBits; i++, position++)
+			{
+				if ((value >> i) & 1) {
+					data[position >> 3] |= 1 << (position & 7);
+				}
+			}
+		}
+	};
+
+	struct BitReader {
+		const unsigned char* data;
+		int position = 0;
+		unsigned int read(int numBits) {
+			unsigned int value = 0;
+			for (int i = 0; i < numBits; i++, position++)
+			{
+				value |= ((data[position >> 3] >> (position & 7)) & 1) << i;
+			}
+			return value;
+		}
+	};
+
+	void quantizeBC7(const float* color, int pBit, int* quantized) {
+		for (int c = 0; c < 4; c++)
+		{
+			quantized[c] = std::min(std::max((int)floorf((color[c] - pBit) * 0.5f + 0.5f), 0), 127);
+		}
+	}
+
+	//P-bit with the lower error for this endpoint on its own
+	int quantizeBC7(const float* color, int* quantized) {
+		float errors[2];
+		int candidates[2][4];
+		for (int p = 0; p < 2; p++)
+		{
+			quantizeBC7(color, p, candidates[p]);
+			errors[p] = 0.0f;
+			for (int c = 0; c < 4; c++)
+			{
+				float d = (float)((candidates[p][c] << 1) | p) - color[c];
+				errors[p] += d * d;
+			}
+		}
+		int p = errors[1] < errors[0] ? 1 : 0;
+		memcpy(quantized, candidates[p], sizeof(candidates[p]));
+		return p;
+	}
+
+	void bc7Palette(const int* q0, int p0, const int* q1, int p1, int(*palette)[4]) {
+		for (int c = 0; c < 4; c++)
+		{
+			int a = (q0[c] << 1) | p0;
+			int b = (q1[c] << 1) | p1;
+			for (int i = 0; i < 16; i++)
+			{
+				palette[i][c] = ((64 - BC7_WEIGHTS[i]) * a + BC7_WEIGHTS[i] * b + 32) >> 6;
+			}
+		}
+	}
+
+	float evaluateBC7(const float(*pixels)[16], const int* q0, int p0, const int* q1, int p1, unsigned char* indices) {
+		int palette[16][4];
+		bc7Palette(q0, p0, q1, p1, palette);
+		float paletteFloat[16][4];
+		for (int i = 0; i < 64; i++)
+		{
+			paletteFloat[i / 4][i % 4] = (float)palette[i / 4][i % 4];
+		}
+		return assignIndices(pixels, paletteFloat, 16, 4, indices);
+	}
+
+	void encodeBC7(const float(*pixels)[16], unsigned char* out) {
+		float weights[16];
+		for (int i = 0; i < 16; i++)
+		{
+			weights[i] = (64 - BC7_WEIGHTS[i]) / 64.0f;
+		}
+		float e0[4];
+		float e1[4];
+		fitEndpoints(pixels, 4, e0, e1);
+		float bestE0[4];
+		float bestE1[4];
+		int best0[4], best1[4], bestP0 = 0, bestP1 = 0;
+		unsigned char indices[16];
+		unsigned char bestIndices[16];
+		float bestError = FLT_MAX;
+		for (int iteration = 0; iteration < 3; iteration++)
+		{
+			int q0[4], q1[4];
+			int p0 = quantizeBC7(e0, q0);
+			int p1 = quantizeBC7(e1, q1);
+			float error = evaluateBC7(pixels, q0, p0, q1, p1, indices);
+			if (error < bestError) {
+				bestError = error;
+				memcpy(bestE0, e0, sizeof(e0));
+				memcpy(bestE1, e1, sizeof(e1));
+				memcpy(best0, q0, sizeof(q0));
+				memcpy(best1, q1, sizeof(q1));
+				bestP0 = p0;
+				bestP1 = p1;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+			if (error == 0.0f || !refineEndpoints(pixels, 4, indices, weights, e0, e1)) {
+				break;
+			}
+		}
+		//A p-bit moves every channel of its endpoint, so the choice that's best per endpoint isn't always best for the block
+		for (int combination = 0; combination < 4 && bestError > 0.0f; combination++)
+		{
+			int p0 = combination & 1;
+			int p1 = combination >> 1;
+			int q0[4], q1[4];
+			quantizeBC7(bestE0, p0, q0);
+			quantizeBC7(bestE1, p1, q1);
+			float error = evaluateBC7(pixels, q0, p0, q1, p1, indices);
+			if (error < bestError) {
+				bestError = error;
+				memcpy(best0, q0, sizeof(q0));
+				memcpy(best1, q1, sizeof(q1));
+				bestP0 = p0;
+				bestP1 = p1;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+		}
+		//The first index is stored with 3 bits, so its top bit has to be clear
+		if (bestIndices[0] & 8) {
+			for (int c = 0; c < 4; c++)
+			{
+				std::swap(best0[c], best1[c]);
+			}
+			std::swap(bestP0, bestP1);
+			for (int i = 0; i < 16; i++)
+			{
+				bestIndices[i] = 15 - bestIndices[i];
+			}
+		}
+		memset(out, 0, 16);
+		BitWriter writer = { out };
+		writer.write(1 << 6, 7);
+		for (int c = 0; c < 4; c++)
+		{
+			writer.write(best0[c], 7);
+			writer.write(best1[c], 7);
+		}
+		writer.write(bestP0, 1);
+		writer.write(bestP1, 1);
+		for (int i = 0; i < 16; i++)
+		{
+			writer.write(bestIndices[i], i == 0 ? 3 : 4);
+		}
+	}
+
+	//Only mode 6 is decoded, other modes come back black
+	void decodeBC7(const unsigned char* block, unsigned char(*pixels)[4]) {
+		if ((block[0] & 0x7F) != 0x40) {
+			memset(pixels, 0, 64);
+			return;
+		}
+		BitReader reader = { block };
+		reader.read(7);
+		int q0[4], q1[4];
+		for (int c = 0; c < 4; c++)
+		{
+			q0[c] = reader.read(7);
+			q1[c] = reader.read(7);
+		}
+		int p0 = reader.read(1);
+		int p1 = reader.read(1);
+		int palette[16][4];
+		bc7Palette(q0, p0, q1, p1, palette);
+		for (int i = 0; i < 16; i++)
+		{
+			int index = reader.read(i == 0 ? 3 : 4);
+			for (int c = 0; c < 4; c++)
+			{
+				pixels[i][c] = (unsigned char)palette[index][c];
+			}
+		}
+	}
+
+	void encodeBlock(const float(*pixels)[16], hannah::BlockFormat format, unsigned char* out) {
+		switch (format) {
+		case hannah::BlockFormat::BC1:
+			encodeBC1(pixels, out);
+			break;
+		case hannah::BlockFormat::BC3:
+			encodeBC4(pixels[3], out);
+			encodeBC1(pixels, out + 8);
+			break;
+		case hannah::BlockFormat::BC5:
+			encodeBC4(pixels[0], out);
+			encodeBC4(pixels[1], out + 8);
+			break;
+		case hannah::BlockFormat::BC7:
+			encodeBC7(pixels, out);
+			break;
+		case hannah::BlockFormat::RGBA8:
+			break;
+		}
+	}
+
+	void decodeBlock(const unsigned char* block, hannah::BlockFormat format, unsigned char(*pixels)[4]) {
+		switch (format) {
+		case hannah::BlockFormat::BC1:
+			decodeBC1(block, false, pixels);
+			break;
+		case hannah::BlockFormat::BC3:
+			decodeBC1(block + 8, true, pixels);
+			decodeBC4(block, &pixels[0][3], 4);
+			break;
+		case hannah::BlockFormat::BC5:
+			decodeBC4(block, &pixels[0][0], 4);
+			decodeBC4(block + 8, &pixels[0][1], 4);
+			for (int i = 0; i < 16; i++)
+			{
+				pixels[i][2] = 0;
+				pixels[i][3] = 255;
+			}
+			break;
+		case hannah::BlockFormat::BC7:
+			decodeBC7(block, pixels);
+			break;
+		case hannah::BlockFormat::RGBA8:
+			break;
+		}
+	}
+
+	int getNumChannels(hannah::BlockFormat format) {
+		switch (format) {
+		case hannah::BlockFormat::BC1:
+			return 3;
+		case hannah::BlockFormat::BC5:
+			return 2;
+		default:
+			return 4;
+		}
+	}
+}
+
+int hannah::getBlockBytes(BlockFormat format)
+{
+	switch (format) {
+	case BlockFormat::BC1:
+		return 8;
+	case BlockFormat::RGBA8:
+		return 64;
+	default:
+		return 16;
+	}
+}
+
+size_t hannah::getCompressedSize(int width, int height, BlockFormat format)
+{
+	if (format == BlockFormat::RGBA8) {
+		return (size_t)width * height * 4;
+	}
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+}
+
+const char* hannah::getFormatName(BlockFormat format)
+{
+	switch (format) {
+	case BlockFormat::BC1:
+		return "bc1";
+	case BlockFormat::BC3:
+		return "bc3";
+	case BlockFormat::BC5:
+		return "bc5";
+	case BlockFormat::BC7:
+		return "bc7";
+	default:
+		return "rgba8";
+	}
+}
+
+std::vector<unsigned char> hannah::compressImage(const unsigned char* rgba, int width, int height, BlockFormat format)
+{
+	if (format == BlockFormat::RGBA8) {
+		return std::vector<unsigned char>(rgba, rgba + (size_t)width * height * 4);
+	}
+	int blocksX = (width + 3) / 4;
+	int blocksY = (height + 3) / 4;
+	int blockBytes = getBlockBytes(format);
+	std::vector<unsigned char> blocks(getCompressedSize(width, height, format));
+	size_t rowsPerBatch = std::max(BLOCKS_PER_BATCH / blocksX, (size_t)1);
+	ew::parallelFor(blocksY, rowsPerBatch, [&](size_t begin, size_t end) {
+		float pixels[4][16];
+		for (size_t y = begin; y < end; y++)
+		{
+			for (int x = 0; x < blocksX; x++)
+			{
+				loadBlock(rgba, width, height, x, (int)y, pixels);
+				encodeBlock(pixels, format, blocks.data() + (y * blocksX + x) * blockBytes);
+			}
+		}
+	});
+	return blocks;
+}
+
+std::vector<unsigned char> hannah::decompressImage(const unsigned char* blocks, int width, int height, BlockFormat format)
+{
+	if (format == BlockFormat::RGBA8) {
+		return std::vector<unsigned char>(blocks, blocks + (size_t)width * height * 4);
+	}
+	int blocksX = (width + 3) / 4;
+	int blocksY = (height + 3) / 4;
+	int blockBytes = getBlockBytes(format);
+	std::vector<unsigned char> rgba((size_t)width * height * 4);
+	for (int by = 0; by < blocksY; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			unsigned char pixels[16][4];
+			decodeBlock(blocks + ((size_t)by * blocksX + bx) * blockBytes, format, pixels);
+			for (int i = 0; i < 16; i++)
+			{
+				int x = bx * 4 + i % 4;
+				int y = by * 4 + i / 4;
+				if (x < width && y < height) {
+					memcpy(&rgba[((size_t)y * width + x) * 4], pixels[i], 4);
+				}
+			}
+		}
+	}
+	return rgba;
+}
+
+hannah::CompressedTexture hannah::compressTexture(const unsigned char* rgba, int width, int height, BlockFormat format, const MipSettings& mipSettings, CompressionStats* stats)
+{
+	auto start = std::chrono::steady_clock::now();
+	CompressedTexture texture;
+	texture.format = format;
+	texture.width = width;
+	texture.height = height;
+	texture.levels = buildMipChain(rgba, width, height, mipSettings);
+	size_t numPixels = 0;
+	for (size_t i = 0; i < texture.levels.size(); i++)
+	{
+		int levelWidth = std::max(width >> i, 1);
+		int levelHeight = std::max(height >> i, 1);
+		numPixels += (size_t)levelWidth * levelHeight;
+		if (format != BlockFormat::RGBA8) {
+			texture.levels[i] = compressImage(texture.levels[i].data(), levelWidth, levelHeight, format);
+		}
+	}
+	if (stats != nullptr) {
+		stats->pixels = numPixels;
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::vector<unsigned char> decoded = decompressImage(texture.levels[0].data(), width, height, format);
+		stats->psnr = computePSNR(rgba, decoded.data(), width, height, getNumChannels(format));
+	}
+	return texture;
+}
+
+double hannah::computePSNR(const unsigned char* a, const unsigned char* b, int width, int height, int numChannels)
+{
+	double sum = 0.0;
+	size_t numPixels = (size_t)width * height;
+	for (size_t i = 0; i < numPixels; i++)
+	{
+		for (int c = 0; c < numChannels; c++)
+		{
+			double d = (double)a[i * 4 + c] - b[i * 4 + c];
+			sum += d * d;
+		}
+	}
+	double mse = sum / ((double)numPixels * numChannels);
+	//Identical images are reported as 100 dB rather than infinity
+	return mse > 0.0 ? std::min(10.0 * log10(255.0 * 255.0 / mse), 100.0) : 100.0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+#include "mipmap.h"
+
+namespace hannah {
+	//GPU block compression formats. All of them encode 4x4 pixel blocks.
+	enum class BlockFormat {
+		BC1 = 0, //RGB at 8 bytes per block, alpha is dropped
+		BC3 = 1, //RGBA, BC1 color plus a separate alpha block
+		BC5 = 2, //RG as two independent channels. For normal maps, rebuild z = sqrt(1 - x * x - y * y) in the shader.
+		BC7 = 3, //RGBA at the highest quality. Only mode 6 is produced, a single endpoint pair with 16 levels.
+		RGBA8 = 4 //Uncompressed, for caching prebuilt mip chains in the same container
+	};
+
+	struct CompressionStats {
+		size_t pixels = 0; //Summed over every level
+		double seconds = 0.0;
+		double psnr = 0.0; //Level 0, over the channels the format stores
+		inline double getMegapixelsPerSecond()const { return seconds > 0.0 ? pixels / seconds / 1000000.0 : 0.0; }
+	};
+
+	//Full mip chain, levels[0] is the full size image.
+	//For arrays and cubemaps a level holds every image of that size back to back, faces inside layers, as KTX2 stores them.
+	struct CompressedTexture {
+		BlockFormat format = BlockFormat::BC1;
+		bool srgb = false;
+		int width = 0;
+		int height = 0;
+		int numLayers = 0; //0 for a single texture, otherwise the array size
+		int numFaces = 1; //6 for cubemaps, ordered +X -X +Y -Y +Z -Z
+		std::vector<std::vector<unsigned char>> levels;
+		inline int getNumImages()const { return (numLayers > 0 ? numLayers : 1) * numFaces; }
+	};
+
+	//Bytes per 4x4 block, 64 for RGBA8
+	int getBlockBytes(BlockFormat format);
+	size_t getCompressedSize(int width, int height, BlockFormat format);
+	//Short lowercase name, e.g. "bc7"
+	const char* getFormatName(BlockFormat format);
+
+	//Compresses one RGBA8 image, split into block rows over the job system.
+	//Sizes don't have to be a multiple of 4, edge blocks repeat the last row/column.
+	std::vector<unsigned char> compressImage(const unsigned char* rgba, int width, int height, BlockFormat format);
+	//Decodes back to RGBA8 to measure quality. Channels the format doesn't store come back as 0, or 255 for alpha.
+	std::vector<unsigned char> decompressImage(const unsigned char* blocks, int width, int height, BlockFormat format);
+	//Builds the mip chain down to 1x1 and compresses every level. No GL, so it runs on machines without a GPU.
+	CompressedTexture compressTexture(const unsigned char* rgba, int width, int height, BlockFormat format, const MipSettings& mipSettings, CompressionStats* stats = nullptr);
+	//PSNR in dB between two RGBA8 images over the first numChannels channels
+	double computePSNR(const unsigned char* a, const unsigned char* b, int width, int height, int numChannels);
+}
@@ -0,0 +1,459 @@
+#include "textureStreamer.h"
+#include "../ew/jobSystem.h"
+#include "mipmap.h"
+#include "external/glad.h"
+#include "external/stb_image.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <mutex>
+#include <algorithm>
+
+//Decoded images waiting for the render thread to upload them
+struct hannah::TextureStreamer::Shared {
+	struct Decoded {
+		StreamedTexture id;
+		int width = 0;
+		int height = 0;
+		int decodedLevel = 0;
+		std::vector<std::vector<unsigned char>> mips; //Empty if the image failed to load
+	};
+	TextureStreamingSettings settings;
+	std::mutex mutex;
+	std::vector<Decoded> completed;
+};
+
+static int levelSize(int size, int level) {
+	return std::max(1, size >> level);
+}
+
+static size_t levelBytes(int width, int height, int level) {
+	return (size_t)levelSize(width, level) * levelSize(height, level) * 4;
+}
+
+static size_t rangeBytes(int width, int height, int firstLevel, int numLevels) {
+	size_t bytes = 0;
+	for (int i = firstLevel; i < numLevels; i++)
+	{
+		bytes += levelBytes(width, height, i);
+	}
+	return bytes;
+}
+
+static int countLevels(int width, int height) {
+	int levels = 1;
+	while ((std::max(width, height) >> levels) > 0) {
+		levels++;
+	}
+	return levels;
+}
+
+static int findTailLevel(int width, int height, int tailSize) {
+	int level = 0;
+	while (std::max(levelSize(width, level), levelSize(height, level)) > tailSize && level + 1 < countLevels(width, height)) {
+		level++;
+	}
+	return level;
+}
+
+//Finest level that isn't larger than the screen footprint, anything finer would only be filtered away
+static int levelForSize(int width, int height, float screenPixels, float lodBias, int tailLevel) {
+	float lod = log2f(std::max(width, height) / std::max(screenPixels, 1.0f)) + lodBias;
+	return std::min(std::max((int)floorf(lod), 0), tailLevel);
+}
+
+//Runs on a worker thread. Only levels from the one the texture currently needs down to the last are kept.
+static void decodeImage(const std::string& filePath, float screenPixels, const hannah::TextureStreamingSettings& settings, int* width, int* height, int* decodedLevel, std::vector<std::vector<unsigned char>>* mips) {
+	//Same orientation as ew::loadTexture, without touching the flag other threads read
+	stbi_set_flip_vertically_on_load_thread(true);
+	int numComponents;
+	unsigned char* data = stbi_load(filePath.c_str(), width, height, &numComponents, 4);
+	if (data == NULL) {
+		return;
+	}
+	int tailLevel = findTailLevel(*width, *height, settings.tailSize);
+	*decodedLevel = levelForSize(*width, *height, screenPixels, settings.lodBias, tailLevel);
+
+	//Mips are built with the job system too, nested inside this job
+	*mips = hannah::buildMipChain(data, *width, *height, hannah::guessMipSettings(filePath.c_str()));
+	stbi_image_free(data);
+	for (int level = 0; level < *decodedLevel; level++)
+	{
+		std::vector<unsigned char>().swap((*mips)[level]);
+	}
+}
+
+static ew::TextureHandle createStorage(int width, int height, int firstLevel, int numLevels) {
+	unsigned int texture;
+	glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+	glTextureStorage2D(texture, numLevels - firstLevel, GL_RGBA8, levelSize(width, firstLevel), levelSize(height, firstLevel));
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return ew::TextureHandle(texture);
+}
+
+//GPU side copy of the levels both textures hold. Level indices are relative to each texture's first level.
+static void copyLevels(unsigned int src, int srcFirstLevel, unsigned int dst, int dstFirstLevel, int width, int height, int numLevels) {
+	for (int level = std::max(srcFirstLevel, dstFirstLevel); level < numLevels; level++)
+	{
+		glCopyImageSubData(src, GL_TEXTURE_2D, level - srcFirstLevel, 0, 0, 0, dst, GL_TEXTURE_2D, level - dstFirstLevel, 0, 0, 0, levelSize(width, level), levelSize(height, level), 1);
+	}
+}
+
+hannah::TextureStreamer::TextureStreamer(const TextureStreamingSettings& settings)
+	: m_settings(settings)
+{
+	//Offsets into the staging buffer have to respect GL_UNPACK_ALIGNMENT, and one row of a 64K texture has to fit
+	m_settings.uploadBudget = std::max(m_settings.uploadBudget, (size_t)256 * 1024) & ~(size_t)3;
+	m_settings.numStagingBuffers = std::max(m_settings.numStagingBuffers, 1);
+	m_settings.maxInFlight = std::max(m_settings.maxInFlight, 1);
+	m_shared = std::make_shared<Shared>();
+	m_shared->settings = m_settings;
+
+	m_placeholder = createStorage(1, 1, 0, 1);
+	const unsigned char gray[4] = { 128, 128, 128, 255 };
+	glTextureSubImage2D(m_placeholder, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, gray);
+
+	//Mapped once for the streamer's lifetime. Coherent, so memcpy is all an upload needs before the GL call.
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	size_t stagingSize = m_settings.uploadBudget * m_settings.numStagingBuffers;
+	unsigned int buffer;
+	glCreateBuffers(1, &buffer);
+	glNamedBufferStorage(buffer, stagingSize, nullptr, flags);
+	m_stagingMemory = (unsigned char*)glMapNamedBufferRange(buffer, 0, stagingSize, flags);
+	m_stagingBuffer = ew::BufferHandle(buffer);
+	m_fences.resize(m_settings.numStagingBuffers, nullptr);
+}
+
+hannah::TextureStreamer::~TextureStreamer()
+{
+	for (size_t i = 0; i < m_fences.size(); i++)
+	{
+		if (m_fences[i] != nullptr) {
+			glDeleteSync((GLsync)m_fences[i]);
+		}
+	}
+	//m_stagingBuffer is unmapped when it is deleted, which is deferred until the GPU is done with pending uploads
+}
+
+hannah::StreamedTexture hannah::TextureStreamer::add(const std::string& filePath)
+{
+	Texture texture;
+	texture.filePath = filePath;
+	m_textures.push_back(std::move(texture));
+	m_stats.texturesRegistered = m_textures.size();
+	return m_textures.size() - 1;
+}
+
+void hannah::TextureStreamer::reportUsage(StreamedTexture texture, float screenPixels)
+{
+	Texture& t = m_textures[texture];
+	if (t.lastUsedFrame != m_frame) {
+		t.lastUsedFrame = m_frame;
+		t.screenPixels = 0.0f;
+	}
+	t.screenPixels = std::max(t.screenPixels, screenPixels);
+}
+
+unsigned int hannah::TextureStreamer::getTexture(StreamedTexture texture)const
+{
+	const ew::TextureHandle& handle = m_textures[texture].texture;
+	return handle.get() != 0 ? handle.get() : m_placeholder.get();
+}
+
+int hannah::TextureStreamer::getResidentLevel(StreamedTexture texture)const
+{
+	const Texture& t = m_textures[texture];
+	return t.texture.get() != 0 ? t.residentLevel : -1;
+}
+
+void hannah::TextureStreamer::update()
+{
+	receiveDecoded();
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		Texture& t = m_textures[i];
+		if (t.numLevels == 0) {
+			continue;
+		}
+		bool used = t.lastUsedFrame != 0 && m_frame - t.lastUsedFrame < m_settings.unusedFrames;
+		t.wantedLevel = used ? levelForSize(t.width, t.height, t.screenPixels, m_settings.lodBias, t.tailLevel) : t.tailLevel;
+	}
+	evict();
+	startUpgrades();
+	upload();
+
+	m_stats.texturesPending = 0;
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		if (m_textures[i].decodePending || m_textures[i].staging.get() != 0) {
+			m_stats.texturesPending++;
+		}
+	}
+	m_frame++;
+}
+
+void hannah::TextureStreamer::receiveDecoded()
+{
+	std::vector<Shared::Decoded> completed;
+	{
+		std::lock_guard<std::mutex> lock(m_shared->mutex);
+		completed.swap(m_shared->completed);
+	}
+	for (size_t i = 0; i < completed.size(); i++)
+	{
+		Shared::Decoded& decoded = completed[i];
+		Texture& t = m_textures[decoded.id];
+		t.decodePending = false;
+		if (decoded.mips.empty()) {
+			printf("Failed to load image %s\n", t.filePath.c_str());
+			t.failed = true;
+			continue;
+		}
+		if (t.numLevels == 0) {
+			t.width = decoded.width;
+			t.height = decoded.height;
+			t.numLevels = decoded.mips.size();
+			t.tailLevel = findTailLevel(t.width, t.height, m_settings.tailSize);
+			t.residentLevel = t.numLevels;
+		}
+		t.mips.swap(decoded.mips);
+		t.decodedLevel = decoded.decodedLevel;
+	}
+}
+
+void hannah::TextureStreamer::evict()
+{
+	//Room for every texture that wants more detail to take its next step
+	size_t demand = 0;
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		const Texture& t = m_textures[i];
+		if (t.numLevels > 0 && t.staging.get() == 0 && t.wantedLevel < t.residentLevel && t.residentLevel <= t.tailLevel) {
+			demand += rangeBytes(t.width, t.height, t.residentLevel - 1, t.numLevels);
+		}
+	}
+	if (m_stats.memoryUsed + demand <= m_settings.memoryBudget) {
+		return;
+	}
+	//Only detail beyond what this frame needs is evicted, least recently used first.
+	//If that isn't enough the budget is full and upgrades wait until something is no longer needed.
+	m_order.clear();
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		const Texture& t = m_textures[i];
+		if (t.numLevels > 0 && t.staging.get() == 0 && t.texture.get() != 0 && t.residentLevel < t.wantedLevel) {
+			m_order.push_back(i);
+		}
+	}
+	std::sort(m_order.begin(), m_order.end(), [this](StreamedTexture a, StreamedTexture b) {
+		const Texture& ta = m_textures[a];
+		const Texture& tb = m_textures[b];
+		if (ta.lastUsedFrame != tb.lastUsedFrame) {
+			return ta.lastUsedFrame < tb.lastUsedFrame;
+		}
+		return ta.wantedLevel - ta.residentLevel > tb.wantedLevel - tb.residentLevel;
+	});
+	for (size_t i = 0; i < m_order.size() && m_stats.memoryUsed + demand > m_settings.memoryBudget; i++)
+	{
+		Texture& t = m_textures[m_order[i]];
+		m_stats.levelsEvicted += t.wantedLevel - t.residentLevel;
+		reallocate(&t, t.wantedLevel);
+	}
+}
+
+void hannah::TextureStreamer::startUpgrades()
+{
+	//Textures with nothing resident come first, then the ones missing the most levels
+	unsigned int inFlight = 0;
+	m_order.clear();
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		Texture& t = m_textures[i];
+		if (t.failed) {
+			continue;
+		}
+		if (t.staging.get() == 0 && t.numLevels > 0 && t.wantedLevel >= t.residentLevel && !t.mips.empty()) {
+			//No longer needed, e.g. the camera moved away while the image was decoding
+			std::vector<std::vector<unsigned char>>().swap(t.mips);
+		}
+		if (t.decodePending || !t.mips.empty()) {
+			inFlight++;
+		}
+		if (t.numLevels == 0 || (t.staging.get() == 0 && t.wantedLevel < t.residentLevel)) {
+			m_order.push_back(i);
+		}
+	}
+	std::sort(m_order.begin(), m_order.end(), [this](StreamedTexture a, StreamedTexture b) {
+		const Texture& ta = m_textures[a];
+		const Texture& tb = m_textures[b];
+		if ((ta.numLevels == 0) != (tb.numLevels == 0)) {
+			return ta.numLevels == 0;
+		}
+		int missingA = ta.residentLevel - ta.wantedLevel;
+		int missingB = tb.residentLevel - tb.wantedLevel;
+		if (missingA != missingB) {
+			return missingA > missingB;
+		}
+		return ta.screenPixels > tb.screenPixels;
+	});
+
+	for (size_t i = 0; i < m_order.size(); i++)
+	{
+		StreamedTexture id = m_order[i];
+		Texture& t = m_textures[id];
+		if (t.decodePending) {
+			continue;
+		}
+		//Decoded levels don't reach any further than what is resident, so decode again
+		if (!t.mips.empty() && t.decodedLevel >= t.residentLevel) {
+			std::vector<std::vector<unsigned char>>().swap(t.mips);
+			inFlight--;
+		}
+		//Textures that already have their tail only take a step if it fits in the budget
+		bool hasTail = t.numLevels > 0 && t.residentLevel <= t.tailLevel;
+		size_t available = m_settings.memoryBudget - std::min(m_stats.memoryUsed, m_settings.memoryBudget);
+		if (hasTail && rangeBytes(t.width, t.height, t.residentLevel - 1, t.numLevels) > available) {
+			//Mips that can't be uploaded would only block other decodes
+			if (!t.mips.empty()) {
+				std::vector<std::vector<unsigned char>>().swap(t.mips);
+				inFlight--;
+			}
+			continue;
+		}
+		if (t.mips.empty()) {
+			if (inFlight >= (unsigned int)m_settings.maxInFlight) {
+				continue;
+			}
+			inFlight++;
+			t.decodePending = true;
+			bool used = t.lastUsedFrame != 0 && m_frame - t.lastUsedFrame < m_settings.unusedFrames;
+			float screenPixels = used ? t.screenPixels : 0.0f;
+			std::string filePath = t.filePath;
+			//Jobs hold the shared state, so they can finish safely even if the streamer is destroyed first
+			std::shared_ptr<Shared> shared = m_shared;
+			ew::JobSystem::get().submit([shared, id, filePath, screenPixels]() {
+				Shared::Decoded result;
+				result.id = id;
+				decodeImage(filePath, screenPixels, shared->settings, &result.width, &result.height, &result.decodedLevel, &result.mips);
+				std::lock_guard<std::mutex> lock(shared->mutex);
+				shared->completed.push_back(std::move(result));
+			});
+			continue;
+		}
+
+		//Add levels from coarse to fine until the new ones no longer fit in one frame's uploads, so detail appears progressively.
+		//The tail is always allowed, it is what gets drawn while everything else streams.
+		int lastLevel = std::max(t.wantedLevel, t.decodedLevel);
+		int firstLevel = t.residentLevel - 1;
+		size_t newBytes = levelBytes(t.width, t.height, firstLevel);
+		while (firstLevel > lastLevel && newBytes + levelBytes(t.width, t.height, firstLevel - 1) <= m_settings.uploadBudget
+			&& (firstLevel > t.tailLevel || rangeBytes(t.width, t.height, firstLevel - 1, t.numLevels) <= available)) {
+			firstLevel--;
+			newBytes += levelBytes(t.width, t.height, firstLevel);
+		}
+		size_t stagingBytes = rangeBytes(t.width, t.height, firstLevel, t.numLevels);
+		t.staging = createStorage(t.width, t.height, firstLevel, t.numLevels);
+		if (t.texture.get() != 0) {
+			copyLevels(t.texture, t.residentLevel, t.staging, firstLevel, t.width, t.height, t.numLevels);
+		}
+		t.stagingLevel = firstLevel;
+		t.uploadLevel = t.residentLevel - 1;
+		t.uploadRow = 0;
+		m_stats.memoryUsed += stagingBytes;
+	}
+}
+
+void hannah::TextureStreamer::upload()
+{
+	m_stats.bytesUploaded = 0;
+	m_order.clear();
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		if (m_textures[i].staging.get() != 0) {
+			m_order.push_back(i);
+		}
+	}
+	if (m_order.empty()) {
+		return;
+	}
+	//Coarsest pending levels first, so textures missing their tail get it before anything gets more detail
+	std::sort(m_order.begin(), m_order.end(), [this](StreamedTexture a, StreamedTexture b) {
+		return m_textures[a].uploadLevel - m_textures[a].tailLevel > m_textures[b].uploadLevel - m_textures[b].tailLevel;
+	});
+
+	//Never stall the render thread, if the GPU is still reading this buffer try again next frame
+	GLsync fence = (GLsync)m_fences[m_stagingIndex];
+	if (fence != nullptr) {
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			return;
+		}
+		glDeleteSync(fence);
+		m_fences[m_stagingIndex] = nullptr;
+	}
+
+	size_t bufferOffset = m_settings.uploadBudget * m_stagingIndex;
+	size_t used = 0;
+	bool full = false;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_stagingBuffer);
+	for (size_t i = 0; i < m_order.size() && !full; i++)
+	{
+		Texture& t = m_textures[m_order[i]];
+		//Large levels are split into bands of rows, so a 4K level spreads over several frames instead of spiking one
+		while (t.uploadLevel >= t.stagingLevel) {
+			int width = levelSize(t.width, t.uploadLevel);
+			int height = levelSize(t.height, t.uploadLevel);
+			size_t rowBytes = (size_t)width * 4;
+			int rows = std::min((size_t)(height - t.uploadRow), (m_settings.uploadBudget - used) / rowBytes);
+			if (rows <= 0) {
+				full = true;
+				break;
+			}
+			memcpy(m_stagingMemory + bufferOffset + used, t.mips[t.uploadLevel].data() + t.uploadRow * rowBytes, rows * rowBytes);
+			glTextureSubImage2D(t.staging, t.uploadLevel - t.stagingLevel, 0, t.uploadRow, width, rows, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)(bufferOffset + used));
+			used += rows * rowBytes;
+			t.uploadRow += rows;
+			if (t.uploadRow == height) {
+				t.uploadLevel--;
+				t.uploadRow = 0;
+			}
+		}
+		if (t.uploadLevel < t.stagingLevel) {
+			finishUpgrade(&t);
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (used > 0) {
+		m_fences[m_stagingIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_stagingIndex = (m_stagingIndex + 1) % m_settings.numStagingBuffers;
+	}
+	m_stats.bytesUploaded = used;
+}
+
+//Replaces the texture with one holding levels [firstLevel, numLevels), copying whatever both have on the GPU
+void hannah::TextureStreamer::reallocate(Texture* texture, int firstLevel)
+{
+	ew::TextureHandle replacement = createStorage(texture->width, texture->height, firstLevel, texture->numLevels);
+	copyLevels(texture->texture, texture->residentLevel, replacement, firstLevel, texture->width, texture->height, texture->numLevels);
+	size_t bytes = rangeBytes(texture->width, texture->height, firstLevel, texture->numLevels);
+	m_stats.memoryUsed = m_stats.memoryUsed - texture->bytes + bytes;
+	texture->texture = std::move(replacement);
+	texture->residentLevel = firstLevel;
+	texture->bytes = bytes;
+}
+
+void hannah::TextureStreamer::finishUpgrade(Texture* texture)
+{
+	//Staging memory was counted when it was allocated, the old texture is released once the GPU is done with it
+	m_stats.memoryUsed -= texture->bytes;
+	texture->texture = std::move(texture->staging);
+	texture->residentLevel = texture->stagingLevel;
+	texture->bytes = rangeBytes(texture->width, texture->height, texture->residentLevel, texture->numLevels);
+	if (texture->residentLevel <= texture->decodedLevel) {
+		std::vector<std::vector<unsigned char>>().swap(texture->mips);
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../ew/gpuResource.h"
+
+namespace hannah {
+	struct TextureStreamingSettings {
+		size_t memoryBudget = 512 * 1024 * 1024; //Bytes of mip levels kept in VRAM. The smallest mips of every texture are always kept, even over budget.
+		size_t uploadBudget = 8 * 1024 * 1024; //Bytes copied to the GPU per frame, also the size of each staging buffer
+		int numStagingBuffers = 3; //Frames of uploads in flight. Uploads skip a frame rather than wait on the GPU.
+		int maxInFlight = 8; //Textures decoding or uploading at once, each holds its decoded mips in system memory
+		int tailSize = 64; //Mips this size and smaller are loaded first and never evicted
+		float lodBias = 0.0f; //Positive values stream less detail
+		unsigned int unusedFrames = 60; //Textures not reported for this many frames only need their tail
+	};
+
+	struct TextureStreamingStats {
+		unsigned int texturesRegistered = 0;
+		unsigned int texturesPending = 0; //Decoding or uploading
+		unsigned int levelsEvicted = 0; //Total since creation
+		size_t memoryUsed = 0;
+		size_t bytesUploaded = 0; //Last update
+	};
+
+	//Index returned by TextureStreamer::add
+	typedef unsigned int StreamedTexture;
+
+	//RGBA8 textures whose resident mip levels follow how large they appear on screen.
+	//Images are decoded and mipmapped on worker threads, then uploaded coarsest level first through a ring of persistently mapped PBOs.
+	//Each texture object only holds its resident levels, so evicting detail frees VRAM. getTexture can return a new object after any update.
+	class TextureStreamer {
+	public:
+		TextureStreamer(const TextureStreamingSettings& settings = TextureStreamingSettings());
+		~TextureStreamer();
+		TextureStreamer(const TextureStreamer&) = delete;
+		TextureStreamer& operator=(const TextureStreamer&) = delete;
+		//Registers an image file. Nothing is loaded until the next update.
+		StreamedTexture add(const std::string& filePath);
+		//Screen pixels covered by the texture's width at its largest use this frame, e.g. pixelsPerUnit * world size / uv repeats.
+		//Call it for every texture you draw, before update. Unreported textures only keep their tail.
+		void reportUsage(StreamedTexture texture, float screenPixels);
+		//Picks resident levels from this frame's usage, evicts over budget, starts decodes and uploads up to the byte budget
+		void update();
+		//Texture to bind this frame. A 1x1 gray placeholder until the first levels arrive.
+		unsigned int getTexture(StreamedTexture texture)const;
+		//Finest resident mip level, -1 if nothing is resident yet
+		int getResidentLevel(StreamedTexture texture)const;
+		inline const TextureStreamingStats& getStats()const { return m_stats; }
+	private:
+		struct Texture {
+			std::string filePath;
+			int width = 0;
+			int height = 0;
+			int numLevels = 0; //0 until the first decode finishes
+			int tailLevel = 0;
+			int residentLevel = 0; //Finest level on the GPU, numLevels when there are none
+			int wantedLevel = 0;
+			float screenPixels = 0.0f;
+			unsigned int lastUsedFrame = 0;
+			bool decodePending = false;
+			bool failed = false;
+			ew::TextureHandle texture; //Holds levels [residentLevel, numLevels)
+			size_t bytes = 0;
+			//Decoded levels, only [decodedLevel, numLevels) are kept
+			std::vector<std::vector<unsigned char>> mips;
+			int decodedLevel = 0;
+			//Upgrade in flight to levels [stagingLevel, numLevels), swapped in once levels down to stagingLevel are uploaded
+			ew::TextureHandle staging;
+			int stagingLevel = 0;
+			int uploadLevel = 0;
+			int uploadRow = 0;
+		};
+		struct Shared;
+		void receiveDecoded();
+		void evict();
+		void startUpgrades();
+		void upload();
+		void reallocate(Texture* texture, int firstLevel);
+		void finishUpgrade(Texture* texture);
+
+		TextureStreamingSettings m_settings;
+		std::shared_ptr<Shared> m_shared;
+		std::vector<Texture> m_textures;
+		std::vector<StreamedTexture> m_order; //Scratch, textures sorted by how much detail they are missing
+		ew::TextureHandle m_placeholder;
+		ew::BufferHandle m_stagingBuffer;
+		unsigned char* m_stagingMemory = nullptr;
+		std::vector<void*> m_fences; //GLsync per staging buffer, null when the buffer is free
+		int m_stagingIndex = 0;
+		unsigned int m_frame = 1;
+		TextureStreamingStats m_stats;
+	};
+}